@@ -28,36 +28,42 @@
 // #LICENSE_END#
 //
 
+#include "Benchmark.hpp"
 #include "CommandLineParser.hpp"
 
 #include <libWexpr/libWexpr.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 namespace
 {
-	std::string s_readAllInputFrom (const std::string& inputPath)
+	std::string s_readAllInputFrom (std::istream& input)
 	{
-		std::string data;
-		
-		if (inputPath == "-")
-		{
-			return std::string (
-				std::istreambuf_iterator<char>(std::cin), {}
-			);
-		}
-		else
-		{
-			std::fstream file (inputPath, std::ios::in);
-			
-			return std::string (
-				std::istreambuf_iterator<char>(file), {}
-			);
-		}
-		
+		return std::string (
+			std::istreambuf_iterator<char>(input), {}
+		);
+	}
+	
+	// reads up to length bytes, returning the amount read
+	size_t s_readFrom (std::istream& input, void* buffer, size_t length)
+	{
+		input.read (static_cast<char*>(buffer), static_cast<std::streamsize>(length));
+		return static_cast<size_t>(input.gcount());
+	}
+	
+	void s_setError (WexprError* err, WexprErrorCode code, const char* message)
+	{
+		err->code = code;
+		err->column = 0;
+		err->line = 0;
+		err->message = strdup(message);
 	}
 
 	void s_writeAllOutputTo (const std::string& outputPath, const std::string& str)
@@ -115,6 +121,194 @@ namespace
 			delete f;
 		}
 	}
+	
+	void s_writeToStream (void* userData, const char* data, size_t length)
+	{
+		static_cast<std::ostream*>(userData)->write (data, static_cast<std::streamsize>(length));
+	}
+	
+	// binary chunks are read from input this many bytes at a time
+	const size_t s_blockSize = 64 * 1024;
+	
+	// Gives a binary expression chunk to the transcoder as it's read from input.
+	// chunkHeader was already read, the size bytes of the chunk follow it in input.
+	void s_feedBinaryChunk (WexprTranscoder* transcoder, std::istream& input,
+		const uint8_t* chunkHeader, size_t size, WexprError* err
+	)
+	{
+		bool success = (wexpr_Transcoder_write (transcoder, chunkHeader, sizeof(uint32_t) + sizeof(uint8_t), err) > 0);
+		
+		std::vector<uint8_t> block (s_blockSize);
+		
+		while (success && size > 0)
+		{
+			size_t amount = s_readFrom (input, block.data(), std::min (size, block.size()));
+			if (amount == 0)
+				break; // input ended early
+			
+			success = (wexpr_Transcoder_write (transcoder, block.data(), amount, err) == amount);
+			size -= amount;
+		}
+		
+		if (success && !wexpr_Transcoder_isDone (transcoder))
+			s_setError (err, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given");
+	}
+	
+	// Reads a whole binary expression chunk from input into chunk, header included. See s_feedBinaryChunk().
+	// The buffer grows a block at a time as data arrives, so a size bigger than the input is never allocated.
+	bool s_readBinaryChunk (std::istream& input, const uint8_t* chunkHeader, size_t size,
+		std::vector<uint8_t>& chunk, WexprError* err
+	)
+	{
+		const size_t headerSize = sizeof(uint32_t) + sizeof(uint8_t);
+		
+		chunk.assign (chunkHeader, chunkHeader + headerSize);
+		
+		while (chunk.size() - headerSize < size)
+		{
+			size_t used = chunk.size();
+			chunk.resize (used + std::min (size - (used - headerSize), s_blockSize));
+			
+			size_t amount = s_readFrom (input, chunk.data() + used, chunk.size() - used);
+			if (amount < chunk.size() - used)
+			{
+				s_setError (err, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given");
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	// Writes a binary expression chunk as text directly as it's read from input, without creating the expression.
+	void s_transcodeBinaryChunkTo (const std::string& outputPath, std::istream& input,
+		const uint8_t* chunkHeader, size_t size, WexprWriteFlags flags, WexprError* err
+	)
+	{
+		std::fstream* f = nullptr;
+		std::ostream* stream = &(std::cout);
+		
+		if (outputPath != "-")
+		{
+			f = new std::fstream(outputPath, std::ios::out | std::ios::trunc);
+			stream = f;
+		}
+		
+		WexprSink sink;
+		sink.write = &s_writeToStream;
+		sink.userData = stream;
+		
+		WexprTranscoder* transcoder = wexpr_Transcoder_create (0, flags, sink);
+		s_feedBinaryChunk (transcoder, input, chunkHeader, size, err);
+		wexpr_Transcoder_destroy (transcoder);
+		
+		stream->flush();
+		
+		if (f)
+		{
+			delete f;
+		}
+	}
+	
+	// Measures the shape of a binary expression chunk as it's read from input, without creating the expression.
+	void s_measureBinaryChunk (WexprShape* shape, std::istream& input,
+		const uint8_t* chunkHeader, size_t size, WexprError* err
+	)
+	{
+		WexprSink sink;
+		sink.write = nullptr; // nothing is written
+		sink.userData = nullptr;
+		
+		WexprTranscoder* transcoder = wexpr_Transcoder_create (0, WexprWriteFlagNone, sink);
+		wexpr_Transcoder_measureShape (transcoder, shape);
+		s_feedBinaryChunk (transcoder, input, chunkHeader, size, err);
+		wexpr_Transcoder_destroy (transcoder);
+	}
+	
+	// the buckets of a WexprShape histogram which counted anything, as a map of "low-high" to count
+	std::string s_shapeHistogram (const size_t* buckets, const std::string& indent)
+	{
+		std::string output = "@(\n";
+		
+		for (size_t bucket=0; bucket < WEXPR_SHAPE_BUCKET_COUNT; ++bucket)
+		{
+			if (buckets[bucket] == 0)
+				continue;
+			
+			size_t low = (bucket == 0) ? 0 : (size_t(1) << (bucket-1));
+			size_t high = (bucket == 0) ? 0 : (size_t(1) << bucket) - 1;
+			
+			std::string label = std::to_string (low);
+			if (bucket == WEXPR_SHAPE_BUCKET_COUNT-1)
+				label += "+";
+			else if (high != low)
+				label += "-" + std::to_string (high);
+			
+			output += indent + "\t" + label + " " + std::to_string (buckets[bucket]) + "\n";
+		}
+		
+		return output + indent + ")";
+	}
+	
+	// a ratio with two decimal places
+	std::string s_formatRatio (double numerator, double denominator)
+	{
+		char buffer [64];
+		snprintf (buffer, sizeof(buffer), "%.2f", (denominator > 0) ? numerator / denominator : 0.0);
+		
+		return buffer;
+	}
+	
+	// the stats command's output. usage is only written if given.
+	std::string s_formatStats (const WexprShape& shape, const WexprMemoryUsage* usage)
+	{
+		// written in a fixed order, so it can be compared between runs
+		std::string output =
+			"@(\n"
+			"\tnodes @(\n"
+			"\t\ttotal " + std::to_string (shape.nodeCount) + "\n"
+			"\t\tnulls " + std::to_string (shape.nullCount) + "\n"
+			"\t\tvalues " + std::to_string (shape.valueCount) + "\n"
+			"\t\tarrays " + std::to_string (shape.arrayCount) + "\n"
+			"\t\tmaps " + std::to_string (shape.mapCount) + "\n"
+			"\t\tbinaryData " + std::to_string (shape.binaryDataCount) + "\n"
+			"\t)\n"
+			"\tdepth @(\n"
+			"\t\tmax " + std::to_string (shape.maxDepth) + "\n"
+			"\t\taverage " + s_formatRatio (double(shape.depthTotal), double(shape.nodeCount)) + "\n"
+			"\t)\n"
+			"\tarrayLengths " + s_shapeHistogram (shape.arrayLengths, "\t") + "\n"
+			"\tmapSizes " + s_shapeHistogram (shape.mapSizes, "\t") + "\n"
+			"\tvalueLengths " + s_shapeHistogram (shape.valueLengths, "\t") + "\n"
+			"\tvalues @(\n"
+			"\t\tbytes " + std::to_string (shape.valueBytes) + "\n"
+			"\t\tmaxLength " + std::to_string (shape.maxValueLength) + "\n"
+			"\t)\n"
+			"\treferences @(\n"
+			"\t\tdefinitions " + std::to_string (shape.referenceDefinitionCount) + "\n"
+			"\t\tinserts " + std::to_string (shape.referenceCount) + "\n"
+			"\t\texpandedNodes " + std::to_string (shape.expandedNodeCount) + "\n"
+			"\t\texpansionFactor " + s_formatRatio (double(shape.expandedNodeCount), double(shape.nodeCount)) + "\n"
+			"\t)\n"
+			"\tbinaryData @(\n"
+			"\t\tcount " + std::to_string (shape.binaryDataCount) + "\n"
+			"\t\tbytes " + std::to_string (shape.binaryDataBytes) + "\n"
+			"\t)\n";
+		
+		if (usage)
+		{
+			output +=
+				"\tmemory @(\n"
+				"\t\ttotal " + std::to_string (usage->totalBytes) + "\n"
+				"\t\tnodes " + std::to_string (usage->nodeBytes) + "\n"
+				"\t\tstrings " + std::to_string (usage->stringBytes) + "\n"
+				"\t\tcontainers " + std::to_string (usage->containerBytes) + "\n"
+				"\t\tbinaryData " + std::to_string (usage->binaryDataBytes) + "\n"
+				"\t)\n";
+		}
+		
+		return output + ")\n";
+	}
 }
 
 //
@@ -124,6 +318,9 @@ int main (int argc, char** argv)
 {
 	auto results = CommandLineParser::parse (argc, argv);
 	
+	// we're a single short lived thread, so the pool can't leak past us
+	wexpr_Pool_setMaxCachedBytes (1024 * 1024);
+	
 	if (results.version)
 	{
 		std::cout << "WexprTool " << wexpr_Version_major() << "." << wexpr_Version_minor() << "." << wexpr_Version_patch() << std::endl;
@@ -141,12 +338,42 @@ int main (int argc, char** argv)
 	if (results.command == CommandLineParser::Command::HumanReadable ||
 		results.command == CommandLineParser::Command::Validate ||
 		results.command == CommandLineParser::Command::Mini ||
-		results.command == CommandLineParser::Command::Binary
+		results.command == CommandLineParser::Command::Binary ||
+		results.command == CommandLineParser::Command::Query ||
+		results.command == CommandLineParser::Command::Stats ||
+		results.command == CommandLineParser::Command::Bench
 	)
 	{
 		bool isValidate = (results.command == CommandLineParser::Command::Validate);
 		
-		auto inputStr = s_readAllInputFrom(results.inputPath);
+		// binary input going to text doesn't need the expression, so is written as we read it.
+		bool isTextOutput = (results.command == CommandLineParser::Command::HumanReadable ||
+			results.command == CommandLineParser::Command::Mini
+		);
+		bool wasTranscoded = false;
+		
+		// the shape is found as we read, without the expression. Only the memory report needs it.
+		bool isStats = (results.command == CommandLineParser::Command::Stats);
+		bool isShapeOnly = (isStats && !results.memory);
+		bool wasMeasured = false;
+		WexprShape shape;
+		
+		// bench parses the expression chunk again itself
+		std::vector<uint8_t> binaryChunkData;
+		const uint8_t* binaryChunk = nullptr;
+		size_t binaryChunkSize = 0;
+		
+		std::ifstream file;
+		std::istream* input = &(std::cin);
+		
+		if (results.inputPath != "-")
+		{
+			file.open (results.inputPath, std::ios::in | std::ios::binary);
+			input = &file;
+		}
+		
+		// text is read all at once, binary is read a chunk at a time
+		std::string inputStr;
 		
 		WexprError err = WEXPR_ERROR_INIT();
 		
@@ -156,14 +383,13 @@ int main (int argc, char** argv)
 		
 		do { // so we can break back to here
 		
-			if (inputStr.size() >= 1 && static_cast<unsigned char>(inputStr[0]) == 0x83)
+			if (input->peek() == 0x83)
 			{
-				if (inputStr.size() < 20)
+				uint8_t fileHeader [20];
+				
+				if (s_readFrom (*input, fileHeader, sizeof(fileHeader)) < sizeof(fileHeader))
 				{
-					err.code = WexprErrorCodeBinaryInvalidHeader;
-					err.column = 0;
-					err.line = 0;
-					err.message = strdup("Invalid binary header - not big enough");
+					s_setError (&err, WexprErrorCodeBinaryInvalidHeader, "Invalid binary header - not big enough");
 					break;
 				}
 				
@@ -171,75 +397,127 @@ int main (int argc, char** argv)
 					0x83, 'B', 'W', 'E', 'X', 'P', 'R', 0x0A
 				};
 				
-				if (memcmp(inputStr.data(), magic, sizeof(magic)) != 0)
+				if (memcmp(fileHeader, magic, sizeof(magic)) != 0)
 				{
-					err.code = WexprErrorCodeBinaryInvalidHeader;
-					err.column = 0;
-					err.line = 0;
-					err.message = strdup("Invalid binary header - invalid magic");
+					s_setError (&err, WexprErrorCodeBinaryInvalidHeader, "Invalid binary header - invalid magic");
 					break;
 				}
 				
-				if (*reinterpret_cast<const uint32_t*>(inputStr.data() + 8) != wexpr_uint32ToBig(0x01))
+				if (*reinterpret_cast<const uint32_t*>(fileHeader + 8) != wexpr_uint32ToBig(0x01))
 				{
-					err.code = WexprErrorCodeBinaryUnknownVersion;
-					err.column = 0;
-					err.line = 0;
-					err.message = strdup("Invalid binary header - unknown version");
+					s_setError (&err, WexprErrorCodeBinaryUnknownVersion, "Invalid binary header - unknown version");
 					break;
 				}
 				
 				// make sure reserved is blank
 				uint8_t reserved [8] = {};
-				if (memcmp(inputStr.data() + 12, reserved, 8) != 0)
+				if (memcmp(fileHeader + 12, reserved, 8) != 0)
 				{
-					err.code = WexprErrorCodeBinaryInvalidHeader;
-					err.column = 0;
-					err.line = 0;
-					err.message = strdup("Invalid binary header - unknown reserved bits");
+					s_setError (&err, WexprErrorCodeBinaryInvalidHeader, "Invalid binary header - unknown reserved bits");
 					break;
 				}
 				
-				// header seems valid, skip it
-				const uint8_t* data = reinterpret_cast<const uint8_t*> (inputStr.data());
-				size_t curPos = 20;
-				size_t endPos = inputStr.size();
-				
-				while (curPos < endPos)
+				// header seems valid, read the chunks after it
+				while (true)
 				{
 					// read the size and type
+					uint8_t chunkHeader [sizeof(uint32_t) + sizeof(uint8_t)];
+					size_t headerRead = s_readFrom (*input, chunkHeader, sizeof(chunkHeader));
+					
+					if (headerRead == 0)
+						break; // end of input
+					
+					if (headerRead < sizeof(chunkHeader))
+					{
+						s_setError (&err, WexprErrorCodeBinaryChunkNotBigEnough, "Chunk not big enough for header");
+						break;
+					}
+					
 					size_t size = wexpr_bigUInt32ToNative(
-						*reinterpret_cast<const uint32_t*> (
-							data + curPos
-						)
+						*reinterpret_cast<const uint32_t*> (chunkHeader)
 					);
-					uint8_t type = data[curPos + sizeof(uint32_t)];
+					uint8_t type = chunkHeader[sizeof(uint32_t)];
 					if (/*given: type >= 0x00 &&*/ type <= 0x04)
 					{
 						// cool, parse it
-						if (expr)
+						if (expr || wasTranscoded || wasMeasured)
 						{
-							err.code = WexprErrorCodeBinaryMultipleExpressions;
-							err.column = 0;
-							err.line = 0;
-							err.message = strdup("Found multiple expression chunks");
+							s_setError (&err, WexprErrorCodeBinaryMultipleExpressions, "Found multiple expression chunks");
 							break;
 						}
 						
-						expr = wexpr_Expression_createFromBinaryChunk(
-							data + curPos, size + sizeof(uint32_t) + sizeof(uint8_t),
-							&err
-						);
+						if (isTextOutput)
+						{
+							s_transcodeBinaryChunkTo (results.outputPath, *input, chunkHeader, size,
+								(results.command == CommandLineParser::Command::HumanReadable)
+									? WexprWriteFlagHumanReadable : WexprWriteFlagNone,
+								&err
+							);
+							
+							wasTranscoded = true;
+						}
+						else if (isShapeOnly)
+						{
+							s_measureBinaryChunk (&shape, *input, chunkHeader, size, &err);
+							wasMeasured = true;
+						}
+						else
+						{
+							if (!s_readBinaryChunk (*input, chunkHeader, size, binaryChunkData, &err))
+								break;
+							
+							binaryChunk = binaryChunkData.data();
+							binaryChunkSize = binaryChunkData.size();
+							
+							if (isStats && !wexpr_Shape_fromBinaryChunk (
+								&shape, binaryChunk, binaryChunkSize,
+								&err
+							))
+							{
+								break;
+							}
+							
+							expr = wexpr_Expression_createFromBinaryChunk(
+								binaryChunk, binaryChunkSize,
+								&err
+							);
+						}
+						
+						if (err.code)
+							break;
+					}
+					else
+					{
+						// not something we know about, skip it
+						input->ignore (static_cast<std::streamsize>(size));
+						
+						if (static_cast<size_t>(input->gcount()) < size)
+						{
+							s_setError (&err, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given");
+							break;
+						}
 					}
-					
-					// move forward
-					curPos += sizeof(uint32_t) + sizeof(uint8_t);
-					curPos += size;
 				}
 			}
 			else
 			{
 				// assume string
+				inputStr = s_readAllInputFrom (*input);
+				
+				if (isStats && !wexpr_Shape_fromLengthString (
+					&shape, inputStr.c_str(), inputStr.size(),
+					&err
+				))
+				{
+					break;
+				}
+				
+				if (isShapeOnly)
+				{
+					wasMeasured = true;
+					break;
+				}
+				
 				expr = wexpr_Expression_createFromLengthString (
 					inputStr.c_str(), inputStr.size(),
 					WexprParseFlagNone,
@@ -253,6 +531,7 @@ int main (int argc, char** argv)
 			if (isValidate)
 			{
 				s_writeAllOutputTo(results.outputPath, "false\n");
+				WEXPR_ERROR_FREE (err);
 				return EXIT_FAILURE;
 			}
 			else
@@ -263,10 +542,25 @@ int main (int argc, char** argv)
 				
 				std::cerr << "WexprTool: Error occurred with wexpr:" << std::endl;
 				std::cerr << "WexprTool: " << input << ":" << err.line << ":" << err.column << ": " << err.message << std::endl;
+				WEXPR_ERROR_FREE (err);
 				return EXIT_FAILURE;
 			}
 		}
 		
+		if (wasTranscoded)
+		{
+			// already written out
+			WEXPR_ERROR_FREE (err);
+			return EXIT_SUCCESS;
+		}
+		
+		if (wasMeasured)
+		{
+			s_writeAllOutputTo(results.outputPath, s_formatStats (shape, nullptr));
+			WEXPR_ERROR_FREE (err);
+			return EXIT_SUCCESS;
+		}
+		
 		if (!expr)
 		{
 			if (isValidate)
@@ -310,14 +604,71 @@ int main (int argc, char** argv)
 		
 		else if (results.command == CommandLineParser::Command::Binary)
 		{
-			WexprMutableBuffer binDataInfo = wexpr_Expression_createBinaryRepresentation (
-				expr
+			WexprMutableBuffer binDataInfo = wexpr_Expression_createBinaryRepresentationWithFlags (
+				expr, results.shareRepeats ? WexprWriteFlagShareRepeats : WexprWriteFlagNone
 			);
 			
 			s_writeAllOutputWithFileHeaderTo(results.outputPath, binDataInfo.data, binDataInfo.byteSize);
 			
 			free (binDataInfo.data);
 		}
+		
+		else if (results.command == CommandLineParser::Command::Query)
+		{
+			WexprQuery* query = wexpr_Query_compileLengthString (
+				results.query.c_str(), results.query.size(), &err
+			);
+			
+			if (!query)
+			{
+				std::cerr << "WexprTool: Invalid query:" << err.column << ": " << err.message << std::endl;
+				WEXPR_ERROR_FREE (err);
+				wexpr_Expression_destroy (expr);
+				return EXIT_FAILURE;
+			}
+			
+			// gather copies of the matches into an array
+			WexprExpression* matches = wexpr_Expression_createNull();
+			wexpr_Expression_changeType (matches, WexprExpressionTypeArray);
+			
+			WexprQueryIterator* it = wexpr_Query_evaluate (query, expr);
+			for (WexprExpression* match = wexpr_QueryIterator_next (it); match; match = wexpr_QueryIterator_next (it))
+			{
+				wexpr_Expression_arrayAddElementToEnd (matches, wexpr_Expression_createCopy (match));
+			}
+			
+			wexpr_QueryIterator_destroy (it);
+			wexpr_Query_destroy (query);
+			
+			char* buffer = wexpr_Expression_createStringRepresentation (
+				matches, 0, WexprWriteFlagHumanReadable
+			);
+			
+			s_writeAllOutputTo(results.outputPath, std::string(buffer));
+			free (buffer);
+			
+			wexpr_Expression_destroy (matches);
+		}
+		
+		else if (results.command == CommandLineParser::Command::Stats)
+		{
+			WexprMemoryUsage usage;
+			wexpr_Expression_memoryUsage (expr, &usage);
+			
+			s_writeAllOutputTo(results.outputPath, s_formatStats (shape, &usage));
+		}
+		
+		else if (results.command == CommandLineParser::Command::Bench)
+		{
+			Benchmark::Settings settings;
+			settings.warmup = results.benchWarmup;
+			settings.iterations = results.benchIterations;
+			settings.shareRepeats = results.shareRepeats;
+			
+			s_writeAllOutputTo(results.outputPath,
+				Benchmark::run (inputStr, binaryChunk, binaryChunkSize, expr, settings)
+			);
+		}
 
 		wexpr_Expression_destroy (expr);
 	}
@@ -0,0 +1,220 @@
+//
+/// \file WexprTool/Benchmark.cpp
+/// \brief Times parsing and writing a document
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+ 
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// counts what the library allocates while set for the thread, passing everything on to the previous allocator
+	struct CountingAllocator
+	{
+		WexprAllocator allocator;
+		const WexprAllocator* next;
+		
+		size_t allocations = 0;
+		size_t bytes = 0;
+	};
+	
+	void* s_countingAlloc (void* userData, size_t size)
+	{
+		auto* self = static_cast<CountingAllocator*>(userData);
+		++self->allocations;
+		self->bytes += size;
+		
+		return self->next->alloc (self->next->userData, size);
+	}
+	
+	void* s_countingRealloc (void* userData, void* ptr, size_t size)
+	{
+		auto* self = static_cast<CountingAllocator*>(userData);
+		++self->allocations;
+		self->bytes += size;
+		
+		return self->next->realloc (self->next->userData, ptr, size);
+	}
+	
+	void s_countingFree (void* userData, void* ptr)
+	{
+		auto* self = static_cast<CountingAllocator*>(userData);
+		self->next->free (self->next->userData, ptr);
+	}
+	
+	// what one phase did over every timed run
+	struct PhaseResult
+	{
+		std::vector<double> seconds;
+		size_t allocations = 0;
+		size_t bytes = 0;
+		size_t dataBytes = 0; // bytes read or written by a single run, for throughput
+	};
+	
+	// a phase is run once per call, and returns the bytes it read or wrote. Only the run is timed and counted.
+	template <typename Run, typename Cleanup>
+	PhaseResult s_measure (CountingAllocator& counter, const Benchmark::Settings& settings, Run run, Cleanup cleanup)
+	{
+		PhaseResult result;
+		size_t iterations = std::max (settings.iterations, size_t(1));
+		
+		for (size_t i=0; i < settings.warmup + iterations; ++i)
+		{
+			counter.allocations = 0;
+			counter.bytes = 0;
+			
+			auto start = std::chrono::steady_clock::now();
+			void* output = nullptr;
+			result.dataBytes = run (&output);
+			auto end = std::chrono::steady_clock::now();
+			
+			if (i >= settings.warmup)
+			{
+				result.seconds.push_back (std::chrono::duration<double>(end - start).count());
+				result.allocations += counter.allocations;
+				result.bytes += counter.bytes;
+			}
+			
+			cleanup (output);
+		}
+		
+		return result;
+	}
+	
+	std::string s_formatNumber (double number)
+	{
+		char buffer [64];
+		snprintf (buffer, sizeof(buffer), "%.3f", number);
+		
+		return buffer;
+	}
+	
+	std::string s_formatPhase (const std::string& name, PhaseResult& result)
+	{
+		std::vector<double>& seconds = result.seconds;
+		std::sort (seconds.begin(), seconds.end());
+		
+		size_t count = seconds.size();
+		double median = (count % 2) ? seconds[count/2] : (seconds[count/2 - 1] + seconds[count/2]) / 2;
+		double p99 = seconds[std::min (count - 1, (count * 99 + 99) / 100 - 1)]; // nearest rank
+		double mbPerSecond = (median > 0) ? (double(result.dataBytes) / (1024.0 * 1024.0)) / median : 0;
+		
+		return
+			"\t\t" + name + " @(\n"
+			"\t\t\tminMs " + s_formatNumber (seconds.front() * 1000) + "\n"
+			"\t\t\tmedianMs " + s_formatNumber (median * 1000) + "\n"
+			"\t\t\tp99Ms " + s_formatNumber (p99 * 1000) + "\n"
+			"\t\t\tbytes " + std::to_string (result.dataBytes) + "\n"
+			"\t\t\tmbPerSecond " + s_formatNumber (mbPerSecond) + "\n"
+			"\t\t\tallocations " + std::to_string (result.allocations / count) + "\n"
+			"\t\t\tallocatedBytes " + std::to_string (result.bytes / count) + "\n"
+			"\t\t)\n";
+	}
+	
+	// writing expr as text, as a phase
+	PhaseResult s_measureWriteString (CountingAllocator& counter, const Benchmark::Settings& settings,
+		WexprExpression* expr, WexprWriteFlags flags
+	)
+	{
+		return s_measure (counter, settings,
+			[expr, flags] (void** output) {
+				char* str = wexpr_Expression_createStringRepresentation (expr, 0, flags);
+				*output = str;
+				return strlen (str);
+			},
+			[] (void* output) { wexpr_Allocator_free (output); }
+		);
+	}
+}
+
+std::string Benchmark::run (const std::string& text, const uint8_t* binaryChunk, size_t binaryChunkSize,
+	WexprExpression* expr, const Settings& settings
+)
+{
+	CountingAllocator counter;
+	counter.allocator.alloc = &s_countingAlloc;
+	counter.allocator.realloc = &s_countingRealloc;
+	counter.allocator.free = &s_countingFree;
+	counter.allocator.userData = &counter;
+	counter.next = wexpr_Allocator_current();
+	
+	// memory from before is still freed correctly, as everything goes to the same allocator underneath
+	const WexprAllocator* previous = wexpr_Allocator_setForThread (&counter.allocator);
+	
+	PhaseResult parse = s_measure (counter, settings,
+		[&text, binaryChunk, binaryChunkSize] (void** output) {
+			if (binaryChunk)
+			{
+				*output = wexpr_Expression_createFromBinaryChunk (binaryChunk, binaryChunkSize, nullptr);
+				return binaryChunkSize;
+			}
+			
+			*output = wexpr_Expression_createFromLengthString (text.c_str(), text.size(), WexprParseFlagNone, nullptr);
+			return text.size();
+		},
+		[] (void* output) { wexpr_Expression_destroy (static_cast<WexprExpression*>(output)); }
+	);
+	
+	PhaseResult writeMini = s_measureWriteString (counter, settings, expr, WexprWriteFlagNone);
+	PhaseResult writeHuman = s_measureWriteString (counter, settings, expr, WexprWriteFlagHumanReadable);
+	
+	PhaseResult writeBinary = s_measure (counter, settings,
+		[expr, &settings] (void** output) {
+			WexprMutableBuffer buffer = wexpr_Expression_createBinaryRepresentationWithFlags (
+				expr, settings.shareRepeats ? WexprWriteFlagShareRepeats : WexprWriteFlagNone
+			);
+			*output = buffer.data;
+			return buffer.byteSize;
+		},
+		[] (void* output) { wexpr_Allocator_free (output); }
+	);
+	
+	wexpr_Allocator_setForThread (previous);
+	
+	return
+		"@(\n"
+		"\tsettings @(\n"
+		"\t\tinput " + std::string (binaryChunk ? "binary" : "text") + "\n"
+		"\t\twarmup " + std::to_string (settings.warmup) + "\n"
+		"\t\titerations " + std::to_string (std::max (settings.iterations, size_t(1))) + "\n"
+		"\t\tshareRepeats " + std::string (settings.shareRepeats ? "true" : "false") + "\n"
+		"\t)\n"
+		"\tphases @(\n" +
+		s_formatPhase ("parse", parse) +
+		s_formatPhase ("writeMini", writeMini) +
+		s_formatPhase ("writeHuman", writeHuman) +
+		s_formatPhase ("writeBinary", writeBinary) +
+		"\t)\n"
+		")\n";
+}
@@ -0,0 +1,68 @@
+//
+/// \file WexprTool/Benchmark.hpp
+/// \brief Times parsing and writing a document
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef WEXPRTOOL_BENCHMARK_HPP
+#define WEXPRTOOL_BENCHMARK_HPP
+
+#include <libWexpr/libWexpr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//
+/// \brief Times parsing and writing a document in process
+//
+class Benchmark
+{
+	public:
+		struct Settings
+		{
+			size_t warmup = 3; ///< Runs of each phase before timing
+			size_t iterations = 20; ///< Timed runs of each phase
+			bool shareRepeats = false; ///< Write binary with WexprWriteFlagShareRepeats
+		};
+		
+		//
+		/// \brief Time each phase on the input, and return the results as wexpr.
+		///
+		/// Phases are parsing the input as given, then writing expr as mini text, human readable text and binary.
+		/// \param text The input as read
+		/// \param binaryChunk The expression chunk if the input was binary, otherwise nullptr to parse text.
+		/// \param expr The input already parsed, used by the write phases.
+		//
+		static std::string run (const std::string& text, const uint8_t* binaryChunk, size_t binaryChunkSize,
+			WexprExpression* expr, const Settings& settings
+		);
+		
+	private:
+};
+
+#endif // WEXPRTOOL_BENCHMARK_HPP
@@ -30,6 +30,7 @@
  
 #include "CommandLineParser.hpp"
 
+#include <cstdlib>
 #include <iostream>
 
 namespace
@@ -44,6 +45,12 @@ namespace
 			return CommandLineParser::Command::Mini;
 		else if (str == "binary")
 			return CommandLineParser::Command::Binary;
+		else if (str == "query")
+			return CommandLineParser::Command::Query;
+		else if (str == "stats")
+			return CommandLineParser::Command::Stats;
+		else if (str == "bench")
+			return CommandLineParser::Command::Bench;
 		
 		return CommandLineParser::Command::Unknown;
 	}
@@ -83,6 +90,31 @@ CommandLineParser::Results CommandLineParser::parse(int argc, char ** argv)
 				r.outputPath = argv[argIndex+1];
 			}
 		}
+		else if (arg == "-s" || arg == "--share-repeats")
+			r.shareRepeats = true;
+		else if (arg == "-m" || arg == "--memory")
+			r.memory = true;
+		else if (arg == "-q" || arg == "--query")
+		{
+			if ( (argIndex+1) < argc)
+			{
+				r.query = argv[argIndex+1];
+			}
+		}
+		else if (arg == "-n" || arg == "--iterations")
+		{
+			if ( (argIndex+1) < argc)
+			{
+				r.benchIterations = std::strtoul (argv[argIndex+1], nullptr, 10);
+			}
+		}
+		else if (arg == "-w" || arg == "--warmup")
+		{
+			if ( (argIndex+1) < argc)
+			{
+				r.benchWarmup = std::strtoul (argv[argIndex+1], nullptr, 10);
+			}
+		}
 	}
 	
 	return r;
@@ -102,9 +134,19 @@ void CommandLineParser::displayHelp(int argc, char** argv)
 	cout << "              validate      - Checks the wexpr. If valid outputs 'true' and returns 0, otherwise 'false' and 1." << std::endl;
 	cout << "              mini          - Minifies the wexpr output" << std::endl;
 	cout << "              binary        - Write the wexpr out as binary" << std::endl;
+	cout << "              query         - Output an array of everything matching the path given by -q" << std::endl;
+	cout << "              stats         - Output the shape of the expression (nodes, depth, sizes, references), reading binary as it goes" << std::endl;
+	cout << "              bench         - Time parsing the input and writing it in each format, with warm-up runs first" << std::endl;
 	cout << std::endl;
 	cout << "-i, --input   The input file to read from (default is -, stdin)." << std::endl;
 	cout << "-o, --output  The place to write the output (default is -, stdout)." << std::endl;
+	cout << "-q, --query   The path for the query command. eg: servers/#0/limits/rps or servers/*/name" << std::endl;
+	cout << "-s, --share-repeats" << std::endl;
+	cout << "              With binary or bench, write repeated arrays and maps once and refer back to them. Older readers cannot read it." << std::endl;
+	cout << "-m, --memory  With stats, also load the expression and report the memory it uses." << std::endl;
+	cout << "-n, --iterations" << std::endl;
+	cout << "              With bench, the number of timed runs of each phase (default 20)." << std::endl;
+	cout << "-w, --warmup  With bench, the number of untimed runs of each phase first (default 3)." << std::endl;
 	cout << "-h, --help    Display this help and exit" << std::endl;
 	cout << "-v, --version Output the version and exit" << std::endl;
 }
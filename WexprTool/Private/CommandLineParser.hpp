@@ -31,6 +31,7 @@
 #ifndef WEXPRTOOL_COMMANDLINEPARSER_HPP
 #define WEXPRTOOL_COMMANDLINEPARSER_HPP
 
+#include <cstddef>
 #include <string>
 
 //
@@ -53,7 +54,16 @@ class CommandLineParser
 			Mini,
 			
 			/// Convert the wexpr to binary
-			Binary
+			Binary,
+			
+			/// Output an array of everything matching the query
+			Query,
+			
+			/// Output the shape of the expression, and how much memory it uses with memory
+			Stats,
+			
+			/// Time parsing and writing the input
+			Bench
 		};
 		
 		struct Results
@@ -61,10 +71,16 @@ class CommandLineParser
 			bool help = false;
 			bool version = false;
 			bool validate = false;
+			bool shareRepeats = false;
+			bool memory = false;
 			
 			Command command = Command::HumanReadable;
 			std::string inputPath = "-";
 			std::string outputPath = "-";
+			std::string query = "";
+			
+			size_t benchWarmup = 3;
+			size_t benchIterations = 20;
 		};
 		
 		//
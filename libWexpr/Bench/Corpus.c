@@ -0,0 +1,428 @@
+//
+/// \file libWexprBench/Corpus.c
+/// \brief Generates documents to benchmark with
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include "Corpus.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- structures
+
+// a growable buffer the document is written into
+typedef struct BenchBuffer
+{
+	char* data;
+	size_t length;
+	size_t capacity;
+} BenchBuffer;
+
+// random numbers which are the same on every platform (splitmix64)
+typedef struct BenchRandom
+{
+	uint64_t state;
+} BenchRandom;
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void s_Buffer_reserve (BenchBuffer* self, size_t length)
+{
+	if (length + 1 <= self->capacity)
+		return;
+	
+	size_t capacity = self->capacity < 4096 ? 4096 : self->capacity;
+	while (capacity < length + 1)
+		capacity *= 2;
+	
+	char* data = realloc (self->data, capacity);
+	if (!data)
+	{
+		fprintf (stderr, "Out of memory generating the corpus\n");
+		exit (1);
+	}
+	
+	self->data = data;
+	self->capacity = capacity;
+}
+
+static void s_Buffer_append (BenchBuffer* self, const char* str, size_t length)
+{
+	s_Buffer_reserve (self, self->length + length);
+	memcpy (self->data + self->length, str, length);
+	self->length += length;
+	self->data[self->length] = '\0';
+}
+
+static void s_Buffer_appendString (BenchBuffer* self, const char* str)
+{
+	s_Buffer_append (self, str, strlen (str));
+}
+
+static void s_Buffer_appendf (BenchBuffer* self, const char* format, ...)
+{
+	char piece [256];
+	
+	va_list args;
+	va_start (args, format);
+	int length = vsnprintf (piece, sizeof(piece), format, args);
+	va_end (args);
+	
+	if (length > 0)
+		s_Buffer_append (self, piece, (size_t) length < sizeof(piece) ? (size_t) length : sizeof(piece) - 1);
+}
+
+static BenchCorpus s_Buffer_toCorpus (BenchBuffer* self)
+{
+	s_Buffer_reserve (self, self->length); // so empty buffers are still terminated
+	self->data[self->length] = '\0';
+	
+	BenchCorpus corpus;
+	corpus.text = self->data;
+	corpus.length = self->length;
+	
+	return corpus;
+}
+
+static uint64_t s_Random_next (BenchRandom* self)
+{
+	uint64_t z = (self->state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	
+	return z ^ (z >> 31);
+}
+
+static size_t s_Random_below (BenchRandom* self, size_t limit)
+{
+	return (size_t) (s_Random_next (self) % limit);
+}
+
+// a bareword made of lowercase letters
+static void s_appendWord (BenchBuffer* buffer, BenchRandom* random, size_t minLength, size_t maxLength)
+{
+	char word [64];
+	size_t length = minLength + s_Random_below (random, maxLength - minLength + 1);
+	
+	for (size_t i=0; i < length; ++i)
+		word[i] = (char) ('a' + s_Random_below (random, 26));
+	
+	s_Buffer_append (buffer, word, length);
+}
+
+// a small leaf value : a word or a number
+static void s_appendLeaf (BenchBuffer* buffer, BenchRandom* random)
+{
+	if (s_Random_below (random, 2) == 0)
+		s_appendWord (buffer, random, 3, 10);
+	else
+		s_Buffer_appendf (buffer, "%u", (unsigned) s_Random_below (random, 1000000));
+}
+
+// one array holding a lot of small values
+static BenchCorpus s_generateWideArray (size_t targetSize)
+{
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 1 };
+	
+	s_Buffer_appendString (&buffer, "#(");
+	
+	while (buffer.length < targetSize)
+	{
+		s_appendLeaf (&buffer, &random);
+		s_Buffer_appendString (&buffer, " ");
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// chains of arrays and maps nested inside each other
+static BenchCorpus s_generateDeepNesting (size_t targetSize)
+{
+	static const size_t s_depth = 256;
+	
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 2 };
+	
+	s_Buffer_appendString (&buffer, "#(");
+	
+	while (buffer.length < targetSize)
+	{
+		for (size_t i=0; i < s_depth; ++i)
+		{
+			if (i % 2 == 0)
+				s_Buffer_appendString (&buffer, "#(");
+			else
+				s_Buffer_appendString (&buffer, "@(child ");
+			
+			s_appendLeaf (&buffer, &random);
+			s_Buffer_appendString (&buffer, i % 2 == 0 ? " " : " next ");
+		}
+		
+		s_Buffer_appendString (&buffer, "null");
+		
+		for (size_t i=0; i < s_depth; ++i)
+			s_Buffer_appendString (&buffer, ")");
+		
+		s_Buffer_appendString (&buffer, " ");
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// an array of records, each a map with a few keys
+static BenchCorpus s_generateSmallMaps (size_t targetSize)
+{
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 3 };
+	
+	s_Buffer_appendString (&buffer, "#(");
+	
+	for (size_t id=0; buffer.length < targetSize; ++id)
+	{
+		s_Buffer_appendf (&buffer, "@(id %lu name ", (unsigned long) id);
+		s_appendWord (&buffer, &random, 4, 12);
+		s_Buffer_appendf (&buffer, " x %u y %u enabled %s) ",
+			(unsigned) s_Random_below (&random, 4096),
+			(unsigned) s_Random_below (&random, 4096),
+			s_Random_below (&random, 2) ? "true" : "false"
+		);
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// one map with a lot of unique keys
+static BenchCorpus s_generateLargeMap (size_t targetSize)
+{
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 4 };
+	
+	s_Buffer_appendString (&buffer, "@(");
+	
+	for (size_t id=0; buffer.length < targetSize; ++id)
+	{
+		// the id keeps keys unique, the word keeps them from sharing a long prefix
+		s_appendWord (&buffer, &random, 4, 8);
+		s_Buffer_appendf (&buffer, "%lu ", (unsigned long) id);
+		s_appendLeaf (&buffer, &random);
+		s_Buffer_appendString (&buffer, " ");
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// long quoted strings, with all of the escapes mixed in
+static BenchCorpus s_generateQuotedStrings (size_t targetSize)
+{
+	static const char* s_escapes[] = { "\\\"", "\\r", "\\n", "\\t", "\\\\" };
+	
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 5 };
+	
+	s_Buffer_appendString (&buffer, "#(");
+	
+	while (buffer.length < targetSize)
+	{
+		size_t words = 100 + s_Random_below (&random, 400);
+		
+		s_Buffer_appendString (&buffer, "\"");
+		for (size_t i=0; i < words; ++i)
+		{
+			s_appendWord (&buffer, &random, 1, 9);
+			
+			if (s_Random_below (&random, 8) == 0)
+				s_Buffer_appendString (&buffer, s_escapes[s_Random_below (&random, sizeof(s_escapes) / sizeof(s_escapes[0]))]);
+			else
+				s_Buffer_appendString (&buffer, " ");
+		}
+		
+		s_Buffer_appendString (&buffer, "\" ");
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// large binary data, as base64
+static BenchCorpus s_generateBase64Blobs (size_t targetSize)
+{
+	static const char s_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 6 };
+	
+	s_Buffer_appendString (&buffer, "#(");
+	
+	while (buffer.length < targetSize)
+	{
+		// whole groups of 4, so no padding is needed
+		size_t groups = 4096 + s_Random_below (&random, 60 * 1024);
+		
+		s_Buffer_reserve (&buffer, buffer.length + groups * 4 + 3);
+		s_Buffer_appendString (&buffer, "<");
+		
+		for (size_t i=0; i < groups; ++i)
+		{
+			uint64_t bits = s_Random_next (&random);
+			char group [4] = {
+				s_alphabet[bits & 63], s_alphabet[(bits >> 6) & 63],
+				s_alphabet[(bits >> 12) & 63], s_alphabet[(bits >> 18) & 63]
+			};
+			
+			s_Buffer_append (&buffer, group, 4);
+		}
+		
+		s_Buffer_appendString (&buffer, "> ");
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// a few templates defined once, then referred to by many records
+static BenchCorpus s_generateReferenceTemplates (size_t targetSize)
+{
+	static const size_t s_templateCount = 16;
+	
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 7 };
+	
+	s_Buffer_appendString (&buffer, "#(");
+	
+	// the first record for each template defines it
+	for (size_t i=0; i < s_templateCount; ++i)
+	{
+		s_Buffer_appendf (&buffer, "@(id t%lu template [t%lu]@(allow #(", (unsigned long) i, (unsigned long) i);
+		for (size_t permission=0; permission < 8; ++permission)
+		{
+			s_appendWord (&buffer, &random, 4, 8);
+			s_Buffer_appendString (&buffer, " ");
+		}
+		
+		s_Buffer_appendf (&buffer, ") limits @(rps %u burst %u) tags #(",
+			(unsigned) s_Random_below (&random, 1000),
+			(unsigned) s_Random_below (&random, 1000)
+		);
+		for (size_t tag=0; tag < 4; ++tag)
+		{
+			s_appendWord (&buffer, &random, 3, 6);
+			s_Buffer_appendString (&buffer, " ");
+		}
+		
+		s_Buffer_appendString (&buffer, "))) ");
+	}
+	
+	for (size_t id=0; buffer.length < targetSize; ++id)
+	{
+		s_Buffer_appendf (&buffer, "@(id %lu template *[t%lu] extra *[t%lu]) ",
+			(unsigned long) id,
+			(unsigned long) s_Random_below (&random, s_templateCount),
+			(unsigned long) s_Random_below (&random, s_templateCount)
+		);
+	}
+	
+	s_Buffer_appendString (&buffer, ")");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// mostly comments, both line and block, with a little data between them
+static BenchCorpus s_generateLargeComments (size_t targetSize)
+{
+	BenchBuffer buffer = { NULL, 0, 0 };
+	BenchRandom random = { 8 };
+	
+	s_Buffer_appendString (&buffer, "#(\n");
+	
+	while (buffer.length < targetSize)
+	{
+		if (s_Random_below (&random, 2) == 0)
+		{
+			size_t lines = 1 + s_Random_below (&random, 8);
+			for (size_t line=0; line < lines; ++line)
+			{
+				s_Buffer_appendString (&buffer, "\t;");
+				for (size_t word=0; word < 12; ++word)
+				{
+					s_Buffer_appendString (&buffer, " ");
+					s_appendWord (&buffer, &random, 2, 9);
+				}
+				
+				s_Buffer_appendString (&buffer, "\n");
+			}
+		}
+		else
+		{
+			s_Buffer_appendString (&buffer, "\t;(--");
+			
+			size_t words = 50 + s_Random_below (&random, 500);
+			for (size_t word=0; word < words; ++word)
+			{
+				s_Buffer_appendString (&buffer, (word % 12 == 11) ? "\n\t" : " ");
+				s_appendWord (&buffer, &random, 2, 9);
+			}
+			
+			s_Buffer_appendString (&buffer, " --)\n");
+		}
+		
+		s_Buffer_appendString (&buffer, "\t");
+		s_appendLeaf (&buffer, &random);
+		s_Buffer_appendString (&buffer, "\n");
+	}
+	
+	s_Buffer_appendString (&buffer, ")\n");
+	return s_Buffer_toCorpus (&buffer);
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+const BenchCorpusKind g_benchCorpusKinds[] = {
+	{ "wideArray", &s_generateWideArray },
+	{ "deepNesting", &s_generateDeepNesting },
+	{ "smallMaps", &s_generateSmallMaps },
+	{ "largeMap", &s_generateLargeMap },
+	{ "quotedStrings", &s_generateQuotedStrings },
+	{ "base64Blobs", &s_generateBase64Blobs },
+	{ "referenceTemplates", &s_generateReferenceTemplates },
+	{ "largeComments", &s_generateLargeComments },
+	{ NULL, NULL }
+};
+
+void bench_Corpus_free (BenchCorpus* self)
+{
+	free (self->text);
+	self->text = NULL;
+	self->length = 0;
+}
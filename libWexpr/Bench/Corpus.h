@@ -0,0 +1,69 @@
+//
+/// \file libWexprBench/Corpus.h
+/// \brief Generates documents to benchmark with
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_BENCH_CORPUS_H
+#define WEXPR_BENCH_CORPUS_H
+
+#include <stddef.h>
+
+//
+/// \brief A generated wexpr document, in text form.
+//
+typedef struct BenchCorpus
+{
+	char* text; ///< Null terminated. Free with bench_Corpus_free().
+	size_t length; ///< Length of text in bytes
+} BenchCorpus;
+
+//
+/// \brief Generates a document of around targetSize bytes. The same size always gives the same document.
+//
+typedef BenchCorpus (*BenchCorpusGenerator) (size_t targetSize);
+
+//
+/// \brief A kind of document to benchmark with.
+//
+typedef struct BenchCorpusKind
+{
+	const char* name; ///< Short name, usable as a bareword
+	BenchCorpusGenerator generate;
+} BenchCorpusKind;
+
+//
+/// \brief Every kind of corpus. Ends with an entry with a NULL name.
+//
+extern const BenchCorpusKind g_benchCorpusKinds[];
+
+//
+/// \brief Free a corpus made by a generator.
+//
+void bench_Corpus_free (BenchCorpus* self);
+
+#endif // WEXPR_BENCH_CORPUS_H
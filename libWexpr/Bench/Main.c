@@ -0,0 +1,471 @@
+//
+/// \file libWexprBench/Main.c
+/// \brief Benchmarks libWexpr over generated documents
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/libWexpr.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Corpus.h"
+#include "Measure.h"
+
+// --- structures
+
+// what an operation works on. setup fills in what run needs, cleanup frees whatever was made.
+typedef struct BenchState
+{
+	const BenchCorpus* corpus;
+	WexprExpression* expression;
+	WexprExpression* result;
+	char* string;
+	WexprMutableBuffer binary;
+	
+	size_t bytes; // bytes the operation read or wrote, for MB/s
+} BenchState;
+
+typedef struct BenchOperation
+{
+	const char* name;
+	void (*setup) (BenchState* state);
+	void (*run) (BenchState* state); // the timed part
+	void (*cleanup) (BenchState* state);
+} BenchOperation;
+
+typedef struct BenchOptions
+{
+	size_t scale; // target corpus size in bytes
+	size_t repeat; // runs of each operation, the fastest is kept
+	const char* corpus; // only run this corpus, or NULL for all
+	const char* output; // file for the results, or NULL for stdout
+	const char* writeCorpus; // folder to write each corpus to, or NULL
+} BenchOptions;
+
+// ---------------------- PRIVATE ----------------------------------
+
+static WexprExpression* s_parseText (const BenchCorpus* corpus)
+{
+	WexprError error = WEXPR_ERROR_INIT();
+	WexprExpression* expression = wexpr_Expression_createFromLengthString (corpus->text, corpus->length, WexprParseFlagNone, &error);
+	
+	if (!expression)
+	{
+		fprintf (stderr, "Corpus failed to parse (line %lu column %lu) : %s\n",
+			(unsigned long) error.line, (unsigned long) error.column, error.message ? error.message : "");
+		exit (1);
+	}
+	
+	WEXPR_ERROR_FREE (error);
+	return expression;
+}
+
+static void s_setupNothing (BenchState* state)
+{
+	(void)state;
+}
+
+static void s_setupParsed (BenchState* state)
+{
+	state->expression = s_parseText (state->corpus);
+}
+
+static void s_setupBinary (BenchState* state)
+{
+	s_setupParsed (state);
+	state->binary = wexpr_Expression_createBinaryRepresentation (state->expression);
+}
+
+static void s_cleanup (BenchState* state)
+{
+	if (state->expression) wexpr_Expression_destroy (state->expression);
+	if (state->result) wexpr_Expression_destroy (state->result);
+	if (state->string) wexpr_Allocator_free (state->string);
+	if (state->binary.data) wexpr_Allocator_free (state->binary.data);
+	
+	state->expression = NULL;
+	state->result = NULL;
+	state->string = NULL;
+	state->binary.data = NULL;
+}
+
+static void s_runParseText (BenchState* state)
+{
+	state->result = s_parseText (state->corpus);
+	state->bytes = state->corpus->length;
+}
+
+static void s_runWriteMini (BenchState* state)
+{
+	state->string = wexpr_Expression_createStringRepresentation (state->expression, 0, WexprWriteFlagNone);
+	state->bytes = strlen (state->string);
+}
+
+static void s_runWriteHuman (BenchState* state)
+{
+	state->string = wexpr_Expression_createStringRepresentation (state->expression, 0, WexprWriteFlagHumanReadable);
+	state->bytes = strlen (state->string);
+}
+
+static void s_runWriteBinary (BenchState* state)
+{
+	state->binary = wexpr_Expression_createBinaryRepresentation (state->expression);
+	state->bytes = state->binary.byteSize;
+}
+
+static void s_runParseBinary (BenchState* state)
+{
+	WexprError error = WEXPR_ERROR_INIT();
+	state->result = wexpr_Expression_createFromBinaryChunk (state->binary.data, state->binary.byteSize, &error);
+	state->bytes = state->binary.byteSize;
+	
+	if (!state->result)
+	{
+		fprintf (stderr, "Binary failed to parse : %s\n", error.message ? error.message : "");
+		exit (1);
+	}
+	
+	WEXPR_ERROR_FREE (error);
+}
+
+static void s_runCopy (BenchState* state)
+{
+	state->result = wexpr_Expression_createCopy (state->expression);
+	state->bytes = state->corpus->length;
+}
+
+static void s_runDestroy (BenchState* state)
+{
+	wexpr_Expression_destroy (state->expression);
+	state->expression = NULL;
+	state->bytes = state->corpus->length;
+}
+
+static const BenchOperation s_operations[] = {
+	{ "parseText", &s_setupNothing, &s_runParseText, &s_cleanup },
+	{ "writeMini", &s_setupParsed, &s_runWriteMini, &s_cleanup },
+	{ "writeHuman", &s_setupParsed, &s_runWriteHuman, &s_cleanup },
+	{ "writeBinary", &s_setupParsed, &s_runWriteBinary, &s_cleanup },
+	{ "parseBinary", &s_setupBinary, &s_runParseBinary, &s_cleanup },
+	{ "copy", &s_setupParsed, &s_runCopy, &s_cleanup },
+	{ "destroy", &s_setupParsed, &s_runDestroy, &s_cleanup },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static size_t s_countNodes (WexprExpression* expression)
+{
+	size_t count = 1;
+	WexprExpressionType type = wexpr_Expression_type (expression);
+	
+	if (type == WexprExpressionTypeArray)
+	{
+		WexprArrayIterator it;
+		wexpr_ArrayIterator_init (&it, expression);
+		
+		for (WexprExpression* child = wexpr_ArrayIterator_next (&it); child; child = wexpr_ArrayIterator_next (&it))
+			count += s_countNodes (child);
+	}
+	
+	else if (type == WexprExpressionTypeMap)
+	{
+		WexprMapIterator it;
+		wexpr_MapIterator_init (&it, expression);
+		
+		const char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		while (wexpr_MapIterator_next (&it, &key, &value))
+			count += s_countNodes (value);
+	}
+	
+	return count;
+}
+
+static void s_setNumber (WexprExpression* map, const char* key, double number, const char* format)
+{
+	char value [64];
+	snprintf (value, sizeof(value), format, number);
+	
+	wexpr_Expression_mapSetValueForKey (map, key, wexpr_Expression_createValue (value));
+}
+
+static WexprExpression* s_createMap (void)
+{
+	WexprExpression* map = wexpr_Expression_createNull ();
+	wexpr_Expression_changeType (map, WexprExpressionTypeMap);
+	
+	return map;
+}
+
+// run the operation a few times, and add the fastest to results
+static void s_benchmark (const BenchOptions* options, const char* corpusName, const BenchCorpus* corpus, size_t nodes,
+	const BenchOperation* operation, WexprExpression* results)
+{
+	double best = -1.0;
+	size_t bytes = 0;
+	BenchAllocations allocations = { 0, 0 };
+	
+	for (size_t i=0; i < options->repeat; ++i)
+	{
+		BenchState state;
+		memset (&state, 0, sizeof(state));
+		state.corpus = corpus;
+		
+		operation->setup (&state);
+		bench_Measure_reset ();
+		
+		double start = bench_Measure_now ();
+		operation->run (&state);
+		double seconds = bench_Measure_now () - start;
+		
+		allocations = bench_Measure_allocations ();
+		bytes = state.bytes;
+		
+		operation->cleanup (&state);
+		
+		if (best < 0.0 || seconds < best)
+			best = seconds;
+	}
+	
+	// too fast to time is reported as the timer's resolution, rather than infinitely fast
+	double seconds = best > 1e-9 ? best : 1e-9;
+	size_t peakRssKb = bench_Measure_peakRssKb ();
+	
+	WexprExpression* result = s_createMap ();
+	wexpr_Expression_mapSetValueForKey (result, "corpus", wexpr_Expression_createValue (corpusName));
+	wexpr_Expression_mapSetValueForKey (result, "op", wexpr_Expression_createValue (operation->name));
+	s_setNumber (result, "seconds", best, "%.9f");
+	s_setNumber (result, "bytes", (double) bytes, "%.0f");
+	s_setNumber (result, "nodes", (double) nodes, "%.0f");
+	s_setNumber (result, "mbPerSecond", (double) bytes / (1024.0 * 1024.0) / seconds, "%.2f");
+	s_setNumber (result, "nodesPerSecond", (double) nodes / seconds, "%.0f");
+	s_setNumber (result, "allocations", (double) allocations.count, "%.0f");
+	s_setNumber (result, "peakBytes", (double) allocations.peakBytes, "%.0f");
+	s_setNumber (result, "peakRssKb", (double) peakRssKb, "%.0f");
+	wexpr_Expression_arrayAddElementToEnd (results, result);
+	
+	fprintf (stderr, "%-20s %-12s %10.2f MB/s %14.0f nodes/s %10lu allocs %12lu peak bytes\n",
+		corpusName, operation->name,
+		(double) bytes / (1024.0 * 1024.0) / seconds, (double) nodes / seconds,
+		(unsigned long) allocations.count, (unsigned long) allocations.peakBytes
+	);
+}
+
+static bool s_writeCorpus (const char* folder, const char* name, const BenchCorpus* corpus)
+{
+	char path [1024];
+	snprintf (path, sizeof(path), "%s/%s.wexpr", folder, name);
+	
+	FILE* file = fopen (path, "wb");
+	if (!file)
+	{
+		fprintf (stderr, "Unable to write %s\n", path);
+		return false;
+	}
+	
+	fwrite (corpus->text, 1, corpus->length, file);
+	fclose (file);
+	
+	return true;
+}
+
+static void s_printHelp (void)
+{
+	fprintf (stderr,
+		"Usage: libWexprBench [OPTIONS]\n"
+		"Benchmarks libWexpr over generated documents, writing the results as wexpr.\n"
+		"\n"
+		"  -s, --scale=MB          Size of each corpus in megabytes (default 4)\n"
+		"  -r, --repeat=COUNT      Runs of each operation, keeping the fastest (default 5)\n"
+		"  -c, --corpus=NAME       Only benchmark the named corpus\n"
+		"  -o, --output=FILE       Write the results to the file instead of stdout\n"
+		"  -w, --write-corpus=DIR  Also write each corpus to DIR/<name>.wexpr\n"
+		"  -h, --help              Display this help\n"
+		"\n"
+		"Corpora:"
+	);
+	
+	for (const BenchCorpusKind* kind = g_benchCorpusKinds; kind->name; ++kind)
+		fprintf (stderr, " %s", kind->name);
+	
+	fprintf (stderr, "\n");
+}
+
+// the value for an option, from either "--name=value" or "-n value". NULL if arg isnt the option.
+static const char* s_optionValue (int argc, char** argv, int* index, const char* shortName, const char* longName)
+{
+	const char* arg = argv[*index];
+	size_t longLength = strlen (longName);
+	
+	if (strncmp (arg, longName, longLength) == 0 && arg[longLength] == '=')
+		return arg + longLength + 1;
+	
+	if (strcmp (arg, shortName) == 0 || strcmp (arg, longName) == 0)
+	{
+		if (*index + 1 >= argc)
+		{
+			fprintf (stderr, "Missing value for %s\n", arg);
+			exit (1);
+		}
+		
+		return argv[++*index];
+	}
+	
+	return NULL;
+}
+
+static BenchOptions s_parseOptions (int argc, char** argv)
+{
+	BenchOptions options;
+	options.scale = 4 * 1024 * 1024;
+	options.repeat = 5;
+	options.corpus = NULL;
+	options.output = NULL;
+	options.writeCorpus = NULL;
+	
+	for (int i=1; i < argc; ++i)
+	{
+		const char* value = NULL;
+		
+		if (strcmp (argv[i], "-h") == 0 || strcmp (argv[i], "--help") == 0)
+		{
+			s_printHelp ();
+			exit (0);
+		}
+		
+		else if ((value = s_optionValue (argc, argv, &i, "-s", "--scale")))
+		{
+			double megabytes = atof (value);
+			if (megabytes <= 0.0)
+			{
+				fprintf (stderr, "Scale must be above 0\n");
+				exit (1);
+			}
+			
+			options.scale = (size_t) (megabytes * 1024.0 * 1024.0);
+		}
+		
+		else if ((value = s_optionValue (argc, argv, &i, "-r", "--repeat")))
+		{
+			int repeat = atoi (value);
+			options.repeat = repeat > 0 ? (size_t) repeat : 1;
+		}
+		
+		else if ((value = s_optionValue (argc, argv, &i, "-c", "--corpus")))
+			options.corpus = value;
+		
+		else if ((value = s_optionValue (argc, argv, &i, "-o", "--output")))
+			options.output = value;
+		
+		else if ((value = s_optionValue (argc, argv, &i, "-w", "--write-corpus")))
+			options.writeCorpus = value;
+		
+		else
+		{
+			fprintf (stderr, "Unknown option %s\n", argv[i]);
+			s_printHelp ();
+			exit (1);
+		}
+	}
+	
+	return options;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+int main (int argc, char** argv)
+{
+	BenchOptions options = s_parseOptions (argc, argv);
+	bench_Measure_installAllocator ();
+	wexpr_Pool_setMaxCachedBytes (1024 * 1024); // one long lived thread, so measure with the pool on
+	
+	WexprExpression* report = s_createMap ();
+	
+	char version [32];
+	snprintf (version, sizeof(version), "%d.%d.%d", wexpr_Version_major (), wexpr_Version_minor (), wexpr_Version_patch ());
+	
+	WexprExpression* settings = s_createMap ();
+	wexpr_Expression_mapSetValueForKey (settings, "version", wexpr_Expression_createValue (version));
+	s_setNumber (settings, "scale", (double) options.scale, "%.0f");
+	s_setNumber (settings, "repeat", (double) options.repeat, "%.0f");
+	wexpr_Expression_mapSetValueForKey (report, "settings", settings);
+	
+	WexprExpression* results = wexpr_Expression_createNull ();
+	wexpr_Expression_changeType (results, WexprExpressionTypeArray);
+	
+	bool foundCorpus = false;
+	for (const BenchCorpusKind* kind = g_benchCorpusKinds; kind->name; ++kind)
+	{
+		if (options.corpus && strcmp (options.corpus, kind->name) != 0)
+			continue;
+		
+		foundCorpus = true;
+		BenchCorpus corpus = kind->generate (options.scale);
+		
+		if (options.writeCorpus && !s_writeCorpus (options.writeCorpus, kind->name, &corpus))
+			return 1;
+		
+		WexprExpression* counted = s_parseText (&corpus);
+		size_t nodes = s_countNodes (counted);
+		wexpr_Expression_destroy (counted);
+		
+		for (const BenchOperation* operation = s_operations; operation->name; ++operation)
+			s_benchmark (&options, kind->name, &corpus, nodes, operation, results);
+		
+		bench_Corpus_free (&corpus);
+	}
+	
+	if (!foundCorpus)
+	{
+		fprintf (stderr, "Unknown corpus %s\n", options.corpus);
+		return 1;
+	}
+	
+	wexpr_Expression_mapSetValueForKey (report, "results", results);
+	
+	char* output = wexpr_Expression_createStringRepresentation (report, 0, WexprWriteFlagHumanReadable);
+	
+	FILE* file = options.output ? fopen (options.output, "wb") : stdout;
+	if (!file)
+	{
+		fprintf (stderr, "Unable to write %s\n", options.output);
+		return 1;
+	}
+	
+	fprintf (file, "%s\n", output);
+	
+	if (file != stdout)
+		fclose (file);
+	
+	wexpr_Allocator_free (output);
+	wexpr_Expression_destroy (report);
+	
+	return 0;
+}
@@ -0,0 +1,182 @@
+//
+/// \file libWexprBench/Measure.c
+/// \brief Timing, allocation and memory measurements
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+	#define _POSIX_C_SOURCE 200112L // clock_gettime, getrusage
+#endif
+
+#include "Measure.h"
+
+#include <libWexpr/Allocator.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+// --- structures
+
+// put in front of each allocation, so frees know the size. Sized to keep the allocation aligned.
+typedef union BenchAllocationHeader
+{
+	size_t size;
+	long double alignDouble;
+	void* alignPointer;
+} BenchAllocationHeader;
+
+static size_t s_count = 0;
+static size_t s_liveBytes = 0;
+static size_t s_peakBytes = 0;
+static size_t s_baseBytes = 0;
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void s_added (size_t size)
+{
+	++s_count;
+	s_liveBytes += size;
+	
+	if (s_liveBytes > s_peakBytes)
+		s_peakBytes = s_liveBytes;
+}
+
+static void* s_alloc (void* userData, size_t size)
+{
+	(void)userData;
+	
+	BenchAllocationHeader* header = malloc (sizeof(BenchAllocationHeader) + size);
+	if (!header)
+		return NULL;
+	
+	header->size = size;
+	s_added (size);
+	
+	return header + 1;
+}
+
+static void s_free (void* userData, void* ptr)
+{
+	(void)userData;
+	
+	BenchAllocationHeader* header = (BenchAllocationHeader*) ptr - 1;
+	s_liveBytes -= header->size;
+	
+	free (header);
+}
+
+static void* s_realloc (void* userData, void* ptr, size_t size)
+{
+	if (!ptr)
+		return s_alloc (userData, size);
+	
+	BenchAllocationHeader* header = (BenchAllocationHeader*) ptr - 1;
+	size_t oldSize = header->size;
+	
+	header = realloc (header, sizeof(BenchAllocationHeader) + size);
+	if (!header)
+		return NULL;
+	
+	header->size = size;
+	s_liveBytes -= oldSize;
+	s_added (size);
+	
+	return header + 1;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+void bench_Measure_installAllocator (void)
+{
+	WexprAllocator allocator;
+	allocator.alloc = &s_alloc;
+	allocator.realloc = &s_realloc;
+	allocator.free = &s_free;
+	allocator.userData = NULL;
+	
+	wexpr_Allocator_setGlobal (&allocator);
+}
+
+void bench_Measure_reset (void)
+{
+	s_count = 0;
+	s_baseBytes = s_liveBytes;
+	s_peakBytes = s_liveBytes;
+}
+
+BenchAllocations bench_Measure_allocations (void)
+{
+	BenchAllocations allocations;
+	allocations.count = s_count;
+	allocations.peakBytes = s_peakBytes - s_baseBytes;
+	
+	return allocations;
+}
+
+double bench_Measure_now (void)
+{
+	#ifdef _WIN32
+		LARGE_INTEGER frequency, counter;
+		QueryPerformanceFrequency (&frequency);
+		QueryPerformanceCounter (&counter);
+		
+		return (double) counter.QuadPart / (double) frequency.QuadPart;
+	#else
+		struct timespec now;
+		clock_gettime (CLOCK_MONOTONIC, &now);
+		
+		return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+	#endif
+}
+
+size_t bench_Measure_peakRssKb (void)
+{
+	#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof(counters)))
+			return 0;
+		
+		return counters.PeakWorkingSetSize / 1024;
+	#else
+		struct rusage usage;
+		if (getrusage (RUSAGE_SELF, &usage) != 0)
+			return 0;
+		
+		#ifdef __APPLE__
+			return (size_t) usage.ru_maxrss / 1024; // bytes on macOS
+		#else
+			return (size_t) usage.ru_maxrss;
+		#endif
+	#endif
+}
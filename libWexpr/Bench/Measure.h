@@ -0,0 +1,70 @@
+//
+/// \file libWexprBench/Measure.h
+/// \brief Timing, allocation and memory measurements
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef WEXPR_BENCH_MEASURE_H
+#define WEXPR_BENCH_MEASURE_H
+
+#include <stddef.h>
+
+//
+/// \brief What libWexpr allocated since the last bench_Measure_reset().
+//
+typedef struct BenchAllocations
+{
+	size_t count; ///< Allocations and reallocations made through the allocator. Pool hits are not counted.
+	size_t peakBytes; ///< Most bytes allocated at once, above what was allocated when reset.
+} BenchAllocations;
+
+//
+/// \brief Set a global allocator which counts what libWexpr allocates. Call before using libWexpr.
+//
+void bench_Measure_installAllocator (void);
+
+//
+/// \brief Start counting allocations from now.
+//
+void bench_Measure_reset (void);
+
+//
+/// \brief Allocations made since bench_Measure_reset().
+//
+BenchAllocations bench_Measure_allocations (void);
+
+//
+/// \brief A monotonic time in seconds.
+//
+double bench_Measure_now (void);
+
+//
+/// \brief The most memory the process has used so far in KB, or 0 if unknown.
+//
+size_t bench_Measure_peakRssKb (void);
+
+#endif // WEXPR_BENCH_MEASURE_H
@@ -0,0 +1,184 @@
+//
+/// \file libWexpr/Allocator.c
+/// \brief Lets you choose where libWexpr gets its memory from
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Allocator.h>
+
+#include <libWexpr/Pool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AllocatorPrivate.h"
+#include "Atomic.h"
+#include "StatsPrivate.h"
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void* s_mallocAlloc (void* userData, size_t size)
+{
+	(void)userData;
+	return malloc (size);
+}
+
+static void* s_mallocRealloc (void* userData, void* ptr, size_t size)
+{
+	(void)userData;
+	return realloc (ptr, size);
+}
+
+static void s_mallocFree (void* userData, void* ptr)
+{
+	(void)userData;
+	free (ptr);
+}
+
+static WexprAllocator s_globalAllocator = { s_mallocAlloc, s_mallocRealloc, s_mallocFree, NULL };
+
+static PRIVATE_THREAD_LOCAL const WexprAllocator* s_threadAllocator = NULL;
+
+// blocks from s_threadAllocator not freed yet, so switching away from it can be refused
+static PRIVATE_THREAD_LOCAL long s_threadLiveBlocks = 0;
+
+void* p_wexpr_calloc (size_t count, size_t size)
+{
+	if (size != 0 && count > SIZE_MAX / size)
+		return NULL; // would overflow
+	
+	void* ptr = wexpr_Allocator_alloc (count * size);
+	if (ptr)
+		memset (ptr, 0, count * size);
+	
+	return ptr;
+}
+
+void p_wexpr_Allocator_freeUncounted (void* ptr)
+{
+	if (s_threadAllocator)
+		--s_threadLiveBlocks;
+	
+	const WexprAllocator* allocator = wexpr_Allocator_current ();
+	allocator->free (allocator->userData, ptr);
+}
+
+char* p_wexpr_strdup (const char* str)
+{
+	size_t length = strlen (str) + 1;
+	
+	char* copy = wexpr_Allocator_alloc (length);
+	if (copy)
+		memcpy (copy, str, length);
+	
+	return copy;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+void wexpr_Allocator_setGlobal (const WexprAllocator* allocator)
+{
+	wexpr_Pool_trim (); // cached blocks belong to the old allocator
+	
+	if (allocator)
+	{
+		s_globalAllocator = *allocator;
+	}
+	else
+	{
+		s_globalAllocator.alloc = s_mallocAlloc;
+		s_globalAllocator.realloc = s_mallocRealloc;
+		s_globalAllocator.free = s_mallocFree;
+		s_globalAllocator.userData = NULL;
+	}
+}
+
+const WexprAllocator* wexpr_Allocator_setForThread (const WexprAllocator* allocator)
+{
+	if (allocator == s_threadAllocator)
+		return s_threadAllocator;
+	
+	wexpr_Pool_trim (); // cached blocks belong to the old allocator
+	
+	// memory still out from the old allocator would be freed into the new one
+	if (s_threadAllocator && s_threadLiveBlocks != 0)
+		return s_threadAllocator;
+	
+	const WexprAllocator* previous = s_threadAllocator;
+	s_threadAllocator = allocator;
+	s_threadLiveBlocks = 0;
+	
+	return previous;
+}
+
+const WexprAllocator* wexpr_Allocator_current (void)
+{
+	return s_threadAllocator ? s_threadAllocator : &s_globalAllocator;
+}
+
+void* wexpr_Allocator_alloc (size_t size)
+{
+	PRIVATE_STATS_ADD (allocations, 1);
+	PRIVATE_STATS_ADD (bytesAllocated, size);
+	
+	const WexprAllocator* allocator = wexpr_Allocator_current ();
+	void* ptr = allocator->alloc (allocator->userData, size);
+	
+	if (ptr && s_threadAllocator)
+		++s_threadLiveBlocks;
+	
+	return ptr;
+}
+
+void* wexpr_Allocator_realloc (void* ptr, size_t size)
+{
+	if (ptr)
+		PRIVATE_STATS_ADD (reallocations, 1);
+	else
+		PRIVATE_STATS_ADD (allocations, 1);
+	
+	PRIVATE_STATS_ADD (bytesAllocated, size);
+	
+	const WexprAllocator* allocator = wexpr_Allocator_current ();
+	void* result = allocator->realloc (allocator->userData, ptr, size);
+	
+	if (!ptr && result && s_threadAllocator)
+		++s_threadLiveBlocks;
+	
+	return result;
+}
+
+void wexpr_Allocator_free (void* ptr)
+{
+	if (!ptr)
+		return;
+	
+	PRIVATE_STATS_ADD (frees, 1);
+	
+	p_wexpr_Allocator_freeUncounted (ptr);
+}
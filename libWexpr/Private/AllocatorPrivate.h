@@ -0,0 +1,47 @@
+//
+/// \file libWexpr/AllocatorPrivate.h
+/// \brief Allocation helpers used inside the library
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ALLOCATORPRIVATE_H
+#define LIBWEXPR_ALLOCATORPRIVATE_H
+
+#include <libWexpr/Allocator.h>
+
+#include <stddef.h> // size_t
+
+// allocate zeroed memory for count items of size bytes
+void* p_wexpr_calloc (size_t count, size_t size);
+
+// free through the current allocator without counting it in wexpr_Stats, for blocks already counted as freed
+void p_wexpr_Allocator_freeUncounted (void* ptr);
+
+// copy a zero terminated string
+char* p_wexpr_strdup (const char* str);
+
+#endif // LIBWEXPR_ALLOCATORPRIVATE_H
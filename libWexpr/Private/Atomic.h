@@ -0,0 +1,72 @@
+//
+/// \file libWexpr/Atomic.h
+/// \brief Atomic counters for shared data
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ATOMIC_H
+#define LIBWEXPR_ATOMIC_H
+
+// C99 has no atomics, so use what the compiler provides.
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	
+	typedef volatile long PrivateAtomicCount;
+	
+	static __inline long p_wexpr_atomicIncrement (PrivateAtomicCount* count) { return _InterlockedIncrement (count); }
+	static __inline long p_wexpr_atomicDecrement (PrivateAtomicCount* count) { return _InterlockedDecrement (count); }
+	static __inline long p_wexpr_atomicLoad (PrivateAtomicCount* count) { return *count; }
+	
+#elif defined(__GNUC__) || defined(__clang__)
+	typedef long PrivateAtomicCount;
+	
+	static inline long p_wexpr_atomicIncrement (PrivateAtomicCount* count) { return __atomic_add_fetch (count, 1, __ATOMIC_RELAXED); }
+	static inline long p_wexpr_atomicDecrement (PrivateAtomicCount* count) { return __atomic_sub_fetch (count, 1, __ATOMIC_ACQ_REL); }
+	static inline long p_wexpr_atomicLoad (PrivateAtomicCount* count) { return __atomic_load_n (count, __ATOMIC_ACQUIRE); }
+	
+#else
+	// unknown compiler : shared data will not be thread safe
+	
+	typedef long PrivateAtomicCount;
+	
+	static inline long p_wexpr_atomicIncrement (PrivateAtomicCount* count) { return ++(*count); }
+	static inline long p_wexpr_atomicDecrement (PrivateAtomicCount* count) { return --(*count); }
+	static inline long p_wexpr_atomicLoad (PrivateAtomicCount* count) { return *count; }
+	
+#endif
+
+// thread local storage, for data each thread keeps on its own
+#if defined(_MSC_VER)
+	#define PRIVATE_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+	#define PRIVATE_THREAD_LOCAL __thread
+#else
+	#define PRIVATE_THREAD_LOCAL // unknown compiler : shared by all threads
+#endif
+
+#endif // LIBWEXPR_ATOMIC_H
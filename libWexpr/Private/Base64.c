@@ -30,6 +30,9 @@
 
 #include "Base64.h"
 
+#include "AllocatorPrivate.h"
+#include "PoolPrivate.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -106,7 +109,7 @@ Base64Buffer base64_decode (Base64IBuffer buf)
 	
 	// estimate size : every 4 bytes of text becomes 3 bytes binary.
 	res.size = buf.size * 3 / 4 + 1;
-	res.buffer = malloc(res.size);
+	res.buffer = p_wexpr_Pool_alloc(res.size); // becomes the payload of binary data
 	
 	if (!res.buffer)
 		return res; // buffer is null so it's invalid
@@ -170,34 +173,65 @@ Base64Buffer base64_decode (Base64IBuffer buf)
 	return res;
 }
 
+bool base64_decodedSize (Base64IBuffer buf, size_t* byteSize)
+{
+	const char* characters = buf.buffer;
+	size_t count = 0;
+	
+	// same rules as base64_decode : stop at padding, every 4 characters are 3 bytes, and a partial group is one less
+	while (count < buf.size && characters[count] != '=')
+	{
+		if (!s_isValidBase64Character (characters[count]))
+			return false;
+		
+		++count;
+	}
+	
+	*byteSize = (count / 4) * 3 + ((count % 4) ? (count % 4) - 1 : 0);
+	return true;
+}
+
 Base64Buffer base64_encode (Base64IBuffer buf)
 {
 	Base64Buffer res;
 	
 	// estimated size : every 3 bytes becomes 4 bytes
-	res.size = 4 * ((buf.size / 3) + 1); // 4*ceil(n/3)
-	res.buffer = malloc(res.size);
+	res.size = base64_encodedSize (buf.size);
+	res.buffer = wexpr_Allocator_alloc(res.size > 0 ? res.size : 1);
 	
 	if (!res.buffer)
 		return res; // buffer is null so its invalid
 	
+	// make sure its output size is correct
+	res.size = base64_encodeInto (buf, res.buffer);
+	
+	return res; // success
+}
+
+size_t base64_encodedSize (size_t byteSize)
+{
+	return 4 * ((byteSize + 2) / 3); // 4*ceil(n/3)
+}
+
+size_t base64_encodeInto (Base64IBuffer buf, char* output)
+{
 	size_t remaining = buf.size;
 	uint8_t inputBytes[3];
 	
 	size_t curInInputBytes = 0; // current position in inputBytes
 	size_t curInInput = 0; // current position in buf.buffer
-	size_t curInOutput = 0; // current position in res.buffer
+	size_t curInOutput = 0; // current position in output
 	
 	while (remaining--)
 	{
-		inputBytes[curInInputBytes] = *( (uint8_t*)buf.buffer + curInInput);
+		inputBytes[curInInputBytes] = *( (const uint8_t*)buf.buffer + curInInput);
 		curInInputBytes++;
 		curInInput++;
 		
 		if (curInInputBytes == 3)
 		{
 			// filled up - encode
-			s_base64EncodeAndAppend((char*)res.buffer + curInOutput, inputBytes, 4);
+			s_base64EncodeAndAppend(output + curInOutput, inputBytes, 4);
 			curInOutput += 4;
 			curInInputBytes = 0;
 		}
@@ -211,19 +245,16 @@ Base64Buffer base64_encode (Base64IBuffer buf)
 			inputBytes[j] = 0;
 		}
 		
-		s_base64EncodeAndAppend((char*)res.buffer + curInOutput, inputBytes, curInInputBytes+1);
+		s_base64EncodeAndAppend(output + curInOutput, inputBytes, curInInputBytes+1);
 		curInOutput += curInInputBytes+1;
 		
 		// append padding
 		while (curInInputBytes++ < 3)
 		{
-			((uint8_t*)res.buffer)[curInOutput] = '=';
+			output[curInOutput] = '=';
 			curInOutput++;
 		}
 	}
 	
-	// make sure its output size is correct
-	res.size = curInOutput;
-	
-	return res; // success
+	return curInOutput;
 }
@@ -31,6 +31,7 @@
 #ifndef LIBWEXPR_BASE64_H
 #define LIBWEXPR_BASE64_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef struct Base64IBuffer
@@ -50,9 +51,27 @@ typedef struct Base64Buffer
 //
 Base64Buffer base64_decode (Base64IBuffer buf);
 
+//
+/// \brief Find the number of bytes base64_decode() would give, without decoding.
+/// \return false if the string is not valid base64.
+//
+bool base64_decodedSize (Base64IBuffer buf, size_t* byteSize);
+
 //
 /// \brief Encode the given buffer as a Base64 string. You own the new buffer.
 //
 Base64Buffer base64_encode (Base64IBuffer buf);
 
+//
+/// \brief Return the number of characters base64_encodeInto() will write for byteSize bytes of input.
+//
+size_t base64_encodedSize (size_t byteSize);
+
+//
+/// \brief Encode the given buffer as Base64 into output, which must have room for base64_encodedSize() characters.
+/// Does not allocate. Input which is a multiple of 3 bytes produces no padding, so large buffers can be encoded in pieces.
+/// \return The number of characters written.
+//
+size_t base64_encodeInto (Base64IBuffer buf, char* output);
+
 #endif // LIBWEXPR_BASE64_H
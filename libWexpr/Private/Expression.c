@@ -31,30 +31,29 @@
 #include <libWexpr/Expression.h>
 
 #include <libWexpr/Endian.h>
+#include <libWexpr/Iterator.h>
+#include <libWexpr/Shape.h>
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "AllocatorPrivate.h"
+#include "Atomic.h"
 #include "Base64.h"
+#include "ExpressionPrivate.h"
+#include "KeyTable.h"
+#include "PoolPrivate.h"
+#include "StatsPrivate.h"
 
-#include "ThirdParty/sglib/sglib.h"
 #include "ThirdParty/c_hashmap/hashmap.h"
 
 // --- structures
 
-typedef struct WexprExpressionPrivateArrayElement
-{
-	WexprExpression* expression; // we own
-	struct WexprExpressionPrivateArrayElement* next; // next element
-} WexprExpressionPrivateArrayElement;
-
-#define WEXPREXPRESSIONPRIVATEARRAYELEMENT_COMPARATOR(e1, e2) ( (char*)(e1->expression) - (char*)(e2->expression))
-
-SGLIB_DEFINE_LIST_PROTOTYPES (WexprExpressionPrivateArrayElement, WEXPREXPRESSIONPRIVATEARRAYELEMENT_COMPARATOR, next)
-SGLIB_DEFINE_LIST_FUNCTIONS (WexprExpressionPrivateArrayElement, WEXPREXPRESSIONPRIVATEARRAYELEMENT_COMPARATOR, next)
-
+// used for the parser's aliases. Maps store PrivateKey::string -> WexprExpression* directly.
 typedef struct WexprExpressionPrivateMapElement
 {
 	char* key; // strdup, we own
@@ -65,33 +64,63 @@ typedef struct WexprExpressionPrivateMapElement
 
 typedef struct WexprExpressionPrivateValue
 {
-	char* data; // UTF-8 zero terminated data, we own.
+	char* data; // UTF-8 zero terminated data, we own. Length is WexprExpression::m_length.
 } WexprExpressionPrivateValue;
 
 typedef struct WexprExpressionPrivateBinaryData
 {
-	void* data;
-	size_t size; // in bytes
+	void* data; // we own. Size in bytes is WexprExpression::m_length.
 } WexprExpressionPrivateBinaryData;
 
 typedef struct WexprExpressionPrivateMap
 {
-	map_t hash;
+	map_t hash; // PrivateKey::string -> WexprExpression*, we own a reference to each key and the values. Shared with copies until changed.
 	
 } WexprExpressionPrivateMap;
 
+// array elements, with the capacity kept alongside so the node stays small
+typedef struct PrivateArrayStorage
+{
+	size_t capacity; // number of items there is room for
+	PrivateAtomicCount refs; // expressions using this storage. Copies share it until one of them changes.
+	uint64_t hash; // wexpr_Expression_hash() of the owner, set when frozen
+	WexprExpression* items[];
+} PrivateArrayStorage;
+
 typedef struct WexprExpressionPrivateArray
 {
-	WexprExpressionPrivateArrayElement* list;
-	size_t listCount; // number of items in the list
+	PrivateArrayStorage* storage; // we own the storage and each expression in it. NULL until needed. Count is WexprExpression::m_length.
 	
 } WexprExpressionPrivateArray;
 
-// privates to WexprExpression
+// flags about an expression
+enum
+{
+	PrivateExpressionFlagIndexed = 0x01, // part of a tree a WexprPathIndex was built from
+	
+	// set by wexpr_Expression_compact()
+	PrivateExpressionFlagArenaNode = 0x02, // the node is inside an arena, and is never freed on its own
+	PrivateExpressionFlagArenaPayload = 0x04, // the value, binary data or array storage is inside an arena, so is never freed or resized
+	PrivateExpressionFlagArenaRoot = 0x08, // the node is the start of an arena, which is freed with it
+	
+	PrivateExpressionFlagFrozen = 0x10, // set by wexpr_Expression_freeze(), nothing may change until destroyed
+	PrivateExpressionFlagBorrowed = 0x20 // a copy sharing the storage of a frozen expression, so its children are frozen
+};
+
+// privates to WexprExpression. Kept to 16 bytes on 64-bit platforms.
 struct WexprExpression
 {
-	// our type
-	WexprExpressionType m_type;
+	// our type, a WexprExpressionType
+	uint8_t m_type;
+	
+	// PrivateExpressionFlag
+	uint8_t m_flags;
+	
+	// with PrivateExpressionFlagIndexed, the slot of the path index(es) it's in. Fits in the padding before m_length.
+	uint16_t m_indexSlot;
+	
+	// value length, binary data size, or array count. The binary format limits these to 32 bits already.
+	uint32_t m_length;
 	
 	// our data based on type
 	union
@@ -103,12 +132,59 @@ struct WexprExpression
 	};
 };
 
+// the most m_length can hold. Longer values, binary data and arrays are rejected rather than truncated.
+#define PRIVATE_EXPRESSION_MAX_LENGTH UINT32_MAX
+
+// fails to compile if a change makes the node bigger on 64-bit platforms
+typedef char PrivateExpressionSizeCheck [(sizeof(void*) != 8 || sizeof(struct WexprExpression) == 16) ? 1 : -1];
+
 // ---------------------- PRIVATE ----------------------------------
 
+// call before changing an expression
+static void s_Expression_willMutate (WexprExpression* self)
+{
+	if (self->m_flags & PrivateExpressionFlagIndexed)
+		p_wexpr_PathIndex_invalidate (self->m_indexSlot);
+}
+
+// frozen expressions ignore anything that would change them
+static bool s_Expression_isFrozen (WexprExpression* self)
+{
+	return (self->m_flags & PrivateExpressionFlagFrozen) != 0;
+}
+
+// value strings and binary data come from the pool, so short lived values are recycled
+static char* s_Value_create (const char* str, size_t length)
+{
+	char* value = p_wexpr_Pool_alloc (length + 1);
+	if (!value)
+		return NULL;
+	
+	memcpy (value, str, length);
+	value[length] = '\0';
+	return value;
+}
+
+static void s_Value_destroy (char* value, size_t length)
+{
+	p_wexpr_Pool_free (value, length + 1);
+}
+
+// replace the value's string with one we own
+static void s_Expression_valueReplace (WexprExpression* self, char* value, size_t length)
+{
+	if (!(self->m_flags & PrivateExpressionFlagArenaPayload))
+		s_Value_destroy (self->m_value.data, self->m_length);
+	
+	self->m_flags &= ~PrivateExpressionFlagArenaPayload;
+	self->m_value.data = value;
+	self->m_length = (uint32_t) length;
+}
+
 static char* s_dupLengthString (const char* s, size_t n)
 {
 	size_t len = n;
-	char* result = (char*)malloc (len + 1);
+	char* result = (char*)wexpr_Allocator_alloc (len + 1);
 	if (!result)
 		return NULL;
 
@@ -227,11 +303,15 @@ typedef struct PrivateParserState
 	// contains WexprExpressionPrivateMapElement that we own
 	map_t aliasHash;
 	
+	// map keys created while parsing, so repeated keys are shared
+	PrivateKeyTable keyTable;
+	
 } PrivateParserState;
 
 void s_privateParserState_init (PrivateParserState* state)
 {
 	state->aliasHash = hashmap_new();
+	p_wexpr_KeyTable_init (&state->keyTable);
 	
 	// first position in the file
 	state->line = 1;
@@ -241,6 +321,7 @@ void s_privateParserState_init (PrivateParserState* state)
 void s_privateParserState_free (PrivateParserState* state)
 {
 	hashmap_free(state->aliasHash);
+	p_wexpr_KeyTable_free (&state->keyTable);
 }
 
 void s_privateParserState_moveForwardBasedOnString (PrivateParserState* parserState, PrivateStringRef str)
@@ -432,7 +513,7 @@ static PrivateWexprStringValue s_createValueOfString (
 					if (error)
 					{
 						error->code = WexprErrorCodeInvalidStringEscape;
-						error->message = "Invalid escape found in the string";
+						error->message = p_wexpr_strdup ("Invalid escape found in the string");
 						error->column = parserState->column;
 						error->line = parserState->line;
 					}
@@ -484,7 +565,7 @@ static PrivateWexprStringValue s_createValueOfString (
 		if (error)
 		{
 			error->code = WexprErrorCodeEmptyString;
-			error->message = strdup("Was told to parse an empty string");
+			error->message = p_wexpr_strdup("Was told to parse an empty string");
 			error->line = parserState->line;
 			error->column = parserState->column;
 		}
@@ -499,7 +580,7 @@ static PrivateWexprStringValue s_createValueOfString (
 	size_t end = pos;
 	
 	// we now know our buffer size and the string has been checked
-	char* buffer = malloc(bufferLength+1);
+	char* buffer = p_wexpr_Pool_alloc(bufferLength+1);
 	if (!buffer) {
 		PrivateWexprStringValue ret;
 		ret.value = NULL;
@@ -595,59 +676,192 @@ static PrivateWexprValueStringProperties s_wexprValueStringProperties (PrivateSt
 	return props;
 }
 
-static int s_copyToHash (any_t hashToWriteTo, any_t data)
+bool p_wexpr_Expression_isValueBarewordSafe (const char* str, size_t length)
+{
+	return s_wexprValueStringProperties (
+		s_stringRef_createFromPointerSize (str, length)
+	).isBarewordSafe;
+}
+
+// frees an alias in PrivateParserState::aliasHash
+static int s_freeHashData (any_t userData, any_t data)
 {
-	map_t hash = hashToWriteTo;
 	WexprExpressionPrivateMapElement* elem = data;
+	wexpr_Allocator_free (elem->key);
+	wexpr_Expression_destroy(elem->value);
+	wexpr_Allocator_free (elem);
+	
+	return MAP_OK; // keep iterating
+}
+
+// make room for at least capacity elements
+static size_t s_Expression_arrayCapacity (WexprExpression* self)
+{
+	return self->m_array.storage ? self->m_array.storage->capacity : 0;
+}
+
+// resize the storage to exactly capacity elements, which must be at least the count.
+// Returns false, leaving the storage as it was, if it's too big or unable to allocate.
+static bool s_Expression_arrayResize (WexprExpression* self, size_t capacity)
+{
+	if (capacity > PRIVATE_EXPRESSION_MAX_LENGTH ||
+		capacity > (SIZE_MAX - sizeof(PrivateArrayStorage)) / sizeof(WexprExpression*))
+	{
+		return false;
+	}
+	
+	if (self->m_flags & PrivateExpressionFlagArenaPayload)
+	{
+		// cant resize inside the arena, move to our own storage
+		PrivateArrayStorage* arenaStorage = self->m_array.storage;
+		self->m_array.storage = NULL;
+		self->m_flags &= ~PrivateExpressionFlagArenaPayload;
+		
+		if (capacity > 0)
+		{
+			if (!s_Expression_arrayResize (self, capacity))
+			{
+				self->m_array.storage = arenaStorage;
+				self->m_flags |= PrivateExpressionFlagArenaPayload;
+				return false;
+			}
+			
+			memcpy (self->m_array.storage->items, arenaStorage->items, self->m_length * sizeof(WexprExpression*));
+		}
+		
+		return true;
+	}
+	
+	if (capacity == 0)
+	{
+		wexpr_Allocator_free (self->m_array.storage);
+		self->m_array.storage = NULL;
+		return true;
+	}
 	
-	WexprExpressionPrivateMapElement* newElem = malloc(sizeof(WexprExpressionPrivateMapElement));
-	newElem->key = strdup (elem->key);
-	newElem->value = wexpr_Expression_createCopy(elem->value);
+	bool isNew = !self->m_array.storage;
 	
-	hashmap_put (hash, newElem->key, newElem);
+	PrivateArrayStorage* storage = wexpr_Allocator_realloc (self->m_array.storage,
+		sizeof(PrivateArrayStorage) + capacity * sizeof(WexprExpression*)
+	);
+	if (!storage)
+		return false; // unable to allocate, the old storage is untouched
+	
+	self->m_array.storage = storage;
+	self->m_array.storage->capacity = capacity;
+	
+	if (isNew)
+		self->m_array.storage->refs = 1;
+	
+	return true;
+}
+
+// make room for at least capacity elements. Returns false if unable to.
+static bool s_Expression_arrayReserve (WexprExpression* self, size_t capacity)
+{
+	if (capacity > s_Expression_arrayCapacity (self))
+		return s_Expression_arrayResize (self, capacity);
+	
+	return true;
+}
+
+// add to the end of the array, taking ownership. Grows geometrically so building an array is linear.
+// Returns false without taking the element if the array can't grow.
+static bool s_Expression_arrayAppend (WexprExpression* self, WexprExpression* element)
+{
+	size_t capacity = s_Expression_arrayCapacity (self);
+	if (self->m_length == capacity)
+	{
+		size_t newCapacity = capacity < 2 ? 4 : capacity * 2;
+		if (capacity > PRIVATE_EXPRESSION_MAX_LENGTH / 2)
+			newCapacity = PRIVATE_EXPRESSION_MAX_LENGTH;
+		
+		if (self->m_length >= PRIVATE_EXPRESSION_MAX_LENGTH || !s_Expression_arrayReserve (self, newCapacity))
+			return false;
+	}
+	
+	self->m_array.storage->items[self->m_length] = element;
+	++(self->m_length);
+	
+	return true;
+}
+
+// find the value slot for the key, adding it with a NULL value if missing. Takes ownership of the key reference.
+// Returns NULL if the map was unable to grow.
+static WexprExpression** s_Expression_mapUpsert (WexprExpression* self, PrivateKey* key)
+{
+	any_t* slot = NULL;
+	
+	int res = hashmap_upsert_hashed (self->m_map.hash, key->string, key->length, key->hash, &slot);
+	if (res == MAP_OMEM)
+	{
+		p_wexpr_Key_release (key);
+		return NULL;
+	}
+	
+	if (res == MAP_EXISTS)
+		p_wexpr_Key_release (key); // already have an identical key stored
+	
+	return (WexprExpression**) slot;
+}
+
+// add to the map, taking ownership of the key reference and value. Replaces (and destroys) any existing value.
+// Returns false without taking the value if the map was unable to grow.
+static bool s_Expression_mapPut (WexprExpression* self, PrivateKey* key, WexprExpression* value)
+{
+	WexprExpression** slot = s_Expression_mapUpsert (self, key);
+	if (!slot)
+		return false;
+	
+	if (*slot)
+		wexpr_Expression_destroy (*slot);
 	
-	return MAP_OK; // continue
+	*slot = value;
+	return true;
+}
+
+// reserve room for count elements, ignoring counts the hashmap cant hold
+static void s_Expression_mapReserve (WexprExpression* self, size_t count)
+{
+	if (count <= INT_MAX)
+		hashmap_reserve (self->m_map.hash, (int) count);
 }
 
 // Copy an expression into self. self should be null cause we dont cleanup ourself atm.
+// Every array and map is copied, so nothing is shared with rhs.
 static void s_Expression_copyInto (WexprExpression* self, WexprExpression* rhs)
 {
-	
-	// copy recursively
 	switch (wexpr_Expression_type(rhs))
 	{
 		case WexprExpressionTypeValue:
 		{
 			self->m_type = WexprExpressionTypeValue;
-			self->m_value.data = strdup (rhs->m_value.data);
+			self->m_value.data = s_Value_create (rhs->m_value.data, rhs->m_length);
+			self->m_length = rhs->m_length;
+			break;
+		}
+		
+		case WexprExpressionTypeBinaryData:
+		{
+			wexpr_Expression_changeType (self, WexprExpressionTypeBinaryData);
+			wexpr_Expression_binaryData_setValue (self, rhs->m_binaryData.data, rhs->m_length);
 			break;
 		}
 		
 		case WexprExpressionTypeArray:
 		{
 			self->m_type = WexprExpressionTypeArray;
-			self->m_array.list = NULL;
-			self->m_array.listCount = rhs->m_array.listCount;
+			self->m_array.storage = NULL;
+			self->m_length = 0;
+			
+			s_Expression_arrayReserve (self, rhs->m_length);
 			
-			for (size_t i=0; i < self->m_array.listCount; ++i)
+			WexprArrayIterator it;
+			wexpr_ArrayIterator_init (&it, rhs);
+			
+			for (WexprExpression* child = wexpr_ArrayIterator_next (&it); child; child = wexpr_ArrayIterator_next (&it))
 			{
-				WexprExpression* child = wexpr_Expression_arrayAt(rhs, i);
-				WexprExpression* childCopy = wexpr_Expression_createCopy(child);
-				
-				// add to our array
-				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
-				lelem->expression = childCopy;
-				lelem->next = NULL;
-				
-				WexprExpressionPrivateArrayElement* endOfList = self->m_array.list;
-				if (endOfList) {
-					while (endOfList->next) { endOfList = endOfList->next; }
-					endOfList->next = lelem;
-				}
-				else
-				{
-					self->m_array.list = lelem;
-				}
+				s_Expression_arrayAppend (self, wexpr_Expression_createCopy(child));
 			}
 			
 			break;
@@ -657,8 +871,23 @@ static void s_Expression_copyInto (WexprExpression* self, WexprExpression* rhs)
 		{
 			self->m_type = WexprExpressionTypeMap;
 			self->m_map.hash = hashmap_new();
+			s_Expression_mapReserve (self, (size_t) hashmap_length (rhs->m_map.hash));
+			
+			// keys are immutable, so the copy shares them
+			WexprMapIterator it;
+			wexpr_MapIterator_init (&it, rhs);
+			
+			const char* key = NULL;
+			WexprExpression* value = NULL;
+			
+			while (wexpr_MapIterator_next (&it, &key, &value))
+			{
+				s_Expression_mapPut (self,
+					p_wexpr_Key_retain (p_wexpr_Key_fromString (key)),
+					wexpr_Expression_createCopy (value)
+				);
+			}
 			
-			hashmap_iterate(rhs->m_map.hash, &s_copyToHash, self->m_map.hash);
 			break;
 		}
 		
@@ -667,16 +896,220 @@ static void s_Expression_copyInto (WexprExpression* self, WexprExpression* rhs)
 	}
 }
 
+// Like s_Expression_copyInto(), but arrays and maps share their storage with rhs until one of them changes,
+// so this doesnt depend on the size of rhs. Children stay shared : only safe when rhs is frozen, or when
+// everything changed is reached through s_Expression_unshare() from the top.
+static void s_Expression_shareInto (WexprExpression* self, WexprExpression* rhs)
+{
+	// nodes in an arena die with it, so those are copied fully
+	if ((rhs->m_flags & PrivateExpressionFlagArenaNode) ||
+		(rhs->m_type != WexprExpressionTypeArray && rhs->m_type != WexprExpressionTypeMap))
+	{
+		s_Expression_copyInto (self, rhs);
+		return;
+	}
+	
+	if (rhs->m_type == WexprExpressionTypeArray)
+	{
+		self->m_type = WexprExpressionTypeArray;
+		self->m_array.storage = rhs->m_array.storage;
+		self->m_length = rhs->m_length;
+		
+		if (self->m_array.storage)
+			p_wexpr_atomicIncrement (&self->m_array.storage->refs);
+	}
+	else
+	{
+		self->m_type = WexprExpressionTypeMap;
+		self->m_map.hash = rhs->m_map.hash;
+		hashmap_retain (self->m_map.hash);
+	}
+	
+	if (s_Expression_isFrozen (rhs))
+		self->m_flags |= PrivateExpressionFlagBorrowed;
+}
+
+// a new expression sharing rhs's storage, see s_Expression_shareInto()
+static WexprExpression* s_Expression_createShared (WexprExpression* rhs)
+{
+	WexprExpression* expr = wexpr_Expression_createNull();
+	
+	s_Expression_shareInto (expr, rhs);
+	
+	return expr;
+}
+
+WexprExpression* p_wexpr_Expression_createShared (WexprExpression* rhs)
+{
+	return s_Expression_createShared (rhs);
+}
+
+// drop a reference to array storage, destroying it and its elements with the last one
+static void s_ArrayStorage_release (PrivateArrayStorage* storage, size_t count)
+{
+	if (p_wexpr_atomicDecrement (&storage->refs) > 0)
+		return; // still used by a copy
+	
+	for (size_t i = 0; i < count; ++i)
+	{
+		wexpr_Expression_destroy (storage->items[i]);
+	}
+	
+	wexpr_Allocator_free (storage);
+}
+
+// drop a reference to a map table, destroying it with its keys and values with the last one
+static void s_Map_release (map_t hash)
+{
+	if (hashmap_release (hash) > 0)
+		return; // still used by a copy
+	
+	char* key = NULL;
+	WexprExpression* value = NULL;
+	
+	for (int i = hashmap_next (hash, 0, &key, (any_t*) &value);
+		i != MAP_MISSING; i = hashmap_next (hash, i+1, &key, (any_t*) &value))
+	{
+		p_wexpr_Key_release (p_wexpr_Key_fromString (key));
+		wexpr_Expression_destroy (value);
+	}
+	
+	hashmap_free (hash);
+}
+
+// Give self its own array or map storage if it shares it with a snapshot or repeat. Call before changing children.
+// Each child is copied in turn, which only shares their storage, so just this level is duplicated.
+static void s_Expression_unshare (WexprExpression* self)
+{
+	if (s_Expression_isFrozen (self))
+		return; // never changes, so is safe to share
+	
+	// borrowed storage holds frozen children, which need copying even once we are the only user
+	bool isBorrowed = (self->m_flags & PrivateExpressionFlagBorrowed);
+	self->m_flags &= ~PrivateExpressionFlagBorrowed;
+	
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		PrivateArrayStorage* shared = self->m_array.storage;
+		if (!shared || (!isBorrowed && p_wexpr_atomicLoad (&shared->refs) == 1))
+			return;
+		
+		s_Expression_willMutate (self);
+		
+		self->m_array.storage = NULL;
+		s_Expression_arrayResize (self, self->m_length);
+		
+		for (size_t i = 0; i < self->m_length; ++i)
+		{
+			self->m_array.storage->items[i] = s_Expression_createShared (shared->items[i]);
+		}
+		
+		s_ArrayStorage_release (shared, self->m_length);
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		map_t shared = self->m_map.hash;
+		if (!isBorrowed && !hashmap_is_shared (shared))
+			return;
+		
+		s_Expression_willMutate (self);
+		
+		self->m_map.hash = hashmap_new ();
+		hashmap_reserve (self->m_map.hash, hashmap_length (shared));
+		
+		char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (int i = hashmap_next (shared, 0, &key, (any_t*) &value);
+			i != MAP_MISSING; i = hashmap_next (shared, i+1, &key, (any_t*) &value))
+		{
+			s_Expression_mapPut (self,
+				p_wexpr_Key_retain (p_wexpr_Key_fromString (key)),
+				s_Expression_createShared (value)
+			);
+		}
+		
+		s_Map_release (shared);
+	}
+}
+
+void p_wexpr_Expression_unshare (WexprExpression* self)
+{
+	s_Expression_unshare (self);
+}
+
+// count the child chunks in a container chunk's data, so it can be allocated once.
+// Stops early if the data is malformed, the parse will report it.
+static size_t s_countBinaryChildren (const uint8_t* data, size_t size)
+{
+	size_t count = 0;
+	size_t curPos = 0;
+	
+	while (size - curPos >= sizeof(uint32_t) + sizeof(uint8_t))
+	{
+		uint32_t childSize;
+		memcpy (&childSize, data + curPos, sizeof(childSize));
+		childSize = wexpr_bigUInt32ToNative (childSize);
+		
+		curPos += sizeof(uint32_t) + sizeof(uint8_t);
+		if (childSize > size - curPos)
+			break;
+		
+		curPos += childSize;
+		++count;
+	}
+	
+	return count;
+}
+
+// the amount of child data we can safely look at : the chunk size, limited to what is actually in the buffer
+static size_t s_childDataSize (WexprBuffer data, size_t readAmount, uint32_t size)
+{
+	size_t available = data.byteSize - readAmount;
+	return (size < available) ? size : available;
+}
+
+// state kept while reading a binary chunk
+typedef struct PrivateBinaryParserState
+{
+	PrivateKeyTable keyTable;
+	
+	// the chunk inside each definition chunk, in the order they ended. Reference chunks read it again,
+	// so each one gets its own expression rather than sharing nodes which could change or be destroyed.
+	WexprBuffer* definitions;
+	size_t definitionCount;
+	size_t definitionCapacity;
+	size_t replaying; // above 0 while reading a definition again, so definitions inside it arent added twice
+} PrivateBinaryParserState;
+
+static bool s_BinaryParserState_addDefinition (PrivateBinaryParserState* state, WexprBuffer chunk)
+{
+	if (state->definitionCount == state->definitionCapacity)
+	{
+		size_t capacity = state->definitionCapacity ? state->definitionCapacity * 2 : 16;
+		WexprBuffer* definitions = wexpr_Allocator_realloc (state->definitions, capacity * sizeof(WexprBuffer));
+		if (!definitions)
+			return false;
+		
+		state->definitions = definitions;
+		state->definitionCapacity = capacity;
+	}
+	
+	state->definitions[state->definitionCount++] = chunk;
+	return true;
+}
+
 // returns the part of the buffer remaining
 // will load into self, setting up everything. Assumes we're empty/null to start.
-static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, WexprBuffer data, WexprError* error)
+static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, WexprBuffer data, PrivateBinaryParserState* state, WexprError* error)
 {
 	
 	if (data.byteSize < (sizeof(uint32_t) + sizeof(uint8_t)))
 	{
 		if (error)
 		{
-			error->message = strdup ("Chunk not big enough for header");
+			error->message = p_wexpr_strdup ("Chunk not big enough for header");
 			error->code = WexprErrorCodeBinaryChunkNotBigEnough;
 		}
 		
@@ -689,13 +1122,15 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 	
 	#define BUFCAST(buf, position, type) ((type)((uint8_t*)buf+(position)))
 	
-	uint32_t size = wexpr_bigUInt32ToNative(*BUFCAST(buf, 0, uint32_t*));
+	uint32_t size;
+	memcpy (&size, buf, sizeof(size));
+	size = wexpr_bigUInt32ToNative (size);
 	uint8_t chunkType = *BUFCAST(buf, 4, uint8_t*);
 	
 	size_t readAmount = sizeof(uint32_t) + sizeof(uint8_t);
 	
 	#define RETURN_REST() \
-		{ \
+		do { \
 			WexprBuffer rest; \
 			rest.byteSize = data.byteSize - readAmount; \
 			rest.data = (uint8_t*)buf + readAmount; \
@@ -727,6 +1162,7 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 	{
 		// data is child chunks
 		wexpr_Expression_changeType(self, WexprExpressionTypeArray);
+		s_Expression_arrayReserve (self, s_countBinaryChildren (BUFCAST(buf, readAmount, const uint8_t*), s_childDataSize (data, readAmount, size)));
 		
 		size_t curPos = 0;
 		
@@ -743,6 +1179,7 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			WexprBuffer remaining = s_Expression_parseFromBinaryChunk(
 				childExpr,
 				inBuf,
+				state,
 				error
 			);
 			
@@ -751,27 +1188,28 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			if (remaining.data == NULL)
 			{
 				// failure when parsing the array
+				wexpr_Expression_destroy (childExpr);
+				
 				WexprBuffer buf;
 				buf.byteSize = 0; buf.data = NULL;
 				return buf;
 			}
 			
 			// otherwise, add it
-			WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
-				lelem->expression = childExpr;
-				lelem->next = NULL;
-				
-			WexprExpressionPrivateArrayElement* endOfList = self->m_array.list;
-			if (endOfList) {
-				while (endOfList->next) { endOfList = endOfList->next; }
-				endOfList->next = lelem;
-			}
-			else
+			if (!s_Expression_arrayAppend (self, childExpr))
 			{
-				self->m_array.list = lelem;
+				wexpr_Expression_destroy (childExpr);
+				
+				if (error)
+				{
+					error->code = WexprErrorCodeTooLarge;
+					error->message = p_wexpr_strdup ("Array has too many elements");
+				}
+				
+				WexprBuffer buf;
+				buf.byteSize = 0; buf.data = NULL;
+				return buf;
 			}
-			
-			(self->m_array.listCount)++;
 		}
 		
 		readAmount += curPos;
@@ -782,6 +1220,7 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 	{
 		// data is key,value chunks
 		wexpr_Expression_changeType(self, WexprExpressionTypeMap);
+		s_Expression_mapReserve (self, s_countBinaryChildren (BUFCAST(buf, readAmount, const uint8_t*), s_childDataSize (data, readAmount, size)) / 2);
 		
 		size_t curPos = 0;
 		
@@ -794,10 +1233,25 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			inBuf.data = BUFCAST(buf, readAmount+curPos, const void*);
 			inBuf.byteSize = startSize;
 			
+			// keys are plain values. Definitions and references only make sense for values the map keeps.
+			if (startSize > sizeof(uint32_t) && *BUFCAST(buf, readAmount+curPos+sizeof(uint32_t), const uint8_t*) != WexprExpressionTypeValue)
+			{
+				if (error)
+				{
+					error->message = p_wexpr_strdup ("Map keys must be a value");
+					error->code = WexprErrorCodeMapKeyMustBeAValue;
+				}
+				
+				WexprBuffer buf;
+				buf.byteSize = 0; buf.data = NULL;
+				return buf;
+			}
+			
 			WexprExpression* keyExpression = wexpr_Expression_createInvalid();
 			WexprBuffer remaining = s_Expression_parseFromBinaryChunk(
 				keyExpression,
 				inBuf,
+				state,
 				error
 			);
 			
@@ -807,6 +1261,23 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			if (remaining.data == NULL)
 			{
 				// failure when parsing the child
+				wexpr_Expression_destroy (keyExpression);
+				
+				WexprBuffer buf;
+				buf.byteSize = 0; buf.data = NULL;
+				return buf;
+			}
+			
+			if (wexpr_Expression_type(keyExpression) != WexprExpressionTypeValue)
+			{
+				if (error)
+				{
+					error->message = p_wexpr_strdup ("Map keys must be a value");
+					error->code = WexprErrorCodeMapKeyMustBeAValue;
+				}
+				
+				wexpr_Expression_destroy(keyExpression);
+				
 				WexprBuffer buf;
 				buf.byteSize = 0; buf.data = NULL;
 				return buf;
@@ -817,6 +1288,7 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			remaining = s_Expression_parseFromBinaryChunk(
 				valueExpr,
 				remaining,
+				state,
 				error
 			);
 			
@@ -825,25 +1297,42 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 			if (remaining.data == NULL)
 			{
 				// failure when parsing the child
+				wexpr_Expression_destroy (keyExpression);
+				wexpr_Expression_destroy (valueExpr);
+				
 				WexprBuffer buf;
 				buf.byteSize = 0; buf.data = NULL;
 				return buf;
 			}
 			
 			// now add it
-			// both malloc so can free later
-			WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-			elem->key = strdup(wexpr_Expression_value(keyExpression));
-			elem->value = valueExpr;
-			
-			hashmap_put(self->m_map.hash, elem->key, elem);
+			const char* keyValue = wexpr_Expression_value(keyExpression);
+			bool added = s_Expression_mapPut (self,
+				p_wexpr_KeyTable_intern (&state->keyTable, keyValue, keyExpression->m_length),
+				valueExpr
+			);
 			
 			// destroy our key since thats not stored anywhere
 			wexpr_Expression_destroy(keyExpression);
-		}
-		
-		readAmount += curPos;
-		RETURN_REST();
+			
+			if (!added)
+			{
+				wexpr_Expression_destroy (valueExpr);
+				
+				if (error)
+				{
+					error->code = WexprErrorCodeTooLarge;
+					error->message = p_wexpr_strdup ("Map has too many elements");
+				}
+				
+				WexprBuffer buf;
+				buf.byteSize = 0; buf.data = NULL;
+				return buf;
+			}
+		}
+		
+		readAmount += curPos;
+		RETURN_REST();
 	}
 	
 	else if (chunkType == WexprExpressionTypeBinaryData)
@@ -856,7 +1345,7 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 		{
 			if (error)
 			{
-				error->message = strdup ("Unknown compression method to use");
+				error->message = p_wexpr_strdup ("Unknown compression method to use");
 				error->code = WexprErrorCodeBinaryUnknownCompression;
 			}
 			
@@ -876,25 +1365,139 @@ static WexprBuffer s_Expression_parseFromBinaryChunk (WexprExpression* self, Wex
 		RETURN_REST();
 	}
 	
-	else
+	else if (chunkType == PrivateBinaryChunkDefinition)
 	{
-		// unknown type
-		if (error)
+		// data is the expression being defined, which is also what goes here
+		if (size > data.byteSize - readAmount)
 		{
-			error->message = strdup ("Unknown chunk type to read");
-			error->code = WexprErrorCodeBinaryChunkNotBigEnough;
+			if (error)
+			{
+				error->message = p_wexpr_strdup ("Chunk size is bigger than the data given");
+				error->code = WexprErrorCodeBinaryChunkBiggerThanData;
+			}
+			
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
 		}
 		
-		WexprBuffer rest;
-		rest.byteSize = 0; rest.data = NULL;
-		return rest;
+		WexprBuffer inBuf;
+		inBuf.data = BUFCAST(buf, readAmount, const void*);
+		inBuf.byteSize = size;
+		
+		WexprBuffer remaining = s_Expression_parseFromBinaryChunk (self, inBuf, state, error);
+		if (remaining.data == NULL)
+		{
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
+		}
+		
+		// numbered once finished, so nested definitions come first
+		inBuf.byteSize -= remaining.byteSize;
+		
+		if (state->replaying == 0 && !s_BinaryParserState_addDefinition (state, inBuf))
+		{
+			if (error)
+			{
+				error->message = p_wexpr_strdup ("Too many definition chunks");
+				error->code = WexprErrorCodeTooLarge;
+			}
+			
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
+		}
+		
+		readAmount += size;
+		RETURN_REST();
+	}
+	
+	else if (chunkType == PrivateBinaryChunkReference)
+	{
+		// data is the id of an earlier definition
+		if (size != sizeof(uint32_t) || data.byteSize - readAmount < sizeof(uint32_t))
+		{
+			if (error)
+			{
+				error->message = p_wexpr_strdup ("Reference chunk must be the size of an id");
+				error->code = WexprErrorCodeBinaryChunkNotBigEnough;
+			}
+			
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
+		}
+		
+		uint32_t id;
+		memcpy (&id, BUFCAST(buf, readAmount, const uint8_t*), sizeof(id));
+		id = wexpr_bigUInt32ToNative (id);
+		
+		if (id >= state->definitionCount)
+		{
+			if (error)
+			{
+				error->message = p_wexpr_strdup ("Reference to a definition which wasn't read yet");
+				error->code = WexprErrorCodeBinaryUnknownReference;
+			}
+			
+			WexprBuffer buf;
+			buf.byteSize = 0; buf.data = NULL;
+			return buf;
+		}
+		
+		// read what was defined again, which was already checked the first time
+		++state->replaying;
+		WexprBuffer replayed = s_Expression_parseFromBinaryChunk (self, state->definitions[id], state, error);
+		--state->replaying;
+		
+		if (replayed.data == NULL)
+			return replayed;
+		
+		readAmount += size;
+		RETURN_REST();
 	}
 	
 	#undef BUFCAST
 	#undef RETURN_REST
+	
+	// unknown type
+	if (error)
+	{
+		error->message = p_wexpr_strdup ("Unknown chunk type to read");
+		error->code = WexprErrorCodeBinaryUnknownChunkType;
+	}
+	
+	WexprBuffer rest;
+	rest.byteSize = 0; rest.data = NULL;
+	return rest;
 }
 
 // returns the part of the string remaining
+// reference names are like identifiers : letters, numbers and underscores, not starting with a number
+static bool s_isReferenceNameValid (PrivateStringRef name)
+{
+	for (size_t i=0; i < name.size; ++i)
+	{
+		char v = name.ptr[i];
+		
+		bool isAlpha = (v >= 'a' && v <= 'z') || (v >= 'A' && v <= 'Z');
+		bool isNumber = (v >= '0' && v <= '9');
+		bool isUnder = (v == '_');
+		
+		if (i == 0 && (isAlpha || isUnder))
+		{}
+		else if (i != 0 && (isAlpha || isNumber || isUnder))
+		{}
+		else
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
 // will load into self, setting up everything. Assumes we're empty/null to start.
 static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, PrivateStringRef str, WexprParseFlags parseFlags,
 	PrivateParserState* parserState, WexprError* error)
@@ -904,7 +1507,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		if (error)
 		{
 			error->code = WexprErrorCodeEmptyString;
-			error->message = strdup("Was told to parse an empty string");
+			error->message = p_wexpr_strdup("Was told to parse an empty string");
 			error->line = parserState->line;
 			error->column = parserState->column;
 		}
@@ -931,8 +1534,8 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 	{
 		// We're an array
 		self->m_type = WexprExpressionTypeArray;
-		self->m_array.listCount = 0;
-		self->m_array.list = NULL;
+		self->m_length = 0;
+		self->m_array.storage = NULL;
 		
 		// move our string forward
 		str = s_StringRef_slice(str, 2);
@@ -946,7 +1549,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 			if (str.size == 0)
 			{
 				error->code = WexprErrorCodeArrayMissingEndParen;
-				error->message = strdup("An Array was missing its ending paren");
+				error->message = p_wexpr_strdup("An Array was missing its ending paren");
 				error->line = parserState->line;
 				error->column = parserState->column;
 				
@@ -973,22 +1576,17 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 				}
 				
 				// otherwise, add it to our array
-				WexprExpressionPrivateArrayElement* lelem = malloc(sizeof(WexprExpressionPrivateArrayElement));
-				lelem->expression = newExpression;
-				lelem->next = NULL;
-				
-				WexprExpressionPrivateArrayElement* endOfList = self->m_array.list;
-				if (endOfList) {
-					while (endOfList->next) { endOfList = endOfList->next; }
-					endOfList->next = lelem;
-				}
-				else
+				if (!s_Expression_arrayAppend (self, newExpression))
 				{
-					self->m_array.list = lelem;
+					wexpr_Expression_destroy(newExpression); // not added
+					
+					error->code = WexprErrorCodeTooLarge;
+					error->message = p_wexpr_strdup("An Array has too many elements");
+					error->line = parserState->line;
+					error->column = parserState->column;
+					
+					return s_StringRef_createInvalid();
 				}
-				
-				(self->m_array.listCount)++;
-				
 			}
 		}
 		
@@ -1017,7 +1615,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 			if (str.size == 0)
 			{
 				error->code = WexprErrorCodeMapMissingEndParen;
-				error->message = strdup("A Map was missing its ending paren");
+				error->message = p_wexpr_strdup("A Map was missing its ending paren");
 				error->line = parserState->line;
 				error->column = parserState->column;
 				
@@ -1045,7 +1643,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 				if (wexpr_Expression_type(keyExpression) != WexprExpressionTypeValue)
 				{
 					error->code = WexprErrorCodeMapKeyMustBeAValue;
-					error->message = strdup("Map keys must be a value");
+					error->message = p_wexpr_strdup("Map keys must be a value");
 					error->line = prevLine;
 					error->column = prevColumn;
 				
@@ -1061,7 +1659,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 				{
 					// it wasnt filled in! no key found.
 					error->code = WexprErrorCodeMapNoValue;
-					error->message = strdup("Map key must have a value");
+					error->message = p_wexpr_strdup("Map key must have a value");
 					error->line = prevLine;
 					error->column = prevColumn;
 				
@@ -1072,15 +1670,26 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 				}
 				
 				// ok we now have the key and the value
-				// both malloc so can free later
-				WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-				elem->key = strdup(wexpr_Expression_value(keyExpression));
-				elem->value = valueExpression;
-				
-				hashmap_put(self->m_map.hash, elem->key, elem);
+				const char* keyValue = wexpr_Expression_value(keyExpression);
+				bool added = s_Expression_mapPut (self,
+					p_wexpr_KeyTable_intern (&parserState->keyTable, keyValue, keyExpression->m_length),
+					valueExpression
+				);
 				
 				// destroy our key since thats not stored anywhere
 				wexpr_Expression_destroy(keyExpression);
+				
+				if (!added)
+				{
+					wexpr_Expression_destroy(valueExpression);
+					
+					error->code = WexprErrorCodeTooLarge;
+					error->message = p_wexpr_strdup("A Map has too many elements");
+					error->line = prevLine;
+					error->column = prevColumn;
+					
+					return s_StringRef_createInvalid();
+				}
 			}
 		}
 		
@@ -1101,7 +1710,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		if (endingBracketIndex == s_InvalidIndex)
 		{
 			error->code = WexprErrorCodeReferenceMissingEndBracket;
-			error->message = strdup ("A reference [] is missing its ending bracket");
+			error->message = p_wexpr_strdup ("A reference [] is missing its ending bracket");
 			error->line = parserState->line;
 			error->column = parserState->column;
 			
@@ -1111,32 +1720,12 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		PrivateStringRef refName = s_StringRef_slice2(str, 1, endingBracketIndex-1);
 		
 		// validate the contents
-		bool invalidName = false;
-		for (size_t i=0; i < refName.size; ++i)
-		{
-			char v = refName.ptr[i];
-			
-			bool isAlpha = (v >= 'a' && v <= 'z') || (v >= 'A' && v <= 'Z');
-			bool isNumber = (v >= '0' && v <= '9');
-			bool isUnder = (v == '_');
-			
-			if (i == 0 && (isAlpha || isUnder))
-			{}
-			else if (i != 0 && (isAlpha || isNumber || isUnder))
-			{}
-			else
-			{
-				invalidName = true;
-				break;
-			}
-		}
-		
-		if (invalidName)
+		if (!s_isReferenceNameValid (refName))
 		{
 			if (error)
 			{
 				error->code = WexprErrorCodeReferenceInvalidName;
-				error->message = strdup ("A reference doesn't have a valid name");
+				error->message = p_wexpr_strdup ("A reference doesn't have a valid name");
 				error->line = parserState->line;
 				error->column = parserState->column;
 				
@@ -1160,12 +1749,19 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		}
 		
 		// now bind the ref - creating a copy of what was made. This will be used for the template.
-		WexprExpressionPrivateMapElement* elem = malloc(sizeof(WexprExpressionPrivateMapElement));
+		WexprExpressionPrivateMapElement* elem = wexpr_Allocator_alloc(sizeof(WexprExpressionPrivateMapElement));
 		elem->key = s_dupLengthString (refName.ptr, refName.size);
 		elem->value = wexpr_Expression_createCopy (self);
 		
+		// rebinding a name replaces the old one
+		WexprExpressionPrivateMapElement* oldElem = NULL;
+		hashmap_get (parserState->aliasHash, elem->key, (any_t*) &oldElem);
+		
 		hashmap_put(parserState->aliasHash, elem->key, elem);
 		
+		if (oldElem)
+			s_freeHashData (NULL, oldElem);
+		
 		// and continue
 		return resultString;
 	}
@@ -1177,7 +1773,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		if (endingBracketIndex == s_InvalidIndex)
 		{
 			error->code = WexprErrorCodeReferenceInsertMissingEndBracket;
-			error->message = strdup ("A reference insert *[] is missing its ending bracket");
+			error->message = p_wexpr_strdup ("A reference insert *[] is missing its ending bracket");
 			error->line = parserState->line;
 			error->column = parserState->column;
 			
@@ -1196,13 +1792,13 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		char* refStr = s_dupLengthString (refName.ptr, refName.size);
 		int found = hashmap_get(parserState->aliasHash, refStr, (void**) &elem);
 		
-		free (refStr);
+		wexpr_Allocator_free (refStr);
 		
 		if (found != MAP_OK || !elem)
 		{
 			// not found
 			error->code = WexprErrorCodeReferenceUnknownReference;
-			error->message = strdup ("Tried to insert a reference, but couldn't find it.");
+			error->message = p_wexpr_strdup ("Tried to insert a reference, but couldn't find it.");
 			error->line = parserState->line;
 			error->column = parserState->column;
 			
@@ -1229,7 +1825,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		{
 			// not found
 			error->code = WexprErrorCodeBinaryDataNoEnding;
-			error->message = strdup ("Tried to find the ending > for binary data, but not found.");
+			error->message = p_wexpr_strdup ("Tried to find the ending > for binary data, but not found.");
 			error->line = parserState->line;
 			error->column = parserState->column;
 			
@@ -1244,7 +1840,19 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		if (outBuf.buffer == NULL)
 		{
 			error->code = WexprErrorCodeBinaryDataInvalidBase64;
-			error->message = strdup ("Unable to decode the base64 data.");
+			error->message = p_wexpr_strdup ("Unable to decode the base64 data.");
+			error->line = parserState->line;
+			error->column = parserState->column;
+			
+			return s_StringRef_createInvalid();
+		}
+		
+		if (outBuf.size > PRIVATE_EXPRESSION_MAX_LENGTH)
+		{
+			p_wexpr_Pool_free (outBuf.buffer, outBuf.size);
+			
+			error->code = WexprErrorCodeTooLarge;
+			error->message = p_wexpr_strdup ("Binary data is too large.");
 			error->line = parserState->line;
 			error->column = parserState->column;
 			
@@ -1253,7 +1861,7 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		
 		self->m_type = WexprExpressionTypeBinaryData;
 		self->m_binaryData.data = outBuf.buffer;
-		self->m_binaryData.size = outBuf.size;
+		self->m_length = (uint32_t) outBuf.size;
 		
 		s_privateParserState_moveForwardBasedOnString (parserState,
 			s_StringRef_slice2 (str, 0, endingQuote+1)
@@ -1269,19 +1877,34 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 		if (error && error->code != WexprErrorCodeNone)
 			return s_StringRef_createInvalid();
 		
+		size_t length = strlen (val.value);
+		
+		if (length > PRIVATE_EXPRESSION_MAX_LENGTH)
+		{
+			s_Value_destroy (val.value, length);
+			
+			error->code = WexprErrorCodeTooLarge;
+			error->message = p_wexpr_strdup ("Value is too large.");
+			error->line = parserState->line;
+			error->column = parserState->column;
+			
+			return s_StringRef_createInvalid();
+		}
+		
 		// was it a null/nil string?
 		if ((strcmp (val.value, "nil") == 0) || (strcmp (val.value, "null") == 0))
 		{
 			self->m_type = WexprExpressionTypeNull;
 			
 			// we dont need the value anymore, trash it
-			free(val.value);
+			s_Value_destroy (val.value, length);
 			val.value = LIBWEXPR_NULLPTR;
 		}
 		else
 		{
 			self->m_type = WexprExpressionTypeValue;
 			self->m_value.data = val.value;
+			self->m_length = (uint32_t) length;
 		}
 		
 		s_privateParserState_moveForwardBasedOnString (parserState,
@@ -1297,14 +1920,26 @@ static PrivateStringRef s_Expression_parseFromString (WexprExpression* self, Pri
 	return s_StringRef_createInvalid();
 }
 
-static int s_freeHashData (any_t userData, any_t data)
+void p_wexpr_Expression_markIndexed (WexprExpression* self, uint16_t slot)
 {
-	WexprExpressionPrivateMapElement* elem = data;
-	free (elem->key);
-	wexpr_Expression_destroy(elem->value);
-	free (elem);
+	// frozen expressions never change, and must not be written to while being read
+	if (s_Expression_isFrozen (self))
+		return;
 	
-	return MAP_OK; // keep iterating
+	// already in another index which still exists, so changes have to invalidate both
+	if ((self->m_flags & PrivateExpressionFlagIndexed) && self->m_indexSlot != slot &&
+		(self->m_indexSlot == PRIVATE_PATHINDEX_SHARED_SLOT || p_wexpr_PathIndex_isSlotInUse (self->m_indexSlot)))
+	{
+		slot = PRIVATE_PATHINDEX_SHARED_SLOT;
+	}
+	
+	self->m_flags |= PrivateExpressionFlagIndexed;
+	self->m_indexSlot = slot;
+}
+
+uint16_t p_wexpr_Expression_indexSlot (WexprExpression* self)
+{
+	return (self->m_flags & PrivateExpressionFlagIndexed) ? self->m_indexSlot : PRIVATE_PATHINDEX_SHARED_SLOT;
 }
 
 static size_t s_byteSizeForIndent (size_t indent)
@@ -1342,7 +1977,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 	if (type == WexprExpressionTypeNull)
 	{
 		size_t newSize = curBufferSize + 4;
-		char* newBuffer = realloc(buffer, newSize);
+		char* newBuffer = wexpr_Allocator_realloc(buffer, newSize);
 		
 		strncpy (newBuffer+curBufferSize, "null", 4);
 		return s_stringRef_createFromPointerSize(newBuffer, newSize);
@@ -1353,7 +1988,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		// value - always write directly
 		
 		const char* value = wexpr_Expression_value(self);
-		size_t len = strlen(value);
+		size_t len = self->m_length;
 		
 		PrivateWexprValueStringProperties props = s_wexprValueStringProperties(
 			s_StringRef_create(value)
@@ -1361,7 +1996,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		
 		char* newBuffer = buffer;
 		size_t newSize = curBufferSize + len + (props.isBarewordSafe ? 0 : 2); // add quotes if needed
-		newBuffer = realloc (newBuffer, newSize);
+		newBuffer = wexpr_Allocator_realloc (newBuffer, newSize);
 		
 		// copy the value, taking into account quotes or not
 		strncpy (newBuffer+curBufferSize + (props.isBarewordSafe ? 0 : 1), value, len);
@@ -1388,7 +2023,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		
 		Base64Buffer outBuf = base64_encode(ibuf);
 		size_t newSize = curBufferSize + 2 + outBuf.size;
-		char* newBuffer = realloc(buffer, newSize);
+		char* newBuffer = wexpr_Allocator_realloc(buffer, newSize);
 		strncpy (newBuffer+curBufferSize, "<", 1); curBufferSize += 1;
 		
 		strncpy (newBuffer+curBufferSize, outBuf.buffer, outBuf.size);
@@ -1398,7 +2033,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		curBufferSize += 1;
 		
 		// cleanup our buffer
-		free (outBuf.buffer);
+		wexpr_Allocator_free (outBuf.buffer);
 		outBuf.buffer = NULL;
 		
 		return s_stringRef_createFromPointerSize(newBuffer, newSize);
@@ -1413,7 +2048,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		{
 			// straightforward, always empty structure
 			size_t newSize = curBufferSize + 3;
-			char* newBuffer = realloc(buffer, newSize);
+			char* newBuffer = wexpr_Allocator_realloc(buffer, newSize);
 			strncpy (newBuffer+curBufferSize, "#()", 3);
 			return s_stringRef_createFromPointerSize(newBuffer, newSize);
 		}
@@ -1422,23 +2057,26 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		
 		// array : human readable we'll write each one on its own line.
 		size_t newSize = curBufferSize + 2 + (writeHumanReadable ? 1 : 0); // room for #( and newline if needed
-		char* newBuffer = realloc(buffer, newSize);
+		char* newBuffer = wexpr_Allocator_realloc(buffer, newSize);
 		
 		if (writeHumanReadable)
 			strncpy (newBuffer+curBufferSize, "#(\n", 3);
 		else
 			strncpy (newBuffer+curBufferSize, "#(", 2);
 		
+		WexprArrayIterator it;
+		wexpr_ArrayIterator_init (&it, self);
+		
 		for (size_t i=0; i < arraySize; ++i)
 		{
-			WexprExpression* obj = wexpr_Expression_arrayAt(self, i);
+			WexprExpression* obj = wexpr_ArrayIterator_next (&it);
 			
 			// if human readable, we need to indent the line, output the object, then add a newline
 			if (writeHumanReadable)
 			{
 				size_t indentBytes = s_byteSizeForIndent(indent+1);
 				newSize += indentBytes;
-				newBuffer = realloc(newBuffer, newSize);
+				newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 				s_fillIndent(newBuffer+newSize-indentBytes, indent+1);
 				
 				// now add our normal
@@ -1450,7 +2088,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 				
 				// add the newline
 				newSize += 1;
-				newBuffer = realloc(newBuffer, newSize);
+				newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 				newBuffer[newSize-1] = '\n';
 			}
 			
@@ -1461,7 +2099,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 				{
 					// we need a space
 					newSize += 1;
-					newBuffer = realloc(newBuffer, newSize);
+					newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 					newBuffer[newSize-1] = ' ';
 				}
 				
@@ -1482,12 +2120,12 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		{
 			size_t indentBytes = s_byteSizeForIndent(indent);
 			newSize += indentBytes;
-			newBuffer = realloc(newBuffer, newSize);
+			newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 			s_fillIndent(newBuffer+newSize-indentBytes, indent);
 		}
 		
 		newSize += 1;
-		newBuffer = realloc(newBuffer, newSize);
+		newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 		newBuffer[newSize-1] = ')';
 		
 		// and done
@@ -1502,7 +2140,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		{
 			// straightforward, always empty structure
 			size_t newSize = curBufferSize + 3;
-			char* newBuffer = realloc(buffer, newSize);
+			char* newBuffer = wexpr_Allocator_realloc(buffer, newSize);
 			strncpy (newBuffer + curBufferSize, "@()", 3);
 			return s_stringRef_createFromPointerSize(newBuffer, newSize);
 		}
@@ -1511,21 +2149,22 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		
 		// map : human readable we'll write each one on its own line
 		size_t newSize = curBufferSize + 2 + (writeHumanReadable ? 1 : 0); // room for @( and newline if needed
-		char* newBuffer = realloc (buffer, newSize);
+		char* newBuffer = wexpr_Allocator_realloc (buffer, newSize);
 		
 		if (writeHumanReadable)
 			strncpy (newBuffer+curBufferSize, "@(\n", 3);
 		else
 			strncpy (newBuffer+curBufferSize, "@(", 2);
 		
-		for (size_t i=0; i < mapSize; ++i)
+		WexprMapIterator it;
+		wexpr_MapIterator_init (&it, self);
+		
+		const char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (size_t i=0; wexpr_MapIterator_next (&it, &key, &value); ++i)
 		{
-			const char* key = wexpr_Expression_mapKeyAt(self, i);
-			if (!key)
-				continue; // we shouldnt ever get an empty key, but its possible currently in the case of dereffing in a key for some reason : @([a]a b *[a] c)
-			
 			size_t keyLength = strlen(key);
-			WexprExpression* value = wexpr_Expression_mapValueAt(self, i);
 			
 			// if human readable, indent the line, output the key, space, object, newline
 			if (writeHumanReadable)
@@ -1533,7 +2172,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 				size_t indentBytes = s_byteSizeForIndent(indent+1);
 				size_t prevSize = newSize;
 				newSize += indentBytes + keyLength + 1; // get us to the object
-				newBuffer = realloc(newBuffer, newSize);
+				newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 				s_fillIndent(newBuffer+prevSize, indent+1);
 				strncpy (newBuffer+prevSize+indentBytes, key, keyLength);
 				newBuffer[newSize-1] = ' ';
@@ -1547,7 +2186,7 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 				
 				// add the newline
 				newSize += 1;
-				newBuffer = realloc(newBuffer, newSize);
+				newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 				newBuffer[newSize-1] = '\n';
 			}
 			
@@ -1558,14 +2197,14 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 				{
 					// we need a space
 					newSize += 1;
-					newBuffer = realloc(newBuffer, newSize);
+					newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 					newBuffer[newSize-1] = ' ';
 				}
 				
 				// now key, space, value
 				size_t prevSize = newSize;
 				newSize += keyLength+1;
-				newBuffer = realloc(newBuffer, newSize);
+				newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 				strncpy (newBuffer+prevSize, key, keyLength);
 				newBuffer[newSize-1] = ' ';
 				
@@ -1585,12 +2224,12 @@ static PrivateStringRef p_wexpr_Expression_appendStringRepresentationToAllocated
 		{
 			size_t indentBytes = s_byteSizeForIndent(indent);
 			newSize += indentBytes;
-			newBuffer = realloc(newBuffer, newSize);
+			newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 			s_fillIndent(newBuffer+newSize-indentBytes, indent);
 		}
 		
 		newSize += 1;
-		newBuffer = realloc(newBuffer, newSize);
+		newBuffer = wexpr_Allocator_realloc(newBuffer, newSize);
 		newBuffer[newSize-1] = ')';
 		
 		// and done
@@ -1623,8 +2262,12 @@ WexprExpression* wexpr_Expression_createFromLengthString (
 	WexprError* error
 )
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
+	WexprExpression* expr = p_wexpr_Pool_alloc (sizeof(WexprExpression));
+	PRIVATE_STATS_ADD (nodes, 1);
 	expr->m_type = WexprExpressionTypeInvalid;
+	expr->m_flags = 0;
+	expr->m_indexSlot = 0;
+	expr->m_length = 0;
 	
 	PrivateParserState parserState;
 	s_privateParserState_init (&parserState);
@@ -1645,7 +2288,7 @@ WexprExpression* wexpr_Expression_createFromLengthString (
 		if (postRest.size != 0)
 		{
 			err.code = WexprErrorCodeExtraDataAfterParsingRoot;
-			err.message = strdup ("Extra data after parsing the root expression");
+			err.message = p_wexpr_strdup ("Extra data after parsing the root expression");
 			err.line = parserState.line;
 			err.column = parserState.column;
 		}
@@ -1654,7 +2297,7 @@ WexprExpression* wexpr_Expression_createFromLengthString (
 		{
 			// we didnt get an expression and no error currently reported
 			err.code = WexprErrorCodeEmptyString;
-			err.message = strdup ("No expression found [remained invalid]");
+			err.message = p_wexpr_strdup ("No expression found [remained invalid]");
 			err.line = parserState.line;
 			err.column = parserState.column;
 		}
@@ -1662,7 +2305,7 @@ WexprExpression* wexpr_Expression_createFromLengthString (
 	else
 	{
 		err.code = WexprErrorCodeInvalidUTF8;
-		err.message = strdup ("Invalid UTF8");
+		err.message = p_wexpr_strdup ("Invalid UTF8");
 	}
 	
 	// cleanup our parser state
@@ -1693,8 +2336,12 @@ WexprExpression* wexpr_Expression_createFromBinaryChunk (
 	const void* data, size_t length, WexprError* error
 )
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
+	WexprExpression* expr = p_wexpr_Pool_alloc (sizeof(WexprExpression));
+	PRIVATE_STATS_ADD (nodes, 1);
 	expr->m_type = WexprExpressionTypeInvalid;
+	expr->m_flags = 0;
+	expr->m_indexSlot = 0;
+	expr->m_length = 0;
 	
 	WexprError err = WEXPR_ERROR_INIT();
 	
@@ -1702,10 +2349,17 @@ WexprExpression* wexpr_Expression_createFromBinaryChunk (
 	inBuf.data = data;
 	inBuf.byteSize = length;
 	
+	PrivateBinaryParserState state;
+	memset (&state, 0, sizeof(state));
+	p_wexpr_KeyTable_init (&state.keyTable);
+	
 	WexprBuffer buf = s_Expression_parseFromBinaryChunk (
-		expr, inBuf, &err
+		expr, inBuf, &state, &err
 	);
 	
+	p_wexpr_KeyTable_free (&state.keyTable);
+	wexpr_Allocator_free (state.definitions);
+	
 	if (err.code != WexprErrorCodeNone)
 	{
 		wexpr_Expression_destroy (expr);
@@ -1722,18 +2376,49 @@ WexprExpression* wexpr_Expression_createFromBinaryChunk (
 	return expr;
 }
 
+WexprExpression* wexpr_Expression_createFromLengthStringWithStats (
+	const char* str, size_t length, WexprParseFlags flags,
+	WexprError* error, WexprStats* stats
+)
+{
+	WexprStats start = wexpr_Stats_get ();
+	WexprExpression* expr = wexpr_Expression_createFromLengthString (str, length, flags, error);
+	p_wexpr_Stats_since (&start, stats);
+	
+	return expr;
+}
+
+WexprExpression* wexpr_Expression_createFromBinaryChunkWithStats (
+	const void* data, size_t length, WexprError* error, WexprStats* stats
+)
+{
+	WexprStats start = wexpr_Stats_get ();
+	WexprExpression* expr = wexpr_Expression_createFromBinaryChunk (data, length, error);
+	p_wexpr_Stats_since (&start, stats);
+	
+	return expr;
+}
+
 WexprExpression* wexpr_Expression_createInvalid (void)
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
+	WexprExpression* expr = p_wexpr_Pool_alloc (sizeof(WexprExpression));
+	PRIVATE_STATS_ADD (nodes, 1);
 	expr->m_type = WexprExpressionTypeInvalid;
+	expr->m_flags = 0;
+	expr->m_indexSlot = 0;
+	expr->m_length = 0;
 	
 	return expr;
 }
 
 WexprExpression* wexpr_Expression_createNull (void)
 {
-	WexprExpression* expr = malloc (sizeof(WexprExpression));
+	WexprExpression* expr = p_wexpr_Pool_alloc (sizeof(WexprExpression));
+	PRIVATE_STATS_ADD (nodes, 1);
 	expr->m_type = WexprExpressionTypeNull;
+	expr->m_flags = 0;
+	expr->m_indexSlot = 0;
+	expr->m_length = 0;
 	
 	return expr;
 }
@@ -1752,6 +2437,9 @@ WexprExpression* wexpr_Expression_createValue (const char* val)
 
 WexprExpression* wexpr_Expression_createValueFromLengthString (const char* val, size_t length)
 {
+	if (length > PRIVATE_EXPRESSION_MAX_LENGTH)
+		return NULL; // too large
+	
 	WexprExpression* expr = wexpr_Expression_createNull();
 	if (expr)
 	{
@@ -1771,15 +2459,28 @@ WexprExpression* wexpr_Expression_createCopy (WexprExpression* rhs)
 	return expr; // you own
 }
 
+WexprExpression* wexpr_Expression_createSnapshot (WexprExpression* rhs)
+{
+	// only frozen storage is safe to share, as nothing can change it underneath the snapshot
+	if (!s_Expression_isFrozen (rhs))
+		return wexpr_Expression_createCopy (rhs);
+	
+	return s_Expression_createShared (rhs);
+}
+
 void wexpr_Expression_destroy (WexprExpression* self)
 {
 	// null doesnt store anything, so can use this to destroy it
-	if (self)
-	{
-		wexpr_Expression_changeType(self, WexprExpressionTypeNull);
-	}
+	if (!self)
+		return;
+	
+	self->m_flags &= ~PrivateExpressionFlagFrozen; // destroying is always allowed
+	wexpr_Expression_changeType(self, WexprExpressionTypeNull);
 	
-	free (self);
+	if (self->m_flags & PrivateExpressionFlagArenaRoot)
+		wexpr_Allocator_free (self); // the whole arena
+	else if (!(self->m_flags & PrivateExpressionFlagArenaNode))
+		p_wexpr_Pool_free (self, sizeof(WexprExpression));
 }
 
 // --- Information
@@ -1791,39 +2492,52 @@ WexprExpressionType wexpr_Expression_type (WexprExpression* self)
 
 void wexpr_Expression_changeType (WexprExpression* self, WexprExpressionType type)
 {
+	if (s_Expression_isFrozen (self))
+		return;
+	
+	s_Expression_willMutate (self);
+	
+	bool ownsPayload = !(self->m_flags & PrivateExpressionFlagArenaPayload);
+	self->m_flags &= ~PrivateExpressionFlagArenaPayload;
+	
 	// first destroy
 	if (self->m_type == WexprExpressionTypeValue)
 	{
-		free (self->m_value.data);
+		if (ownsPayload)
+			s_Value_destroy (self->m_value.data, self->m_length);
 	}
 	
 	else if (self->m_type == WexprExpressionTypeBinaryData)
 	{
-		free(self->m_binaryData.data);
-		self->m_binaryData.size = 0;
+		if (ownsPayload)
+			p_wexpr_Pool_free (self->m_binaryData.data, self->m_length);
 	}
 	
 	else if (self->m_type == WexprExpressionTypeArray)
 	{
-		struct sglib_WexprExpressionPrivateArrayElement_iterator it;
-		for (WexprExpressionPrivateArrayElement* list = sglib_WexprExpressionPrivateArrayElement_it_init(&it, self->m_array.list);
-			 list != NULL; list = sglib_WexprExpressionPrivateArrayElement_it_next(&it))
+		if (!ownsPayload)
+		{
+			// the storage goes with the arena
+			for (size_t i = 0; i < self->m_length; ++i)
+			{
+				wexpr_Expression_destroy (self->m_array.storage->items[i]);
+			}
+		}
+		
+		else if (self->m_array.storage)
 		{
-			wexpr_Expression_destroy (list->expression);
-			free (list);
+			s_ArrayStorage_release (self->m_array.storage, self->m_length);
 		}
-		self->m_array.listCount = 0;
 	}
 	
 	else if (self->m_type == WexprExpressionTypeMap)
 	{
-		hashmap_iterate(self->m_map.hash, &s_freeHashData, NULL);
-		
-		hashmap_free (self->m_map.hash);
+		s_Map_release (self->m_map.hash);
 	}
 	
 	// then set
 	self->m_type = type;
+	self->m_length = 0;
 	
 	// then init
 	if (self->m_type == WexprExpressionTypeValue)
@@ -1834,13 +2548,11 @@ void wexpr_Expression_changeType (WexprExpression* self, WexprExpressionType typ
 	else if (self->m_type == WexprExpressionTypeBinaryData)
 	{
 		self->m_binaryData.data = NULL;
-		self->m_binaryData.size = 0;
 	}
 	
 	else if (self->m_type == WexprExpressionTypeArray)
 	{
-		self->m_array.list = NULL;
-		self->m_array.listCount = 0;
+		self->m_array.storage = NULL;
 	}
 	
 	else if (self->m_type == WexprExpressionTypeMap)
@@ -1857,377 +2569,2167 @@ char* wexpr_Expression_createStringRepresentation (WexprExpression* self, size_t
 	);
 	
 	// reallocate the for the null
-	char* buf = realloc( (void*)ref.ptr, ref.size+1);
+	char* buf = wexpr_Allocator_realloc( (void*)ref.ptr, ref.size+1);
 	buf[ref.size] = 0;
 	
 	return buf;
 }
 
+char* wexpr_Expression_createStringRepresentationWithStats (WexprExpression* self, size_t indent, WexprWriteFlags flags, WexprStats* stats)
+{
+	WexprStats start = wexpr_Stats_get ();
+	char* buf = wexpr_Expression_createStringRepresentation (self, indent, flags);
+	p_wexpr_Stats_since (&start, stats);
+	
+	return buf;
+}
+
 WexprMutableBuffer wexpr_Expression_createBinaryRepresentation (WexprExpression* self)
 {
-	WexprMutableBuffer buf;
-	buf.byteSize = 0;
-	buf.data = 0;
+	return wexpr_Expression_createBinaryRepresentationWithFlags (self, WexprWriteFlagNone);
+}
+
+void wexpr_Expression_shrinkToFit (WexprExpression* self)
+{
+	if (s_Expression_isFrozen (self))
+		return; // already as small as it gets
 	
-	WexprExpressionType type = wexpr_Expression_type(self);
+	s_Expression_unshare (self);
 	
-	#define BUFCAST(buf, position, type) ((type)((uint8_t*)buf+(position)))
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		s_Expression_arrayResize (self, self->m_length);
+	}
 	
-	if (type == WexprExpressionTypeNull)
+	else if (self->m_type == WexprExpressionTypeMap)
 	{
-		// data is 0x0
-		buf.byteSize = sizeof(uint32_t) + sizeof(uint8_t);
-		buf.data = realloc(buf.data, buf.byteSize);
-		*BUFCAST (buf.data, 0, uint32_t*) = wexpr_uint32ToBig(0);
-		*BUFCAST (buf.data, 4, uint8_t*) = 0x00;
+		hashmap_shrink_to_fit (self->m_map.hash);
 	}
+}
+
+// the arena needs room for each node followed by its own data. Keeps everything pointer aligned.
+static size_t s_compactAlign (size_t size)
+{
+	return (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+static size_t s_Expression_compactSize (WexprExpression* self)
+{
+	size_t size = s_compactAlign (sizeof(WexprExpression));
 	
-	else if (type == WexprExpressionTypeValue)
+	if (self->m_type == WexprExpressionTypeValue)
 	{
-		const char* val = wexpr_Expression_value(self);
-		size_t valLength = strlen(val);
-		
-		buf.byteSize = sizeof(uint32_t) + sizeof(uint8_t) + valLength;
-		buf.data = realloc(buf.data, buf.byteSize);
-		*BUFCAST (buf.data, 0, uint32_t*) = wexpr_uint32ToBig(valLength);
-		*BUFCAST (buf.data, 4, uint8_t*) = 0x01;
-		memcpy ((uint8_t*)buf.data + 5, val, valLength);
+		size += s_compactAlign (self->m_length + 1);
 	}
 	
-	else if (type == WexprExpressionTypeArray)
+	else if (self->m_type == WexprExpressionTypeBinaryData)
 	{
-		// just the header for now
-		buf.byteSize = sizeof(uint32_t) + sizeof(uint8_t);
-		buf.data = realloc(buf.data, buf.byteSize);
-		*BUFCAST (buf.data, 4, uint8_t*) = 0x02; // write the array buffer
-		
-		size_t len = wexpr_Expression_arrayCount(self);
-		size_t curPos = 5;
-		for (size_t i=0; i < len; ++i)
-		{
-			WexprMutableBuffer childBuffer = wexpr_Expression_createBinaryRepresentation(
-				wexpr_Expression_arrayAt(self, i)
-			);
-			
-			buf.byteSize += childBuffer.byteSize;
-			buf.data = realloc(buf.data, buf.byteSize);
-			memcpy ((uint8_t*)buf.data + curPos, childBuffer.data, childBuffer.byteSize);
-			
-			free (childBuffer.data);
-			curPos += childBuffer.byteSize;
-		}
-		
-		// set total length - remove our bytesize and data from it
-		*BUFCAST (buf.data, 0, uint32_t*) = wexpr_uint32ToBig(curPos-5);
+		size += s_compactAlign (self->m_length);
 	}
 	
-	else if (type == WexprExpressionTypeMap)
+	else if (self->m_type == WexprExpressionTypeArray)
 	{
-		// key value pairs
-		buf.byteSize = sizeof(uint32_t) + sizeof(uint8_t);
-		buf.data = realloc(buf.data, buf.byteSize);
-		*BUFCAST (buf.data, 4, uint8_t*) = 0x03; // write the map buffer
-		
-		size_t len = wexpr_Expression_mapCount(self);
-		size_t curPos = 5;
-		for (size_t i=0; i < len; ++i)
-		{
-			const char* mapKey = wexpr_Expression_mapKeyAt(self, i);
-			size_t mapKeyLen = strlen(mapKey);
-			WexprExpression* mapValue = wexpr_Expression_mapValueAt(self, i);
-			
-			// write the map key as a new value
-			size_t newSize = sizeof(uint32_t) + sizeof(uint8_t) + mapKeyLen;
-			buf.byteSize += newSize;
-			buf.data = realloc(buf.data, buf.byteSize);
-			*BUFCAST (buf.data, curPos, uint32_t*) = wexpr_uint32ToBig(mapKeyLen);
-			*BUFCAST (buf.data, curPos + 4, uint8_t*) = 0x01;
-			memcpy ((uint8_t*)buf.data + curPos + 5, mapKey, mapKeyLen);
-		
-			curPos += newSize;
-			
-			// write the map value
-			WexprMutableBuffer childBuffer = wexpr_Expression_createBinaryRepresentation(
-				mapValue
-			);
-			
-			buf.byteSize += childBuffer.byteSize;
-			buf.data = realloc(buf.data, buf.byteSize);
-			memcpy ((uint8_t*)buf.data + curPos, childBuffer.data, childBuffer.byteSize);
-			
-			free (childBuffer.data);
-			curPos += childBuffer.byteSize;
-		}
+		if (self->m_length > 0)
+			size += s_compactAlign (sizeof(PrivateArrayStorage) + self->m_length * sizeof(WexprExpression*));
 		
-		// set total length : remove our type and size from it
-		*BUFCAST (buf.data, 0, uint32_t*) = wexpr_uint32ToBig(curPos-5);
+		for (size_t i = 0; i < self->m_length; ++i)
+			size += s_Expression_compactSize (self->m_array.storage->items[i]);
 	}
 	
-	else if (type == WexprExpressionTypeBinaryData)
+	else if (self->m_type == WexprExpressionTypeMap)
 	{
-		const void* data = wexpr_Expression_binaryData_data(self);
-		size_t dataSize = wexpr_Expression_binaryData_size(self);
+		// the table itself stays in the map
+		WexprMapIterator it;
+		wexpr_MapIterator_init (&it, self);
 		
-		buf.byteSize = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint8_t) + dataSize;
-		buf.data = realloc(buf.data, buf.byteSize);
-		*BUFCAST (buf.data, 0, uint32_t*) = wexpr_uint32ToBig(dataSize+1); // 1 byte for the compression method
-		*BUFCAST (buf.data, 4, uint8_t*) = 0x04;
-		*BUFCAST (buf.data, 5, uint8_t*) = 0x00; // for now, only raw (no compression)
-		memcpy ((uint8_t*)buf.data + 6, data, dataSize);
+		WexprExpression* value = NULL;
+		while (wexpr_MapIterator_next (&it, NULL, &value))
+			size += s_Expression_compactSize (value);
 	}
 	
-	#undef BUFCAST
-
-	return buf;
+	return size;
 }
 
-// --- Value
-
-const char* wexpr_Expression_value (WexprExpression* self)
+// take size bytes from the arena
+static void* s_compactTake (uint8_t* arena, size_t* used, size_t size)
 {
-	if (self->m_type != WexprExpressionTypeValue)
-		return NULL;
+	void* ptr = arena + *used;
+	*used += s_compactAlign (size);
 	
-	return self->m_value.data;
+	return ptr;
 }
 
-void wexpr_Expression_valueSet (WexprExpression* self, const char* str)
+// copy self into the arena in depth first order, each node followed by its data then its children
+static WexprExpression* s_Expression_compactInto (WexprExpression* self, uint8_t* arena, size_t* used)
 {
-	if (self->m_type != WexprExpressionTypeValue)
-		return;
+	WexprExpression* node = s_compactTake (arena, used, sizeof(WexprExpression));
+	node->m_type = self->m_type;
+	node->m_flags = PrivateExpressionFlagArenaNode;
+	node->m_indexSlot = 0;
+	node->m_length = self->m_length;
 	
-	free (self->m_value.data);
-	self->m_value.data = strdup(str);
-}
-
-void wexpr_Expression_valueSetLengthString (WexprExpression* self, const char* str, size_t length)
-{
-	if (self->m_type != WexprExpressionTypeValue)
-		return;
+	if (self->m_type == WexprExpressionTypeValue)
+	{
+		node->m_value.data = s_compactTake (arena, used, self->m_length + 1);
+		memcpy (node->m_value.data, self->m_value.data, self->m_length + 1);
+		node->m_flags |= PrivateExpressionFlagArenaPayload;
+	}
 	
-	free (self->m_value.data);
-	self->m_value.data = malloc(length+1);
-	memcpy (self->m_value.data, str, length);
-	self->m_value.data[length] = 0;
-}
-
-// --- BinaryData
+	else if (self->m_type == WexprExpressionTypeBinaryData)
+	{
+		node->m_binaryData.data = s_compactTake (arena, used, self->m_length);
+		memcpy (node->m_binaryData.data, self->m_binaryData.data, self->m_length);
+		node->m_flags |= PrivateExpressionFlagArenaPayload;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeArray)
+	{
+		node->m_array.storage = NULL;
+		
+		if (self->m_length > 0)
+		{
+			node->m_array.storage = s_compactTake (arena, used,
+				sizeof(PrivateArrayStorage) + self->m_length * sizeof(WexprExpression*)
+			);
+			node->m_array.storage->capacity = self->m_length;
+			node->m_array.storage->refs = 1;
+			node->m_flags |= PrivateExpressionFlagArenaPayload;
+		}
+		
+		for (size_t i = 0; i < self->m_length; ++i)
+			node->m_array.storage->items[i] = s_Expression_compactInto (self->m_array.storage->items[i], arena, used);
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		node->m_map.hash = hashmap_new ();
+		hashmap_reserve (node->m_map.hash, hashmap_length (self->m_map.hash));
+		
+		// keys are immutable, so share them
+		WexprMapIterator it;
+		wexpr_MapIterator_init (&it, self);
+		
+		const char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		while (wexpr_MapIterator_next (&it, &key, &value))
+		{
+			s_Expression_mapPut (node,
+				p_wexpr_Key_retain (p_wexpr_Key_fromString (key)),
+				s_Expression_compactInto (value, arena, used)
+			);
+		}
+	}
+	
+	return node;
+}
 
-const void* wexpr_Expression_binaryData_data (WexprExpression* self)
+WexprExpression* wexpr_Expression_compact (WexprExpression* self)
 {
-	if (self->m_type != WexprExpressionTypeBinaryData)
-		return NULL;
+	bool wasFrozen = s_Expression_isFrozen (self);
+	size_t size = s_Expression_compactSize (self);
 	
-	return self->m_binaryData.data;
+	uint8_t* arena = wexpr_Allocator_alloc (size);
+	if (!arena)
+		return self; // leave it as it was
+	
+	size_t used = 0;
+	WexprExpression* root = s_Expression_compactInto (self, arena, &used);
+	root->m_flags |= PrivateExpressionFlagArenaRoot;
+	
+	wexpr_Expression_destroy (self);
+	
+	if (wasFrozen)
+		wexpr_Expression_freeze (root);
+	
+	return root;
 }
 
-size_t wexpr_Expression_binaryData_size (WexprExpression* self)
+// --- Comparing
+
+// finish a hash so similar inputs spread out (splitmix64's finalizer)
+static uint64_t s_hashMix (uint64_t h)
 {
-	if (self->m_type != WexprExpressionTypeBinaryData)
-		return 0;
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
 	
-	return self->m_binaryData.size;
+	return h;
 }
 
-void wexpr_Expression_binaryData_setValue (WexprExpression* self, const void* buffer, size_t byteSize)
+// FNV-1a, seeded so the same bytes hash differently for each type
+static uint64_t s_hashBytes (uint64_t seed, const void* data, size_t size)
 {
-	if (self->m_type != WexprExpressionTypeBinaryData)
-		return;
+	const uint8_t* bytes = data;
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed;
 	
-	free(self->m_binaryData.data);
-	self->m_binaryData.size = byteSize;
-	self->m_binaryData.data = malloc(byteSize);
-	if (!self->m_binaryData.data)
-		return; // unable to allocate
+	for (size_t i = 0; i < size; ++i)
+	{
+		h ^= bytes[i];
+		h *= 0x100000001b3ULL;
+	}
 	
-	memcpy (self->m_binaryData.data, buffer, byteSize);
+	return s_hashMix (h);
 }
 
-// --- Array
+// frozen contents (and those borrowed from them) have their hash stored with them
+static bool s_Expression_hasStoredHash (WexprExpression* self)
+{
+	return (self->m_flags & (PrivateExpressionFlagFrozen | PrivateExpressionFlagBorrowed)) != 0;
+}
 
-size_t wexpr_Expression_arrayCount (WexprExpression* self)
+// arrays hash in order, so reordering an array changes the hash
+static uint64_t s_hashArrayBegin (size_t count)
 {
-	if (self->m_type != WexprExpressionTypeArray)
-		return 0;
+	return s_hashMix (WexprExpressionTypeArray ^ ((uint64_t) count << 8));
+}
+
+static uint64_t s_hashArrayAdd (uint64_t h, uint64_t elementHash)
+{
+	return s_hashMix (h + elementHash);
+}
+
+// map pairs are summed, so the order the map stores them in doesnt matter
+static uint64_t s_hashMapPair (const char* key, uint64_t valueHash)
+{
+	PrivateKey* privateKey = p_wexpr_Key_fromString (key);
+	uint64_t keyHash = ((uint64_t) privateKey->hash << 32) | privateKey->length;
 	
-	return self->m_array.listCount;
+	return s_hashMix (keyHash ^ s_hashMix (valueHash));
 }
 
-WexprExpression* wexpr_Expression_arrayAt (WexprExpression* self, size_t index)
+static uint64_t s_hashMapEnd (size_t count, uint64_t sum)
 {
-	if (self->m_type != WexprExpressionTypeArray)
-		return NULL;
+	return s_hashMix (WexprExpressionTypeMap ^ ((uint64_t) count << 8) ^ sum);
+}
+
+static uint64_t s_Expression_arrayHash (WexprExpression* self)
+{
+	uint64_t h = s_hashArrayBegin (self->m_length);
 	
-	for (WexprExpressionPrivateArrayElement* list = self->m_array.list;
-		 list != NULL; list = list->next)
+	for (size_t i = 0; i < self->m_length; ++i)
 	{
-		if (index == 0)
-			return list->expression;
-		
-		--index;
+		h = s_hashArrayAdd (h, wexpr_Expression_hash (self->m_array.storage->items[i]));
 	}
 	
-	// Couldnt find, out of range.
-	return NULL;
+	return h;
 }
 
-void wexpr_Expression_arrayAddElementToEnd (WexprExpression* self, WexprExpression* element)
+static uint64_t s_Expression_mapHash (WexprExpression* self)
 {
-	if (self->m_type != WexprExpressionTypeArray)
-		return;
+	uint64_t sum = 0;
 	
-	WexprExpressionPrivateArrayElement* elem = malloc(sizeof(WexprExpressionPrivateArrayElement));
-	elem->expression = element;
-	elem->next = NULL;
+	char* key = NULL;
+	WexprExpression* value = NULL;
 	
-	if (self->m_array.listCount == 0)
+	for (int i = hashmap_next (self->m_map.hash, 0, &key, (any_t*) &value);
+		i != MAP_MISSING; i = hashmap_next (self->m_map.hash, i+1, &key, (any_t*) &value))
 	{
-		self->m_array.list = elem;
+		sum += s_hashMapPair (key, wexpr_Expression_hash (value));
 	}
-	else
+	
+	return s_hashMapEnd ((size_t) hashmap_length (self->m_map.hash), sum);
+}
+
+uint64_t wexpr_Expression_hash (WexprExpression* self)
+{
+	switch (self->m_type)
 	{
-		WexprExpressionPrivateArrayElement* head = self->m_array.list;
+		case WexprExpressionTypeValue:
+			return s_hashBytes (WexprExpressionTypeValue, self->m_value.data, self->m_length);
+		
+		case WexprExpressionTypeBinaryData:
+			return s_hashBytes (WexprExpressionTypeBinaryData, self->m_binaryData.data, self->m_length);
+		
+		case WexprExpressionTypeArray:
+			if (self->m_array.storage && s_Expression_hasStoredHash (self))
+				return self->m_array.storage->hash;
+			
+			return s_Expression_arrayHash (self);
 		
-		while (head->next != NULL) { head = head->next; }
+		case WexprExpressionTypeMap:
+			if (s_Expression_hasStoredHash (self))
+				return hashmap_tag (self->m_map.hash);
+			
+			return s_Expression_mapHash (self);
 		
-		head->next = elem;
+		default:
+			return s_hashMix (self->m_type);
 	}
-	
-	++(self->m_array.listCount);
 }
 
-// --- Map
-
-size_t wexpr_Expression_mapCount (WexprExpression* self)
+bool p_wexpr_Expression_isUnchanged (WexprExpression* lhs, WexprExpression* rhs)
 {
-	if (self->m_type != WexprExpressionTypeMap)
-		return 0;
+	if (lhs == rhs)
+		return true;
 	
-	return hashmap_length(self->m_map.hash);
+	if (lhs->m_type != rhs->m_type || !s_Expression_hasStoredHash (lhs) || !s_Expression_hasStoredHash (rhs))
+	{
+		// only sharing tells us anything
+		if (lhs->m_type == WexprExpressionTypeArray && rhs->m_type == WexprExpressionTypeArray)
+			return lhs->m_length == rhs->m_length && lhs->m_array.storage == rhs->m_array.storage;
+		
+		if (lhs->m_type == WexprExpressionTypeMap && rhs->m_type == WexprExpressionTypeMap)
+			return lhs->m_map.hash == rhs->m_map.hash;
+		
+		return false;
+	}
+	
+	// the same hash is almost certainly equal, make sure
+	return wexpr_Expression_hash (lhs) == wexpr_Expression_hash (rhs) && wexpr_Expression_isEqual (lhs, rhs);
 }
 
-typedef struct PrivateGetKeyValueAtIndex
+bool wexpr_Expression_isEqual (WexprExpression* lhs, WexprExpression* rhs)
 {
-	size_t index; // the index we're requesting
-	void* result; // will be null if not found, or a value if found.
-} PrivateGetKeyValueAtIndex;
+	if (lhs == rhs)
+		return true;
+	
+	if (lhs->m_type != rhs->m_type)
+		return false;
+	
+	switch (lhs->m_type)
+	{
+		case WexprExpressionTypeValue:
+			return lhs->m_length == rhs->m_length && memcmp (lhs->m_value.data, rhs->m_value.data, lhs->m_length) == 0;
+		
+		case WexprExpressionTypeBinaryData:
+			return lhs->m_length == rhs->m_length && memcmp (lhs->m_binaryData.data, rhs->m_binaryData.data, lhs->m_length) == 0;
+		
+		case WexprExpressionTypeArray:
+		{
+			if (lhs->m_length != rhs->m_length)
+				return false;
+			
+			if (lhs->m_array.storage == rhs->m_array.storage)
+				return true; // shared by copies, or both empty
+			
+			if (s_Expression_hasStoredHash (lhs) && s_Expression_hasStoredHash (rhs) &&
+				lhs->m_array.storage->hash != rhs->m_array.storage->hash)
+			{
+				return false;
+			}
+			
+			for (size_t i = 0; i < lhs->m_length; ++i)
+			{
+				if (!wexpr_Expression_isEqual (lhs->m_array.storage->items[i], rhs->m_array.storage->items[i]))
+					return false;
+			}
+			
+			return true;
+		}
+		
+		case WexprExpressionTypeMap:
+		{
+			if (hashmap_length (lhs->m_map.hash) != hashmap_length (rhs->m_map.hash))
+				return false;
+			
+			if (lhs->m_map.hash == rhs->m_map.hash)
+				return true; // shared by copies
+			
+			if (s_Expression_hasStoredHash (lhs) && s_Expression_hasStoredHash (rhs) &&
+				hashmap_tag (lhs->m_map.hash) != hashmap_tag (rhs->m_map.hash))
+			{
+				return false;
+			}
+			
+			char* key = NULL;
+			WexprExpression* value = NULL;
+			
+			for (int i = hashmap_next (lhs->m_map.hash, 0, &key, (any_t*) &value);
+				i != MAP_MISSING; i = hashmap_next (lhs->m_map.hash, i+1, &key, (any_t*) &value))
+			{
+				PrivateKey* privateKey = p_wexpr_Key_fromString (key);
+				WexprExpression* rhsValue = NULL;
+				
+				if (hashmap_get_hashed (rhs->m_map.hash, privateKey->string, privateKey->length, privateKey->hash, (any_t*) &rhsValue) != MAP_OK)
+					return false;
+				
+				if (!wexpr_Expression_isEqual (value, rhsValue))
+					return false;
+			}
+			
+			return true;
+		}
+		
+		default:
+			return true; // null and invalid have nothing else to compare
+	}
+}
 
-static int s_getKeyAtIndex (any_t userData, any_t data)
+void wexpr_Expression_freeze (WexprExpression* self)
 {
-	PrivateGetKeyValueAtIndex* ud = userData;
-	WexprExpressionPrivateMapElement* elem = data;
+	if (s_Expression_isFrozen (self))
+		return;
+	
+	if (self->m_flags & PrivateExpressionFlagBorrowed)
+	{
+		// everything below is already frozen, so keep sharing it
+		self->m_flags = (self->m_flags & ~PrivateExpressionFlagBorrowed) | PrivateExpressionFlagFrozen;
+		return;
+	}
+	
+	// anything shared with a copy has to stay changeable for it
+	s_Expression_unshare (self);
 	
-	if (ud->index == 0)
+	if (self->m_type == WexprExpressionTypeArray)
 	{
-		ud->result = elem->key;
-		return !MAP_OK; // exit
+		if (!(self->m_flags & PrivateExpressionFlagArenaPayload))
+			s_Expression_arrayResize (self, self->m_length);
+		
+		for (size_t i = 0; i < self->m_length; ++i)
+		{
+			wexpr_Expression_freeze (self->m_array.storage->items[i]);
+		}
 	}
-	else
+	
+	else if (self->m_type == WexprExpressionTypeMap)
 	{
-		ud->index -= 1;
+		hashmap_shrink_to_fit (self->m_map.hash);
+		
+		WexprMapIterator it;
+		wexpr_MapIterator_init (&it, self);
+		
+		WexprExpression* value = NULL;
+		while (wexpr_MapIterator_next (&it, NULL, &value))
+		{
+			wexpr_Expression_freeze (value);
+		}
 	}
 	
-	return MAP_OK;
+	// the contents cant change anymore, so remember the hash with them
+	if (self->m_type == WexprExpressionTypeArray && self->m_array.storage)
+		self->m_array.storage->hash = s_Expression_arrayHash (self);
+	else if (self->m_type == WexprExpressionTypeMap)
+		hashmap_set_tag (self->m_map.hash, s_Expression_mapHash (self));
+	
+	self->m_flags |= PrivateExpressionFlagFrozen;
 }
 
-static int s_getValueAtIndex (any_t userData, any_t data)
+bool wexpr_Expression_isFrozen (WexprExpression* self)
 {
-	PrivateGetKeyValueAtIndex* ud = userData;
-	WexprExpressionPrivateMapElement* elem = data;
+	return s_Expression_isFrozen (self);
+}
+
+void p_wexpr_Expression_assign (WexprExpression* self, WexprExpression* value)
+{
+	wexpr_Expression_changeType (self, WexprExpressionTypeNull);
+	
+	// take over the contents, keeping our own place in any index
+	self->m_type = value->m_type;
+	self->m_length = value->m_length;
+	self->m_flags = (self->m_flags & PrivateExpressionFlagIndexed) | (value->m_flags & ~PrivateExpressionFlagIndexed);
+	memcpy (&self->m_value, &value->m_value, sizeof(self->m_value));
+	
+	p_wexpr_Pool_free (value, sizeof(WexprExpression));
+}
+
+// --- Sharing
+
+// an array or map, and every other one equal to it
+typedef struct PrivateRepeat
+{
+	WexprExpression* expression; // the first one seen
+	uint64_t hash;
+	
+	// used by the binary writer
+	size_t count; // times it is written out
+	size_t byteSize; // size of its chunk when written in full
+	bool isWritten; // id is set once its definition chunk is written
+	uint32_t id;
+} PrivateRepeat;
+
+// finds repeats by hash
+typedef struct PrivateRepeatTable
+{
+	size_t* slots; // index into repeats + 1, or 0 if empty
+	size_t capacity; // of slots, a power of 2
+	
+	PrivateRepeat* repeats;
+	size_t count;
+	size_t repeatCapacity;
+} PrivateRepeatTable;
+
+static void s_RepeatTable_free (PrivateRepeatTable* self)
+{
+	wexpr_Allocator_free (self->slots);
+	wexpr_Allocator_free (self->repeats);
+}
+
+static void s_RepeatTable_insert (size_t* slots, size_t capacity, uint64_t hash, size_t index)
+{
+	size_t slot = (size_t) hash & (capacity - 1);
+	while (slots[slot])
+		slot = (slot + 1) & (capacity - 1);
+	
+	slots[slot] = index + 1;
+}
+
+// returns the index of the repeat equal to self, adding a new one for self if there isnt one. isNew is set to which happened.
+static size_t s_RepeatTable_findOrAdd (PrivateRepeatTable* self, WexprExpression* expression, uint64_t hash, bool* isNew)
+{
+	*isNew = false;
+	
+	if (self->capacity > 0)
+	{
+		for (size_t slot = (size_t) hash & (self->capacity - 1); self->slots[slot];
+			slot = (slot + 1) & (self->capacity - 1))
+		{
+			size_t index = self->slots[slot] - 1;
+			if (self->repeats[index].hash == hash && wexpr_Expression_isEqual (self->repeats[index].expression, expression))
+				return index;
+		}
+	}
 	
-	if (ud->index == 0)
+	// keep it at most half full
+	if ((self->count + 1) * 2 > self->capacity)
 	{
-		ud->result = elem->value;
-		return !MAP_OK; // exit
+		size_t capacity = self->capacity ? self->capacity * 2 : 64;
+		size_t* slots = p_wexpr_calloc (capacity, sizeof(size_t));
+		
+		for (size_t i = 0; i < self->count; ++i)
+		{
+			s_RepeatTable_insert (slots, capacity, self->repeats[i].hash, i);
+		}
+		
+		wexpr_Allocator_free (self->slots);
+		self->slots = slots;
+		self->capacity = capacity;
 	}
-	else
+	
+	if (self->count == self->repeatCapacity)
 	{
-		ud->index -= 1;
+		self->repeatCapacity = self->repeatCapacity ? self->repeatCapacity * 2 : 32;
+		self->repeats = wexpr_Allocator_realloc (self->repeats, self->repeatCapacity * sizeof(PrivateRepeat));
 	}
 	
-	return MAP_OK;
+	PrivateRepeat* repeat = &self->repeats[self->count];
+	memset (repeat, 0, sizeof(PrivateRepeat));
+	repeat->expression = expression;
+	repeat->hash = hash;
+	
+	s_RepeatTable_insert (self->slots, self->capacity, hash, self->count);
+	*isNew = true;
+	
+	return self->count++;
 }
 
-const char* wexpr_Expression_mapKeyAt (WexprExpression* self, size_t index)
+static size_t s_Expression_storageFreeSize (WexprExpression* self);
+
+// bytes destroying a node would free
+static size_t s_Expression_nodeFreeSize (WexprExpression* self)
 {
-	if (self->m_type != WexprExpressionTypeMap)
-		return NULL; // not a map
-	
-	PrivateGetKeyValueAtIndex val;
-	val.index = index;
-	val.result = NULL;
+	size_t size = sizeof(WexprExpression);
 	
-	hashmap_iterate (self->m_map.hash, &s_getKeyAtIndex, &val);
+	if (self->m_type == WexprExpressionTypeValue)
+		size += self->m_length + 1;
+	else if (self->m_type == WexprExpressionTypeBinaryData)
+		size += self->m_length;
+	else
+		size += s_Expression_storageFreeSize (self);
 	
-	return val.result;
+	return size;
 }
 
-WexprExpression* wexpr_Expression_mapValueAt (WexprExpression* self, size_t index)
+// bytes releasing self's array or map storage would free, which is nothing if a copy still uses it
+static size_t s_Expression_storageFreeSize (WexprExpression* self)
 {
-	if (self->m_type != WexprExpressionTypeMap)
-		return NULL; // not a map
+	size_t size = 0;
+	
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		PrivateArrayStorage* storage = self->m_array.storage;
+		if (!storage || p_wexpr_atomicLoad (&storage->refs) > 1)
+			return 0;
 		
-	PrivateGetKeyValueAtIndex val;
-	val.index = index;
-	val.result = NULL;
+		size = sizeof(PrivateArrayStorage) + storage->capacity * sizeof(WexprExpression*);
+		
+		for (size_t i = 0; i < self->m_length; ++i)
+		{
+			size += s_Expression_nodeFreeSize (storage->items[i]);
+		}
+	}
 	
-	hashmap_iterate (self->m_map.hash, &s_getValueAtIndex, &val);
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		if (hashmap_is_shared (self->m_map.hash))
+			return 0;
+		
+		size = hashmap_byte_size (self->m_map.hash);
+		
+		char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (int i = hashmap_next (self->m_map.hash, 0, &key, (any_t*) &value);
+			i != MAP_MISSING; i = hashmap_next (self->m_map.hash, i+1, &key, (any_t*) &value))
+		{
+			size += s_Expression_nodeFreeSize (value);
+		}
+	}
 	
-	return val.result;
+	return size;
 }
 
-WexprExpression* wexpr_Expression_mapValueForKey (WexprExpression* self, const char* key)
+// make self use the storage of canonical, which is equal to it
+static void s_Expression_shareStorage (WexprExpression* self, WexprExpression* canonical, size_t* freed)
 {
-	if (self->m_type != WexprExpressionTypeMap)
-		return NULL; // not a map
+	// frozen storage may only be shared with frozen storage, as nothing would copy it before changing
+	if (s_Expression_hasStoredHash (self) && !s_Expression_hasStoredHash (canonical))
+		return;
 	
-	WexprExpressionPrivateMapElement* elem = NULL;
-	int res = hashmap_get (self->m_map.hash, (char*) key, (void**) &elem);
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		if (self->m_array.storage == canonical->m_array.storage)
+			return; // already shared by copies
+		
+		s_Expression_willMutate (self);
+		*freed += s_Expression_storageFreeSize (self);
+		
+		s_ArrayStorage_release (self->m_array.storage, self->m_length);
+		self->m_array.storage = canonical->m_array.storage;
+		p_wexpr_atomicIncrement (&self->m_array.storage->refs);
+	}
 	
-	if (res == MAP_OK && elem)
+	else
 	{
-		return elem->value;
+		if (self->m_map.hash == canonical->m_map.hash)
+			return;
+		
+		s_Expression_willMutate (self);
+		*freed += s_Expression_storageFreeSize (self);
+		
+		s_Map_release (self->m_map.hash);
+		self->m_map.hash = canonical->m_map.hash;
+		hashmap_retain (self->m_map.hash);
 	}
 	
-	return NULL;
+	if (s_Expression_hasStoredHash (canonical) && !s_Expression_isFrozen (self))
+		self->m_flags |= PrivateExpressionFlagBorrowed;
 }
 
-WexprExpression* wexpr_Expression_mapValueForLengthKey (WexprExpression* self, const char* key, size_t length)
+// deduplicate the children, then self. Returns the hash of self, worked out on the way up so each node is only read once.
+static uint64_t s_Expression_deduplicate (WexprExpression* self, PrivateRepeatTable* table, size_t* freed)
 {
-	// key has to be 0 terminated for our hash
-	// TODO: use stack functions for this if its short? then we dont have to hit memory
-	char* newKey = malloc(length+1);
-	memcpy (newKey, key, length);
-	newKey[length] = 0; // end terminator
+	uint64_t hash = 0;
 	
-	WexprExpression* res = wexpr_Expression_mapValueForKey (self, newKey);
-	free (newKey);
+	if (self->m_type == WexprExpressionTypeArray)
+	{
+		hash = s_hashArrayBegin (self->m_length);
+		
+		for (size_t i = 0; i < self->m_length; ++i)
+		{
+			hash = s_hashArrayAdd (hash, s_Expression_deduplicate (self->m_array.storage->items[i], table, freed));
+		}
+		
+		if (!self->m_array.storage)
+			return hash; // nothing to share
+	}
 	
-	return res;
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		uint64_t sum = 0;
+		
+		char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (int i = hashmap_next (self->m_map.hash, 0, &key, (any_t*) &value);
+			i != MAP_MISSING; i = hashmap_next (self->m_map.hash, i+1, &key, (any_t*) &value))
+		{
+			sum += s_hashMapPair (key, s_Expression_deduplicate (value, table, freed));
+		}
+		
+		hash = s_hashMapEnd ((size_t) hashmap_length (self->m_map.hash), sum);
+	}
+	
+	else
+	{
+		return wexpr_Expression_hash (self);
+	}
+	
+	// arena storage cant be reference counted
+	if (self->m_flags & (PrivateExpressionFlagArenaNode | PrivateExpressionFlagArenaPayload))
+		return hash;
+	
+	bool isNew = false;
+	size_t index = s_RepeatTable_findOrAdd (table, self, hash, &isNew);
+	
+	if (!isNew)
+		s_Expression_shareStorage (self, table->repeats[index].expression, freed);
+	
+	return hash;
 }
 
-void wexpr_Expression_mapSetValueForKey (WexprExpression* self, const char* key, WexprExpression* value)
+size_t wexpr_Expression_deduplicate (WexprExpression* self)
 {
-	if (self->m_type != WexprExpressionTypeMap)
-		return;
+	PrivateRepeatTable table;
+	memset (&table, 0, sizeof(table));
 	
-	WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-	elem->key = strdup(key);
-	elem->value = value;
+	size_t freed = 0;
+	s_Expression_deduplicate (self, &table, &freed);
+	s_RepeatTable_free (&table);
 	
-	hashmap_put(self->m_map.hash, elem->key, elem);
+	return freed;
 }
 
-void wexpr_Expression_mapSetValueForKeyLengthString (WexprExpression* self, const char* key, size_t length, WexprExpression* value)
+// --- Memory usage
+
+// pointers already counted, for what is shared. Open addressing, kept at most half full.
+typedef struct PrivatePointerSet
 {
-	if (self->m_type != WexprExpressionTypeMap)
-		return;
-	
-	WexprExpressionPrivateMapElement* elem = malloc (sizeof(WexprExpressionPrivateMapElement));
-	elem->value = value;
-	elem->key = malloc(length+1);
-	memcpy (elem->key, key, length);
-	elem->key[length] = 0;
+	const void** slots;
+	size_t capacity; // a power of 2
+	size_t count;
+} PrivatePointerSet;
+
+static void s_PointerSet_insert (const void** slots, size_t capacity, const void* ptr)
+{
+	size_t slot = (size_t) (((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL) & (capacity - 1);
+	while (slots[slot])
+		slot = (slot + 1) & (capacity - 1);
+	
+	slots[slot] = ptr;
+}
+
+// add ptr, returning false if it was already there
+static bool s_PointerSet_add (PrivatePointerSet* self, const void* ptr)
+{
+	if (self->capacity > 0)
+	{
+		size_t slot = (size_t) (((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL) & (self->capacity - 1);
+		for (; self->slots[slot]; slot = (slot + 1) & (self->capacity - 1))
+		{
+			if (self->slots[slot] == ptr)
+				return false;
+		}
+	}
+	
+	if ((self->count + 1) * 2 > self->capacity)
+	{
+		size_t capacity = self->capacity ? self->capacity * 2 : 64;
+		const void** slots = p_wexpr_calloc (capacity, sizeof(const void*));
+		
+		for (size_t i = 0; i < self->capacity; ++i)
+		{
+			if (self->slots[i])
+				s_PointerSet_insert (slots, capacity, self->slots[i]);
+		}
+		
+		wexpr_Allocator_free ((void*) self->slots);
+		self->slots = slots;
+		self->capacity = capacity;
+	}
+	
+	s_PointerSet_insert (self->slots, self->capacity, ptr);
+	++self->count;
+	
+	return true;
+}
+
+// add the bytes of self and everything in it to report. Only shared storage and keys go into seen, as nothing else can be reached twice.
+static void s_Expression_memoryUsage (WexprExpression* self, WexprMemoryUsage* report, PrivatePointerSet* seen)
+{
+	bool inArena = (self->m_flags & PrivateExpressionFlagArenaPayload) != 0;
+	
+	++report->nodeCount;
+	report->nodeBytes += (self->m_flags & PrivateExpressionFlagArenaNode)
+		? s_compactAlign (sizeof(WexprExpression))
+		: p_wexpr_Pool_blockSize (sizeof(WexprExpression));
+	
+	if (self->m_type == WexprExpressionTypeNull)
+	{
+		++report->nullCount;
+	}
+	
+	else if (self->m_type == WexprExpressionTypeValue)
+	{
+		++report->valueCount;
+		report->stringBytes += inArena ? s_compactAlign (self->m_length + 1) : p_wexpr_Pool_blockSize (self->m_length + 1);
+	}
+	
+	else if (self->m_type == WexprExpressionTypeBinaryData)
+	{
+		++report->binaryDataCount;
+		
+		if (self->m_binaryData.data)
+			report->binaryDataBytes += inArena ? s_compactAlign (self->m_length) : p_wexpr_Pool_blockSize (self->m_length);
+	}
+	
+	else if (self->m_type == WexprExpressionTypeArray)
+	{
+		++report->arrayCount;
+		
+		PrivateArrayStorage* storage = self->m_array.storage;
+		if (!storage)
+			return;
+		
+		if (p_wexpr_atomicLoad (&storage->refs) > 1 && !s_PointerSet_add (seen, storage))
+			return; // counted with another copy
+		
+		report->containerBytes += inArena
+			? s_compactAlign (sizeof(PrivateArrayStorage) + storage->capacity * sizeof(WexprExpression*))
+			: sizeof(PrivateArrayStorage) + storage->capacity * sizeof(WexprExpression*);
+		
+		for (size_t i = 0; i < self->m_length; ++i)
+		{
+			s_Expression_memoryUsage (storage->items[i], report, seen);
+		}
+	}
+	
+	else if (self->m_type == WexprExpressionTypeMap)
+	{
+		++report->mapCount;
+		
+		if (hashmap_is_shared (self->m_map.hash) && !s_PointerSet_add (seen, self->m_map.hash))
+			return; // counted with another copy
+		
+		report->containerBytes += hashmap_byte_size (self->m_map.hash);
+		
+		char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (int i = hashmap_next (self->m_map.hash, 0, &key, (any_t*) &value);
+			i != MAP_MISSING; i = hashmap_next (self->m_map.hash, i+1, &key, (any_t*) &value))
+		{
+			// keys are shared between maps by interning and copies
+			PrivateKey* privateKey = p_wexpr_Key_fromString (key);
+			if (p_wexpr_atomicLoad (&privateKey->refCount) == 1 || s_PointerSet_add (seen, privateKey))
+				report->stringBytes += sizeof(PrivateKey) + privateKey->length + 1;
+			
+			s_Expression_memoryUsage (value, report, seen);
+		}
+	}
+}
+
+size_t wexpr_Expression_memoryUsage (WexprExpression* self, WexprMemoryUsage* report)
+{
+	WexprMemoryUsage usage;
+	memset (&usage, 0, sizeof(usage));
+	
+	PrivatePointerSet seen = { NULL, 0, 0 };
+	s_Expression_memoryUsage (self, &usage, &seen);
+	wexpr_Allocator_free ((void*) seen.slots);
+	
+	usage.totalBytes = usage.nodeBytes + usage.stringBytes + usage.containerBytes + usage.binaryDataBytes;
+	
+	if (report)
+		*report = usage;
+	
+	return usage.totalBytes;
+}
+
+// --- Binary writing
+
+// an array or map, in the order they are written
+typedef struct PrivateBinaryWriterNode
+{
+	size_t repeat; // index into PrivateBinaryWriter::repeats
+	size_t subtreeCount; // arrays and maps from this one to the end of its children, including itself
+} PrivateBinaryWriterNode;
+
+typedef struct PrivateBinaryWriter
+{
+	uint8_t* data;
+	size_t used;
+	size_t capacity;
+	
+	// only used with WexprWriteFlagShareRepeats
+	PrivateRepeatTable* repeats;
+	PrivateBinaryWriterNode* nodes;
+	size_t nodeCount;
+	size_t nodeCapacity;
+	size_t nextNode; // while writing
+	uint32_t nextId; // of the next definition chunk
+} PrivateBinaryWriter;
+
+// make room for size more bytes, returning where they go
+static uint8_t* s_BinaryWriter_append (PrivateBinaryWriter* self, size_t size)
+{
+	if (self->used + size > self->capacity)
+	{
+		size_t capacity = self->capacity < 256 ? 256 : self->capacity * 2;
+		while (capacity < self->used + size)
+			capacity *= 2;
+		
+		self->data = wexpr_Allocator_realloc (self->data, capacity);
+		self->capacity = capacity;
+	}
+	
+	uint8_t* position = self->data + self->used;
+	self->used += size;
+	
+	return position;
+}
+
+// write a chunk header, returning where it is for s_BinaryWriter_endChunk()
+static size_t s_BinaryWriter_beginChunk (PrivateBinaryWriter* self, uint8_t type)
+{
+	size_t start = self->used;
+	
+	uint8_t* header = s_BinaryWriter_append (self, sizeof(uint32_t) + sizeof(uint8_t));
+	header[sizeof(uint32_t)] = type;
+	
+	return start;
+}
+
+// set the size of the chunk to everything written since it began
+static void s_BinaryWriter_endChunk (PrivateBinaryWriter* self, size_t start)
+{
+	uint32_t size = wexpr_uint32ToBig ((uint32_t) (self->used - start - sizeof(uint32_t) - sizeof(uint8_t)));
+	memcpy (self->data + start, &size, sizeof(size));
+}
+
+static void s_BinaryWriter_writeChunk (PrivateBinaryWriter* self, uint8_t type, const void* data, size_t size)
+{
+	size_t start = s_BinaryWriter_beginChunk (self, type);
+	
+	if (size > 0)
+		memcpy (s_BinaryWriter_append (self, size), data, size);
+	
+	s_BinaryWriter_endChunk (self, start);
+}
+
+// hash every array and map, grouping equal ones into repeats and listing them in the order they are written.
+// Returns the size of the expression's chunk if written out in full.
+static size_t s_BinaryWriter_findRepeats (PrivateBinaryWriter* self, WexprExpression* expression, uint64_t* hash)
+{
+	const size_t headerSize = sizeof(uint32_t) + sizeof(uint8_t);
+	
+	if (expression->m_type != WexprExpressionTypeArray && expression->m_type != WexprExpressionTypeMap)
+	{
+		*hash = wexpr_Expression_hash (expression);
+		
+		switch (expression->m_type)
+		{
+			case WexprExpressionTypeNull: return headerSize;
+			case WexprExpressionTypeValue: return headerSize + expression->m_length;
+			case WexprExpressionTypeBinaryData: return headerSize + 1 + expression->m_length;
+			default: return 0; // not written
+		}
+	}
+	
+	if (self->nodeCount == self->nodeCapacity)
+	{
+		self->nodeCapacity = self->nodeCapacity ? self->nodeCapacity * 2 : 64;
+		self->nodes = wexpr_Allocator_realloc (self->nodes, self->nodeCapacity * sizeof(PrivateBinaryWriterNode));
+	}
+	
+	size_t node = self->nodeCount++;
+	size_t byteSize = headerSize;
+	uint64_t childHash = 0;
+	
+	if (expression->m_type == WexprExpressionTypeArray)
+	{
+		*hash = s_hashArrayBegin (expression->m_length);
+		
+		for (size_t i = 0; i < expression->m_length; ++i)
+		{
+			byteSize += s_BinaryWriter_findRepeats (self, expression->m_array.storage->items[i], &childHash);
+			*hash = s_hashArrayAdd (*hash, childHash);
+		}
+	}
+	
+	else
+	{
+		uint64_t sum = 0;
+		
+		char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (int i = hashmap_next (expression->m_map.hash, 0, &key, (any_t*) &value);
+			i != MAP_MISSING; i = hashmap_next (expression->m_map.hash, i+1, &key, (any_t*) &value))
+		{
+			byteSize += headerSize + p_wexpr_Key_fromString (key)->length;
+			byteSize += s_BinaryWriter_findRepeats (self, value, &childHash);
+			sum += s_hashMapPair (key, childHash);
+		}
+		
+		*hash = s_hashMapEnd ((size_t) hashmap_length (expression->m_map.hash), sum);
+	}
+	
+	bool isNew = false;
+	size_t repeat = s_RepeatTable_findOrAdd (self->repeats, expression, *hash, &isNew);
+	
+	if (isNew)
+		self->repeats->repeats[repeat].byteSize = byteSize;
+	
+	self->nodes[node].repeat = repeat;
+	self->nodes[node].subtreeCount = self->nodeCount - node;
+	
+	return byteSize;
+}
+
+// count how often each repeat is written. Once one is written, the rest are references, so whats inside them isnt counted.
+static void s_BinaryWriter_countRepeats (PrivateBinaryWriter* self)
+{
+	for (size_t i = 0; i < self->nodeCount; )
+	{
+		PrivateRepeat* repeat = &self->repeats->repeats[self->nodes[i].repeat];
+		
+		if (repeat->count > 0)
+		{
+			++repeat->count;
+			i += self->nodes[i].subtreeCount;
+		}
+		
+		else
+		{
+			repeat->count = 1;
+			++i;
+		}
+	}
+}
+
+// each reference is a 9 byte chunk, and the definition adds a chunk header
+static bool s_Repeat_isWorthSharing (const PrivateRepeat* self)
+{
+	const size_t referenceSize = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+	
+	if (self->count < 2)
+		return false;
+	
+	return (self->count - 1) * self->byteSize > (self->count - 1) * referenceSize + sizeof(uint32_t) + sizeof(uint8_t);
+}
+
+static void s_BinaryWriter_write (PrivateBinaryWriter* self, WexprExpression* expression);
+
+static void s_BinaryWriter_writeContainer (PrivateBinaryWriter* self, WexprExpression* expression)
+{
+	size_t start = s_BinaryWriter_beginChunk (self, expression->m_type);
+	
+	if (expression->m_type == WexprExpressionTypeArray)
+	{
+		for (size_t i = 0; i < expression->m_length; ++i)
+		{
+			s_BinaryWriter_write (self, expression->m_array.storage->items[i]);
+		}
+	}
+	
+	else
+	{
+		char* key = NULL;
+		WexprExpression* value = NULL;
+		
+		for (int i = hashmap_next (expression->m_map.hash, 0, &key, (any_t*) &value);
+			i != MAP_MISSING; i = hashmap_next (expression->m_map.hash, i+1, &key, (any_t*) &value))
+		{
+			s_BinaryWriter_writeChunk (self, WexprExpressionTypeValue, key, p_wexpr_Key_fromString (key)->length);
+			s_BinaryWriter_write (self, value);
+		}
+	}
+	
+	s_BinaryWriter_endChunk (self, start);
+}
+
+static void s_BinaryWriter_write (PrivateBinaryWriter* self, WexprExpression* expression)
+{
+	switch (expression->m_type)
+	{
+		case WexprExpressionTypeNull:
+			s_BinaryWriter_writeChunk (self, WexprExpressionTypeNull, NULL, 0);
+			return;
+		
+		case WexprExpressionTypeValue:
+			s_BinaryWriter_writeChunk (self, WexprExpressionTypeValue, expression->m_value.data, expression->m_length);
+			return;
+		
+		case WexprExpressionTypeBinaryData:
+		{
+			size_t start = s_BinaryWriter_beginChunk (self, WexprExpressionTypeBinaryData);
+			
+			*s_BinaryWriter_append (self, 1) = 0x00; // for now, only raw (no compression)
+			if (expression->m_length > 0)
+				memcpy (s_BinaryWriter_append (self, expression->m_length), expression->m_binaryData.data, expression->m_length);
+			
+			s_BinaryWriter_endChunk (self, start);
+			return;
+		}
+		
+		case WexprExpressionTypeArray:
+		case WexprExpressionTypeMap:
+			break;
+		
+		default:
+			return; // nothing to write
+	}
+	
+	if (self->repeats)
+	{
+		const PrivateBinaryWriterNode* node = &self->nodes[self->nextNode];
+		PrivateRepeat* repeat = &self->repeats->repeats[node->repeat];
+		
+		if (repeat->isWritten)
+		{
+			uint32_t id = wexpr_uint32ToBig (repeat->id);
+			s_BinaryWriter_writeChunk (self, PrivateBinaryChunkReference, &id, sizeof(id));
+			
+			self->nextNode += node->subtreeCount;
+			return;
+		}
+		
+		++self->nextNode;
+		
+		if (s_Repeat_isWorthSharing (repeat))
+		{
+			size_t start = s_BinaryWriter_beginChunk (self, PrivateBinaryChunkDefinition);
+			s_BinaryWriter_writeContainer (self, expression);
+			s_BinaryWriter_endChunk (self, start);
+			
+			// numbered as they finish, which is the order a reader finishes them
+			repeat->isWritten = true;
+			repeat->id = self->nextId++;
+			return;
+		}
+	}
+	
+	s_BinaryWriter_writeContainer (self, expression);
+}
+
+WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithFlags (WexprExpression* self, WexprWriteFlags flags)
+{
+	PrivateBinaryWriter writer;
+	memset (&writer, 0, sizeof(writer));
+	
+	PrivateRepeatTable repeats;
+	memset (&repeats, 0, sizeof(repeats));
+	
+	if (flags & WexprWriteFlagShareRepeats)
+	{
+		uint64_t hash = 0;
+		
+		writer.repeats = &repeats;
+		s_BinaryWriter_findRepeats (&writer, self, &hash);
+		s_BinaryWriter_countRepeats (&writer);
+	}
+	
+	s_BinaryWriter_write (&writer, self);
+	
+	wexpr_Allocator_free (writer.nodes);
+	s_RepeatTable_free (&repeats);
+	
+	WexprMutableBuffer buf;
+	buf.byteSize = writer.used;
+	buf.data = NULL;
+	
+	if (writer.used > 0)
+		buf.data = wexpr_Allocator_realloc (writer.data, writer.used);
+	else
+		wexpr_Allocator_free (writer.data);
+	
+	return buf;
+}
+
+WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithStats (WexprExpression* self, WexprWriteFlags flags, WexprStats* stats)
+{
+	WexprStats start = wexpr_Stats_get ();
+	WexprMutableBuffer buf = wexpr_Expression_createBinaryRepresentationWithFlags (self, flags);
+	p_wexpr_Stats_since (&start, stats);
+	
+	return buf;
+}
+
+// --- Value
+
+const char* wexpr_Expression_value (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeValue)
+		return NULL;
+	
+	return self->m_value.data;
+}
+
+void wexpr_Expression_valueSet (WexprExpression* self, const char* str)
+{
+	wexpr_Expression_valueSetLengthString (self, str, strlen (str));
+}
+
+void wexpr_Expression_valueSetLengthString (WexprExpression* self, const char* str, size_t length)
+{
+	if (self->m_type != WexprExpressionTypeValue || s_Expression_isFrozen (self))
+		return;
+	
+	if (length > PRIVATE_EXPRESSION_MAX_LENGTH)
+		return; // too large
+	
+	s_Expression_willMutate (self);
+	
+	s_Expression_valueReplace (self, s_Value_create (str, length), length);
+}
+
+// --- BinaryData
+
+const void* wexpr_Expression_binaryData_data (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeBinaryData)
+		return NULL;
+	
+	return self->m_binaryData.data;
+}
+
+size_t wexpr_Expression_binaryData_size (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeBinaryData)
+		return 0;
+	
+	return self->m_length;
+}
+
+void wexpr_Expression_binaryData_setValue (WexprExpression* self, const void* buffer, size_t byteSize)
+{
+	if (self->m_type != WexprExpressionTypeBinaryData || s_Expression_isFrozen (self))
+		return;
+	
+	if (byteSize > PRIVATE_EXPRESSION_MAX_LENGTH)
+		return; // too large
+	
+	s_Expression_willMutate (self);
+	
+	if (!(self->m_flags & PrivateExpressionFlagArenaPayload))
+		p_wexpr_Pool_free (self->m_binaryData.data, self->m_length);
+	
+	self->m_flags &= ~PrivateExpressionFlagArenaPayload;
+	self->m_length = (uint32_t) byteSize;
+	self->m_binaryData.data = p_wexpr_Pool_alloc (byteSize);
+	if (!self->m_binaryData.data)
+		return; // unable to allocate
+	
+	memcpy (self->m_binaryData.data, buffer, byteSize);
+}
+
+// --- Array
+
+size_t wexpr_Expression_arrayCount (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeArray)
+		return 0;
+	
+	return self->m_length;
+}
+
+WexprExpression* wexpr_Expression_arrayAt (WexprExpression* self, size_t index)
+{
+	if (self->m_type != WexprExpressionTypeArray)
+		return NULL;
+	
+	if (index >= self->m_length)
+		return NULL; // out of range
+	
+	return self->m_array.storage->items[index];
+}
+
+WexprExpression* wexpr_Expression_arraySlotAt (WexprExpression* self, size_t index)
+{
+	if (self->m_type != WexprExpressionTypeArray || s_Expression_isFrozen (self))
+		return NULL;
+	
+	if (index >= self->m_length)
+		return NULL; // out of range
+	
+	s_Expression_unshare (self);
+	
+	return self->m_array.storage->items[index];
+}
+
+void wexpr_Expression_arrayAddElementToEnd (WexprExpression* self, WexprExpression* element)
+{
+	if (self->m_type != WexprExpressionTypeArray || s_Expression_isFrozen (self))
+		return;
+	
+	s_Expression_unshare (self);
+	s_Expression_willMutate (self);
+	
+	s_Expression_arrayAppend (self, element); // not taken if the array is full
+}
+
+void wexpr_Expression_arrayInsertAt (WexprExpression* self, size_t index, WexprExpression* element)
+{
+	if (self->m_type != WexprExpressionTypeArray || s_Expression_isFrozen (self))
+		return;
+	
+	s_Expression_unshare (self);
+	s_Expression_willMutate (self);
+	
+	if (index >= self->m_length)
+	{
+		s_Expression_arrayAppend (self, element);
+		return;
+	}
+	
+	if (!s_Expression_arrayAppend (self, NULL)) // make room
+		return; // full
+	
+	WexprExpression** list = self->m_array.storage->items;
+	memmove (list + index + 1, list + index, (self->m_length - index - 1) * sizeof(WexprExpression*));
+	list[index] = element;
+}
+
+// nodes in an arena die with it, so anything taken out of one has to be copied out first
+static WexprExpression* s_Expression_detach (WexprExpression* self)
+{
+	if (!self || !(self->m_flags & PrivateExpressionFlagArenaNode))
+		return self;
+	
+	WexprExpression* copy = wexpr_Expression_createCopy (self);
+	wexpr_Expression_destroy (self);
+	
+	return copy;
+}
+
+// remove and return the element, which could still be in an arena
+static WexprExpression* s_Expression_arrayTakeAt (WexprExpression* self, size_t index)
+{
+	if (self->m_type != WexprExpressionTypeArray || s_Expression_isFrozen (self))
+		return NULL;
+	
+	if (index >= self->m_length)
+		return NULL; // out of range
+	
+	s_Expression_unshare (self);
+	s_Expression_willMutate (self);
+	
+	WexprExpression** list = self->m_array.storage->items;
+	WexprExpression* expression = list[index];
+	
+	--(self->m_length);
+	memmove (list + index, list + index + 1, (self->m_length - index) * sizeof(WexprExpression*));
+	
+	return expression;
+}
+
+WexprExpression* wexpr_Expression_arrayTakeAt (WexprExpression* self, size_t index)
+{
+	return s_Expression_detach (s_Expression_arrayTakeAt (self, index));
+}
+
+void wexpr_Expression_arrayRemoveAt (WexprExpression* self, size_t index)
+{
+	WexprExpression* expression = s_Expression_arrayTakeAt (self, index);
+	
+	if (expression)
+		wexpr_Expression_destroy (expression);
+}
+
+void wexpr_Expression_arraySwap (WexprExpression* self, size_t indexA, size_t indexB)
+{
+	if (self->m_type != WexprExpressionTypeArray || s_Expression_isFrozen (self))
+		return;
+	
+	if (indexA >= self->m_length || indexB >= self->m_length)
+		return; // out of range
+	
+	s_Expression_unshare (self);
+	s_Expression_willMutate (self);
+	
+	WexprExpression* temp = self->m_array.storage->items[indexA];
+	self->m_array.storage->items[indexA] = self->m_array.storage->items[indexB];
+	self->m_array.storage->items[indexB] = temp;
+}
+
+void wexpr_Expression_arrayReserve (WexprExpression* self, size_t capacity)
+{
+	if (self->m_type != WexprExpressionTypeArray || s_Expression_isFrozen (self))
+		return;
+	
+	s_Expression_unshare (self);
+	s_Expression_arrayReserve (self, capacity);
+}
+
+// --- Map
+
+size_t wexpr_Expression_mapCount (WexprExpression* self)
+{
+	if (self->m_type != WexprExpressionTypeMap)
+		return 0;
+	
+	return hashmap_length(self->m_map.hash);
+}
+
+// find the slot of the map at the given index, or MAP_MISSING
+static int s_Expression_mapSlotAtIndex (WexprExpression* self, size_t index, char** key, WexprExpression** value)
+{
+	int slot = hashmap_next (self->m_map.hash, 0, key, (any_t*) value);
+	
+	while (slot != MAP_MISSING && index > 0)
+	{
+		slot = hashmap_next (self->m_map.hash, slot+1, key, (any_t*) value);
+		--index;
+	}
+	
+	return slot;
+}
+
+const char* wexpr_Expression_mapKeyAt (WexprExpression* self, size_t index)
+{
+	if (self->m_type != WexprExpressionTypeMap)
+		return NULL; // not a map
+	
+	char* key = NULL;
+	if (s_Expression_mapSlotAtIndex (self, index, &key, NULL) == MAP_MISSING)
+		return NULL;
+	
+	return key;
+}
+
+WexprExpression* wexpr_Expression_mapValueAt (WexprExpression* self, size_t index)
+{
+	if (self->m_type != WexprExpressionTypeMap)
+		return NULL; // not a map
+	
+	WexprExpression* value = NULL;
+	if (s_Expression_mapSlotAtIndex (self, index, NULL, &value) == MAP_MISSING)
+		return NULL;
+	
+	return value;
+}
+
+WexprExpression* wexpr_Expression_mapValueForKey (WexprExpression* self, const char* key)
+{
+	return wexpr_Expression_mapValueForLengthKey (self, key, strlen(key));
+}
+
+WexprExpression* wexpr_Expression_mapValueForLengthKey (WexprExpression* self, const char* key, size_t length)
+{
+	WexprKey keyHandle = wexpr_Key_fromLengthString (key, length);
+	return wexpr_Expression_mapValueForKeyHandle (self, &keyHandle);
+}
+
+WexprExpression* wexpr_Expression_mapValueForKeyHandle (WexprExpression* self, const WexprKey* key)
+{
+	if (self->m_type != WexprExpressionTypeMap)
+		return NULL; // not a map
+	
+	WexprExpression* value = NULL;
+	int res = hashmap_get_hashed (self->m_map.hash, (char*) key->string, (unsigned int) key->length,
+		key->hash, (any_t*) &value
+	);
+	
+	if (res == MAP_OK)
+		return value;
+	
+	return NULL;
+}
+
+void wexpr_Expression_mapSetValueForKey (WexprExpression* self, const char* key, WexprExpression* value)
+{
+	wexpr_Expression_mapSetValueForKeyLengthString (self, key, strlen(key), value);
+}
+
+void wexpr_Expression_mapSetValueForKeyLengthString (WexprExpression* self, const char* key, size_t length, WexprExpression* value)
+{
+	if (self->m_type != WexprExpressionTypeMap || s_Expression_isFrozen (self))
+		return;
+	
+	s_Expression_unshare (self);
+	s_Expression_willMutate (self);
+	
+	s_Expression_mapPut (self, p_wexpr_Key_create (key, length), value); // not taken if the map cant grow
+}
+
+void wexpr_Expression_mapReserve (WexprExpression* self, size_t count)
+{
+	if (self->m_type != WexprExpressionTypeMap || s_Expression_isFrozen (self))
+		return;
+	
+	s_Expression_unshare (self);
+	s_Expression_mapReserve (self, count);
+}
+
+WexprExpression* wexpr_Expression_mapSlotForKey (WexprExpression* self, const char* key)
+{
+	return wexpr_Expression_mapSlotForLengthKey (self, key, strlen(key));
+}
+
+WexprExpression* wexpr_Expression_mapSlotForLengthKey (WexprExpression* self, const char* key, size_t length)
+{
+	if (self->m_type != WexprExpressionTypeMap || s_Expression_isFrozen (self))
+		return NULL;
+	
+	s_Expression_unshare (self);
+	s_Expression_willMutate (self);
+	
+	WexprExpression** slot = s_Expression_mapUpsert (self, p_wexpr_Key_create (key, length));
+	if (!slot)
+		return NULL; // unable to grow
+	
+	if (!*slot)
+		*slot = wexpr_Expression_createNull ();
+	
+	return *slot;
+}
+
+WexprExpression* wexpr_Expression_mapTakeValueForKey (WexprExpression* self, const char* key)
+{
+	return wexpr_Expression_mapTakeValueForLengthKey (self, key, strlen(key));
+}
+
+// remove and return the value, which could still be in an arena
+static WexprExpression* s_Expression_mapTakeValue (WexprExpression* self, const char* key, size_t length)
+{
+	if (self->m_type != WexprExpressionTypeMap || s_Expression_isFrozen (self))
+		return NULL;
+	
+	s_Expression_unshare (self);
+	
+	WexprKey keyHandle = wexpr_Key_fromLengthString (key, length);
+	char* oldKey = NULL;
+	WexprExpression* value = NULL;
+	
+	int res = hashmap_take_hashed (self->m_map.hash, (char*) keyHandle.string, (unsigned int) keyHandle.length,
+		keyHandle.hash, &oldKey, (any_t*) &value
+	);
+	
+	if (res != MAP_OK)
+		return NULL; // not found, nothing changed
+	
+	s_Expression_willMutate (self);
+	p_wexpr_Key_release (p_wexpr_Key_fromString (oldKey));
+	
+	return value;
+}
+
+WexprExpression* wexpr_Expression_mapTakeValueForLengthKey (WexprExpression* self, const char* key, size_t length)
+{
+	return s_Expression_detach (s_Expression_mapTakeValue (self, key, length));
+}
+
+bool wexpr_Expression_mapRemoveKey (WexprExpression* self, const char* key)
+{
+	WexprExpression* value = s_Expression_mapTakeValue (self, key, strlen(key));
+	if (!value)
+		return false;
+	
+	wexpr_Expression_destroy (value);
+	return true;
+}
+
+// --- Iterators
+
+void wexpr_ArrayIterator_init (WexprArrayIterator* self, WexprExpression* array)
+{
+	wexpr_ArrayIterator_initAtIndex (self, array, 0);
+}
+
+void wexpr_ArrayIterator_initAtIndex (WexprArrayIterator* self, WexprExpression* array, size_t index)
+{
+	self->m_array = array;
+	self->m_index = index;
+}
+
+WexprExpression* wexpr_ArrayIterator_next (WexprArrayIterator* self)
+{
+	if (self->m_index >= wexpr_Expression_arrayCount (self->m_array))
+		return NULL; // done, or not an array
+	
+	return self->m_array->m_array.storage->items[self->m_index++];
+}
+
+void wexpr_MapIterator_init (WexprMapIterator* self, WexprExpression* map)
+{
+	self->m_map = map;
+	self->m_slot = (map->m_type == WexprExpressionTypeMap) ? 0 : MAP_MISSING;
+}
+
+bool wexpr_MapIterator_next (WexprMapIterator* self, const char** key, WexprExpression** value)
+{
+	if (self->m_slot == MAP_MISSING)
+		return false;
+	
+	char* foundKey = NULL;
+	WexprExpression* foundValue = NULL;
+	
+	int slot = hashmap_next (self->m_map->m_map.hash, self->m_slot, &foundKey, (any_t*) &foundValue);
+	if (slot == MAP_MISSING)
+	{
+		self->m_slot = MAP_MISSING;
+		return false;
+	}
+	
+	self->m_slot = slot + 1;
+	
+	if (key) *key = foundKey;
+	if (value) *value = foundValue;
+	
+	return true;
+}
+
+// --- Shape
+
+// what was found for an expression, for its parent
+typedef struct PrivateShapeScan
+{
+	WexprExpressionType type; // invalid if nothing was found
+	size_t expandedNodes; // nodes in it with references inserted
+} PrivateShapeScan;
+
+// a reference name from text, and what it was bound to
+typedef struct PrivateShapeReference
+{
+	char* name;
+	PrivateShapeScan scan;
+} PrivateShapeReference;
+
+typedef struct PrivateShapeState
+{
+	WexprShape* shape;
+	
+	map_t references; // text : name -> PrivateShapeReference we own
+	
+	// binary : what each definition chunk held, by id
+	PrivateShapeScan* definitions;
+	size_t definitionCount;
+	size_t definitionCapacity;
+} PrivateShapeState;
+
+static int s_Shape_freeReference (any_t userData, any_t data)
+{
+	(void)userData;
+	
+	PrivateShapeReference* reference = data;
+	wexpr_Allocator_free (reference->name);
+	wexpr_Allocator_free (reference);
+	
+	return MAP_OK; // keep iterating
+}
+
+static void s_Shape_setError (WexprError* error, WexprErrorCode code, const char* message, WexprLineNumber line, WexprColumnNumber column)
+{
+	if (error)
+	{
+		error->code = code;
+		error->message = p_wexpr_strdup (message);
+		error->line = line;
+		error->column = column;
+	}
+}
+
+void p_wexpr_Shape_addNode (WexprShape* shape, WexprExpressionType type, size_t depth)
+{
+	++shape->nodeCount;
+	shape->depthTotal += depth;
+	
+	if (depth > shape->maxDepth)
+		shape->maxDepth = depth;
+	
+	switch (type)
+	{
+		case WexprExpressionTypeNull: ++shape->nullCount; break;
+		case WexprExpressionTypeValue: ++shape->valueCount; break;
+		case WexprExpressionTypeArray: ++shape->arrayCount; break;
+		case WexprExpressionTypeMap: ++shape->mapCount; break;
+		case WexprExpressionTypeBinaryData: ++shape->binaryDataCount; break;
+		default: break;
+	}
+}
+
+void p_wexpr_Shape_addValue (WexprShape* shape, size_t length, size_t depth)
+{
+	p_wexpr_Shape_addNode (shape, WexprExpressionTypeValue, depth);
+	
+	++shape->valueLengths[wexpr_Shape_bucketForLength (length)];
+	shape->valueBytes += length;
+	
+	if (length > shape->maxValueLength)
+		shape->maxValueLength = length;
+}
+
+// follows s_Expression_parseFromString(), counting instead of creating. Keys are checked but not counted.
+static PrivateStringRef s_Shape_scanString (PrivateShapeState* state, PrivateStringRef str, size_t depth, bool isKey,
+	PrivateParserState* parserState, PrivateShapeScan* scan, WexprError* error)
+{
+	scan->type = WexprExpressionTypeInvalid;
+	scan->expandedNodes = 1;
+	
+	str = s_trimFrontOfString (str, parserState);
+	
+	if (str.size == 0)
+		return s_StringRef_createInvalid(); // nothing left
+	
+	bool isArray = (str.size >= 2 && s_StringRef_isEqual (s_StringRef_slice2 (str, 0, 2), s_StringRef_create ("#(")));
+	bool isMap = (str.size >= 2 && s_StringRef_isEqual (s_StringRef_slice2 (str, 0, 2), s_StringRef_create ("@(")));
+	
+	if (isArray || isMap)
+	{
+		scan->type = isArray ? WexprExpressionTypeArray : WexprExpressionTypeMap;
+		if (!isKey)
+			p_wexpr_Shape_addNode (state->shape, scan->type, depth);
+		
+		str = s_StringRef_slice (str, 2);
+		parserState->column += 2;
+		
+		size_t count = 0;
+		
+		while (true)
+		{
+			str = s_trimFrontOfString (str, parserState);
+			
+			if (str.size == 0)
+			{
+				s_Shape_setError (error,
+					isArray ? WexprErrorCodeArrayMissingEndParen : WexprErrorCodeMapMissingEndParen,
+					isArray ? "An Array was missing its ending paren" : "A Map was missing its ending paren",
+					parserState->line, parserState->column
+				);
+				
+				return s_StringRef_createInvalid();
+			}
+			
+			if (str.ptr[0] == ')')
+				break; // done
+			
+			if (isMap)
+			{
+				WexprLineNumber prevLine = parserState->line;
+				WexprColumnNumber prevColumn = parserState->column;
+				
+				PrivateShapeScan key;
+				str = s_Shape_scanString (state, str, depth+1, true, parserState, &key, error);
+				
+				if (error->code)
+					return s_StringRef_createInvalid();
+				
+				if (key.type != WexprExpressionTypeValue)
+				{
+					s_Shape_setError (error, WexprErrorCodeMapKeyMustBeAValue, "Map keys must be a value", prevLine, prevColumn);
+					return s_StringRef_createInvalid();
+				}
+				
+				PrivateShapeScan value;
+				str = s_Shape_scanString (state, str, depth+1, isKey, parserState, &value, error);
+				
+				if (error->code)
+					return s_StringRef_createInvalid();
+				
+				if (value.type == WexprExpressionTypeInvalid)
+				{
+					s_Shape_setError (error, WexprErrorCodeMapNoValue, "Map key must have a value", prevLine, prevColumn);
+					return s_StringRef_createInvalid();
+				}
+				
+				scan->expandedNodes += value.expandedNodes;
+			}
+			
+			else
+			{
+				PrivateShapeScan child;
+				str = s_Shape_scanString (state, str, depth+1, isKey, parserState, &child, error);
+				
+				if (error->code)
+					return s_StringRef_createInvalid();
+				
+				scan->expandedNodes += child.expandedNodes;
+			}
+			
+			++count;
+		}
+		
+		if (!isKey)
+			++(isArray ? state->shape->arrayLengths : state->shape->mapSizes)[wexpr_Shape_bucketForLength (count)];
+		
+		str = s_StringRef_slice (str, 1); // remove the end paren
+		parserState->column += 1;
+		
+		return str;
+	}
+	
+	else if (str.ptr[0] == '[')
+	{
+		size_t endingBracketIndex = s_StringRef_find (str, ']');
+		if (endingBracketIndex == s_InvalidIndex)
+		{
+			s_Shape_setError (error, WexprErrorCodeReferenceMissingEndBracket, "A reference [] is missing its ending bracket",
+				parserState->line, parserState->column
+			);
+			return s_StringRef_createInvalid();
+		}
+		
+		PrivateStringRef refName = s_StringRef_slice2 (str, 1, endingBracketIndex-1);
+		if (!s_isReferenceNameValid (refName))
+		{
+			s_Shape_setError (error, WexprErrorCodeReferenceInvalidName, "A reference doesn't have a valid name",
+				parserState->line, parserState->column
+			);
+			return s_StringRef_createInvalid();
+		}
+		
+		s_privateParserState_moveForwardBasedOnString (parserState, s_StringRef_slice2 (str, 0, endingBracketIndex+1));
+		str = s_StringRef_slice (str, endingBracketIndex+1);
+		
+		// what follows is written as usual, and bound to the name
+		PrivateStringRef rest = s_Shape_scanString (state, str, depth, isKey, parserState, scan, error);
+		if (error->code)
+			return s_StringRef_createInvalid();
+		
+		char* name = s_dupLengthString (refName.ptr, refName.size);
+		
+		PrivateShapeReference* reference = NULL;
+		if (hashmap_get (state->references, name, (any_t*) &reference) == MAP_OK && reference)
+		{
+			wexpr_Allocator_free (name); // rebinding
+		}
+		else
+		{
+			reference = wexpr_Allocator_alloc (sizeof(PrivateShapeReference));
+			reference->name = name;
+			hashmap_put (state->references, reference->name, reference);
+		}
+		
+		reference->scan = *scan;
+		++state->shape->referenceDefinitionCount;
+		
+		return rest;
+	}
+	
+	else if (str.size >= 2 && s_StringRef_isEqual (s_StringRef_slice2 (str, 0, 2), s_StringRef_create ("*[")))
+	{
+		size_t endingBracketIndex = s_StringRef_find (str, ']');
+		if (endingBracketIndex == s_InvalidIndex)
+		{
+			s_Shape_setError (error, WexprErrorCodeReferenceInsertMissingEndBracket, "A reference insert *[] is missing its ending bracket",
+				parserState->line, parserState->column
+			);
+			return s_StringRef_createInvalid();
+		}
+		
+		PrivateStringRef refName = s_StringRef_slice2 (str, 2, endingBracketIndex-2);
+		
+		s_privateParserState_moveForwardBasedOnString (parserState, s_StringRef_slice2 (str, 0, endingBracketIndex+1));
+		str = s_StringRef_slice (str, endingBracketIndex+1);
+		
+		char* name = s_dupLengthString (refName.ptr, refName.size);
+		PrivateShapeReference* reference = NULL;
+		int found = hashmap_get (state->references, name, (any_t*) &reference);
+		wexpr_Allocator_free (name);
+		
+		if (found != MAP_OK || !reference)
+		{
+			s_Shape_setError (error, WexprErrorCodeReferenceUnknownReference, "Tried to insert a reference, but couldn't find it.",
+				parserState->line, parserState->column
+			);
+			return s_StringRef_createInvalid();
+		}
+		
+		*scan = reference->scan;
+		
+		if (!isKey)
+			++state->shape->referenceCount;
+		
+		return str;
+	}
+	
+	else if (str.ptr[0] == '<')
+	{
+		size_t endingQuote = s_StringRef_find (str, '>');
+		if (endingQuote == s_InvalidIndex)
+		{
+			s_Shape_setError (error, WexprErrorCodeBinaryDataNoEnding, "Tried to find the ending > for binary data, but not found.",
+				parserState->line, parserState->column
+			);
+			return s_StringRef_createInvalid();
+		}
+		
+		Base64IBuffer inputBuf;
+		inputBuf.buffer = str.ptr+1;
+		inputBuf.size = endingQuote-1;
+		
+		size_t byteSize = 0;
+		if (!base64_decodedSize (inputBuf, &byteSize))
+		{
+			s_Shape_setError (error, WexprErrorCodeBinaryDataInvalidBase64, "Unable to decode the base64 data.",
+				parserState->line, parserState->column
+			);
+			return s_StringRef_createInvalid();
+		}
+		
+		scan->type = WexprExpressionTypeBinaryData;
+		if (!isKey)
+		{
+			p_wexpr_Shape_addNode (state->shape, scan->type, depth);
+			state->shape->binaryDataBytes += byteSize;
+		}
+		
+		s_privateParserState_moveForwardBasedOnString (parserState, s_StringRef_slice2 (str, 0, endingQuote+1));
+		return s_StringRef_slice (str, endingQuote+1);
+	}
+	
+	else
+	{
+		PrivateWexprStringValue val = s_createValueOfString (str, parserState, error);
+		
+		if (error->code != WexprErrorCodeNone)
+			return s_StringRef_createInvalid();
+		
+		size_t length = strlen (val.value);
+		
+		if ((strcmp (val.value, "nil") == 0) || (strcmp (val.value, "null") == 0))
+		{
+			scan->type = WexprExpressionTypeNull;
+			if (!isKey)
+				p_wexpr_Shape_addNode (state->shape, scan->type, depth);
+		}
+		else
+		{
+			scan->type = WexprExpressionTypeValue;
+			if (!isKey)
+				p_wexpr_Shape_addValue (state->shape, length, depth);
+		}
+		
+		s_Value_destroy (val.value, length);
+		
+		s_privateParserState_moveForwardBasedOnString (parserState, s_StringRef_slice2 (str, 0, val.endIndex));
+		return s_StringRef_slice (str, val.endIndex);
+	}
+}
+
+// follows s_Expression_parseFromBinaryChunk(), counting instead of creating. Keys are checked but not counted.
+// chunkSize is set to the size of the chunk including its header.
+static bool s_Shape_scanChunk (PrivateShapeState* state, const uint8_t* data, size_t length, size_t depth, bool isKey,
+	PrivateShapeScan* scan, size_t* chunkSize, WexprError* error)
+{
+	static const size_t s_headerSize = sizeof(uint32_t) + sizeof(uint8_t);
+	
+	scan->type = WexprExpressionTypeInvalid;
+	scan->expandedNodes = 1;
+	
+	if (length < s_headerSize)
+	{
+		s_Shape_setError (error, WexprErrorCodeBinaryChunkNotBigEnough, "Chunk not big enough for header", 0, 0);
+		return false;
+	}
+	
+	uint32_t size;
+	memcpy (&size, data, sizeof(size));
+	size = wexpr_bigUInt32ToNative (size);
+	
+	uint8_t type = data[sizeof(uint32_t)];
+	
+	if (size > length - s_headerSize)
+	{
+		s_Shape_setError (error, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given", 0, 0);
+		return false;
+	}
+	
+	*chunkSize = s_headerSize + size;
+	data += s_headerSize;
+	
+	if (type == WexprExpressionTypeNull)
+	{
+		scan->type = WexprExpressionTypeNull;
+		if (!isKey)
+			p_wexpr_Shape_addNode (state->shape, scan->type, depth);
+	}
+	
+	else if (type == WexprExpressionTypeValue)
+	{
+		scan->type = WexprExpressionTypeValue;
+		if (!isKey)
+			p_wexpr_Shape_addValue (state->shape, size, depth);
+	}
+	
+	else if (type == WexprExpressionTypeBinaryData)
+	{
+		if (size < 1 || data[0] != 0x00)
+		{
+			s_Shape_setError (error, WexprErrorCodeBinaryUnknownCompression, "Unknown compression method to use", 0, 0);
+			return false;
+		}
+		
+		scan->type = WexprExpressionTypeBinaryData;
+		if (!isKey)
+		{
+			p_wexpr_Shape_addNode (state->shape, scan->type, depth);
+			state->shape->binaryDataBytes += size - 1;
+		}
+	}
+	
+	else if (type == WexprExpressionTypeArray || type == WexprExpressionTypeMap)
+	{
+		bool isMap = (type == WexprExpressionTypeMap);
+		
+		scan->type = type;
+		if (!isKey)
+			p_wexpr_Shape_addNode (state->shape, scan->type, depth);
+		
+		size_t curPos = 0;
+		size_t count = 0;
+		
+		while (curPos < size)
+		{
+			PrivateShapeScan child;
+			size_t childSize = 0;
+			
+			if (isMap)
+			{
+				if (size - curPos > sizeof(uint32_t) && data[curPos + sizeof(uint32_t)] != WexprExpressionTypeValue)
+				{
+					s_Shape_setError (error, WexprErrorCodeMapKeyMustBeAValue, "Map keys must be a value", 0, 0);
+					return false;
+				}
+				
+				if (!s_Shape_scanChunk (state, data + curPos, size - curPos, depth+1, true, &child, &childSize, error))
+					return false;
+				
+				if (child.type != WexprExpressionTypeValue)
+				{
+					s_Shape_setError (error, WexprErrorCodeMapKeyMustBeAValue, "Map keys must be a value", 0, 0);
+					return false;
+				}
+				
+				curPos += childSize;
+				
+				if (curPos >= size)
+				{
+					s_Shape_setError (error, WexprErrorCodeMapNoValue, "Map key must have a value", 0, 0);
+					return false;
+				}
+			}
+			
+			if (!s_Shape_scanChunk (state, data + curPos, size - curPos, depth+1, isKey, &child, &childSize, error))
+				return false;
+			
+			curPos += childSize;
+			scan->expandedNodes += child.expandedNodes;
+			++count;
+		}
+		
+		if (!isKey)
+			++(isMap ? state->shape->mapSizes : state->shape->arrayLengths)[wexpr_Shape_bucketForLength (count)];
+	}
+	
+	else if (type == PrivateBinaryChunkDefinition)
+	{
+		// written as usual here, then given the next id
+		size_t childSize = 0;
+		if (!s_Shape_scanChunk (state, data, size, depth, isKey, scan, &childSize, error))
+			return false;
+		
+		if (state->definitionCount == state->definitionCapacity)
+		{
+			state->definitionCapacity = state->definitionCapacity ? state->definitionCapacity * 2 : 16;
+			state->definitions = wexpr_Allocator_realloc (state->definitions, state->definitionCapacity * sizeof(PrivateShapeScan));
+		}
+		
+		state->definitions[state->definitionCount++] = *scan;
+		++state->shape->referenceDefinitionCount;
+	}
+	
+	else if (type == PrivateBinaryChunkReference)
+	{
+		if (size != sizeof(uint32_t))
+		{
+			s_Shape_setError (error, WexprErrorCodeBinaryChunkNotBigEnough, "Reference chunk must be the size of an id", 0, 0);
+			return false;
+		}
+		
+		uint32_t id;
+		memcpy (&id, data, sizeof(id));
+		id = wexpr_bigUInt32ToNative (id);
+		
+		if (id >= state->definitionCount)
+		{
+			s_Shape_setError (error, WexprErrorCodeBinaryUnknownReference, "Reference to a definition which wasn't read yet", 0, 0);
+			return false;
+		}
+		
+		*scan = state->definitions[id];
+		
+		if (!isKey)
+			++state->shape->referenceCount;
+	}
+	
+	else
+	{
+		s_Shape_setError (error, WexprErrorCodeBinaryUnknownChunkType, "Unknown chunk type to read", 0, 0);
+		return false;
+	}
+	
+	return true;
+}
+
+bool wexpr_Shape_fromLengthString (WexprShape* self, const char* str, size_t length, WexprError* error)
+{
+	memset (self, 0, sizeof(WexprShape));
+	
+	PrivateShapeState state;
+	memset (&state, 0, sizeof(state));
+	state.shape = self;
+	state.references = hashmap_new ();
+	
+	PrivateParserState parserState;
+	s_privateParserState_init (&parserState);
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	PrivateShapeScan root;
+	
+	PrivateStringRef rest = s_Shape_scanString (&state, s_stringRef_createFromPointerSize (str, length), 1, false,
+		&parserState, &root, &err
+	);
+	
+	if (err.code == WexprErrorCodeNone)
+	{
+		if (s_trimFrontOfString (rest, &parserState).size != 0)
+		{
+			s_Shape_setError (&err, WexprErrorCodeExtraDataAfterParsingRoot, "Extra data after parsing the root expression",
+				parserState.line, parserState.column
+			);
+		}
+		
+		else if (root.type == WexprExpressionTypeInvalid)
+		{
+			s_Shape_setError (&err, WexprErrorCodeEmptyString, "No expression found [remained invalid]",
+				parserState.line, parserState.column
+			);
+		}
+	}
+	
+	self->expandedNodeCount = (err.code == WexprErrorCodeNone) ? root.expandedNodes : 0;
+	
+	hashmap_iterate (state.references, &s_Shape_freeReference, NULL);
+	hashmap_free (state.references);
+	s_privateParserState_free (&parserState);
+	
+	if (err.code != WexprErrorCodeNone)
+	{
+		if (error)
+		{
+			WEXPR_ERROR_MOVE(error, &err);
+		}
+		
+		WEXPR_ERROR_FREE (err);
+		return false;
+	}
+	
+	return true;
+}
+
+bool wexpr_Shape_fromBinaryChunk (WexprShape* self, const void* data, size_t length, WexprError* error)
+{
+	memset (self, 0, sizeof(WexprShape));
+	
+	PrivateShapeState state;
+	memset (&state, 0, sizeof(state));
+	state.shape = self;
+	
+	PrivateShapeScan root;
+	size_t chunkSize = 0;
+	
+	bool success = s_Shape_scanChunk (&state, data, length, 1, false, &root, &chunkSize, error);
+	if (success)
+		self->expandedNodeCount = root.expandedNodes;
+	
+	wexpr_Allocator_free (state.definitions);
+	
+	return success;
+}
+
+size_t wexpr_Shape_bucketForLength (size_t length)
+{
+	size_t bucket = 0;
+	
+	while (length > 0 && bucket < WEXPR_SHAPE_BUCKET_COUNT - 1)
+	{
+		length >>= 1;
+		++bucket;
+	}
 	
-	hashmap_put(self->m_map.hash, elem->key, elem);
+	return bucket;
 }
@@ -0,0 +1,133 @@
+//
+/// \file libWexpr/ExpressionPrivate.h
+/// \brief Internals of WexprExpression shared with the other parts of the library
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_EXPRESSIONPRIVATE_H
+#define LIBWEXPR_EXPRESSIONPRIVATE_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Iterator.h>
+#include <libWexpr/Query.h>
+#include <libWexpr/Shape.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+/// \brief Returns true if the value can be written without quotes.
+/// This is the same check the string writers use, so other writers can match them exactly.
+//
+bool p_wexpr_Expression_isValueBarewordSafe (const char* str, size_t length);
+
+//
+/// \brief Binary chunks which are not expressions themselves, see WexprBinarySpec.md
+//
+enum
+{
+	PrivateBinaryChunkDefinition = 0x05, // holds one expression chunk, which later reference chunks can refer to
+	PrivateBinaryChunkReference = 0x06 // a uint32_t id of an earlier definition, numbered in the order they ended from 0
+};
+
+//
+/// \brief Path index slot shared by expressions in more than one index. Changing them invalidates every index.
+//
+#define PRIVATE_PATHINDEX_SHARED_SLOT 0
+
+//
+/// \brief Mark the expression as part of the tree indexed in slot. Changing it will invalidate indexes in that slot.
+//
+void p_wexpr_Expression_markIndexed (WexprExpression* self, uint16_t slot);
+
+//
+/// \brief The slot the expression was indexed in, or PRIVATE_PATHINDEX_SHARED_SLOT if it never was.
+//
+uint16_t p_wexpr_Expression_indexSlot (WexprExpression* self);
+
+//
+/// \brief Invalidate the path indexes in slot. Defined in PathIndex.c
+//
+void p_wexpr_PathIndex_invalidate (uint16_t slot);
+
+//
+/// \brief Returns true if a path index is still using slot. Defined in PathIndex.c
+//
+bool p_wexpr_PathIndex_isSlotInUse (uint16_t slot);
+
+//
+/// \brief Give self its own copy of storage it shares with snapshots, before changing its children in place.
+/// Does nothing if frozen or not shared. Children fetched from self before this are no longer part of it.
+//
+void p_wexpr_Expression_unshare (WexprExpression* self);
+
+//
+/// \brief Create a copy sharing rhs's arrays and maps, even if rhs isn't frozen. Changing a child fetched from either
+/// changes both, so everything changed must be reached with p_wexpr_Expression_unshare() from the top down.
+//
+WexprExpression* p_wexpr_Expression_createShared (WexprExpression* rhs);
+
+//
+/// \brief Returns true if lhs and rhs are known to be equal without comparing every child.
+/// Such as storage shared by snapshots, or frozen contents with the same hash. Returning false means they might still be equal.
+//
+bool p_wexpr_Expression_isUnchanged (WexprExpression* lhs, WexprExpression* rhs);
+
+//
+/// \brief Replace the contents of self with value's, destroying what self had. Takes ownership of value, which must not be in an arena.
+//
+void p_wexpr_Expression_assign (WexprExpression* self, WexprExpression* value);
+
+//
+/// \brief Ways p_wexpr_Query_change() can change what a path leads to.
+//
+typedef enum PrivateQueryChange
+{
+	PrivateQueryChangeSet, // add or replace a key, or replace an element. A NULL value removes it.
+	PrivateQueryChangeAdd, // add a key that doesnt exist, or insert an element at an index up to the count
+	PrivateQueryChangeReplace, // replace a key or element that exists
+	PrivateQueryChangeRemove // remove a key or element that exists
+} PrivateQueryChange;
+
+//
+/// \brief Change root in place at the query's path, which may only use keys and #N indexes. Every step but the last must exist.
+/// Takes ownership of value (NULL for removing), destroying it on failure. Returns false if the path couldnt be changed. Defined in Query.c
+//
+bool p_wexpr_Query_change (const WexprQuery* self, WexprExpression* root, PrivateQueryChange change, WexprExpression* value);
+
+//
+/// \brief Count a node at depth in the shape. Values are counted with p_wexpr_Shape_addValue() instead.
+//
+void p_wexpr_Shape_addNode (WexprShape* shape, WexprExpressionType type, size_t depth);
+
+//
+/// \brief Count a value of length bytes at depth in the shape.
+//
+void p_wexpr_Shape_addValue (WexprShape* shape, size_t length, size_t depth);
+
+#endif // LIBWEXPR_EXPRESSIONPRIVATE_H
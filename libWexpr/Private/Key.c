@@ -0,0 +1,52 @@
+//
+/// \file libWexpr/Key.c
+/// \brief Precomputed map keys for fast lookups
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Key.h>
+
+#include <string.h>
+
+#include "ThirdParty/c_hashmap/hashmap.h"
+
+// ---------------------- PUBLIC -----------------------------------
+
+WexprKey wexpr_Key_fromString (const char* str)
+{
+	return wexpr_Key_fromLengthString (str, strlen(str));
+}
+
+WexprKey wexpr_Key_fromLengthString (const char* str, size_t length)
+{
+	WexprKey key;
+	key.string = str;
+	key.length = length;
+	key.hash = hashmap_hash_string (str, (unsigned int) length);
+	
+	return key;
+}
@@ -0,0 +1,109 @@
+//
+/// \file libWexpr/KeyTable.c
+/// \brief Shared, immutable map keys
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include "KeyTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "AllocatorPrivate.h"
+
+// ---------------------- PRIVATE ----------------------------------
+
+static int s_releaseKey (any_t userData, any_t data)
+{
+	(void)userData;
+	
+	p_wexpr_Key_release (data);
+	return MAP_OK; // keep iterating
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+PrivateKey* p_wexpr_Key_create (const char* str, size_t length)
+{
+	PrivateKey* self = wexpr_Allocator_alloc (sizeof(PrivateKey) + length + 1);
+	self->refCount = 1;
+	self->length = (unsigned int) length;
+	self->hash = hashmap_hash_string (str, self->length);
+	memcpy (self->string, str, length);
+	self->string[length] = '\0';
+	
+	return self;
+}
+
+PrivateKey* p_wexpr_Key_fromString (const char* string)
+{
+	return (PrivateKey*) (string - offsetof(PrivateKey, string));
+}
+
+PrivateKey* p_wexpr_Key_retain (PrivateKey* self)
+{
+	p_wexpr_atomicIncrement (&self->refCount);
+	return self;
+}
+
+void p_wexpr_Key_release (PrivateKey* self)
+{
+	if (p_wexpr_atomicDecrement (&self->refCount) == 0)
+		wexpr_Allocator_free (self);
+}
+
+void p_wexpr_KeyTable_init (PrivateKeyTable* self)
+{
+	self->hash = hashmap_new();
+}
+
+void p_wexpr_KeyTable_free (PrivateKeyTable* self)
+{
+	hashmap_iterate (self->hash, &s_releaseKey, NULL);
+	hashmap_free (self->hash);
+	self->hash = NULL;
+}
+
+PrivateKey* p_wexpr_KeyTable_intern (PrivateKeyTable* self, const char* str, size_t length)
+{
+	if (!self)
+		return p_wexpr_Key_create (str, length);
+	
+	unsigned int hash = hashmap_hash_string (str, (unsigned int) length);
+	
+	PrivateKey* key = NULL;
+	if (hashmap_get_hashed (self->hash, (char*) str, (unsigned int) length, hash, (any_t*) &key) == MAP_OK)
+		return p_wexpr_Key_retain (key);
+	
+	key = p_wexpr_Key_create (str, length);
+	
+	// the table only keeps its reference if the key was added, otherwise the caller has the only one
+	if (hashmap_put_hashed (self->hash, key->string, key->length, key->hash, key) != MAP_OK)
+		return key;
+	
+	return p_wexpr_Key_retain (key);
+}
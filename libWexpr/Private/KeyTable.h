@@ -0,0 +1,89 @@
+//
+/// \file libWexpr/KeyTable.h
+/// \brief Shared, immutable map keys
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_KEYTABLE_H
+#define LIBWEXPR_KEYTABLE_H
+
+#include <stddef.h>
+
+#include "Atomic.h"
+#include "ThirdParty/c_hashmap/hashmap.h"
+
+//
+/// \brief A map key. Immutable once created, and shared between every map using it.
+/// Maps store string, and get back to the key using p_wexpr_Key_fromString().
+//
+typedef struct PrivateKey
+{
+	PrivateAtomicCount refCount;
+	unsigned int hash; // hashmap_hash_string() of the string
+	unsigned int length; // in bytes, not including the terminator
+	char string[]; // zero terminated
+} PrivateKey;
+
+//
+/// \brief Create a new key with a reference count of 1.
+//
+PrivateKey* p_wexpr_Key_create (const char* str, size_t length);
+
+//
+/// \brief Get the key a string returned by p_wexpr_Key_create belongs to.
+//
+PrivateKey* p_wexpr_Key_fromString (const char* string);
+
+//
+/// \brief Add a reference to the key.
+//
+PrivateKey* p_wexpr_Key_retain (PrivateKey* self);
+
+//
+/// \brief Remove a reference, destroying the key when it was the last.
+//
+void p_wexpr_Key_release (PrivateKey* self);
+
+//
+/// \brief Interns keys, so identical keys are only created once.
+/// Used while parsing so documents full of records share their keys.
+//
+typedef struct PrivateKeyTable
+{
+	map_t hash; // key string -> PrivateKey*, holds a reference to each
+} PrivateKeyTable;
+
+void p_wexpr_KeyTable_init (PrivateKeyTable* self);
+void p_wexpr_KeyTable_free (PrivateKeyTable* self);
+
+//
+/// \brief Return the key for the given string, creating it if needed.
+/// The key is already retained for the caller. If self is NULL, a new key is always created.
+//
+PrivateKey* p_wexpr_KeyTable_intern (PrivateKeyTable* self, const char* str, size_t length);
+
+#endif // LIBWEXPR_KEYTABLE_H
@@ -0,0 +1,311 @@
+//
+/// \file libWexpr/Patch.c
+/// \brief Finding the differences between expressions, and applying them
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Expression.h>
+
+#include <libWexpr/Iterator.h>
+#include <libWexpr/Query.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AllocatorPrivate.h"
+#include "ExpressionPrivate.h"
+
+// --- structures
+
+// the query path to where we are, built up as we go down
+typedef struct PrivatePatchPath
+{
+	char* data; // not terminated
+	size_t length;
+	size_t capacity;
+} PrivatePatchPath;
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void s_Path_reserve (PrivatePatchPath* self, size_t length)
+{
+	if (length <= self->capacity)
+		return;
+
+	size_t capacity = self->capacity < 64 ? 64 : self->capacity * 2;
+	while (capacity < length)
+		capacity *= 2;
+
+	self->data = wexpr_Allocator_realloc (self->data, capacity);
+	self->capacity = capacity;
+}
+
+// add a key step, escaping anything the query would treat specially. Returns the length to pop back to.
+static size_t s_Path_pushKey (PrivatePatchPath* self, const char* key, size_t length)
+{
+	size_t previousLength = self->length;
+	s_Path_reserve (self, self->length + 1 + length * 2);
+
+	if (self->length > 0)
+		self->data[self->length++] = '/';
+
+	for (size_t i=0; i < length; ++i)
+	{
+		char c = key[i];
+		if (c == '/' || c == '\\' || c == '*' || c == '#')
+			self->data[self->length++] = '\\';
+
+		self->data[self->length++] = c;
+	}
+
+	return previousLength;
+}
+
+// add an index step. Returns the length to pop back to.
+static size_t s_Path_pushIndex (PrivatePatchPath* self, size_t index)
+{
+	char step [32];
+	int stepLength = snprintf (step, sizeof(step), "#%lu", (unsigned long) index);
+
+	size_t previousLength = self->length;
+	s_Path_reserve (self, self->length + 1 + (size_t) stepLength);
+
+	if (self->length > 0)
+		self->data[self->length++] = '/';
+
+	memcpy (self->data + self->length, step, (size_t) stepLength);
+	self->length += (size_t) stepLength;
+
+	return previousLength;
+}
+
+// add @(op <op> path <path> value <value>) to the patch. value can be NULL.
+static void s_addOperation (WexprExpression* patch, const char* op, const PrivatePatchPath* path, WexprExpression* value)
+{
+	WexprExpression* operation = wexpr_Expression_createNull ();
+	wexpr_Expression_changeType (operation, WexprExpressionTypeMap);
+
+	wexpr_Expression_mapSetValueForKey (operation, "op", wexpr_Expression_createValue (op));
+	wexpr_Expression_mapSetValueForKey (operation, "path", wexpr_Expression_createValueFromLengthString (path->data ? path->data : "", path->length));
+
+	if (value)
+		wexpr_Expression_mapSetValueForKey (operation, "value", wexpr_Expression_createCopy (value));
+
+	wexpr_Expression_arrayAddElementToEnd (patch, operation);
+}
+
+// add the operations which turn from into to
+static void s_diff (WexprExpression* from, WexprExpression* to, PrivatePatchPath* path, WexprExpression* patch)
+{
+	WexprExpressionType type = wexpr_Expression_type (from);
+
+	if (type != wexpr_Expression_type (to) || (type != WexprExpressionTypeArray && type != WexprExpressionTypeMap))
+	{
+		if (!wexpr_Expression_isEqual (from, to))
+			s_addOperation (patch, "replace", path, to);
+
+		return;
+	}
+
+	// skip whole branches that are shared or hash the same
+	if (p_wexpr_Expression_isUnchanged (from, to))
+		return;
+
+	if (type == WexprExpressionTypeArray)
+	{
+		size_t fromCount = wexpr_Expression_arrayCount (from);
+		size_t toCount = wexpr_Expression_arrayCount (to);
+
+		WexprArrayIterator fromIt, toIt;
+		wexpr_ArrayIterator_init (&fromIt, from);
+		wexpr_ArrayIterator_init (&toIt, to);
+
+		// elements both have are compared in place
+		size_t index = 0;
+		for (; index < fromCount && index < toCount; ++index)
+		{
+			size_t previousLength = s_Path_pushIndex (path, index);
+			s_diff (wexpr_ArrayIterator_next (&fromIt), wexpr_ArrayIterator_next (&toIt), path, patch);
+			path->length = previousLength;
+		}
+
+		// then remove from the end so earlier indexes stay valid
+		for (size_t removeIndex = fromCount; removeIndex > toCount; --removeIndex)
+		{
+			size_t previousLength = s_Path_pushIndex (path, removeIndex - 1);
+			s_addOperation (patch, "remove", path, NULL);
+			path->length = previousLength;
+		}
+
+		// or add to it
+		for (WexprExpression* child = wexpr_ArrayIterator_next (&toIt); child; child = wexpr_ArrayIterator_next (&toIt), ++index)
+		{
+			size_t previousLength = s_Path_pushIndex (path, index);
+			s_addOperation (patch, "add", path, child);
+			path->length = previousLength;
+		}
+	}
+
+	else
+	{
+		WexprMapIterator it;
+		const char* key = NULL;
+		WexprExpression* value = NULL;
+
+		// changed and removed keys
+		wexpr_MapIterator_init (&it, from);
+		while (wexpr_MapIterator_next (&it, &key, &value))
+		{
+			WexprKey keyHandle = wexpr_Key_fromString (key);
+			WexprExpression* toValue = wexpr_Expression_mapValueForKeyHandle (to, &keyHandle);
+
+			size_t previousLength = s_Path_pushKey (path, key, keyHandle.length);
+
+			if (toValue)
+				s_diff (value, toValue, path, patch);
+			else
+				s_addOperation (patch, "remove", path, NULL);
+
+			path->length = previousLength;
+		}
+
+		// new keys
+		wexpr_MapIterator_init (&it, to);
+		while (wexpr_MapIterator_next (&it, &key, &value))
+		{
+			WexprKey keyHandle = wexpr_Key_fromString (key);
+			if (wexpr_Expression_mapValueForKeyHandle (from, &keyHandle))
+				continue;
+
+			size_t previousLength = s_Path_pushKey (path, key, keyHandle.length);
+			s_addOperation (patch, "add", path, value);
+			path->length = previousLength;
+		}
+	}
+}
+
+static void s_setError (WexprError* error, size_t operationIndex, const char* message)
+{
+	if (error)
+	{
+		error->code = WexprErrorCodePatchInvalid;
+		error->message = p_wexpr_strdup (message);
+		error->line = (WexprLineNumber) (operationIndex + 1); // the operation, as patches are often binary
+		error->column = 0;
+	}
+}
+
+// the value for the key as a string, or NULL
+static const char* s_operationString (WexprExpression* operation, const char* key)
+{
+	WexprKey keyHandle = wexpr_Key_fromString (key);
+	WexprExpression* value = wexpr_Expression_mapValueForKeyHandle (operation, &keyHandle);
+
+	return value ? wexpr_Expression_value (value) : NULL;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+WexprExpression* wexpr_Expression_diff (WexprExpression* from, WexprExpression* to)
+{
+	WexprExpression* patch = wexpr_Expression_createNull ();
+	wexpr_Expression_changeType (patch, WexprExpressionTypeArray);
+
+	PrivatePatchPath path = { NULL, 0, 0 };
+	s_diff (from, to, &path, patch);
+	wexpr_Allocator_free (path.data);
+
+	return patch;
+}
+
+bool wexpr_Expression_applyPatch (WexprExpression* self, WexprExpression* patch, WexprError* error)
+{
+	if (wexpr_Expression_type (patch) != WexprExpressionTypeArray)
+	{
+		s_setError (error, 0, "Patch must be an array of operations");
+		return false;
+	}
+
+	if (wexpr_Expression_isFrozen (self))
+	{
+		s_setError (error, 0, "Cannot patch a frozen expression");
+		return false;
+	}
+
+	// work on a copy, so a patch which fails part way leaves self as it was. Only what changes is copied :
+	// p_wexpr_Query_change() unshares each level it goes through, and the copy replaces self once done.
+	WexprExpression* result = p_wexpr_Expression_createShared (self);
+
+	WexprArrayIterator it;
+	wexpr_ArrayIterator_init (&it, patch);
+
+	size_t operationIndex = 0;
+	for (WexprExpression* operation = wexpr_ArrayIterator_next (&it); operation;
+		operation = wexpr_ArrayIterator_next (&it), ++operationIndex)
+	{
+		const char* op = s_operationString (operation, "op");
+		const char* path = s_operationString (operation, "path");
+
+		WexprKey valueKey = wexpr_Key_fromString ("value");
+		WexprExpression* value = wexpr_Expression_mapValueForKeyHandle (operation, &valueKey);
+
+		PrivateQueryChange change;
+		if (op && strcmp (op, "add") == 0) change = PrivateQueryChangeAdd;
+		else if (op && strcmp (op, "replace") == 0) change = PrivateQueryChangeReplace;
+		else if (op && strcmp (op, "remove") == 0) change = PrivateQueryChangeRemove;
+		else
+		{
+			s_setError (error, operationIndex, "Patch operation has an unknown op");
+			wexpr_Expression_destroy (result);
+			return false;
+		}
+
+		WexprQuery* query = path ? wexpr_Query_compile (path, NULL) : NULL;
+		if (!query)
+		{
+			s_setError (error, operationIndex, "Patch operation has an invalid path");
+			wexpr_Expression_destroy (result);
+			return false;
+		}
+
+		WexprExpression* newValue = (value && change != PrivateQueryChangeRemove) ? wexpr_Expression_createCopy (value) : NULL;
+		bool success = p_wexpr_Query_change (query, result, change, newValue);
+		wexpr_Query_destroy (query);
+
+		if (!success)
+		{
+			s_setError (error, operationIndex, "Patch operation could not be applied");
+			wexpr_Expression_destroy (result);
+			return false;
+		}
+	}
+
+	p_wexpr_Expression_assign (self, result);
+	return true;
+}
@@ -0,0 +1,327 @@
+//
+/// \file libWexpr/PathIndex.c
+/// \brief Constant time lookup of any path in an expression
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/PathIndex.h>
+
+#include <libWexpr/Iterator.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AllocatorPrivate.h"
+#include "Atomic.h"
+#include "ExpressionPrivate.h"
+
+#include "ThirdParty/c_hashmap/hashmap.h"
+
+// --- structures
+
+// storage for path strings. Never moves, so the hash can point into it.
+typedef struct PrivatePathBlock
+{
+	struct PrivatePathBlock* next;
+	size_t used;
+	size_t capacity;
+	char data[];
+} PrivatePathBlock;
+
+struct WexprPathIndex
+{
+	WexprExpression* root;
+	
+	uint16_t slot; // the slot its expressions were marked with
+	long epoch; // s_epochs[slot] when built
+	long sharedEpoch; // s_epochs[PRIVATE_PATHINDEX_SHARED_SLOT] when built
+	
+	map_t hash; // path -> WexprExpression*
+	PrivatePathBlock* blocks; // newest first
+};
+
+// a path being built while walking
+typedef struct PrivatePathBuilder
+{
+	char* data;
+	size_t length;
+	size_t capacity;
+} PrivatePathBuilder;
+
+// minimum size of a block of paths
+#define PRIVATE_PATH_BLOCK_SIZE (64 * 1024)
+
+// number of slots indexes are spread over. Indexes which end up in the same slot still work, but invalidate each other.
+#define PRIVATE_PATHINDEX_SLOT_COUNT 4096
+
+// bumped whenever an expression indexed in that slot changes
+static PrivateAtomicCount s_epochs [PRIVATE_PATHINDEX_SLOT_COUNT];
+
+// indexes using each slot
+static PrivateAtomicCount s_slotUsers [PRIVATE_PATHINDEX_SLOT_COUNT];
+
+// where to start looking for a free slot, so slots are reused as late as possible
+static PrivateAtomicCount s_nextSlot = 0;
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void s_builder_reserve (PrivatePathBuilder* builder, size_t extra)
+{
+	if (builder->length + extra > builder->capacity)
+	{
+		while (builder->length + extra > builder->capacity)
+			builder->capacity = (builder->capacity > 0) ? builder->capacity * 2 : 256;
+		
+		builder->data = wexpr_Allocator_realloc (builder->data, builder->capacity);
+	}
+}
+
+static void s_builder_appendEscapedKey (PrivatePathBuilder* builder, const char* key)
+{
+	size_t length = strlen (key);
+	s_builder_reserve (builder, length * 2 + 1);
+	
+	if (builder->length > 0)
+		builder->data[builder->length++] = '/';
+	
+	// the same escaping the query parser understands
+	if ((length > 0 && key[0] == '#') || (length == 1 && key[0] == '*'))
+		builder->data[builder->length++] = '\\';
+	
+	for (size_t i=0; i < length; ++i)
+	{
+		if (key[i] == '/' || key[i] == '\\')
+			builder->data[builder->length++] = '\\';
+		
+		builder->data[builder->length++] = key[i];
+	}
+}
+
+static void s_builder_appendIndex (PrivatePathBuilder* builder, size_t index)
+{
+	char buffer [32];
+	int length = snprintf (buffer, sizeof(buffer), "#%lu", (unsigned long) index);
+	
+	s_builder_reserve (builder, (size_t) length + 1);
+	
+	if (builder->length > 0)
+		builder->data[builder->length++] = '/';
+	
+	memcpy (builder->data + builder->length, buffer, (size_t) length);
+	builder->length += (size_t) length;
+}
+
+// copy the path into our storage, returning where it's stored
+static char* s_PathIndex_storePath (WexprPathIndex* self, const char* path, size_t length)
+{
+	PrivatePathBlock* block = self->blocks;
+	
+	if (!block || block->used + length > block->capacity)
+	{
+		size_t capacity = (length > PRIVATE_PATH_BLOCK_SIZE) ? length : PRIVATE_PATH_BLOCK_SIZE;
+		
+		block = wexpr_Allocator_alloc (sizeof(PrivatePathBlock) + capacity);
+		block->next = self->blocks;
+		block->used = 0;
+		block->capacity = capacity;
+		
+		self->blocks = block;
+	}
+	
+	char* stored = block->data + block->used;
+	if (length > 0)
+		memcpy (stored, path, length);
+	block->used += length;
+	
+	return stored;
+}
+
+static void s_PathIndex_add (WexprPathIndex* self, PrivatePathBuilder* builder, WexprExpression* expr)
+{
+	p_wexpr_Expression_markIndexed (expr, self->slot);
+	
+	char* path = s_PathIndex_storePath (self, builder->data, builder->length);
+	unsigned int length = (unsigned int) builder->length;
+	hashmap_put_hashed (self->hash, path, length, hashmap_hash_string (path, length), expr);
+	
+	size_t parentLength = builder->length;
+	WexprExpressionType type = wexpr_Expression_type (expr);
+	
+	if (type == WexprExpressionTypeArray)
+	{
+		WexprArrayIterator it;
+		wexpr_ArrayIterator_init (&it, expr);
+		
+		size_t index = 0;
+		for (WexprExpression* child = wexpr_ArrayIterator_next (&it); child;
+			child = wexpr_ArrayIterator_next (&it), ++index)
+		{
+			s_builder_appendIndex (builder, index);
+			s_PathIndex_add (self, builder, child);
+			builder->length = parentLength;
+		}
+	}
+	
+	else if (type == WexprExpressionTypeMap)
+	{
+		WexprMapIterator it;
+		wexpr_MapIterator_init (&it, expr);
+		
+		const char* key = NULL;
+		WexprExpression* child = NULL;
+		while (wexpr_MapIterator_next (&it, &key, &child))
+		{
+			s_builder_appendEscapedKey (builder, key);
+			s_PathIndex_add (self, builder, child);
+			builder->length = parentLength;
+		}
+	}
+}
+
+static void s_PathIndex_free (WexprPathIndex* self)
+{
+	hashmap_free (self->hash);
+	self->hash = NULL;
+	
+	while (self->blocks)
+	{
+		PrivatePathBlock* next = self->blocks->next;
+		wexpr_Allocator_free (self->blocks);
+		self->blocks = next;
+	}
+}
+
+static void s_PathIndex_fill (WexprPathIndex* self)
+{
+	self->epoch = p_wexpr_atomicLoad (&s_epochs[self->slot]);
+	self->sharedEpoch = p_wexpr_atomicLoad (&s_epochs[PRIVATE_PATHINDEX_SHARED_SLOT]);
+	self->hash = hashmap_new();
+	self->blocks = NULL;
+	
+	PrivatePathBuilder builder = { NULL, 0, 0 };
+	s_PathIndex_add (self, &builder, self->root);
+	wexpr_Allocator_free (builder.data);
+}
+
+// pick the slot for a new index of root. Another index of the same tree shares its slot, otherwise an unused one is taken.
+static uint16_t s_PathIndex_claimSlot (WexprExpression* root)
+{
+	uint16_t slot = p_wexpr_Expression_indexSlot (root);
+	
+	if (slot == PRIVATE_PATHINDEX_SHARED_SLOT || !p_wexpr_PathIndex_isSlotInUse (slot))
+	{
+		slot = PRIVATE_PATHINDEX_SHARED_SLOT; // if every slot is taken
+		
+		for (size_t attempt = 0; attempt < PRIVATE_PATHINDEX_SLOT_COUNT; ++attempt)
+		{
+			uint16_t candidate = (uint16_t) (1 + (unsigned long) p_wexpr_atomicIncrement (&s_nextSlot) % (PRIVATE_PATHINDEX_SLOT_COUNT - 1));
+			
+			if (!p_wexpr_PathIndex_isSlotInUse (candidate))
+			{
+				slot = candidate;
+				break;
+			}
+		}
+	}
+	
+	p_wexpr_atomicIncrement (&s_slotUsers[slot]);
+	return slot;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+void p_wexpr_PathIndex_invalidate (uint16_t slot)
+{
+	p_wexpr_atomicIncrement (&s_epochs[slot]);
+}
+
+bool p_wexpr_PathIndex_isSlotInUse (uint16_t slot)
+{
+	return p_wexpr_atomicLoad (&s_slotUsers[slot]) > 0;
+}
+
+WexprPathIndex* wexpr_PathIndex_build (WexprExpression* expr)
+{
+	WexprPathIndex* self = wexpr_Allocator_alloc (sizeof(WexprPathIndex));
+	self->root = expr;
+	self->slot = s_PathIndex_claimSlot (expr);
+	
+	s_PathIndex_fill (self);
+	
+	return self;
+}
+
+void wexpr_PathIndex_destroy (WexprPathIndex* self)
+{
+	if (!self)
+		return;
+	
+	s_PathIndex_free (self);
+	p_wexpr_atomicDecrement (&s_slotUsers[self->slot]);
+	wexpr_Allocator_free (self);
+}
+
+bool wexpr_PathIndex_isValid (const WexprPathIndex* self)
+{
+	return self->epoch == p_wexpr_atomicLoad (&s_epochs[self->slot]) &&
+		self->sharedEpoch == p_wexpr_atomicLoad (&s_epochs[PRIVATE_PATHINDEX_SHARED_SLOT]);
+}
+
+void wexpr_PathIndex_rebuild (WexprPathIndex* self)
+{
+	s_PathIndex_free (self);
+	s_PathIndex_fill (self);
+}
+
+size_t wexpr_PathIndex_count (const WexprPathIndex* self)
+{
+	return (size_t) hashmap_length (self->hash);
+}
+
+WexprExpression* wexpr_PathIndex_lookup (const WexprPathIndex* self, const char* path)
+{
+	return wexpr_PathIndex_lookupLengthString (self, path, strlen(path));
+}
+
+WexprExpression* wexpr_PathIndex_lookupLengthString (const WexprPathIndex* self, const char* path, size_t length)
+{
+	WexprKey key = wexpr_Key_fromLengthString (path, length);
+	return wexpr_PathIndex_lookupKeyHandle (self, &key);
+}
+
+WexprExpression* wexpr_PathIndex_lookupKeyHandle (const WexprPathIndex* self, const WexprKey* path)
+{
+	if (!wexpr_PathIndex_isValid (self))
+		return NULL;
+	
+	WexprExpression* expr = NULL;
+	if (hashmap_get_hashed (self->hash, (char*) path->string, (unsigned int) path->length, path->hash, (any_t*) &expr) != MAP_OK)
+		return NULL;
+	
+	return expr;
+}
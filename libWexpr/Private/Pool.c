@@ -0,0 +1,186 @@
+//
+/// \file libWexpr/Pool.c
+/// \brief Per-thread recycling of small allocations
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Pool.h>
+
+#include <libWexpr/Allocator.h>
+
+#include "AllocatorPrivate.h"
+#include "Atomic.h"
+#include "PoolPrivate.h"
+#include "StatsPrivate.h"
+
+// --- structures
+
+// blocks are sized in steps of the granularity, up to the largest class. Anything bigger is not pooled.
+#define PRIVATE_POOL_GRANULARITY 16
+#define PRIVATE_POOL_CLASS_COUNT 16 // up to 256 bytes
+
+// a free block, linked through its first bytes
+typedef struct PrivatePoolBlock
+{
+	struct PrivatePoolBlock* next;
+} PrivatePoolBlock;
+
+typedef struct PrivatePool
+{
+	PrivatePoolBlock* freeLists[PRIVATE_POOL_CLASS_COUNT];
+	
+	size_t maxCachedBytes;
+	WexprPoolStats stats;
+} PrivatePool;
+
+// off until the thread opts in with wexpr_Pool_setMaxCachedBytes(), as nothing trims it when the thread exits
+static PRIVATE_THREAD_LOCAL PrivatePool s_pool = { { NULL }, 0, { 0, 0, 0, 0, 0, 0 } };
+
+// ---------------------- PRIVATE ----------------------------------
+
+// the class for a size, or PRIVATE_POOL_CLASS_COUNT if too big to pool
+static size_t s_classForSize (size_t size)
+{
+	if (size == 0)
+		size = 1;
+	
+	size_t sizeClass = (size - 1) / PRIVATE_POOL_GRANULARITY;
+	return (sizeClass < PRIVATE_POOL_CLASS_COUNT) ? sizeClass : PRIVATE_POOL_CLASS_COUNT;
+}
+
+static size_t s_sizeOfClass (size_t sizeClass)
+{
+	return (sizeClass + 1) * PRIVATE_POOL_GRANULARITY;
+}
+
+void* p_wexpr_Pool_alloc (size_t size)
+{
+	size_t sizeClass = s_classForSize (size);
+	if (sizeClass == PRIVATE_POOL_CLASS_COUNT)
+	{
+		++s_pool.stats.misses;
+		return wexpr_Allocator_alloc (size);
+	}
+	
+	PrivatePoolBlock* block = s_pool.freeLists[sizeClass];
+	if (block)
+	{
+		s_pool.freeLists[sizeClass] = block->next;
+		
+		++s_pool.stats.hits;
+		PRIVATE_STATS_ADD (allocations, 1);
+		PRIVATE_STATS_ADD (bytesAllocated, size);
+		--s_pool.stats.cachedBlocks;
+		s_pool.stats.cachedBytes -= s_sizeOfClass (sizeClass);
+		
+		return block;
+	}
+	
+	// allocate the full class size so it can be reused by anything in the class
+	++s_pool.stats.misses;
+	return wexpr_Allocator_alloc (s_sizeOfClass (sizeClass));
+}
+
+void p_wexpr_Pool_free (void* ptr, size_t size)
+{
+	if (!ptr)
+		return;
+	
+	// p_wexpr_Pool_alloc rounded up to the class size, so the block is big enough for the whole class.
+	// It may have come from another thread's pool, which is fine as blocks are plain allocator blocks.
+	size_t sizeClass = s_classForSize (size);
+	
+	if (sizeClass == PRIVATE_POOL_CLASS_COUNT ||
+		s_pool.stats.cachedBytes + s_sizeOfClass (sizeClass) > s_pool.maxCachedBytes)
+	{
+		++s_pool.stats.released;
+		wexpr_Allocator_free (ptr);
+		return;
+	}
+	
+	PrivatePoolBlock* block = ptr;
+	block->next = s_pool.freeLists[sizeClass];
+	s_pool.freeLists[sizeClass] = block;
+	
+	++s_pool.stats.recycled;
+	PRIVATE_STATS_ADD (frees, 1);
+	++s_pool.stats.cachedBlocks;
+	s_pool.stats.cachedBytes += s_sizeOfClass (sizeClass);
+}
+
+size_t p_wexpr_Pool_blockSize (size_t size)
+{
+	size_t sizeClass = s_classForSize (size);
+	return (sizeClass == PRIVATE_POOL_CLASS_COUNT) ? size : s_sizeOfClass (sizeClass);
+}
+
+// release blocks until we're within the limit
+static void s_Pool_releaseDownTo (size_t bytes)
+{
+	for (size_t sizeClass = PRIVATE_POOL_CLASS_COUNT; sizeClass > 0 && s_pool.stats.cachedBytes > bytes; --sizeClass)
+	{
+		PrivatePoolBlock** freeList = &s_pool.freeLists[sizeClass-1];
+		
+		while (*freeList && s_pool.stats.cachedBytes > bytes)
+		{
+			PrivatePoolBlock* block = *freeList;
+			*freeList = block->next;
+			
+			--s_pool.stats.cachedBlocks;
+			s_pool.stats.cachedBytes -= s_sizeOfClass (sizeClass-1);
+			
+			// straight to the allocator, as the block was already counted as freed when it was recycled
+			p_wexpr_Allocator_freeUncounted (block);
+		}
+	}
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+WexprPoolStats wexpr_Pool_stats (void)
+{
+	return s_pool.stats;
+}
+
+void wexpr_Pool_resetStats (void)
+{
+	s_pool.stats.hits = 0;
+	s_pool.stats.misses = 0;
+	s_pool.stats.recycled = 0;
+	s_pool.stats.released = 0;
+}
+
+void wexpr_Pool_setMaxCachedBytes (size_t bytes)
+{
+	s_pool.maxCachedBytes = bytes;
+	s_Pool_releaseDownTo (bytes);
+}
+
+void wexpr_Pool_trim (void)
+{
+	s_Pool_releaseDownTo (0);
+}
@@ -0,0 +1,49 @@
+//
+/// \file libWexpr/PoolPrivate.h
+/// \brief Per-thread recycling of small allocations
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_POOLPRIVATE_H
+#define LIBWEXPR_POOLPRIVATE_H
+
+#include <stddef.h> // size_t
+
+// Blocks from the pool are ordinary blocks from the current allocator, so they can also be
+// reallocated or freed directly if they will not be reused.
+
+// allocate at least size bytes, reusing a recycled block if possible
+void* p_wexpr_Pool_alloc (size_t size);
+
+// free a block from p_wexpr_Pool_alloc(), keeping it for reuse if possible. ptr can be NULL.
+// size can be smaller than the block was allocated with (such as a string that was shortened), but not bigger.
+void p_wexpr_Pool_free (void* ptr, size_t size);
+
+// the size of the block p_wexpr_Pool_alloc() gives for size bytes
+size_t p_wexpr_Pool_blockSize (size_t size);
+
+#endif // LIBWEXPR_POOLPRIVATE_H
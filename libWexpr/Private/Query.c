@@ -0,0 +1,619 @@
+//
+/// \file libWexpr/Query.c
+/// \brief Find expressions using a path
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Query.h>
+
+#include <libWexpr/Iterator.h>
+#include <libWexpr/Key.h>
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AllocatorPrivate.h"
+#include "ExpressionPrivate.h"
+
+// --- structures
+
+typedef enum PrivateQueryStepType
+{
+	PrivateQueryStepTypeKey, // map value for a key
+	PrivateQueryStepTypeIndex, // array element at an index
+	PrivateQueryStepTypeSlice, // array elements in a range
+	PrivateQueryStepTypeWildcard // all array elements or map values
+} PrivateQueryStepType;
+
+typedef struct PrivateQueryStep
+{
+	PrivateQueryStepType type;
+	
+	WexprKey key; // for keys, string points into WexprQuery::strings
+	
+	long index; // for indexes, or the start of a slice
+	long end; // for slices
+	bool hasStart; // for slices, if not the start is 0
+	bool hasEnd; // for slices, if not the end is the count
+} PrivateQueryStep;
+
+struct WexprQuery
+{
+	PrivateQueryStep* steps;
+	size_t stepCount;
+	
+	char* strings; // storage for all keys, we own
+};
+
+// state for one step while iterating
+typedef struct PrivateQueryFrame
+{
+	WexprExpression* single; // for key and index steps : the match, returned once
+	WexprArrayIterator arrayIt; // for slices and wildcards over arrays
+	WexprMapIterator mapIt; // for wildcards over maps
+	size_t remaining; // number of array elements left
+	bool isMap; // true while walking mapIt
+} PrivateQueryFrame;
+
+struct WexprQueryIterator
+{
+	const WexprQuery* query;
+	WexprExpression* root;
+	
+	bool started; // have we looked at root yet
+	size_t depth; // number of frames in use
+	PrivateQueryFrame frames[]; // one per step
+};
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void s_setError (WexprError* error, size_t position, const char* message)
+{
+	if (error)
+	{
+		error->code = WexprErrorCodeQueryInvalid;
+		error->message = p_wexpr_strdup (message);
+		error->line = 1;
+		error->column = (WexprColumnNumber) (position + 1);
+	}
+}
+
+// parse a signed number filling the whole string. Returns false if not valid.
+static bool s_parseNumber (const char* str, size_t length, long* value)
+{
+	size_t pos = 0;
+	bool negative = false;
+	
+	if (length > 0 && str[0] == '-')
+	{
+		negative = true;
+		pos = 1;
+	}
+	
+	if (pos == length)
+		return false; // no digits
+	
+	long result = 0;
+	for (; pos < length; ++pos)
+	{
+		if (str[pos] < '0' || str[pos] > '9')
+			return false;
+		
+		int digit = str[pos] - '0';
+		if (result > (LONG_MAX - digit) / 10)
+			return false; // too big for a long
+		
+		result = result * 10 + digit;
+	}
+	
+	*value = negative ? -result : result;
+	return true;
+}
+
+// parse the part of an index or slice step after the #
+static bool s_parseIndexStep (PrivateQueryStep* step, const char* str, size_t length)
+{
+	const char* colon = memchr (str, ':', length);
+	
+	if (!colon)
+	{
+		step->type = PrivateQueryStepTypeIndex;
+		return s_parseNumber (str, length, &step->index);
+	}
+	
+	size_t startLength = (size_t) (colon - str);
+	size_t endLength = length - startLength - 1;
+	
+	step->type = PrivateQueryStepTypeSlice;
+	step->hasStart = (startLength > 0);
+	step->hasEnd = (endLength > 0);
+	step->index = 0;
+	step->end = 0;
+	
+	if (step->hasStart && !s_parseNumber (str, startLength, &step->index))
+		return false;
+	
+	if (step->hasEnd && !s_parseNumber (colon + 1, endLength, &step->end))
+		return false;
+	
+	return true;
+}
+
+// true if every step leads to exactly one place, so the path can be changed
+static bool s_isSinglePath (const WexprQuery* self)
+{
+	for (size_t i=0; i < self->stepCount; ++i)
+	{
+		if (self->steps[i].type != PrivateQueryStepTypeKey && self->steps[i].type != PrivateQueryStepTypeIndex)
+			return false;
+	}
+	
+	return true;
+}
+
+// resolve an index which can be negative against the count. Returns false if out of range.
+static bool s_resolveIndex (long index, size_t count, size_t* resolved)
+{
+	if (index < 0)
+		index += (long) count;
+	
+	if (index < 0 || (size_t) index >= count)
+		return false;
+	
+	*resolved = (size_t) index;
+	return true;
+}
+
+// resolve an index which can be negative against the count, clamping to [0, count]
+static size_t s_resolveSliceIndex (long index, size_t count)
+{
+	if (index < 0)
+	{
+		index += (long) count;
+		if (index < 0)
+			return 0;
+	}
+	
+	if ((size_t) index > count)
+		return count;
+	
+	return (size_t) index;
+}
+
+// setup a frame to apply step to container
+static void s_frameInit (PrivateQueryFrame* frame, const PrivateQueryStep* step, WexprExpression* container)
+{
+	frame->single = NULL;
+	frame->remaining = 0;
+	frame->isMap = false;
+	
+	WexprExpressionType type = wexpr_Expression_type (container);
+	
+	switch (step->type)
+	{
+		case PrivateQueryStepTypeKey:
+		{
+			frame->single = wexpr_Expression_mapValueForKeyHandle (container, &step->key);
+			break;
+		}
+		
+		case PrivateQueryStepTypeIndex:
+		{
+			if (type != WexprExpressionTypeArray)
+				break;
+			
+			size_t index = 0;
+			if (s_resolveIndex (step->index, wexpr_Expression_arrayCount (container), &index))
+				frame->single = wexpr_Expression_arrayAt (container, index);
+			
+			break;
+		}
+		
+		case PrivateQueryStepTypeSlice:
+		{
+			if (type != WexprExpressionTypeArray)
+				break;
+			
+			size_t count = wexpr_Expression_arrayCount (container);
+			size_t start = step->hasStart ? s_resolveSliceIndex (step->index, count) : 0;
+			size_t end = step->hasEnd ? s_resolveSliceIndex (step->end, count) : count;
+			
+			if (end > start)
+			{
+				wexpr_ArrayIterator_initAtIndex (&frame->arrayIt, container, start);
+				frame->remaining = end - start;
+			}
+			
+			break;
+		}
+		
+		case PrivateQueryStepTypeWildcard:
+		{
+			if (type == WexprExpressionTypeArray)
+			{
+				wexpr_ArrayIterator_init (&frame->arrayIt, container);
+				frame->remaining = wexpr_Expression_arrayCount (container);
+			}
+			else if (type == WexprExpressionTypeMap)
+			{
+				wexpr_MapIterator_init (&frame->mapIt, container);
+				frame->isMap = true;
+			}
+			
+			break;
+		}
+	}
+}
+
+// the next match for the frame's step, or NULL if done
+static WexprExpression* s_frameNext (PrivateQueryFrame* frame)
+{
+	if (frame->single)
+	{
+		WexprExpression* res = frame->single;
+		frame->single = NULL;
+		return res;
+	}
+	
+	if (frame->remaining > 0)
+	{
+		--frame->remaining;
+		return wexpr_ArrayIterator_next (&frame->arrayIt);
+	}
+	
+	if (frame->isMap)
+	{
+		WexprExpression* value = NULL;
+		if (wexpr_MapIterator_next (&frame->mapIt, NULL, &value))
+			return value;
+		
+		frame->isMap = false;
+	}
+	
+	return NULL;
+}
+
+// depth first search for the first match, starting at the given step
+static WexprExpression* s_first (const WexprQuery* self, size_t stepIndex, WexprExpression* expr)
+{
+	if (stepIndex == self->stepCount)
+		return expr;
+	
+	PrivateQueryFrame frame;
+	s_frameInit (&frame, &self->steps[stepIndex], expr);
+	
+	for (WexprExpression* child = s_frameNext (&frame); child; child = s_frameNext (&frame))
+	{
+		WexprExpression* res = s_first (self, stepIndex+1, child);
+		if (res)
+			return res;
+	}
+	
+	return NULL;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+WexprQuery* wexpr_Query_compile (const char* path, WexprError* error)
+{
+	return wexpr_Query_compileLengthString (path, strlen(path), error);
+}
+
+WexprQuery* wexpr_Query_compileLengthString (const char* path, size_t length, WexprError* error)
+{
+	// count the steps : one more than the unescaped separators
+	size_t stepCount = 0;
+	if (length > 0)
+	{
+		stepCount = 1;
+		for (size_t i=0; i < length; ++i)
+		{
+			if (path[i] == '\\')
+				++i; // skip the escaped character
+			else if (path[i] == '/')
+				++stepCount;
+		}
+	}
+	
+	WexprQuery* self = wexpr_Allocator_alloc (sizeof(WexprQuery));
+	self->stepCount = stepCount;
+	self->steps = wexpr_Allocator_alloc (sizeof(PrivateQueryStep) * (stepCount > 0 ? stepCount : 1));
+	self->strings = wexpr_Allocator_alloc (length + 1); // unescaped keys are never longer than the path
+	
+	size_t pos = 0; // position in path
+	size_t stringsUsed = 0;
+	
+	for (size_t stepIndex=0; stepIndex < stepCount; ++stepIndex)
+	{
+		PrivateQueryStep* step = &self->steps[stepIndex];
+		size_t stepStart = pos;
+		
+		// find the end of the step
+		size_t stepEnd = pos;
+		while (stepEnd < length && path[stepEnd] != '/')
+		{
+			if (path[stepEnd] == '\\')
+			{
+				if (stepEnd + 1 >= length)
+				{
+					s_setError (error, stepEnd, "Query path ends with an escape");
+					wexpr_Query_destroy (self);
+					return NULL;
+				}
+				
+				++stepEnd;
+			}
+			
+			++stepEnd;
+		}
+		
+		pos = stepEnd + 1; // skip the separator
+		
+		const char* stepStr = path + stepStart;
+		size_t stepLength = stepEnd - stepStart;
+		
+		if (stepLength == 0)
+		{
+			s_setError (error, stepStart, "Query path has an empty step");
+			wexpr_Query_destroy (self);
+			return NULL;
+		}
+		
+		if (stepLength == 1 && stepStr[0] == '*')
+		{
+			step->type = PrivateQueryStepTypeWildcard;
+		}
+		
+		else if (stepStr[0] == '#')
+		{
+			if (!s_parseIndexStep (step, stepStr + 1, stepLength - 1))
+			{
+				s_setError (error, stepStart, "Query path has an invalid array index or slice");
+				wexpr_Query_destroy (self);
+				return NULL;
+			}
+		}
+		
+		else
+		{
+			// a key : unescape it into our strings
+			char* key = self->strings + stringsUsed;
+			size_t keyLength = 0;
+			
+			for (size_t i=0; i < stepLength; ++i)
+			{
+				if (stepStr[i] == '\\')
+					++i;
+				
+				key[keyLength++] = stepStr[i];
+			}
+			
+			stringsUsed += keyLength;
+			
+			step->type = PrivateQueryStepTypeKey;
+			step->key = wexpr_Key_fromLengthString (key, keyLength);
+		}
+	}
+	
+	return self;
+}
+
+void wexpr_Query_destroy (WexprQuery* self)
+{
+	if (!self)
+		return;
+	
+	wexpr_Allocator_free (self->strings);
+	wexpr_Allocator_free (self->steps);
+	wexpr_Allocator_free (self);
+}
+
+WexprQueryIterator* wexpr_Query_evaluate (const WexprQuery* self, WexprExpression* expr)
+{
+	WexprQueryIterator* it = wexpr_Allocator_alloc (sizeof(WexprQueryIterator) + sizeof(PrivateQueryFrame) * self->stepCount);
+	it->query = self;
+	wexpr_QueryIterator_reset (it, expr);
+	
+	return it;
+}
+
+WexprExpression* wexpr_Query_first (const WexprQuery* self, WexprExpression* expr)
+{
+	if (!expr)
+		return NULL;
+	
+	return s_first (self, 0, expr);
+}
+
+WexprExpression* wexpr_QueryIterator_next (WexprQueryIterator* self)
+{
+	const WexprQuery* query = self->query;
+	
+	if (!self->started)
+	{
+		self->started = true;
+		
+		if (!self->root)
+			return NULL;
+		
+		if (query->stepCount == 0)
+			return self->root; // matches only itself
+		
+		s_frameInit (&self->frames[0], &query->steps[0], self->root);
+		self->depth = 1;
+	}
+	
+	// depth first : go as deep as possible, backing up when a step runs out of matches
+	while (self->depth > 0)
+	{
+		WexprExpression* child = s_frameNext (&self->frames[self->depth-1]);
+		
+		if (!child)
+		{
+			--self->depth;
+			continue;
+		}
+		
+		if (self->depth == query->stepCount)
+			return child; // made it through every step
+		
+		s_frameInit (&self->frames[self->depth], &query->steps[self->depth], child);
+		++self->depth;
+	}
+	
+	return NULL;
+}
+
+void wexpr_QueryIterator_reset (WexprQueryIterator* self, WexprExpression* expr)
+{
+	self->root = expr;
+	self->started = false;
+	self->depth = 0;
+}
+
+void wexpr_QueryIterator_destroy (WexprQueryIterator* self)
+{
+	wexpr_Allocator_free (self);
+}
+
+WexprExpression* wexpr_Query_createUpdated (const WexprQuery* self, WexprExpression* root, WexprExpression* value)
+{
+	if (self->stepCount == 0)
+		return value ? value : wexpr_Expression_createNull(); // replaces the whole thing
+	
+	// a frozen root is shared, changing the version only copies the levels along the path
+	WexprExpression* version = wexpr_Expression_createSnapshot (root);
+	
+	if (!p_wexpr_Query_change (self, version, PrivateQueryChangeSet, value))
+	{
+		wexpr_Expression_destroy (version);
+		return NULL;
+	}
+	
+	// versions of a frozen expression stay frozen, still sharing everything that didnt change
+	if (wexpr_Expression_isFrozen (root))
+		wexpr_Expression_freeze (version);
+	
+	return version;
+}
+
+bool p_wexpr_Query_change (const WexprQuery* self, WexprExpression* root, PrivateQueryChange change, WexprExpression* value)
+{
+	bool needsValue = (change == PrivateQueryChangeAdd || change == PrivateQueryChangeReplace);
+	
+	if (!s_isSinglePath (self) || wexpr_Expression_isFrozen (root) || (needsValue && !value) || (change == PrivateQueryChangeRemove && value))
+	{
+		wexpr_Expression_destroy (value);
+		return false;
+	}
+	
+	if (self->stepCount == 0)
+	{
+		// only the whole thing can be replaced
+		if (!value || change == PrivateQueryChangeAdd)
+		{
+			wexpr_Expression_destroy (value);
+			return false;
+		}
+		
+		p_wexpr_Expression_assign (root, value);
+		return true;
+	}
+	
+	// each level on the way down gets its own copy of anything shared, so only this path is cloned
+	WexprExpression* container = root;
+	p_wexpr_Expression_unshare (container);
+	
+	for (size_t i=0; i < self->stepCount - 1 && container; ++i)
+	{
+		PrivateQueryFrame frame;
+		s_frameInit (&frame, &self->steps[i], container);
+		container = frame.single;
+		
+		if (container)
+			p_wexpr_Expression_unshare (container);
+	}
+	
+	const PrivateQueryStep* last = &self->steps[self->stepCount - 1];
+	WexprExpressionType type = container ? wexpr_Expression_type (container) : WexprExpressionTypeInvalid;
+	
+	if (container && wexpr_Expression_isFrozen (container))
+		type = WexprExpressionTypeInvalid; // cant change it
+	
+	if (last->type == PrivateQueryStepTypeKey && type == WexprExpressionTypeMap)
+	{
+		bool exists = (wexpr_Expression_mapValueForKeyHandle (container, &last->key) != NULL);
+		
+		if ((change == PrivateQueryChangeAdd && exists) ||
+			((change == PrivateQueryChangeReplace || change == PrivateQueryChangeRemove) && !exists))
+		{
+			wexpr_Expression_destroy (value);
+			return false;
+		}
+		
+		if (value)
+			wexpr_Expression_mapSetValueForKeyLengthString (container, last->key.string, last->key.length, value);
+		else
+			wexpr_Expression_destroy (wexpr_Expression_mapTakeValueForLengthKey (container, last->key.string, last->key.length));
+		
+		return true;
+	}
+	
+	if (last->type == PrivateQueryStepTypeIndex && type == WexprExpressionTypeArray)
+	{
+		size_t count = wexpr_Expression_arrayCount (container);
+		
+		if (change == PrivateQueryChangeAdd)
+		{
+			// can add anywhere up to the end
+			if (last->index >= 0 && (size_t) last->index <= count)
+			{
+				wexpr_Expression_arrayInsertAt (container, (size_t) last->index, value);
+				return true;
+			}
+		}
+		
+		else
+		{
+			size_t index = 0;
+			if (s_resolveIndex (last->index, count, &index))
+			{
+				wexpr_Expression_arrayRemoveAt (container, index);
+				
+				if (value)
+					wexpr_Expression_arrayInsertAt (container, index, value);
+				
+				return true;
+			}
+		}
+	}
+	
+	wexpr_Expression_destroy (value);
+	return false;
+}
@@ -0,0 +1,83 @@
+//
+/// \file libWexpr/Stats.c
+/// \brief Counters of the work done by the library
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Stats.h>
+
+#include <string.h>
+
+#include "StatsPrivate.h"
+
+// ---------------------- PRIVATE ----------------------------------
+
+#if defined(LIBWEXPR_STATS)
+	PRIVATE_THREAD_LOCAL WexprStats p_wexpr_stats = { 0, 0, 0, 0, 0, 0 };
+#endif
+
+void p_wexpr_Stats_since (const WexprStats* start, WexprStats* result)
+{
+	WexprStats now = wexpr_Stats_get ();
+	
+	result->allocations = now.allocations - start->allocations;
+	result->reallocations = now.reallocations - start->reallocations;
+	result->frees = now.frees - start->frees;
+	result->bytesAllocated = now.bytesAllocated - start->bytesAllocated;
+	result->nodes = now.nodes - start->nodes;
+	result->hashProbes = now.hashProbes - start->hashProbes;
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+bool wexpr_Stats_isEnabled (void)
+{
+	#if defined(LIBWEXPR_STATS)
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+WexprStats wexpr_Stats_get (void)
+{
+	#if defined(LIBWEXPR_STATS)
+		return p_wexpr_stats;
+	#else
+		WexprStats stats;
+		memset (&stats, 0, sizeof(stats));
+		
+		return stats;
+	#endif
+}
+
+void wexpr_Stats_reset (void)
+{
+	#if defined(LIBWEXPR_STATS)
+		memset (&p_wexpr_stats, 0, sizeof(p_wexpr_stats));
+	#endif
+}
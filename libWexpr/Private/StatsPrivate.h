@@ -0,0 +1,50 @@
+//
+/// \file libWexpr/StatsPrivate.h
+/// \brief Counters of the work done by the library
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_STATSPRIVATE_H
+#define LIBWEXPR_STATSPRIVATE_H
+
+#include <libWexpr/Stats.h>
+
+#include "Atomic.h"
+
+// add to one of the current thread's counters. Compiles to nothing unless LIBWEXPR_STATS is set.
+#if defined(LIBWEXPR_STATS)
+	extern PRIVATE_THREAD_LOCAL WexprStats p_wexpr_stats;
+	
+	#define PRIVATE_STATS_ADD(counter, amount) (p_wexpr_stats.counter += (uint64_t)(amount))
+#else
+	#define PRIVATE_STATS_ADD(counter, amount) ((void)0)
+#endif
+
+// the counters that changed since start, so a single call can report what it cost
+void p_wexpr_Stats_since (const WexprStats* start, WexprStats* result);
+
+#endif // LIBWEXPR_STATSPRIVATE_H
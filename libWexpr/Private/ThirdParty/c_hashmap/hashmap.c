@@ -3,17 +3,25 @@
  */
 #include "hashmap.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-#define INITIAL_SIZE (256)
+#include "../../AllocatorPrivate.h" /* libWexpr: allocate through the library allocator */
+#include "../../Atomic.h" /* libWexpr: reference count for sharing */
+#include "../../StatsPrivate.h" /* libWexpr: count probes */
+
+#define INITIAL_SIZE (16)
+#define MIN_SIZE (8) /* smallest table hashmap_shrink_to_fit will use */
 #define MAX_CHAIN_LENGTH (8)
 
-/* We need to keep keys and values */
+/* We need to keep keys and values. A NULL key marks an unused element,
+ * which keeps an element at 24 bytes with the length and hash. */
 typedef struct _hashmap_element{
 	char* key;
-	int in_use;
+	unsigned int key_length;
+	unsigned int hash; /* from hashmap_hash_string, kept so we never rehash the key */
 	any_t data;
 } hashmap_element;
 
@@ -22,6 +30,8 @@ typedef struct _hashmap_element{
 typedef struct _hashmap_map{
 	int table_size;
 	int size;
+	PrivateAtomicCount refs;
+	unsigned long long tag;
 	hashmap_element *data;
 } hashmap_map;
 
@@ -29,14 +39,16 @@ typedef struct _hashmap_map{
  * Return an empty hashmap, or NULL on failure.
  */
 map_t hashmap_new() {
-	hashmap_map* m = (hashmap_map*) malloc(sizeof(hashmap_map));
+	hashmap_map* m = (hashmap_map*) wexpr_Allocator_alloc(sizeof(hashmap_map));
 	if(!m) goto err;
 
-	m->data = (hashmap_element*) calloc(INITIAL_SIZE, sizeof(hashmap_element));
+	m->data = (hashmap_element*) p_wexpr_calloc(INITIAL_SIZE, sizeof(hashmap_element));
 	if(!m->data) goto err;
 
 	m->table_size = INITIAL_SIZE;
 	m->size = 0;
+	m->refs = 1;
+	m->tag = 0;
 
 	return m;
 	err:
@@ -162,11 +174,18 @@ static unsigned long crc32(const unsigned char *s, unsigned int len)
 }
 
 /*
- * Hashing function for a string
+ * Hash of a string, as used by the hashed functions
  */
-unsigned int hashmap_hash_int(hashmap_map * m, char* keystring){
+unsigned int hashmap_hash_string(const char* keystring, unsigned int length){
+	return (unsigned int) crc32((const unsigned char*)(keystring), length);
+}
 
-    unsigned long key = crc32((unsigned char*)(keystring), strlen(keystring));
+/*
+ * Index in the table for a string hash
+ */
+static unsigned int hashmap_hash_int(hashmap_map * m, unsigned int hash){
+
+    unsigned long key = hash;
 
 	/* Robert Jenkins' 32 bit Mix Function */
 	key += (key << 12);
@@ -184,13 +203,22 @@ unsigned int hashmap_hash_int(hashmap_map * m, char* keystring){
 	return key % m->table_size;
 }
 
+/*
+ * Does the element hold the given key
+ */
+static int hashmap_element_matches(hashmap_element* e, char* key, unsigned int length, unsigned int hash){
+	return e->hash == hash && e->key_length == length &&
+		(e->key == key || memcmp(e->key, key, length) == 0);
+}
+
 /*
  * Return the integer of the location in data
  * to store the point to the item, or MAP_FULL.
  */
-int hashmap_hash(map_t in, char* key){
+static int hashmap_hash(map_t in, char* key, unsigned int length, unsigned int hash){
 	int curr;
 	int i;
+	int free_slot = MAP_FULL;
 
 	/* Cast the hashmap */
 	hashmap_map* m = (hashmap_map *) in;
@@ -199,59 +227,120 @@ int hashmap_hash(map_t in, char* key){
 	if(m->size >= (m->table_size/2)) return MAP_FULL;
 
 	/* Find the best index */
-	curr = hashmap_hash_int(m, key);
+	curr = hashmap_hash_int(m, hash);
 
-	/* Linear probing */
+	/* Linear probing : the key could be anywhere in the chain, since removing leaves gaps */
 	for(i = 0; i< MAX_CHAIN_LENGTH; i++){
-		if(m->data[curr].in_use == 0)
-			return curr;
-
-		if(m->data[curr].in_use == 1 && (strcmp(m->data[curr].key,key)==0))
+		PRIVATE_STATS_ADD(hashProbes, 1);
+		if(m->data[curr].key == NULL){
+			if (free_slot == MAP_FULL)
+				free_slot = curr;
+		}
+		else if(hashmap_element_matches(&m->data[curr], key, length, hash))
 			return curr;
 
 		curr = (curr + 1) % m->table_size;
 	}
 
-	return MAP_FULL;
+	return free_slot;
 }
 
 /*
- * Doubles the size of the hashmap, and rehashes all the elements
+ * Moves all the elements into a table of new_size. If they don't all fit,
+ * the map is left as it was and MAP_FULL is returned.
  */
-int hashmap_rehash(map_t in){
+static int hashmap_resize(hashmap_map* m, int new_size){
 	int i;
-	int old_size;
-	hashmap_element* curr;
+	hashmap_map resized;
 
 	/* Setup the new elements */
+	resized.data = (hashmap_element *) p_wexpr_calloc(new_size, sizeof(hashmap_element));
+	if(!resized.data) return MAP_OMEM;
+
+	resized.table_size = new_size;
+	resized.size = 0;
+
+	/* Rehash the elements */
+	for(i = 0; i < m->table_size; i++){
+		int index;
+
+		if (m->data[i].key == NULL)
+			continue;
+
+		index = hashmap_hash(&resized, m->data[i].key, m->data[i].key_length, m->data[i].hash);
+		if (index == MAP_FULL){
+			wexpr_Allocator_free(resized.data);
+			return MAP_FULL;
+		}
+
+		resized.data[index] = m->data[i];
+		resized.size++;
+	}
+
+	wexpr_Allocator_free(m->data);
+	m->data = resized.data;
+	m->table_size = resized.table_size;
+
+	return MAP_OK;
+}
+
+/*
+ * Grows the hashmap to at least min_size, doubling until all the elements fit.
+ */
+static int hashmap_grow(hashmap_map* m, int min_size){
+	int new_size = m->table_size;
+	int status = MAP_FULL;
+
+	do {
+		if (new_size > INT_MAX / 2) return MAP_OMEM; /* the size would overflow */
+		new_size = 2 * new_size;
+		if (new_size < min_size)
+			continue;
+
+		status = hashmap_resize(m, new_size);
+		if (status == MAP_OMEM)
+			return MAP_OMEM;
+	} while (new_size < min_size || status == MAP_FULL);
+
+	return MAP_OK;
+}
+
+/*
+ * Doubles the size of the hashmap, and rehashes all the elements
+ */
+int hashmap_rehash(map_t in){
+	hashmap_map *m = (hashmap_map *) in;
+	return hashmap_grow(m, 2 * m->table_size);
+}
+
+int hashmap_reserve(map_t in, int count){
 	hashmap_map *m = (hashmap_map *) in;
-	hashmap_element* temp = (hashmap_element *)
-		calloc(2 * m->table_size, sizeof(hashmap_element));
-	if(!temp) return MAP_OMEM;
 
-	/* Update the array */
-	curr = m->data;
-	m->data = temp;
+	/* hashmap_hash considers the table full at half capacity */
+	if (count < m->table_size / 2)
+		return MAP_OK;
 
-	/* Update the size */
-	old_size = m->table_size;
-	m->table_size = 2 * m->table_size;
-	m->size = 0;
+	if (count > (INT_MAX - 2) / 2) return MAP_OMEM; /* the size would overflow */
 
-	/* Rehash the elements */
-	for(i = 0; i < old_size; i++){
-        int status;
-
-        if (curr[i].in_use == 0)
-            continue;
-            
-		status = hashmap_put(m, curr[i].key, curr[i].data);
-		if (status != MAP_OK)
+	return hashmap_grow(m, 2 * count + 2);
+}
+
+int hashmap_shrink_to_fit(map_t in){
+	hashmap_map *m = (hashmap_map *) in;
+	int new_size = MIN_SIZE;
+
+	/* try the smallest tables first, keeping the current one if nothing smaller works */
+	for (; new_size < m->table_size; new_size *= 2){
+		int status;
+
+		if (m->size >= new_size / 2)
+			continue;
+
+		status = hashmap_resize(m, new_size);
+		if (status != MAP_FULL)
 			return status;
 	}
 
-	free(curr);
-
 	return MAP_OK;
 }
 
@@ -259,6 +348,11 @@ int hashmap_rehash(map_t in){
  * Add a pointer to the hashmap with some key
  */
 int hashmap_put(map_t in, char* key, any_t value){
+	unsigned int length = (unsigned int) strlen(key);
+	return hashmap_put_hashed(in, key, length, hashmap_hash_string(key, length), value);
+}
+
+int hashmap_put_hashed(map_t in, char* key, unsigned int length, unsigned int hash, any_t value){
 	int index;
 	hashmap_map* m;
 
@@ -266,19 +360,52 @@ int hashmap_put(map_t in, char* key, any_t value){
 	m = (hashmap_map *) in;
 
 	/* Find a place to put our value */
-	index = hashmap_hash(in, key);
+	index = hashmap_hash(in, key, length, hash);
 	while(index == MAP_FULL){
 		if (hashmap_rehash(in) == MAP_OMEM) {
 			return MAP_OMEM;
 		}
-		index = hashmap_hash(in, key);
+		index = hashmap_hash(in, key, length, hash);
 	}
 
-	/* Set the data */
+	/* Set the data, only growing if the key wasnt already there */
+	if (m->data[index].key == NULL)
+		m->size++;
+
 	m->data[index].data = value;
 	m->data[index].key = key;
-	m->data[index].in_use = 1;
-	m->size++; 
+	m->data[index].key_length = length;
+	m->data[index].hash = hash;
+
+	return MAP_OK;
+}
+
+int hashmap_upsert_hashed(map_t in, char* key, unsigned int length, unsigned int hash, any_t** value_slot){
+	int index;
+	hashmap_map* m;
+
+	/* Cast the hashmap */
+	m = (hashmap_map *) in;
+
+	/* Find the key or a place to put it */
+	index = hashmap_hash(in, key, length, hash);
+	while(index == MAP_FULL){
+		if (hashmap_rehash(in) == MAP_OMEM) {
+			return MAP_OMEM;
+		}
+		index = hashmap_hash(in, key, length, hash);
+	}
+
+	*value_slot = &m->data[index].data;
+
+	if (m->data[index].key != NULL)
+		return MAP_EXISTS;
+
+	m->data[index].data = NULL;
+	m->data[index].key = key;
+	m->data[index].key_length = length;
+	m->data[index].hash = hash;
+	m->size++;
 
 	return MAP_OK;
 }
@@ -287,6 +414,11 @@ int hashmap_put(map_t in, char* key, any_t value){
  * Get your pointer out of the hashmap with a key
  */
 int hashmap_get(map_t in, char* key, any_t *arg){
+	unsigned int length = (unsigned int) strlen(key);
+	return hashmap_get_hashed(in, key, length, hashmap_hash_string(key, length), arg);
+}
+
+int hashmap_get_hashed(map_t in, char* key, unsigned int length, unsigned int hash, any_t *arg){
 	int curr;
 	int i;
 	hashmap_map* m;
@@ -295,14 +427,14 @@ int hashmap_get(map_t in, char* key, any_t *arg){
 	m = (hashmap_map *) in;
 
 	/* Find data location */
-	curr = hashmap_hash_int(m, key);
+	curr = hashmap_hash_int(m, hash);
 
 	/* Linear probing, if necessary */
 	for(i = 0; i<MAX_CHAIN_LENGTH; i++){
+		PRIVATE_STATS_ADD(hashProbes, 1);
 
-        int in_use = m->data[curr].in_use;
-        if (in_use == 1){
-            if (strcmp(m->data[curr].key,key)==0){
+        if (m->data[curr].key != NULL){
+            if (hashmap_element_matches(&m->data[curr], key, length, hash)){
                 *arg = (m->data[curr].data);
                 return MAP_OK;
             }
@@ -334,7 +466,7 @@ int hashmap_iterate(map_t in, PFany f, any_t item) {
 
 	/* Linear probing */
 	for(i = 0; i< m->table_size; i++)
-		if(m->data[i].in_use != 0) {
+		if(m->data[i].key != NULL) {
 			any_t data = (any_t) (m->data[i].data);
 			int status = f(item, data);
 			if (status != MAP_OK) {
@@ -349,6 +481,11 @@ int hashmap_iterate(map_t in, PFany f, any_t item) {
  * Remove an element with that key from the map
  */
 int hashmap_remove(map_t in, char* key){
+	unsigned int length = (unsigned int) strlen(key);
+	return hashmap_take_hashed(in, key, length, hashmap_hash_string(key, length), NULL, NULL);
+}
+
+int hashmap_take_hashed(map_t in, char* key, unsigned int length, unsigned int hash, char** old_key, any_t *old_value){
 	int i;
 	int curr;
 	hashmap_map* m;
@@ -357,16 +494,18 @@ int hashmap_remove(map_t in, char* key){
 	m = (hashmap_map *) in;
 
 	/* Find key */
-	curr = hashmap_hash_int(m, key);
+	curr = hashmap_hash_int(m, hash);
 
 	/* Linear probing, if necessary */
 	for(i = 0; i<MAX_CHAIN_LENGTH; i++){
+		PRIVATE_STATS_ADD(hashProbes, 1);
+
+        if (m->data[curr].key != NULL){
+            if (hashmap_element_matches(&m->data[curr], key, length, hash)){
+                if (old_key) *old_key = m->data[curr].key;
+                if (old_value) *old_value = m->data[curr].data;
 
-        int in_use = m->data[curr].in_use;
-        if (in_use == 1){
-            if (strcmp(m->data[curr].key,key)==0){
                 /* Blank out the fields */
-                m->data[curr].in_use = 0;
                 m->data[curr].data = NULL;
                 m->data[curr].key = NULL;
 
@@ -382,11 +521,61 @@ int hashmap_remove(map_t in, char* key){
 	return MAP_MISSING;
 }
 
+/*
+ * Find the first element in use at or after index
+ */
+int hashmap_next(map_t in, int index, char** key, any_t *arg){
+	hashmap_map* m = (hashmap_map *) in;
+
+	for(; index < m->table_size; index++){
+		if(m->data[index].key != NULL){
+			if (key) *key = m->data[index].key;
+			if (arg) *arg = m->data[index].data;
+			return index;
+		}
+	}
+
+	return MAP_MISSING;
+}
+
 /* Deallocate the hashmap */
 void hashmap_free(map_t in){
 	hashmap_map* m = (hashmap_map*) in;
-	free(m->data);
-	free(m);
+	wexpr_Allocator_free(m->data);
+	wexpr_Allocator_free(m);
+}
+
+/* Reference counting for sharing the hashmap */
+void hashmap_retain(map_t in){
+	hashmap_map* m = (hashmap_map*) in;
+	p_wexpr_atomicIncrement(&m->refs);
+}
+
+long hashmap_release(map_t in){
+	hashmap_map* m = (hashmap_map*) in;
+	return p_wexpr_atomicDecrement(&m->refs);
+}
+
+int hashmap_is_shared(map_t in){
+	hashmap_map* m = (hashmap_map*) in;
+	return p_wexpr_atomicLoad(&m->refs) > 1;
+}
+
+/* Value kept for the owner */
+void hashmap_set_tag(map_t in, unsigned long long tag){
+	hashmap_map* m = (hashmap_map*) in;
+	m->tag = tag;
+}
+
+unsigned long long hashmap_tag(map_t in){
+	hashmap_map* m = (hashmap_map*) in;
+	return m->tag;
+}
+
+/* Bytes allocated, not counting keys or values */
+unsigned long hashmap_byte_size(map_t in){
+	hashmap_map* m = (hashmap_map*) in;
+	return (unsigned long) (sizeof(hashmap_map) + (size_t) m->table_size * sizeof(hashmap_element));
 }
 
 /* Return the length of the hashmap */
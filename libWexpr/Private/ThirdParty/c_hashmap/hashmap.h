@@ -9,6 +9,7 @@
 #ifndef __HASHMAP_H__
 #define __HASHMAP_H__
 
+#define MAP_EXISTS -4   /* Element already exists */
 #define MAP_MISSING -3  /* No such element */
 #define MAP_FULL -2 	/* Hashmap is full */
 #define MAP_OMEM -1 	/* Out of Memory */
@@ -49,6 +50,7 @@ extern int hashmap_iterate(map_t in, PFany f, any_t item);
 
 /*
  * Add an element to the hashmap. Return MAP_OK or MAP_OMEM.
+ * If the key already exists, its key and value are replaced without being freed.
  */
 extern int hashmap_put(map_t in, char* key, any_t value);
 
@@ -57,6 +59,48 @@ extern int hashmap_put(map_t in, char* key, any_t value);
  */
 extern int hashmap_get(map_t in, char* key, any_t *arg);
 
+/*
+ * Hash of a key, for use with the hashed functions.
+ */
+extern unsigned int hashmap_hash_string(const char* key, unsigned int length);
+
+/*
+ * Same as put/get, but with a key that is not zero terminated and its
+ * precomputed hash. Keys with the same pointer are matched without comparing.
+ */
+extern int hashmap_put_hashed(map_t in, char* key, unsigned int length, unsigned int hash, any_t value);
+extern int hashmap_get_hashed(map_t in, char* key, unsigned int length, unsigned int hash, any_t *arg);
+
+/*
+ * Make room for count elements without needing to grow again. Return MAP_OK or MAP_OMEM.
+ */
+extern int hashmap_reserve(map_t in, int count);
+
+/*
+ * Shrink the table to the smallest size that holds the current elements. Return MAP_OK or MAP_OMEM.
+ */
+extern int hashmap_shrink_to_fit(map_t in);
+
+/*
+ * Find the element for the key, adding it with a NULL value if missing, in a single probe.
+ * value_slot is set to where the value is stored, valid until the map is next modified.
+ * Return MAP_OK if it was added (the key is now stored in the map), MAP_EXISTS if it was
+ * already there (the key given is not stored), or MAP_OMEM.
+ */
+extern int hashmap_upsert_hashed(map_t in, char* key, unsigned int length, unsigned int hash, any_t** value_slot);
+
+/*
+ * Remove an element, returning the key and value it had so they can be freed.
+ * Return MAP_OK or MAP_MISSING. old_key and old_value can be NULL.
+ */
+extern int hashmap_take_hashed(map_t in, char* key, unsigned int length, unsigned int hash, char** old_key, any_t *old_value);
+
+/*
+ * Find the first element in use at or after index. Returns its index
+ * (continue from index+1) or MAP_MISSING. key and arg can be NULL.
+ */
+extern int hashmap_next(map_t in, int index, char** key, any_t *arg);
+
 /*
  * Remove an element from the hashmap. Return MAP_OK or MAP_MISSING.
  */
@@ -78,4 +122,31 @@ extern void hashmap_free(map_t in);
  */
 extern int hashmap_length(map_t in);
 
+/*
+ * Add a reference to the hashmap, for sharing it. A new hashmap has one reference.
+ */
+extern void hashmap_retain(map_t in);
+
+/*
+ * Remove a reference, returning how many remain. Does not free anything,
+ * the owner of the last reference frees the contents and calls hashmap_free.
+ */
+extern long hashmap_release(map_t in);
+
+/*
+ * Return 1 if more than one reference is held, 0 otherwise.
+ */
+extern int hashmap_is_shared(map_t in);
+
+/*
+ * A value kept alongside the map for its owner, 0 when created.
+ */
+extern void hashmap_set_tag(map_t in, unsigned long long tag);
+extern unsigned long long hashmap_tag(map_t in);
+
+/*
+ * Bytes allocated for the hashmap and its table, not counting keys or values.
+ */
+extern unsigned long hashmap_byte_size(map_t in);
+
 #endif /* __HASHMAP_H__ */
@@ -0,0 +1,982 @@
+//
+/// \file libWexpr/Transcoder.c
+/// \brief Converts between wexpr formats without building expressions
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#include <libWexpr/Transcoder.h>
+
+#include <libWexpr/Endian.h>
+#include <libWexpr/ExpressionType.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AllocatorPrivate.h"
+#include "Base64.h"
+#include "ExpressionPrivate.h"
+
+// --- structures
+
+typedef struct PrivateChunk
+{
+	uint8_t type;
+	const uint8_t* data; // the data of the chunk (past the header)
+	size_t size; // size of data in bytes
+} PrivateChunk;
+
+// a definition chunk which was read, so references can write it again. Its chunk is kept in the record.
+typedef struct PrivateTranscoderDefinition
+{
+	uint8_t type;
+	size_t offset; // where the data of the chunk starts in the record
+	size_t size;
+	size_t expandedNodes; // nodes in it with references inserted, for the shape
+} PrivateTranscoderDefinition;
+
+// output is gathered here and handed to the sink in large pieces
+typedef struct PrivateTranscoderOutput
+{
+	WexprSink sink;
+	bool humanReadable;
+
+	size_t used; // bytes in buffer
+	char buffer[4096];
+
+	// the chunk inside each definition chunk, in the order they ended
+	PrivateTranscoderDefinition* definitions;
+	size_t definitionCount;
+	size_t definitionCapacity;
+
+	// every byte read while inside a definition chunk
+	uint8_t* record;
+	size_t recordUsed;
+	size_t recordCapacity;
+} PrivateTranscoderOutput;
+
+// an array, map or definition chunk whose children are still being read
+typedef struct PrivateTranscoderFrame
+{
+	uint8_t type;
+	size_t remaining; // bytes of the chunk not read yet
+	size_t indent; // indent children are written at
+
+	bool isFirst; // array/map : no child was written yet
+	bool expectingValue; // map : the key was written, the value is next
+
+	bool childDone; // definition : the child was read
+	size_t recordStart; // definition : where the child starts in the record
+
+	// for the shape
+	size_t count; // array/map : children read
+	size_t expandedNodes; // nodes in it with references inserted
+} PrivateTranscoderFrame;
+
+// the header of every chunk : uint32_t size + uint8_t type
+static const size_t s_chunkHeaderSize = sizeof(uint32_t) + sizeof(uint8_t);
+
+// amount of binary data we encode at a time. Must be a multiple of 3 so only the last piece is padded.
+#define PRIVATE_BASE64_PIECE_SIZE (3 * 256)
+
+struct WexprTranscoder
+{
+	PrivateTranscoderOutput out;
+	size_t indent;
+
+	PrivateTranscoderFrame* frames;
+	size_t frameCount;
+	size_t frameCapacity;
+
+	uint8_t header[sizeof(uint32_t) + sizeof(uint8_t)];
+	size_t headerUsed;
+
+	// the chunk without children being read, once its header was read
+	bool isInLeaf;
+	bool leafIsKey;
+	PrivateChunk leaf; // data is only set when complete
+	size_t leafRead;
+	uint8_t* leafBuffer; // gathers values and references which are split across writes
+	size_t leafBufferCapacity;
+
+	// binary data is encoded as it arrives, a piece at a time
+	uint8_t binaryPiece[PRIVATE_BASE64_PIECE_SIZE];
+	size_t binaryPieceUsed;
+
+	size_t skipping; // bytes left in a definition chunk after its child
+	size_t openDefinitions;
+
+	WexprShape* shape; // measured as we read, if not NULL
+
+	bool isDone;
+	bool hasFailed;
+};
+
+// ---------------------- PRIVATE ----------------------------------
+
+static void s_output_flush (PrivateTranscoderOutput* out)
+{
+	if (out->used > 0)
+	{
+		out->sink.write (out->sink.userData, out->buffer, out->used);
+		out->used = 0;
+	}
+}
+
+static void s_output_write (PrivateTranscoderOutput* out, const char* data, size_t length)
+{
+	if (!out->sink.write)
+		return; // only measuring
+
+	if (out->used + length > sizeof(out->buffer))
+	{
+		s_output_flush (out);
+
+		if (length >= sizeof(out->buffer))
+		{
+			// too big to gather, pass it on directly
+			out->sink.write (out->sink.userData, data, length);
+			return;
+		}
+	}
+
+	memcpy (out->buffer + out->used, data, length);
+	out->used += length;
+}
+
+static void s_output_writeIndent (PrivateTranscoderOutput* out, size_t indent)
+{
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+	while (indent > 0)
+	{
+		size_t amount = (indent < sizeof(tabs)-1) ? indent : sizeof(tabs)-1;
+		s_output_write (out, tabs, amount);
+		indent -= amount;
+	}
+}
+
+static void s_setError (WexprError* error, WexprErrorCode code, const char* message)
+{
+	if (error)
+	{
+		error->code = code;
+		error->message = p_wexpr_strdup (message);
+		error->line = 0;
+		error->column = 0;
+	}
+}
+
+// reads the chunk at the start of buffer, making sure it fits.
+static bool s_readChunk (const uint8_t* buffer, size_t length, PrivateChunk* chunk, WexprError* error)
+{
+	if (length < s_chunkHeaderSize)
+	{
+		s_setError (error, WexprErrorCodeBinaryChunkNotBigEnough, "Chunk not big enough for header");
+		return false;
+	}
+
+	uint32_t size;
+	memcpy (&size, buffer, sizeof(size));
+	size = wexpr_bigUInt32ToNative (size);
+
+	if (size > length - s_chunkHeaderSize)
+	{
+		s_setError (error, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given");
+		return false;
+	}
+
+	chunk->type = buffer[sizeof(uint32_t)];
+	chunk->data = buffer + s_chunkHeaderSize;
+	chunk->size = size;
+
+	return true;
+}
+
+static void s_writeValue (PrivateTranscoderOutput* out, const char* value, size_t length)
+{
+	bool isBarewordSafe = p_wexpr_Expression_isValueBarewordSafe (value, length);
+
+	if (!isBarewordSafe) s_output_write (out, "\"", 1);
+	s_output_write (out, value, length);
+	if (!isBarewordSafe) s_output_write (out, "\"", 1);
+}
+
+static void s_writeBinaryData (PrivateTranscoderOutput* out, const uint8_t* data, size_t size)
+{
+	char encoded [PRIVATE_BASE64_PIECE_SIZE / 3 * 4];
+
+	s_output_write (out, "<", 1);
+
+	while (size > 0)
+	{
+		Base64IBuffer piece;
+		piece.buffer = data;
+		piece.size = (size < PRIVATE_BASE64_PIECE_SIZE) ? size : PRIVATE_BASE64_PIECE_SIZE;
+
+		size_t encodedSize = base64_encodeInto (piece, encoded);
+		s_output_write (out, encoded, encodedSize);
+
+		data += piece.size;
+		size -= piece.size;
+	}
+
+	s_output_write (out, ">", 1);
+}
+
+// Writes the chunk as text. Follows the same rules as p_wexpr_Expression_appendStringRepresentationToAllocatedBuffer() :
+// we're already indented for the start of the object, and no newline is written at the end.
+// Used for chunks without children as they're read, and for definitions written again (which are kept whole).
+static bool s_transcodeChunk (PrivateTranscoderOutput* out, const PrivateChunk* chunk, size_t indent, WexprError* error)
+{
+	if (chunk->type == WexprExpressionTypeNull)
+	{
+		s_output_write (out, "null", 4);
+		return true;
+	}
+
+	else if (chunk->type == WexprExpressionTypeValue)
+	{
+		s_writeValue (out, (const char*) chunk->data, chunk->size);
+		return true;
+	}
+
+	else if (chunk->type == WexprExpressionTypeBinaryData)
+	{
+		// first byte is the compression
+		if (chunk->size < 1 || chunk->data[0] != 0x00)
+		{
+			s_setError (error, WexprErrorCodeBinaryUnknownCompression, "Unknown compression method to use");
+			return false;
+		}
+
+		s_writeBinaryData (out, chunk->data + 1, chunk->size - 1);
+		return true;
+	}
+
+	else if (chunk->type == WexprExpressionTypeArray || chunk->type == WexprExpressionTypeMap)
+	{
+		bool isMap = (chunk->type == WexprExpressionTypeMap);
+
+		if (chunk->size == 0)
+		{
+			// straightforward, always empty structure
+			s_output_write (out, isMap ? "@()" : "#()", 3);
+			return true;
+		}
+
+		s_output_write (out, isMap ? "@(" : "#(", 2);
+		if (out->humanReadable)
+			s_output_write (out, "\n", 1);
+
+		size_t curPos = 0;
+		bool isFirst = true;
+
+		while (curPos < chunk->size)
+		{
+			PrivateChunk child;
+			if (!s_readChunk (chunk->data + curPos, chunk->size - curPos, &child, error))
+				return false;
+
+			curPos += s_chunkHeaderSize + child.size;
+
+			// if human readable, each item is on its own indented line
+			// otherwise, items are separated by a space
+			if (out->humanReadable)
+				s_output_writeIndent (out, indent+1);
+			else if (!isFirst)
+				s_output_write (out, " ", 1);
+
+			isFirst = false;
+
+			if (isMap)
+			{
+				// child was the key, the value follows it
+				if (child.type != WexprExpressionTypeValue)
+				{
+					s_setError (error, WexprErrorCodeMapKeyMustBeAValue, "Map keys must be a value");
+					return false;
+				}
+
+				s_output_write (out, (const char*) child.data, child.size);
+				s_output_write (out, " ", 1);
+
+				if (curPos >= chunk->size)
+				{
+					s_setError (error, WexprErrorCodeMapNoValue, "Map key must have a value");
+					return false;
+				}
+
+				if (!s_readChunk (chunk->data + curPos, chunk->size - curPos, &child, error))
+					return false;
+
+				curPos += s_chunkHeaderSize + child.size;
+			}
+
+			if (!s_transcodeChunk (out, &child, indent+1, error))
+				return false;
+
+			if (out->humanReadable)
+				s_output_write (out, "\n", 1);
+		}
+
+		if (out->humanReadable)
+			s_output_writeIndent (out, indent);
+
+		s_output_write (out, ")", 1);
+		return true;
+	}
+
+	else if (chunk->type == PrivateBinaryChunkDefinition)
+	{
+		// only reached when writing a definition again, which was already added the first time
+		PrivateChunk child;
+		if (!s_readChunk (chunk->data, chunk->size, &child, error))
+			return false;
+
+		return s_transcodeChunk (out, &child, indent, error);
+	}
+
+	else if (chunk->type == PrivateBinaryChunkReference)
+	{
+		if (chunk->size != sizeof(uint32_t))
+		{
+			s_setError (error, WexprErrorCodeBinaryChunkNotBigEnough, "Reference chunk must be the size of an id");
+			return false;
+		}
+
+		uint32_t id;
+		memcpy (&id, chunk->data, sizeof(id));
+		id = wexpr_bigUInt32ToNative (id);
+
+		if (id >= out->definitionCount)
+		{
+			s_setError (error, WexprErrorCodeBinaryUnknownReference, "Reference to a definition which wasn't read yet");
+			return false;
+		}
+
+		// write what was defined again, which was already checked the first time
+		PrivateChunk defined;
+		defined.type = out->definitions[id].type;
+		defined.data = out->record + out->definitions[id].offset;
+		defined.size = out->definitions[id].size;
+
+		return s_transcodeChunk (out, &defined, indent, error);
+	}
+
+	else
+	{
+		s_setError (error, WexprErrorCodeBinaryUnknownChunkType, "Unknown chunk type to read");
+		return false;
+	}
+}
+
+// --- streaming
+
+static void s_Transcoder_fail (WexprTranscoder* self, WexprError* error, WexprErrorCode code, const char* message)
+{
+	s_setError (error, code, message);
+	self->hasFailed = true;
+}
+
+// keeps bytes read inside a definition chunk, so it can be written again
+static void s_Transcoder_record (WexprTranscoder* self, const uint8_t* data, size_t length)
+{
+	PrivateTranscoderOutput* out = &self->out;
+
+	if (self->openDefinitions == 0 || length == 0)
+		return;
+
+	if (out->recordUsed + length > out->recordCapacity)
+	{
+		size_t capacity = out->recordCapacity ? out->recordCapacity * 2 : 256;
+		while (capacity < out->recordUsed + length)
+			capacity *= 2;
+
+		out->record = wexpr_Allocator_realloc (out->record, capacity);
+		out->recordCapacity = capacity;
+	}
+
+	memcpy (out->record + out->recordUsed, data, length);
+	out->recordUsed += length;
+}
+
+static PrivateTranscoderFrame* s_Transcoder_top (WexprTranscoder* self)
+{
+	return (self->frameCount > 0) ? &self->frames[self->frameCount-1] : NULL;
+}
+
+// the indent the next child is written at
+static size_t s_Transcoder_childIndent (WexprTranscoder* self)
+{
+	PrivateTranscoderFrame* top = s_Transcoder_top (self);
+	return top ? top->indent : self->indent;
+}
+
+static void s_Transcoder_push (WexprTranscoder* self, uint8_t type, size_t size, size_t indent)
+{
+	if (self->frameCount == self->frameCapacity)
+	{
+		self->frameCapacity = self->frameCapacity ? self->frameCapacity * 2 : 16;
+		self->frames = wexpr_Allocator_realloc (self->frames, self->frameCapacity * sizeof(PrivateTranscoderFrame));
+	}
+
+	PrivateTranscoderFrame* frame = &self->frames[self->frameCount++];
+	frame->type = type;
+	frame->remaining = size;
+	frame->indent = indent;
+	frame->isFirst = true;
+	frame->expectingValue = false;
+	frame->childDone = false;
+	frame->recordStart = self->out.recordUsed;
+	frame->count = 0;
+	frame->expandedNodes = 1;
+}
+
+// counts a chunk which was just begun in the shape, if measuring. Keys and definitions aren't counted.
+static void s_Transcoder_measure (WexprTranscoder* self, uint8_t type, size_t size, bool isKey)
+{
+	WexprShape* shape = self->shape;
+
+	if (!shape || isKey)
+		return;
+
+	// arrays and maps indent their children, definitions don't
+	size_t depth = s_Transcoder_childIndent (self) - self->indent + 1;
+
+	if (type == WexprExpressionTypeValue)
+		p_wexpr_Shape_addValue (shape, size, depth);
+	else if (type == PrivateBinaryChunkReference)
+		++shape->referenceCount;
+	else
+	{
+		p_wexpr_Shape_addNode (shape, type, depth);
+
+		if (type == WexprExpressionTypeBinaryData)
+			shape->binaryDataBytes += size - 1;
+	}
+}
+
+// counts the length of an array or map once all of it was read, if measuring
+static void s_Transcoder_measureLength (WexprTranscoder* self, uint8_t type, size_t count)
+{
+	if (self->shape)
+		++(type == WexprExpressionTypeMap ? self->shape->mapSizes : self->shape->arrayLengths)[wexpr_Shape_bucketForLength (count)];
+}
+
+// the definition's child starts at recordStart in the record, header included
+static void s_Transcoder_addDefinition (WexprTranscoder* self, const PrivateTranscoderFrame* frame)
+{
+	PrivateTranscoderOutput* out = &self->out;
+
+	if (out->definitionCount == out->definitionCapacity)
+	{
+		out->definitionCapacity = out->definitionCapacity ? out->definitionCapacity * 2 : 16;
+		out->definitions = wexpr_Allocator_realloc (out->definitions, out->definitionCapacity * sizeof(PrivateTranscoderDefinition));
+	}
+
+	uint32_t size;
+	memcpy (&size, out->record + frame->recordStart, sizeof(size));
+
+	PrivateTranscoderDefinition* definition = &out->definitions[out->definitionCount++];
+	definition->type = out->record[frame->recordStart + sizeof(uint32_t)];
+	definition->offset = frame->recordStart + s_chunkHeaderSize;
+	definition->size = wexpr_bigUInt32ToNative (size);
+	definition->expandedNodes = frame->expandedNodes;
+
+	if (self->shape)
+		++self->shape->referenceDefinitionCount;
+}
+
+// an array or map with bytes left must have room for another child
+static bool s_Transcoder_checkRoom (WexprTranscoder* self, const PrivateTranscoderFrame* frame, WexprError* error)
+{
+	if (frame->remaining > 0 && frame->remaining < s_chunkHeaderSize)
+	{
+		s_Transcoder_fail (self, error, WexprErrorCodeBinaryChunkNotBigEnough, "Chunk not big enough for header");
+		return false;
+	}
+
+	return true;
+}
+
+// the current child was completely written : finish every chunk which ended with it.
+// expandedNodes is the nodes in the child with references inserted.
+static bool s_Transcoder_childDone (WexprTranscoder* self, size_t expandedNodes, WexprError* error)
+{
+	PrivateTranscoderOutput* out = &self->out;
+
+	while (self->frameCount > 0)
+	{
+		PrivateTranscoderFrame* frame = s_Transcoder_top (self);
+
+		if (frame->type == PrivateBinaryChunkDefinition)
+		{
+			if (!frame->childDone)
+			{
+				frame->childDone = true;
+				frame->expandedNodes = expandedNodes;
+				s_Transcoder_addDefinition (self, frame);
+
+				if (frame->remaining > 0)
+				{
+					// anything after the child is ignored
+					self->skipping = frame->remaining;
+					frame->remaining = 0;
+					return true;
+				}
+			}
+
+			// the definition stands for its child in the parent
+			expandedNodes = frame->expandedNodes;
+			--self->frameCount;
+			--self->openDefinitions;
+			continue;
+		}
+
+		if (out->humanReadable)
+			s_output_write (out, "\n", 1);
+
+		frame->expectingValue = false;
+		frame->expandedNodes += expandedNodes;
+		++frame->count;
+
+		if (frame->remaining > 0)
+			return s_Transcoder_checkRoom (self, frame, error);
+
+		if (out->humanReadable)
+			s_output_writeIndent (out, frame->indent-1);
+
+		s_output_write (out, ")", 1);
+		s_Transcoder_measureLength (self, frame->type, frame->count);
+
+		expandedNodes = frame->expandedNodes;
+		--self->frameCount;
+	}
+
+	if (self->shape)
+		self->shape->expandedNodeCount = expandedNodes;
+
+	self->isDone = true;
+	return true;
+}
+
+// the leaf is complete with data
+static bool s_Transcoder_finishLeaf (WexprTranscoder* self, const uint8_t* data, WexprError* error)
+{
+	PrivateTranscoderOutput* out = &self->out;
+	PrivateTranscoderFrame* top = s_Transcoder_top (self);
+
+	self->isInLeaf = false;
+	self->leaf.data = data;
+
+	if (self->leafIsKey)
+	{
+		// the value follows the key
+		s_output_write (out, (const char*) data, self->leaf.size);
+		s_output_write (out, " ", 1);
+
+		if (top->remaining == 0)
+		{
+			s_Transcoder_fail (self, error, WexprErrorCodeMapNoValue, "Map key must have a value");
+			return false;
+		}
+
+		top->expectingValue = true;
+		return s_Transcoder_checkRoom (self, top, error);
+	}
+
+	if (!s_transcodeChunk (out, &self->leaf, s_Transcoder_childIndent (self), error))
+	{
+		self->hasFailed = true;
+		return false;
+	}
+
+	size_t expandedNodes = 1;
+
+	if (self->leaf.type == PrivateBinaryChunkReference)
+	{
+		// the id was checked when writing it
+		uint32_t id;
+		memcpy (&id, data, sizeof(id));
+		expandedNodes = out->definitions[wexpr_bigUInt32ToNative (id)].expandedNodes;
+	}
+
+	return s_Transcoder_childDone (self, expandedNodes, error);
+}
+
+// the header of a chunk was read
+static bool s_Transcoder_beginChunk (WexprTranscoder* self, WexprError* error)
+{
+	PrivateTranscoderOutput* out = &self->out;
+	PrivateTranscoderFrame* parent = s_Transcoder_top (self);
+
+	uint32_t size;
+	memcpy (&size, self->header, sizeof(size));
+	size = wexpr_bigUInt32ToNative (size);
+
+	uint8_t type = self->header[sizeof(uint32_t)];
+	self->headerUsed = 0;
+
+	bool isKey = false;
+
+	if (parent)
+	{
+		if (size > parent->remaining - s_chunkHeaderSize)
+		{
+			s_Transcoder_fail (self, error, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given");
+			return false;
+		}
+
+		parent->remaining -= s_chunkHeaderSize + size;
+
+		if (parent->type != PrivateBinaryChunkDefinition && !parent->expectingValue)
+		{
+			isKey = (parent->type == WexprExpressionTypeMap);
+
+			if (isKey && type != WexprExpressionTypeValue)
+			{
+				s_Transcoder_fail (self, error, WexprErrorCodeMapKeyMustBeAValue, "Map keys must be a value");
+				return false;
+			}
+
+			// if human readable, each item is on its own indented line
+			// otherwise, items are separated by a space
+			if (out->humanReadable)
+				s_output_writeIndent (out, parent->indent);
+			else if (!parent->isFirst)
+				s_output_write (out, " ", 1);
+
+			parent->isFirst = false;
+		}
+	}
+
+	size_t indent = s_Transcoder_childIndent (self);
+
+	if (type == WexprExpressionTypeArray || type == WexprExpressionTypeMap)
+	{
+		bool isMap = (type == WexprExpressionTypeMap);
+
+		s_Transcoder_measure (self, type, size, isKey);
+
+		if (size == 0)
+		{
+			// straightforward, always empty structure
+			s_output_write (out, isMap ? "@()" : "#()", 3);
+			s_Transcoder_measureLength (self, type, 0);
+			return s_Transcoder_childDone (self, 1, error);
+		}
+
+		s_output_write (out, isMap ? "@(" : "#(", 2);
+		if (out->humanReadable)
+			s_output_write (out, "\n", 1);
+
+		s_Transcoder_push (self, type, size, indent+1);
+		return s_Transcoder_checkRoom (self, s_Transcoder_top (self), error);
+	}
+
+	else if (type == PrivateBinaryChunkDefinition)
+	{
+		// holds exactly one child
+		if (size < s_chunkHeaderSize)
+		{
+			s_Transcoder_fail (self, error, WexprErrorCodeBinaryChunkNotBigEnough, "Chunk not big enough for header");
+			return false;
+		}
+
+		s_Transcoder_push (self, type, size, indent);
+		++self->openDefinitions;
+		return true;
+	}
+
+	else if (type == WexprExpressionTypeNull || type == WexprExpressionTypeValue ||
+		type == WexprExpressionTypeBinaryData || type == PrivateBinaryChunkReference
+	)
+	{
+		if (type == PrivateBinaryChunkReference && size != sizeof(uint32_t))
+		{
+			s_Transcoder_fail (self, error, WexprErrorCodeBinaryChunkNotBigEnough, "Reference chunk must be the size of an id");
+			return false;
+		}
+
+		if (type == WexprExpressionTypeBinaryData && size < 1)
+		{
+			s_Transcoder_fail (self, error, WexprErrorCodeBinaryUnknownCompression, "Unknown compression method to use");
+			return false;
+		}
+
+		s_Transcoder_measure (self, type, size, isKey);
+
+		self->isInLeaf = true;
+		self->leafIsKey = isKey;
+		self->leaf.type = type;
+		self->leaf.data = NULL;
+		self->leaf.size = size;
+		self->leafRead = 0;
+		self->binaryPieceUsed = 0;
+
+		if (size == 0)
+			return s_Transcoder_finishLeaf (self, self->header, error);
+
+		return true;
+	}
+
+	else
+	{
+		s_Transcoder_fail (self, error, WexprErrorCodeBinaryUnknownChunkType, "Unknown chunk type to read");
+		return false;
+	}
+}
+
+// encodes binary data as it arrives. length is at most what's left of it.
+static bool s_Transcoder_readBinaryData (WexprTranscoder* self, const uint8_t* data, size_t length, WexprError* error)
+{
+	PrivateTranscoderOutput* out = &self->out;
+	const uint8_t* end = data + length;
+
+	if (self->leafRead == 0)
+	{
+		// first byte is the compression
+		if (data[0] != 0x00)
+		{
+			s_Transcoder_fail (self, error, WexprErrorCodeBinaryUnknownCompression, "Unknown compression method to use");
+			return false;
+		}
+
+		s_output_write (out, "<", 1);
+		++data;
+	}
+
+	self->leafRead += length;
+
+	char encoded [PRIVATE_BASE64_PIECE_SIZE / 3 * 4];
+
+	while (data < end)
+	{
+		Base64IBuffer piece;
+
+		if (self->binaryPieceUsed == 0 && (size_t)(end - data) >= PRIVATE_BASE64_PIECE_SIZE)
+		{
+			// a whole piece is here already
+			piece.buffer = data;
+			piece.size = PRIVATE_BASE64_PIECE_SIZE;
+			data += piece.size;
+		}
+		else
+		{
+			size_t part = PRIVATE_BASE64_PIECE_SIZE - self->binaryPieceUsed;
+			if (part > (size_t)(end - data))
+				part = (size_t)(end - data);
+
+			memcpy (self->binaryPiece + self->binaryPieceUsed, data, part);
+			self->binaryPieceUsed += part;
+			data += part;
+
+			// the last piece is encoded once the data ends
+			if (self->binaryPieceUsed < PRIVATE_BASE64_PIECE_SIZE)
+				break;
+
+			piece.buffer = self->binaryPiece;
+			piece.size = self->binaryPieceUsed;
+			self->binaryPieceUsed = 0;
+		}
+
+		size_t encodedSize = base64_encodeInto (piece, encoded);
+		s_output_write (out, encoded, encodedSize);
+	}
+
+	if (self->leafRead < self->leaf.size)
+		return true;
+
+	if (self->binaryPieceUsed > 0)
+	{
+		Base64IBuffer piece;
+		piece.buffer = self->binaryPiece;
+		piece.size = self->binaryPieceUsed;
+
+		size_t encodedSize = base64_encodeInto (piece, encoded);
+		s_output_write (out, encoded, encodedSize);
+	}
+
+	s_output_write (out, ">", 1);
+
+	self->isInLeaf = false;
+	return s_Transcoder_childDone (self, 1, error);
+}
+
+// reads a value or reference, gathering it if it's split across writes. length is at most what's left of it.
+static bool s_Transcoder_readLeaf (WexprTranscoder* self, const uint8_t* data, size_t length, WexprError* error)
+{
+	if (self->leafRead == 0 && length == self->leaf.size)
+	{
+		// all here, use it directly
+		return s_Transcoder_finishLeaf (self, data, error);
+	}
+
+	if (self->leafBufferCapacity < self->leaf.size)
+	{
+		self->leafBuffer = wexpr_Allocator_realloc (self->leafBuffer, self->leaf.size);
+		self->leafBufferCapacity = self->leaf.size;
+	}
+
+	memcpy (self->leafBuffer + self->leafRead, data, length);
+	self->leafRead += length;
+
+	if (self->leafRead < self->leaf.size)
+		return true;
+
+	return s_Transcoder_finishLeaf (self, self->leafBuffer, error);
+}
+
+// ---------------------- PUBLIC -----------------------------------
+
+size_t wexpr_Transcoder_binaryChunkToString (
+	const void* data, size_t length, size_t indent, WexprWriteFlags flags,
+	WexprSink sink, WexprError* error
+)
+{
+	WexprTranscoder* transcoder = wexpr_Transcoder_create (indent, flags, sink);
+
+	size_t used = wexpr_Transcoder_write (transcoder, data, length, error);
+
+	if (!transcoder->hasFailed && !transcoder->isDone)
+	{
+		// ran out of data
+		if (length < s_chunkHeaderSize)
+			s_setError (error, WexprErrorCodeBinaryChunkNotBigEnough, "Chunk not big enough for header");
+		else
+			s_setError (error, WexprErrorCodeBinaryChunkBiggerThanData, "Chunk size is bigger than the data given");
+
+		used = 0;
+	}
+
+	wexpr_Transcoder_destroy (transcoder);
+	return used;
+}
+
+WexprTranscoder* wexpr_Transcoder_create (size_t indent, WexprWriteFlags flags, WexprSink sink)
+{
+	WexprTranscoder* self = wexpr_Allocator_alloc (sizeof(WexprTranscoder));
+	memset (self, 0, sizeof(WexprTranscoder));
+
+	self->out.sink = sink;
+	self->out.humanReadable = ((flags & WexprWriteFlagHumanReadable) == WexprWriteFlagHumanReadable);
+	self->indent = indent;
+
+	return self;
+}
+
+void wexpr_Transcoder_destroy (WexprTranscoder* self)
+{
+	if (!self)
+		return;
+
+	wexpr_Allocator_free (self->out.definitions);
+	wexpr_Allocator_free (self->out.record);
+	wexpr_Allocator_free (self->frames);
+	wexpr_Allocator_free (self->leafBuffer);
+	wexpr_Allocator_free (self);
+}
+
+size_t wexpr_Transcoder_write (WexprTranscoder* self, const void* data, size_t length, WexprError* error)
+{
+	const uint8_t* bytes = data;
+	size_t pos = 0;
+
+	if (self->hasFailed)
+		return 0;
+
+	while (pos < length && !self->isDone)
+	{
+		size_t available = length - pos;
+		bool success = true;
+
+		if (self->skipping > 0)
+		{
+			size_t amount = (self->skipping < available) ? self->skipping : available;
+			s_Transcoder_record (self, bytes + pos, amount);
+			pos += amount;
+			self->skipping -= amount;
+
+			// the definition already has its child's nodes
+			if (self->skipping == 0)
+				success = s_Transcoder_childDone (self, 0, error);
+		}
+
+		else if (self->isInLeaf)
+		{
+			size_t left = self->leaf.size - self->leafRead;
+			size_t amount = (left < available) ? left : available;
+
+			// recorded first, as finishing the leaf may finish a definition
+			s_Transcoder_record (self, bytes + pos, amount);
+
+			if (self->leaf.type == WexprExpressionTypeBinaryData)
+				success = s_Transcoder_readBinaryData (self, bytes + pos, amount, error);
+			else
+				success = s_Transcoder_readLeaf (self, bytes + pos, amount, error);
+
+			pos += amount;
+		}
+
+		else
+		{
+			size_t left = s_chunkHeaderSize - self->headerUsed;
+			size_t amount = (left < available) ? left : available;
+
+			s_Transcoder_record (self, bytes + pos, amount);
+			memcpy (self->header + self->headerUsed, bytes + pos, amount);
+			self->headerUsed += amount;
+			pos += amount;
+
+			if (self->headerUsed == s_chunkHeaderSize)
+				success = s_Transcoder_beginChunk (self, error);
+		}
+
+		if (!success)
+		{
+			self->hasFailed = true;
+			s_output_flush (&self->out);
+			return 0;
+		}
+	}
+
+	s_output_flush (&self->out);
+	return pos;
+}
+
+void wexpr_Transcoder_measureShape (WexprTranscoder* self, WexprShape* shape)
+{
+	memset (shape, 0, sizeof(WexprShape));
+	self->shape = shape;
+}
+
+bool wexpr_Transcoder_isDone (const WexprTranscoder* self)
+{
+	return self->isDone;
+}
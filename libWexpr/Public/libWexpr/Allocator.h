@@ -0,0 +1,101 @@
+//
+/// \file libWexpr/Allocator.h
+/// \brief Lets you choose where libWexpr gets its memory from
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ALLOCATOR_H
+#define LIBWEXPR_ALLOCATOR_H
+
+#include "Macros.h"
+
+#include <stddef.h> // size_t
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief A set of functions used for every allocation libWexpr makes.
+///
+/// By default the C library's malloc, realloc and free are used. Everything the library allocates goes through
+/// the current allocator, including memory handed back to you such as strings, buffers and error messages.
+/// Release that memory with wexpr_Allocator_free() (or plain free() when using the default allocator).
+///
+/// Memory must be freed by the allocator it came from, but documents don't remember which allocator made them :
+/// freeing always uses the allocator current on the freeing thread. When overriding the allocator for a thread,
+/// keep the same one set while parsing, changing and destroying a document, and while freeing anything it returned.
+/// The same goes for the global allocator, which should be set once before using the library.
+//
+typedef struct WexprAllocator
+{
+	void* (*alloc) (void* userData, size_t size); ///< Return size bytes, or NULL on failure.
+	void* (*realloc) (void* userData, void* ptr, size_t size); ///< Resize ptr (which can be NULL), like realloc().
+	void (*free) (void* userData, void* ptr); ///< Release ptr. ptr is never NULL.
+	void* userData; ///< Passed to each function as is.
+} WexprAllocator;
+
+//
+/// \brief Set the allocator used by all threads that do not have their own.
+/// Set it before using the rest of the library, as it is not synchronized.
+/// \param allocator The allocator to use, copied in. NULL to go back to malloc/realloc/free.
+//
+LIBWEXPR_PUBLIC void wexpr_Allocator_setGlobal (const WexprAllocator* allocator);
+
+//
+/// \brief Override the allocator for the current thread only, such as around a parse or while working with a document.
+///
+/// Switching away from a thread allocator is refused while memory it allocated on this thread is still live
+/// (documents, strings, error messages), as that memory would otherwise be freed into the wrong allocator.
+/// Memory made under the global allocator is not tracked, so don't free it while a thread allocator is set.
+/// \param allocator The allocator to use. Not copied, so it must remain valid while set. NULL to use the global allocator again.
+/// \return The allocator previously set for this thread (NULL if none), so it can be restored.
+/// If refused, nothing changes and the current thread allocator is returned : compare with wexpr_Allocator_current().
+//
+LIBWEXPR_PUBLIC const WexprAllocator* wexpr_Allocator_setForThread (const WexprAllocator* allocator);
+
+//
+/// \brief Return the allocator currently in use on this thread.
+//
+LIBWEXPR_PUBLIC const WexprAllocator* wexpr_Allocator_current (void);
+
+//
+/// \brief Allocate using the current allocator.
+//
+LIBWEXPR_PUBLIC void* wexpr_Allocator_alloc (size_t size);
+
+//
+/// \brief Reallocate using the current allocator. ptr can be NULL.
+//
+LIBWEXPR_PUBLIC void* wexpr_Allocator_realloc (void* ptr, size_t size);
+
+//
+/// \brief Free using the current allocator. Does nothing if ptr is NULL.
+//
+LIBWEXPR_PUBLIC void wexpr_Allocator_free (void* ptr);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_ALLOCATOR_H
@@ -31,6 +31,7 @@
 #ifndef LIBWEXPR_ERROR_H
 #define LIBWEXPR_ERROR_H
 
+#include "Allocator.h"
 #include "Macros.h"
 
 #include <stdint.h>
@@ -68,7 +69,17 @@ enum
 	WexprErrorCodeBinaryMultipleExpressions, ///< Found multiple expression chunks
 	WexprErrorCodeBinaryChunkBiggerThanData, ///< The chunk size said to expand past the buffer size
 	WexprErrorCodeBinaryChunkNotBigEnough, ///< The length of buffer given wasnt't big enough for a valid chunk.
-	WexprErrorCodeBinaryUnknownCompression ///< Unknown compression method received
+	WexprErrorCodeBinaryUnknownCompression, ///< Unknown compression method received
+	
+	WexprErrorCodeQueryInvalid, ///< A query path couldn't be understood
+	
+	WexprErrorCodePatchInvalid, ///< A patch was malformed, or couldn't be applied
+	
+	WexprErrorCodeBinaryUnknownReference, ///< A reference chunk referred to a definition which wasn't read yet
+	
+	WexprErrorCodeTooLarge, ///< A value, binary data, array or map was bigger than an expression can hold
+	
+	WexprErrorCodeBinaryUnknownChunkType ///< A chunk had a type that isn't known
 };
 
 typedef uint32_t WexprLineNumber;
@@ -107,7 +118,7 @@ typedef struct WexprError
 /// \brief Macro which frees an error. Call when done with the error variable, will cleanup as needed or not.
 //
 #define WEXPR_ERROR_FREE(err) \
-	if (err.message) { free(err.message); err.message = LIBWEXPR_NULLPTR; }
+	if (err.message) { wexpr_Allocator_free(err.message); err.message = LIBWEXPR_NULLPTR; }
 
 LIBWEXPR_EXTERN_C_END()
 
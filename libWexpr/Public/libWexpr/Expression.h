@@ -33,11 +33,15 @@
 
 #include "Error.h"
 #include "ExpressionType.h"
+#include "Key.h"
 #include "Macros.h"
 #include "ParseFlags.h"
+#include "Stats.h"
 #include "WriteFlags.h"
 
+#include <stdbool.h>
 #include <stddef.h> // size_t
+#include <stdint.h>
 
 LIBWEXPR_EXTERN_C_BEGIN()
 
@@ -79,6 +83,26 @@ typedef struct WexprBuffer
 	size_t byteSize;
 } WexprBuffer;
 
+//
+/// \brief Heap memory used by an expression tree, from wexpr_Expression_memoryUsage().
+/// Block sizes are what the library asked for, and dont include any overhead the allocator adds.
+//
+typedef struct WexprMemoryUsage
+{
+	size_t totalBytes; ///< All of the bytes below
+	size_t nodeBytes; ///< The expressions themselves
+	size_t stringBytes; ///< Values and map keys
+	size_t containerBytes; ///< Array storage and map tables, not counting what is in them
+	size_t binaryDataBytes; ///< Binary data
+	
+	size_t nodeCount; ///< Every expression in the tree
+	size_t nullCount;
+	size_t valueCount;
+	size_t arrayCount;
+	size_t mapCount;
+	size_t binaryDataCount;
+} WexprMemoryUsage;
+
 /// \name Construction/Destruction
 /// \{
 
@@ -118,6 +142,22 @@ LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryChunk (
 	const void* data, size_t length, WexprError* error
 );
 
+//
+/// \brief As wexpr_Expression_createFromLengthString(), also filling stats with what this parse cost.
+/// \param stats Filled with the counters for this call only. All 0 unless built with LIBWEXPR_STATS (see Stats.h).
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromLengthStringWithStats (
+	const char* str, size_t length, WexprParseFlags flags,
+	WexprError* error, WexprStats* stats
+);
+
+//
+/// \brief As wexpr_Expression_createFromBinaryChunk(), also filling stats with what this parse cost.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createFromBinaryChunkWithStats (
+	const void* data, size_t length, WexprError* error, WexprStats* stats
+);
+
 //
 /// \brief Creates an empty invalid expression. You own and must destroy.
 /// \return A newly created invalid expression, or null if it fails.
@@ -138,6 +178,7 @@ LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createValue (const char* val);
 
 //
 /// \brief Create a value expression from a length string.
+/// Returns NULL if longer than UINT32_MAX bytes.
 //
 LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createValueFromLengthString (const char* val, size_t length);
 
@@ -146,6 +187,18 @@ LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createValueFromLengthString (c
 //
 LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createCopy (WexprExpression* rhs);
 
+//
+/// \brief Create a copy of a frozen expression in constant time. You own the copy.
+///
+/// The snapshot shares rhs's arrays and maps, which is safe as rhs can't change. The snapshot itself is not frozen,
+/// but the children it shares are : to change one, fetch it from the top down with wexpr_Expression_arraySlotAt() and
+/// wexpr_Expression_mapSlotForKey() (or use wexpr_Query_createUpdated()). Each gives that one level its own copy first,
+/// so only the path to what is changed is ever duplicated.
+///
+/// If rhs isn't frozen, this is the same as wexpr_Expression_createCopy().
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_createSnapshot (WexprExpression* rhs);
+
 //
 /// \brief Destroy an expression that was created by a create* function.
 /// \param self The expression to destroy
@@ -181,6 +234,124 @@ LIBWEXPR_PUBLIC char* wexpr_Expression_createStringRepresentation (WexprExpressi
 //
 LIBWEXPR_PUBLIC WexprMutableBuffer wexpr_Expression_createBinaryRepresentation (WexprExpression* self);
 
+//
+/// \brief Create binary data which represents the expression, as wexpr_Expression_createBinaryRepresentation().
+/// With WexprWriteFlagShareRepeats, arrays and maps which appear more than once are written once in a definition chunk,
+/// and later ones as a small reference to it. Reading it back gives repeats which share their contents, as copies do.
+//
+LIBWEXPR_PUBLIC WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithFlags (WexprExpression* self, WexprWriteFlags flags);
+
+//
+/// \brief As wexpr_Expression_createStringRepresentation(), also filling stats with what this write cost.
+//
+LIBWEXPR_PUBLIC char* wexpr_Expression_createStringRepresentationWithStats (WexprExpression* self, size_t indent, WexprWriteFlags flags, WexprStats* stats);
+
+//
+/// \brief As wexpr_Expression_createBinaryRepresentationWithFlags(), also filling stats with what this write cost.
+//
+LIBWEXPR_PUBLIC WexprMutableBuffer wexpr_Expression_createBinaryRepresentationWithStats (WexprExpression* self, WexprWriteFlags flags, WexprStats* stats);
+
+//
+/// \brief Release any extra room reserved by an array or map, keeping its contents. Does not affect children.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_shrinkToFit (WexprExpression* self);
+
+//
+/// \brief Rebuild an expression into a single block of memory, laid out depth first with each value next to its node.
+///
+/// Walking the result touches memory in order, which helps when a document is read many times.
+/// The expression can still be changed afterwards, anything that grows is simply moved out of the block.
+/// Map tables are not part of the block.
+///
+/// \param self The expression to compact. Must be a root (not inside another expression), and is consumed.
+/// \return The compacted expression, which replaces self. If the block could not be allocated, returns self unchanged.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_compact (WexprExpression* self);
+
+//
+/// \brief Make an expression and all of its children immutable, until destroyed.
+///
+/// Reading a frozen expression never changes anything internally, so any number of threads can read it at once
+/// without locking: wexpr_Expression_value(), arrayAt(), mapValueForKey() and the other read functions, iterators,
+/// queries and creating string or binary representations. Extra room in arrays and maps is released.
+/// Functions that would change a frozen expression do nothing (taking returns NULL).
+///
+/// Copies made with wexpr_Expression_createCopy() share the frozen contents, are not frozen, and can be changed.
+/// Destroying a frozen expression is allowed, once nothing is reading it.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_freeze (WexprExpression* self);
+
+//
+/// \brief Returns true if the expression was frozen with wexpr_Expression_freeze().
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_isFrozen (WexprExpression* self);
+
+//
+/// \brief Returns true if both expressions have the same type and contents. Maps are equal regardless of order.
+///
+/// Parts shared between snapshots are equal without being compared, and frozen expressions with different
+/// hashes are unequal without being compared, so comparing versions of a document is fast.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_isEqual (WexprExpression* lhs, WexprExpression* rhs);
+
+//
+/// \brief Returns a hash of the type and contents, which is the same for equal expressions. Map order does not matter.
+/// Frozen expressions store their hash, so this is immediate for them. Otherwise the whole expression is read.
+//
+LIBWEXPR_PUBLIC uint64_t wexpr_Expression_hash (WexprExpression* self);
+
+//
+/// \brief Make identical arrays and maps within self share one copy of their contents.
+///
+/// Each repeat keeps its own node, but uses the reference counted storage of the first one found, the same way
+/// wexpr_Expression_createSnapshot() shares storage. Changing a shared part fetched with wexpr_Expression_arraySlotAt() or
+/// wexpr_Expression_mapSlotForKey() still only changes that part, as it gets its own copy first. Changing one fetched
+/// with the reading functions (wexpr_Expression_arrayAt() and so on) changes every repeat sharing it.
+/// Freeze first if the tree wont change again: freezing after would give each shared part back its own copy.
+/// Frozen parts only share with other frozen parts. Parts made by wexpr_Expression_compact() are left alone.
+/// Nothing else may be reading self at the time, even if frozen.
+///
+/// \return The number of bytes freed.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Expression_deduplicate (WexprExpression* self);
+
+//
+/// \brief Measure the heap memory self uses, including its map tables, array storage, keys and strings.
+///
+/// Storage and keys shared within the tree (by snapshots or wexpr_Expression_deduplicate()) are counted once.
+/// Storage self shares with expressions outside of it is counted in full, as self would keep it alive.
+///
+/// \param report Filled in with the bytes used by category, and the number of nodes by type. Can be NULL.
+/// \return The total bytes used.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Expression_memoryUsage (WexprExpression* self, WexprMemoryUsage* report);
+
+//
+/// \brief Create a patch of the changes which turn from into to. You own the patch.
+///
+/// The patch is an expression, so can be written and read as text or binary like any other. It is an array of operations
+/// applied in order, each a map with an op (add, remove or replace), a query path (see WexprQuery), and the value if adding or replacing:
+///
+///     #(
+///         @(op replace path servers/#1/limits/rps value 25)
+///         @(op remove path servers/#2)
+///         @(op add path servers/#0/region value west)
+///     )
+///
+/// Arrays are compared by index, with elements added or removed at the end. Branches shared between snapshots,
+/// or frozen with the same hash, are skipped without being compared. Neither from nor to are changed.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_diff (WexprExpression* from, WexprExpression* to);
+
+//
+/// \brief Apply a patch created by wexpr_Expression_diff() to self.
+///
+/// Either every operation is applied, or self is left as it was. Children fetched from self before must be fetched again.
+/// \param error Set with WexprErrorCodePatchInvalid if the patch is malformed or doesnt fit self. The line is the operation that failed, starting at 1.
+/// \return true if the patch was applied.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_applyPatch (WexprExpression* self, WexprExpression* patch, WexprError* error);
+
 /// \}
 
 /// \name Values
@@ -198,6 +369,7 @@ LIBWEXPR_PUBLIC void wexpr_Expression_valueSet (WexprExpression* self, const cha
 
 //
 /// \brief Set the value of the expression using a string with a length.
+/// Values longer than UINT32_MAX bytes are rejected, leaving the value unchanged.
 //
 LIBWEXPR_PUBLIC void wexpr_Expression_valueSetLengthString (WexprExpression* self, const char* str, size_t length);
 
@@ -218,6 +390,7 @@ LIBWEXPR_PUBLIC size_t wexpr_Expression_binaryData_size (WexprExpression* self);
 
 //
 /// \brief Set the binary data to use. Will copy it in.
+/// Data larger than UINT32_MAX bytes is rejected, leaving the data unchanged.
 //
 LIBWEXPR_PUBLIC void wexpr_Expression_binaryData_setValue (WexprExpression* self, const void* buffer, size_t byteSize);
 
@@ -237,12 +410,51 @@ LIBWEXPR_PUBLIC size_t wexpr_Expression_arrayCount (WexprExpression* self);
 //
 LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_arrayAt (WexprExpression* self, size_t index);
 
+//
+/// \brief Return the expression at the given index, to be changed in place. [0 .. arrayCount-1]
+///
+/// Same as wexpr_Expression_arrayAt(), except the array first gets its own copy of anything it shares with copies,
+/// so changing the expression returned does not change them. See wexpr_Expression_createCopy().
+/// \return The expression or NULL if invalid or frozen.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_arraySlotAt (WexprExpression* self, size_t index);
+
 //
 /// \brief Add an element to the end of the array.
 /// \param element The element to add. You MUST own, and we'll take ownership from you. Use wexpr_Expression_createCopy() if you need to add an un-owned pointer.
+/// If the array already holds UINT32_MAX elements or can't grow, the element is not added and you keep ownership.
 //
 LIBWEXPR_PUBLIC void wexpr_Expression_arrayAddElementToEnd (WexprExpression* self, WexprExpression* element);
 
+//
+/// \brief Make room for capacity elements, so adding up to that many does not need to allocate.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_arrayReserve (WexprExpression* self, size_t capacity);
+
+//
+/// \brief Insert an element into the array so it ends up at the given index. Elements after it move up one.
+/// \param index Where to insert [0 .. arrayCount]. If past the end, the element is added to the end.
+/// \param element The element to add. You MUST own, and we'll take ownership from you.
+/// Like wexpr_Expression_arrayAddElementToEnd(), you keep ownership if the array can't grow.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_arrayInsertAt (WexprExpression* self, size_t index, WexprExpression* element);
+
+//
+/// \brief Remove the element at the given index from the array, and return it. Elements after it move down one.
+/// \return The element, which is now owned by you and must be destroyed. NULL if out of range or not an array.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_arrayTakeAt (WexprExpression* self, size_t index);
+
+//
+/// \brief Remove the element at the given index from the array and destroy it. Does nothing if out of range.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_arrayRemoveAt (WexprExpression* self, size_t index);
+
+//
+/// \brief Swap the elements at the two indexes. Does nothing if either is out of range.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_arraySwap (WexprExpression* self, size_t indexA, size_t indexB);
+
 /// \}
 
 /// \name Map
@@ -255,11 +467,13 @@ LIBWEXPR_PUBLIC size_t wexpr_Expression_mapCount (WexprExpression* self);
 
 //
 /// \brief Return the key at a given index within the map.
+/// Walks the map to find the index, so use WexprMapIterator to go through the whole map.
 //
 LIBWEXPR_PUBLIC const char* wexpr_Expression_mapKeyAt (WexprExpression* self, size_t index);
 
 //
 /// \brief Return the value at a given index within the map.
+/// Walks the map to find the index, so use WexprMapIterator to go through the whole map.
 //
 LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapValueAt (WexprExpression* self, size_t index);
 
@@ -274,19 +488,64 @@ LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapValueForKey (WexprExpressio
 LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapValueForLengthKey (WexprExpression* self, const char* key, size_t length);
 
 //
-/// \brief Set the value for a given key in the map
+/// \brief Return the value for a precomputed key within the map, or NULL if not found.
+/// The fastest way to look up the same key repeatedly : never hashes or allocates.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapValueForKeyHandle (WexprExpression* self, const WexprKey* key);
+
+//
+/// \brief Set the value for a given key in the map. Replaces and destroys any existing value for the key.
 /// \param key The key to assign the value to.
-/// \param value The value to use. You MUST own, and we'll take ownership from you.
+/// \param value The value to use. You MUST own, and we'll take ownership from you, unless the map is unable to grow.
 //
 LIBWEXPR_PUBLIC void wexpr_Expression_mapSetValueForKey (WexprExpression* self, const char* key, WexprExpression* value);
 
 //
-/// \brief Set the value for a given key (lengthstr) in the map
+/// \brief Set the value for a given key (lengthstr) in the map. Replaces and destroys any existing value for the key.
 /// \param key The key to assign the value to.
 /// \param value The value to use. You MUST own, and we'll take ownership from you.
 //
 LIBWEXPR_PUBLIC void wexpr_Expression_mapSetValueForKeyLengthString (WexprExpression* self, const char* key, size_t length, WexprExpression* value);
 
+//
+/// \brief Make room for count key-value pairs, so adding up to that many does not need to grow the map.
+//
+LIBWEXPR_PUBLIC void wexpr_Expression_mapReserve (WexprExpression* self, size_t count);
+
+//
+/// \brief Return the value for a given key within the map, adding a null expression for it if missing.
+///
+/// Finds or inserts in a single lookup. The returned expression is owned by the map : fill it in
+/// with wexpr_Expression_changeType(), wexpr_Expression_valueSet() and so on. Like wexpr_Expression_arraySlotAt(),
+/// the map first gets its own copy of anything it shares with copies.
+/// \return The value, or NULL if not a map or unable to grow.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapSlotForKey (WexprExpression* self, const char* key);
+
+//
+/// \brief Return the value for a given key (lengthstr) within the map, adding a null expression for it if missing.
+/// \return The value, or NULL if not a map.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapSlotForLengthKey (WexprExpression* self, const char* key, size_t length);
+
+//
+/// \brief Remove the key from the map, and return its value.
+/// \return The value, which is now owned by you and must be destroyed. NULL if the key wasnt found or not a map.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapTakeValueForKey (WexprExpression* self, const char* key);
+
+//
+/// \brief Remove the key (lengthstr) from the map, and return its value.
+/// \return The value, which is now owned by you and must be destroyed. NULL if the key wasnt found or not a map.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Expression_mapTakeValueForLengthKey (WexprExpression* self, const char* key, size_t length);
+
+//
+/// \brief Remove the key from the map and destroy its value.
+/// \return true if the key was found and removed.
+//
+LIBWEXPR_PUBLIC bool wexpr_Expression_mapRemoveKey (WexprExpression* self, const char* key);
+
 /// \}
 
 LIBWEXPR_EXTERN_C_END()
@@ -0,0 +1,116 @@
+//
+/// \file libWexpr/Iterator.h
+/// \brief Walk the contents of arrays and maps
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_ITERATOR_H
+#define LIBWEXPR_ITERATOR_H
+
+#include "Expression.h"
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Walks the elements of an array in order.
+///
+/// Each step is constant time. Create on the stack, there is nothing to clean up.
+/// The array must not be changed while iterating.
+///
+///     WexprArrayIterator it;
+///     wexpr_ArrayIterator_init (&it, array);
+///     for (WexprExpression* child = wexpr_ArrayIterator_next (&it); child; child = wexpr_ArrayIterator_next (&it))
+///         ...
+//
+typedef struct WexprArrayIterator
+{
+	WexprExpression* m_array; ///< Private
+	size_t m_index; ///< Private
+} WexprArrayIterator;
+
+//
+/// \brief Walks the key/value pairs of a map, in the same order as wexpr_Expression_mapKeyAt().
+///
+/// Each step is constant time, unlike wexpr_Expression_mapKeyAt() and wexpr_Expression_mapValueAt().
+/// Create on the stack, there is nothing to clean up. The map must not be changed while iterating.
+///
+///     WexprMapIterator it;
+///     wexpr_MapIterator_init (&it, map);
+///     const char* key; WexprExpression* value;
+///     while (wexpr_MapIterator_next (&it, &key, &value))
+///         ...
+//
+typedef struct WexprMapIterator
+{
+	WexprExpression* m_map; ///< Private
+	int m_slot; ///< Private
+} WexprMapIterator;
+
+/// \name ArrayIterator
+/// \{
+
+//
+/// \brief Start iterating at the first element. If array is not an array, there are no elements.
+//
+LIBWEXPR_PUBLIC void wexpr_ArrayIterator_init (WexprArrayIterator* self, WexprExpression* array);
+
+//
+/// \brief Start iterating at the element at index.
+//
+LIBWEXPR_PUBLIC void wexpr_ArrayIterator_initAtIndex (WexprArrayIterator* self, WexprExpression* array, size_t index);
+
+//
+/// \brief Return the next element, or NULL if there are no more.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_ArrayIterator_next (WexprArrayIterator* self);
+
+/// \}
+
+/// \name MapIterator
+/// \{
+
+//
+/// \brief Start iterating at the first pair. If map is not a map, there are no pairs.
+//
+LIBWEXPR_PUBLIC void wexpr_MapIterator_init (WexprMapIterator* self, WexprExpression* map);
+
+//
+/// \brief Move to the next pair, returning false if there are no more.
+/// \param key Set to the key. Can be NULL.
+/// \param value Set to the value. Can be NULL.
+//
+LIBWEXPR_PUBLIC bool wexpr_MapIterator_next (WexprMapIterator* self, const char** key, WexprExpression** value);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_ITERATOR_H
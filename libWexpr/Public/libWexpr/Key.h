@@ -0,0 +1,67 @@
+//
+/// \file libWexpr/Key.h
+/// \brief Precomputed map keys for fast lookups
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_KEY_H
+#define LIBWEXPR_KEY_H
+
+#include "Macros.h"
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief A map key with its hash already computed.
+///
+/// Create once and reuse for lookups of the same key, so each lookup doesn't have to hash the string again.
+/// A key does not own its string, which must remain valid while the key is used (string literals are ideal).
+/// Keys need no cleanup.
+//
+typedef struct WexprKey
+{
+	const char* string; ///< The key, not owned. Does not need to be zero terminated.
+	size_t length; ///< Length of string in bytes.
+	uint32_t hash; ///< Hash of string.
+} WexprKey;
+
+//
+/// \brief Create a key from a zero terminated string.
+//
+LIBWEXPR_PUBLIC WexprKey wexpr_Key_fromString (const char* str);
+
+//
+/// \brief Create a key from a string and its length.
+//
+LIBWEXPR_PUBLIC WexprKey wexpr_Key_fromLengthString (const char* str, size_t length);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_KEY_H
@@ -0,0 +1,103 @@
+//
+/// \file libWexpr/PathIndex.h
+/// \brief Constant time lookup of any path in an expression
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_PATHINDEX_H
+#define LIBWEXPR_PATHINDEX_H
+
+#include "Expression.h"
+#include "Key.h"
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief An index of every expression in a tree by its full path.
+///
+/// Building walks the whole tree once. Afterwards any path is found with a single hash lookup,
+/// instead of one per level. Intended for large trees which are read often and rarely change.
+///
+/// Paths use the same form as WexprQuery, without wildcards, slices or negative indexes :
+/// keys and #N separated by '/', with an empty path being the root. eg: "servers/#0/limits/rps".
+/// In keys, '/' and '\\' are always escaped with a '\\', as is a leading '#' and a key of only '*'.
+/// Nothing else is escaped.
+///
+/// Changing or destroying any expression in an indexed tree invalidates the indexes built from that tree.
+/// Other trees, including copies of it, don't affect it. Expressions in more than one index at once, such as
+/// a subtree indexed on its own too, invalidate every index when changed. An invalid index finds nothing until rebuilt.
+//
+typedef struct WexprPathIndex WexprPathIndex;
+
+//
+/// \brief Build an index of expr and everything within it.
+//
+LIBWEXPR_PUBLIC WexprPathIndex* wexpr_PathIndex_build (WexprExpression* expr);
+
+//
+/// \brief Destroy the index. The expression is not affected.
+//
+LIBWEXPR_PUBLIC void wexpr_PathIndex_destroy (WexprPathIndex* self);
+
+//
+/// \brief Returns true if nothing indexed has changed since the index was built.
+//
+LIBWEXPR_PUBLIC bool wexpr_PathIndex_isValid (const WexprPathIndex* self);
+
+//
+/// \brief Build the index again from the same expression, which must still exist.
+//
+LIBWEXPR_PUBLIC void wexpr_PathIndex_rebuild (WexprPathIndex* self);
+
+//
+/// \brief Return the number of paths in the index.
+//
+LIBWEXPR_PUBLIC size_t wexpr_PathIndex_count (const WexprPathIndex* self);
+
+//
+/// \brief Return the expression at path, or NULL if there isn't one or the index is invalid.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_PathIndex_lookup (const WexprPathIndex* self, const char* path);
+
+//
+/// \brief Return the expression at path (w/length), or NULL if there isn't one or the index is invalid.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_PathIndex_lookupLengthString (const WexprPathIndex* self, const char* path, size_t length);
+
+//
+/// \brief Return the expression at a precomputed path, or NULL if there isn't one or the index is invalid.
+/// The fastest way to look up the same path repeatedly : never hashes or allocates.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_PathIndex_lookupKeyHandle (const WexprPathIndex* self, const WexprKey* path);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_PATHINDEX_H
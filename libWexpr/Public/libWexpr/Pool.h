@@ -0,0 +1,88 @@
+//
+/// \file libWexpr/Pool.h
+/// \brief Per-thread recycling of small allocations
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_POOL_H
+#define LIBWEXPR_POOL_H
+
+#include "Macros.h"
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Statistics about the current thread's pool.
+///
+/// Expressions, and small values and binary data, are recycled through free lists kept by each thread
+/// instead of going back to the allocator when destroyed. Blocks are grouped into size classes,
+/// so a destroyed node or short value can be handed straight to the next one created.
+///
+/// Pooling is off until a thread turns it on with wexpr_Pool_setMaxCachedBytes(), since nothing releases a
+/// thread's pool when it exits. Turn it on for long lived threads, and call wexpr_Pool_trim() before they exit.
+///
+/// Expressions can be destroyed on a different thread than created them. Their blocks go to the
+/// destroying thread's pool (or straight back to the allocator if it isn't pooling), and are reused from there.
+//
+typedef struct WexprPoolStats
+{
+	uint64_t hits; ///< Allocations served from the pool.
+	uint64_t misses; ///< Allocations that had to go to the allocator.
+	uint64_t recycled; ///< Frees kept in the pool for reuse.
+	uint64_t released; ///< Frees passed back to the allocator (too big, or the pool was full).
+	size_t cachedBlocks; ///< Blocks currently waiting in the pool.
+	size_t cachedBytes; ///< Bytes currently waiting in the pool.
+} WexprPoolStats;
+
+//
+/// \brief Return the statistics for the current thread's pool. The hit rate is hits / (hits + misses).
+//
+LIBWEXPR_PUBLIC WexprPoolStats wexpr_Pool_stats (void);
+
+//
+/// \brief Reset the counters for the current thread's pool. Cached blocks are kept.
+//
+LIBWEXPR_PUBLIC void wexpr_Pool_resetStats (void);
+
+//
+/// \brief Set the most bytes the current thread's pool will keep. 0 disables pooling for the thread.
+/// The default is 0, so pooling is off. Around 1MB suits most threads. Lowering it releases any blocks over the new limit.
+//
+LIBWEXPR_PUBLIC void wexpr_Pool_setMaxCachedBytes (size_t bytes);
+
+//
+/// \brief Give every block cached by the current thread's pool back to the allocator.
+/// Call before a thread that turned pooling on exits, or its cached blocks will be lost.
+//
+LIBWEXPR_PUBLIC void wexpr_Pool_trim (void);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_POOL_H
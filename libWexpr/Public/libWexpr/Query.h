@@ -0,0 +1,140 @@
+//
+/// \file libWexpr/Query.h
+/// \brief Find expressions using a path
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_QUERY_H
+#define LIBWEXPR_QUERY_H
+
+#include "Error.h"
+#include "Expression.h"
+#include "Macros.h"
+
+#include <stddef.h> // size_t
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief A compiled path used to find expressions.
+///
+/// A path is a list of steps separated by '/', each applied to the results of the previous step:
+/// - key : the value for the key in a map. eg: servers
+/// - #N : the element at index N in an array. Negative counts from the end, so #-1 is the last element.
+/// - #start:end : the elements from start up to (not including) end in an array. Either can be left out
+///     or negative, so #1: skips the first element.
+/// - * : every element of an array, or every value of a map.
+///
+/// Use \\ to escape a '/', '\\', '*' or '#' in a key. An empty path matches the expression itself.
+///
+/// Example : "servers/#0/limits/rps" or "servers/*/name".
+///
+/// Compile a query once, then evaluate it as many times as needed. Keys are hashed when compiled,
+/// so evaluating never hashes a key or allocates per step.
+//
+typedef struct WexprQuery WexprQuery;
+
+//
+/// \brief Iterates over the matches of a query.
+//
+typedef struct WexprQueryIterator WexprQueryIterator;
+
+/// \name Query
+/// \{
+
+//
+/// \brief Compile a query from a path. Returns NULL and sets error if the path is invalid.
+//
+LIBWEXPR_PUBLIC WexprQuery* wexpr_Query_compile (const char* path, WexprError* error);
+
+//
+/// \brief Compile a query from a path (w/length). Returns NULL and sets error if the path is invalid.
+//
+LIBWEXPR_PUBLIC WexprQuery* wexpr_Query_compileLengthString (const char* path, size_t length, WexprError* error);
+
+//
+/// \brief Destroy a query.
+//
+LIBWEXPR_PUBLIC void wexpr_Query_destroy (WexprQuery* self);
+
+//
+/// \brief Start finding the matches of the query within expr. Use wexpr_QueryIterator_next() to get each one.
+/// expr must not be changed while iterating.
+//
+LIBWEXPR_PUBLIC WexprQueryIterator* wexpr_Query_evaluate (const WexprQuery* self, WexprExpression* expr);
+
+//
+/// \brief Return the first match of the query within expr, or NULL if there are none. Does not allocate or change expr.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Query_first (const WexprQuery* self, WexprExpression* expr);
+
+/// \}
+
+/// \name QueryIterator
+/// \{
+
+//
+/// \brief Return the next match, or NULL if there are no more. Matches are owned by the expression.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_QueryIterator_next (WexprQueryIterator* self);
+
+//
+/// \brief Start over, finding the matches within expr. Lets an iterator be reused without allocating.
+//
+LIBWEXPR_PUBLIC void wexpr_QueryIterator_reset (WexprQueryIterator* self, WexprExpression* expr);
+
+//
+/// \brief Destroy the iterator.
+//
+LIBWEXPR_PUBLIC void wexpr_QueryIterator_destroy (WexprQueryIterator* self);
+
+/// \}
+
+/// \name Versions
+/// \{
+
+//
+/// \brief Create a new version of root with the expression at the query's path replaced, leaving root as it was.
+///
+/// If root is frozen, the new version shares everything that did not change with it (see wexpr_Expression_createSnapshot()),
+/// so keeping many versions costs memory for the changes, and the arrays and maps along the path. The new version
+/// is frozen too, letting readers swap between versions safely. Otherwise root is copied in full first.
+///
+/// The path may only use keys and #N indexes. Every step but the last must exist. The last step can
+/// be a new key in a map, or an existing index in an array.
+///
+/// \param root The expression to start from. Not changed.
+/// \param value The new expression, which we take ownership of. NULL removes the key or element instead.
+/// \return The new version which you own, or NULL (with value destroyed) if the path could not be followed.
+//
+LIBWEXPR_PUBLIC WexprExpression* wexpr_Query_createUpdated (const WexprQuery* self, WexprExpression* root, WexprExpression* value);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_QUERY_H
@@ -0,0 +1,105 @@
+//
+/// \file libWexpr/Shape.h
+/// \brief Measures the shape of a document without loading it
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_SHAPE_H
+#define LIBWEXPR_SHAPE_H
+
+#include "Error.h"
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Number of buckets in each WexprShape histogram.
+///
+/// Bucket 0 counts lengths of 0, and bucket b counts lengths from 2^(b-1) to 2^b - 1.
+/// The last bucket also counts everything longer.
+//
+#define WEXPR_SHAPE_BUCKET_COUNT 16
+
+//
+/// \brief The shape of a document : what it holds and how it is nested, as written.
+///
+/// Found in one pass over the text or binary, without creating any expressions, so large documents can be
+/// looked at cheaply. Useful for choosing between formats and settings for the data you actually have.
+///
+/// References are not nodes themselves. Each one inserting a copy is counted in referenceCount,
+/// and expandedNodeCount is the number of nodes there would be with every reference inserted.
+//
+typedef struct WexprShape
+{
+	size_t nodeCount; ///< Every expression written, not counting map keys
+	size_t nullCount;
+	size_t valueCount;
+	size_t arrayCount;
+	size_t mapCount;
+	size_t binaryDataCount;
+	
+	size_t maxDepth; ///< The root is at depth 1
+	uint64_t depthTotal; ///< Depth of every node added together. Divide by nodeCount for the average.
+	
+	size_t arrayLengths[WEXPR_SHAPE_BUCKET_COUNT]; ///< Arrays by their number of elements
+	size_t mapSizes[WEXPR_SHAPE_BUCKET_COUNT]; ///< Maps by their number of pairs
+	size_t valueLengths[WEXPR_SHAPE_BUCKET_COUNT]; ///< Values by their length in bytes
+	
+	uint64_t valueBytes; ///< Bytes in every value, not counting map keys
+	size_t maxValueLength;
+	
+	uint64_t binaryDataBytes; ///< Bytes of binary data, once decoded from base64
+	
+	size_t referenceDefinitionCount; ///< [name] in text, or definition chunks in binary
+	size_t referenceCount; ///< *[name] in text, or reference chunks in binary
+	size_t expandedNodeCount; ///< nodeCount with every reference inserted. Compare to nodeCount for how much references save.
+} WexprShape;
+
+//
+/// \brief Find the shape of a document written as text.
+/// \return true on success. On failure, error is filled in and self is left as far as it got.
+//
+LIBWEXPR_PUBLIC bool wexpr_Shape_fromLengthString (WexprShape* self, const char* str, size_t length, WexprError* error);
+
+//
+/// \brief Find the shape of a binary expression chunk, as given to wexpr_Expression_createFromBinaryChunk().
+/// \return true on success. On failure, error is filled in and self is left as far as it got.
+//
+LIBWEXPR_PUBLIC bool wexpr_Shape_fromBinaryChunk (WexprShape* self, const void* data, size_t length, WexprError* error);
+
+//
+/// \brief Return the histogram bucket a length is counted in.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Shape_bucketForLength (size_t length);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_SHAPE_H
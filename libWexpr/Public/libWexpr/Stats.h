@@ -0,0 +1,74 @@
+//
+/// \file libWexpr/Stats.h
+/// \brief Counters of the work done by the library
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_STATS_H
+#define LIBWEXPR_STATS_H
+
+#include "Macros.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Counts of the work the library has done on the current thread.
+///
+/// Counting is only compiled in when the library is built with LIBWEXPR_STATS (the cmake option of the same name).
+/// Otherwise every counter stays 0, and counting costs nothing.
+//
+typedef struct WexprStats
+{
+	uint64_t allocations; ///< Blocks allocated, from the allocator or the pool. Includes blocks handed back to you.
+	uint64_t reallocations; ///< Blocks resized through the allocator.
+	uint64_t frees; ///< Blocks freed, to the allocator or the pool.
+	uint64_t bytesAllocated; ///< Bytes asked for by allocations and reallocations.
+	uint64_t nodes; ///< Expressions created, not counting ones inside a compacted arena.
+	uint64_t hashProbes; ///< Slots looked at while finding keys in maps.
+} WexprStats;
+
+//
+/// \brief Return if the library was built with LIBWEXPR_STATS, so the counters are kept.
+//
+LIBWEXPR_PUBLIC bool wexpr_Stats_isEnabled (void);
+
+//
+/// \brief Return the counters for the current thread.
+//
+LIBWEXPR_PUBLIC WexprStats wexpr_Stats_get (void);
+
+//
+/// \brief Reset the counters for the current thread to 0.
+//
+LIBWEXPR_PUBLIC void wexpr_Stats_reset (void);
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_STATS_H
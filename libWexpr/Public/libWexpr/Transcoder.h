@@ -0,0 +1,123 @@
+//
+/// \file libWexpr/Transcoder.h
+/// \brief Converts between wexpr formats without building expressions
+//
+// #LICENSE_BEGIN:MIT#
+// 
+// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+// #LICENSE_END#
+//
+
+#ifndef LIBWEXPR_TRANSCODER_H
+#define LIBWEXPR_TRANSCODER_H
+
+#include "Error.h"
+#include "Macros.h"
+#include "Shape.h"
+#include "WriteFlags.h"
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+
+LIBWEXPR_EXTERN_C_BEGIN()
+
+//
+/// \brief Receives output as it is generated.
+/// write() is called with each piece of output in order. The data is only valid for the duration of the call.
+/// A NULL write() discards the output, such as for a WexprTranscoder only measuring a shape.
+//
+typedef struct WexprSink
+{
+	void (*write) (void* userData, const char* data, size_t length);
+	void* userData; ///< Passed to write() as is.
+} WexprSink;
+
+//
+/// \brief Write the text representation of a binary expression chunk to a sink, without creating an expression.
+///
+/// The output is identical to creating the expression with wexpr_Expression_createFromBinaryChunk() and
+/// calling wexpr_Expression_createStringRepresentation(), except that maps are written in the order they are stored.
+/// Memory usage does not depend on the size of the chunk, apart from a copy of each definition chunk
+/// (see WexprWriteFlagShareRepeats). To transcode a chunk without having all of it in memory, use a WexprTranscoder.
+///
+/// \param data The expression chunk (not the file header).
+/// \param length The length of data in bytes.
+/// \param indent The starting indent level, generally 0. Will use tabs to indent.
+/// \param flags Flags about writing.
+/// \param sink Where the text is written to. On error, the output written so far is incomplete.
+/// \param error Will store error information if any occurs.
+/// \return The number of bytes of data used by the chunk, or 0 if an error occurred.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Transcoder_binaryChunkToString (
+	const void* data, size_t length, size_t indent, WexprWriteFlags flags,
+	WexprSink sink, WexprError* error
+);
+
+//
+/// \brief Writes the text representation of a binary expression chunk as its bytes are given, see wexpr_Transcoder_binaryChunkToString().
+///
+/// Feed the chunk in blocks of any size with wexpr_Transcoder_write() until wexpr_Transcoder_isDone().
+/// Values and references split across blocks are gathered, binary data is encoded as it arrives.
+//
+typedef struct WexprTranscoder WexprTranscoder;
+
+/// \name Transcoder
+/// \{
+
+//
+/// \brief Create a transcoder for one expression chunk.
+/// \param indent The starting indent level, generally 0. Will use tabs to indent.
+/// \param flags Flags about writing.
+/// \param sink Where the text is written to.
+//
+LIBWEXPR_PUBLIC WexprTranscoder* wexpr_Transcoder_create (size_t indent, WexprWriteFlags flags, WexprSink sink);
+
+//
+/// \brief Destroy a transcoder.
+//
+LIBWEXPR_PUBLIC void wexpr_Transcoder_destroy (WexprTranscoder* self);
+
+//
+/// \brief Give the next bytes of the chunk. Output is passed to the sink before returning.
+/// \return The number of bytes used, which is less than length if the chunk ended within data.
+/// Returns 0 if an error occurred (the transcoder is unusable afterwards), or if the chunk already ended.
+//
+LIBWEXPR_PUBLIC size_t wexpr_Transcoder_write (WexprTranscoder* self, const void* data, size_t length, WexprError* error);
+
+//
+/// \brief Also measure the shape of the chunk as it is read, giving the same result as wexpr_Shape_fromBinaryChunk().
+/// Call before the first wexpr_Transcoder_write(). shape is cleared here, and complete once wexpr_Transcoder_isDone().
+/// shape must outlive the transcoder. On error, shape is left as far as it got.
+//
+LIBWEXPR_PUBLIC void wexpr_Transcoder_measureShape (WexprTranscoder* self, WexprShape* shape);
+
+//
+/// \brief Returns true once the whole chunk was given and written.
+//
+LIBWEXPR_PUBLIC bool wexpr_Transcoder_isDone (const WexprTranscoder* self);
+
+/// \}
+
+LIBWEXPR_EXTERN_C_END()
+
+#endif // LIBWEXPR_TRANSCODER_H
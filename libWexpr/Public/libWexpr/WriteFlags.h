@@ -46,6 +46,7 @@ enum
 {
 	WexprWriteFlagNone = 0, ///< No special flags
 	WexprWriteFlagHumanReadable = (1 << 0), ///< Instead of trying to compress down, will add newlines and indentation to make it more readable.
+	WexprWriteFlagShareRepeats = (1 << 1), ///< Binary only. Repeated arrays and maps are written once, then referred back to. Needs a reader which supports definition chunks.
 };
 
 LIBWEXPR_EXTERN_C_END()
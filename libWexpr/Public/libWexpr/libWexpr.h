@@ -31,12 +31,21 @@
 #ifndef LIBWEXPR_LIBWEXPR_H
 #define LIBWEXPR_LIBWEXPR_H
 
+#include "Allocator.h"
 #include "Endian.h"
 #include "Error.h"
 #include "Expression.h"
 #include "ExpressionType.h"
+#include "Iterator.h"
+#include "Key.h"
 #include "Macros.h"
 #include "ParseFlags.h"
+#include "PathIndex.h"
+#include "Pool.h"
+#include "Query.h"
+#include "Shape.h"
+#include "Stats.h"
+#include "Transcoder.h"
 
 #define LIBWEXPR_VERSION_MAJOR 1
 #define LIBWEXPR_VERSION_MINOR 0
@@ -0,0 +1,142 @@
+//
+/// \file Allocator.h
+/// \brief Allocator tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_ALLOCATOR_H
+#define WEXPR_TESTS_ALLOCATOR_H
+
+#include <libWexpr/Allocator.h>
+#include <libWexpr/Expression.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+// counts live allocations so we can check everything went through it
+typedef struct CountingAllocatorStats
+{
+	size_t allocations;
+	size_t live;
+} CountingAllocatorStats;
+
+static void* s_countingAlloc (void* userData, size_t size)
+{
+	CountingAllocatorStats* stats = userData;
+	++stats->allocations;
+	++stats->live;
+	return malloc (size);
+}
+
+static void* s_countingRealloc (void* userData, void* ptr, size_t size)
+{
+	CountingAllocatorStats* stats = userData;
+	if (!ptr)
+	{
+		++stats->allocations;
+		++stats->live;
+	}
+	
+	return realloc (ptr, size);
+}
+
+static void s_countingFree (void* userData, void* ptr)
+{
+	CountingAllocatorStats* stats = userData;
+	--stats->live;
+	free (ptr);
+}
+
+WEXPR_UNITTEST_BEGIN(AllocatorIsUsedForThread)
+	CountingAllocatorStats stats = { 0, 0 };
+	WexprAllocator allocator = { s_countingAlloc, s_countingRealloc, s_countingFree, &stats };
+	
+	const WexprAllocator* previous = wexpr_Allocator_setForThread (&allocator);
+	WEXPR_UNITTEST_ASSERT (wexpr_Allocator_current () == &allocator, "Thread allocator should be current");
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a #(1 2 <aGVsbG8=>) b @(c d))", WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (expr, "Should parse");
+	
+	char* str = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagHumanReadable);
+	wexpr_Allocator_free (str);
+	
+	wexpr_Expression_destroy (expr);
+	
+	// errors are allocated too
+	wexpr_Expression_createFromString ("#(", WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (err.message, "Should have an error message");
+	WEXPR_ERROR_FREE (err);
+	
+	wexpr_Allocator_setForThread (previous);
+	
+	WEXPR_UNITTEST_ASSERT (stats.allocations > 0, "Allocator should have been used");
+	WEXPR_UNITTEST_ASSERT (stats.live == 0, "Everything should have been freed through the allocator");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(AllocatorCanBeSetGlobally)
+	CountingAllocatorStats stats = { 0, 0 };
+	WexprAllocator allocator = { s_countingAlloc, s_countingRealloc, s_countingFree, &stats };
+	
+	wexpr_Allocator_setGlobal (&allocator);
+	
+	WexprExpression* expr = wexpr_Expression_createValue ("value");
+	wexpr_Expression_destroy (expr);
+	
+	wexpr_Allocator_setGlobal (NULL);
+	
+	WEXPR_UNITTEST_ASSERT (stats.allocations > 0, "Allocator should have been used");
+	WEXPR_UNITTEST_ASSERT (stats.live == 0, "Everything should have been freed through the allocator");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(AllocatorRefusesSwitchingWithLiveMemory)
+	CountingAllocatorStats stats = { 0, 0 };
+	WexprAllocator allocator = { s_countingAlloc, s_countingRealloc, s_countingFree, &stats };
+	
+	const WexprAllocator* previous = wexpr_Allocator_setForThread (&allocator);
+	WexprExpression* expr = wexpr_Expression_createFromString ("#(a b c)", WexprParseFlagNone, NULL);
+	
+	// the document would be freed into the wrong allocator
+	wexpr_Allocator_setForThread (previous);
+	WEXPR_UNITTEST_ASSERT (wexpr_Allocator_current () == &allocator, "Switching should be refused while the document is alive");
+	
+	wexpr_Expression_destroy (expr);
+	
+	wexpr_Allocator_setForThread (previous);
+	WEXPR_UNITTEST_ASSERT (wexpr_Allocator_current () != &allocator, "Switching should work once everything is freed");
+	WEXPR_UNITTEST_ASSERT (stats.live == 0, "Everything should have been freed through the allocator");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Allocator)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Allocator, AllocatorIsUsedForThread);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Allocator, AllocatorCanBeSetGlobally);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Allocator, AllocatorRefusesSwitchingWithLiveMemory);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_ALLOCATOR_H
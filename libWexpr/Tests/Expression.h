@@ -32,6 +32,7 @@
 #define WEXPR_TESTS_EXPRESSION_H
 
 #include <libWexpr/Expression.h>
+#include <libWexpr/Iterator.h>
 
 #include <stdbool.h>
 
@@ -270,6 +271,46 @@ WEXPR_UNITTEST_BEGIN (ExpressionCanDerefMapProperly)
 	WEXPR_ERROR_FREE (err);
 WEXPR_UNITTEST_END()
 
+WEXPR_UNITTEST_BEGIN (ExpressionSharesParsedMapKeys)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("#(@(id 1) @(id 2))", WexprParseFlagNone, &err);
+	
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeNone, "Should have no error");
+	
+	const char* key1 = wexpr_Expression_mapKeyAt (wexpr_Expression_arrayAt(expr, 0), 0);
+	const char* key2 = wexpr_Expression_mapKeyAt (wexpr_Expression_arrayAt(expr, 1), 0);
+	
+	WEXPR_UNITTEST_ASSERT (key1 == key2, "Identical keys should be shared");
+	
+	// copies share keys too, and must outlive the original
+	WexprExpression* copy = wexpr_Expression_createCopy (wexpr_Expression_arrayAt(expr, 1));
+	wexpr_Expression_destroy(expr);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_mapKeyAt(copy, 0), "id") == 0, "Copy should keep its key");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForLengthKey(copy, "idx", 2)), "2") == 0,
+		"Should find by length key"
+	);
+	
+	wexpr_Expression_destroy(copy);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN (ExpressionCanLookupWithKeyHandle)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("@(name bob age 42)", WexprParseFlagNone, &err);
+	
+	WexprKey nameKey = wexpr_Key_fromString ("name");
+	WexprKey ageKey = wexpr_Key_fromLengthString ("agexxx", 3);
+	WexprKey missingKey = wexpr_Key_fromString ("missing");
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKeyHandle(expr, &nameKey)), "bob") == 0, "Should find name");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKeyHandle(expr, &ageKey)), "42") == 0, "Should find age");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapValueForKeyHandle(expr, &missingKey) == NULL, "Should not find missing");
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
 WEXPR_UNITTEST_BEGIN (ExpressionCanCreateString)
 	WexprError err = WEXPR_ERROR_INIT();
 	WexprExpression* expr = wexpr_Expression_createFromString(
@@ -386,6 +427,530 @@ WEXPR_UNITTEST_BEGIN(ExpressionCanSetInMap)
 	
 WEXPR_UNITTEST_END()
 
+WEXPR_UNITTEST_BEGIN(ExpressionCanMoveArrayElements)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("#(a b c)", WexprParseFlagNone, &err);
+	
+	WexprExpression* b = wexpr_Expression_arrayTakeAt (expr, 1);
+	WEXPR_UNITTEST_ASSERT (b && strcmp(wexpr_Expression_value(b), "b") == 0, "Should take b");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount(expr) == 2, "Should have 2 left");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayTakeAt (expr, 2) == NULL, "Out of range take should return NULL");
+	
+	wexpr_Expression_arrayInsertAt (expr, 0, b);
+	wexpr_Expression_arraySwap (expr, 1, 2);
+	wexpr_Expression_arrayRemoveAt (expr, 0);
+	
+	char* str = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp(str, "#(c a)") == 0, "Array should be #(c a)");
+	free (str);
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanMoveMapValues)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("@(a 1 b #(2) c 3)", WexprParseFlagNone, &err);
+	
+	WexprExpression* b = wexpr_Expression_mapTakeValueForKey (expr, "b");
+	WEXPR_UNITTEST_ASSERT (b && wexpr_Expression_type(b) == WexprExpressionTypeArray, "Should take b's array");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(expr) == 2, "Should have 2 left");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapTakeValueForKey (expr, "b") == NULL, "b should be gone");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapRemoveKey (expr, "a"), "Should remove a");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_mapRemoveKey (expr, "a"), "a should be gone");
+	
+	wexpr_Expression_mapSetValueForKey (expr, "b", b);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapValueForKey (expr, "b") == b, "Should move b back without copying");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapValueForKey (expr, "c") != NULL, "c should remain");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(expr) == 2, "Should have 2 pairs");
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionReplacesDuplicateMapKeys)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString("@(a 1 a 2)", WexprParseFlagNone, &err);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(expr) == 1, "Duplicate key should only be stored once");
+	WEXPR_UNITTEST_ASSERT (strcmp(wexpr_Expression_value(wexpr_Expression_mapValueForKey(expr, "a")), "2") == 0, "Last value should win");
+	
+	wexpr_Expression_mapSetValueForKey (expr, "a", wexpr_Expression_createValue("3"));
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(expr) == 1, "Setting an existing key should replace it");
+	
+	WexprExpression* slot = wexpr_Expression_mapSlotForKey (expr, "b");
+	WEXPR_UNITTEST_ASSERT (slot && wexpr_Expression_type(slot) == WexprExpressionTypeNull, "New slot should be null");
+	wexpr_Expression_changeType (slot, WexprExpressionTypeValue);
+	wexpr_Expression_valueSet (slot, "4");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapSlotForKey (expr, "a") == wexpr_Expression_mapValueForKey (expr, "a"), "Existing slot should be returned");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount(expr) == 2, "Should have 2 pairs");
+	
+	char* str = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strstr(str, "a 3") && strstr(str, "b 4"), "Map should contain a 3 and b 4");
+	free (str);
+	
+	wexpr_Expression_destroy(expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanReserveAndShrink)
+	WexprExpression* array = wexpr_Expression_createNull();
+	wexpr_Expression_changeType (array, WexprExpressionTypeArray);
+	wexpr_Expression_arrayReserve (array, 1000);
+	
+	WexprExpression* map = wexpr_Expression_createNull();
+	wexpr_Expression_changeType (map, WexprExpressionTypeMap);
+	wexpr_Expression_mapReserve (map, 1000);
+	
+	char key[16];
+	for (int i = 0; i < 1000; ++i)
+	{
+		snprintf (key, sizeof(key), "%d", i);
+		wexpr_Expression_arrayAddElementToEnd (array, wexpr_Expression_createValue (key));
+		wexpr_Expression_mapSetValueForKey (map, key, wexpr_Expression_createValue (key));
+	}
+	
+	for (int i = 0; i < 990; ++i)
+	{
+		snprintf (key, sizeof(key), "%d", i);
+		wexpr_Expression_arrayRemoveAt (array, 0);
+		wexpr_Expression_mapRemoveKey (map, key);
+	}
+	
+	wexpr_Expression_shrinkToFit (array);
+	wexpr_Expression_shrinkToFit (map);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (array) == 10, "Array should have 10 left");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_arrayAt (array, 9)), "999") == 0, "Array should end with 999");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount (map) == 10, "Map should have 10 left");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapValueForKey (map, "995"), "Map should still find 995");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_mapValueForKey (map, "5"), "Map should not find 5");
+	
+	wexpr_Expression_destroy (array);
+	wexpr_Expression_destroy (map);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanCompact)
+	const char* text = "@(name bob list #(a \"b c\" <aGVsbG8=> @(x y)) empty #())";
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString (text, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	char* before = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	expr = wexpr_Expression_compact (expr);
+	char* after = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (before, after) == 0, "Compacting should not change the expression");
+	
+	WexprExpression* list = wexpr_Expression_mapValueForKey (expr, "list");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (list) == 4, "List should have 4 elements");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_arrayAt (list, 1)), "b c") == 0, "Second element should be 'b c'");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_binaryData_size (wexpr_Expression_arrayAt (list, 2)) == 5, "Binary data should be 5 bytes");
+	
+	// everything can still be changed
+	wexpr_Expression_valueSet (wexpr_Expression_mapValueForKey (expr, "name"), "a much longer name than before");
+	wexpr_Expression_arrayAddElementToEnd (list, wexpr_Expression_createValue ("d"));
+	wexpr_Expression_arrayAddElementToEnd (wexpr_Expression_mapValueForKey (expr, "empty"), wexpr_Expression_createValue ("e"));
+	
+	WexprExpression* taken = wexpr_Expression_arrayTakeAt (list, 3);
+	wexpr_Expression_arrayRemoveAt (list, 0);
+	WexprExpression* name = wexpr_Expression_mapTakeValueForKey (expr, "name");
+	
+	char* changed = wexpr_Expression_createStringRepresentation (list, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp (changed, "#(\"b c\" <aGVsbG8=> d)") == 0, "Changes should apply");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapCount (expr) == 2, "Name should be gone");
+	
+	// taken expressions outlive the block
+	wexpr_Expression_destroy (expr);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (taken, "x")), "y") == 0, "Taken map should still work");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (name), "a much longer name than before") == 0, "Taken value should still work");
+	
+	wexpr_Expression_destroy (taken);
+	wexpr_Expression_destroy (name);
+	
+	free (before);
+	free (after);
+	free (changed);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCopiesAreIndependent)
+	const char* text = "@(server @(host example.com ports #(80 443)) data <aGVsbG8=>)";
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* original = wexpr_Expression_createFromString (text, WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (original, "Cannot create expression");
+	
+	char* before = wexpr_Expression_createStringRepresentation (original, 0, WexprWriteFlagNone);
+	
+	// change deep inside the copy
+	WexprExpression* copy = wexpr_Expression_createCopy (original);
+	WexprExpression* ports = wexpr_Expression_mapSlotForKey (wexpr_Expression_mapSlotForKey (copy, "server"), "ports");
+	wexpr_Expression_valueSet (wexpr_Expression_arraySlotAt (ports, 0), "8080");
+	wexpr_Expression_arrayAddElementToEnd (ports, wexpr_Expression_createValue ("22"));
+	
+	char* afterCopyChanged = wexpr_Expression_createStringRepresentation (original, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp (before, afterCopyChanged) == 0, "Changing the copy should not change the original");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (ports) == 3, "Copy should have the new port");
+	
+	// change the original, copy keeps what it had
+	WexprExpression* copy2 = wexpr_Expression_createCopy (original);
+	wexpr_Expression_mapRemoveKey (wexpr_Expression_mapSlotForKey (original, "server"), "host");
+	
+	WexprExpression* server2 = wexpr_Expression_mapValueForKey (copy2, "server");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (server2, "host")), "example.com") == 0, "Copy should still have the host");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_binaryData_size (wexpr_Expression_mapValueForKey (copy2, "data")) == 5, "Copy should have the binary data");
+	
+	// copies outlive what they were copied from
+	wexpr_Expression_destroy (original);
+	
+	char* copy2String = wexpr_Expression_createStringRepresentation (copy2, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp (before, copy2String) == 0, "Second copy should match the original before it changed");
+	
+	wexpr_Expression_destroy (copy);
+	wexpr_Expression_destroy (copy2);
+	
+	free (before);
+	free (afterCopyChanged);
+	free (copy2String);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionReadingCopiesKeepsChildren)
+	WexprExpression* source = wexpr_Expression_createFromString ("@(list #(a b) name bob)", WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (source, "Cannot create expression");
+	
+	WexprExpression* list = wexpr_Expression_mapValueForKey (source, "list");
+	WexprExpression* first = wexpr_Expression_arrayAt (list, 0);
+	
+	// reading the source while a copy shares it leaves its children where they were
+	WexprExpression* copy = wexpr_Expression_createCopy (source);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapValueForKey (source, "list") == list, "Reading should not move children");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayAt (list, 0) == first, "Reading should not move children");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_mapValueAt (source, 0) != NULL, "Should read by index");
+	
+	WexprArrayIterator arrayIt;
+	wexpr_ArrayIterator_init (&arrayIt, list);
+	WEXPR_UNITTEST_ASSERT (wexpr_ArrayIterator_next (&arrayIt) == first, "Iterating should not move children");
+	
+	WexprMapIterator mapIt;
+	wexpr_MapIterator_init (&mapIt, source);
+	while (wexpr_MapIterator_next (&mapIt, NULL, NULL)) {}
+	
+	wexpr_Expression_destroy (copy);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (first), "a") == 0, "Children should outlive the copy");
+	
+	wexpr_Expression_destroy (source);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCopiedChildrenAreIndependent)
+	const char* text = "@(list #(1 2 3) a @(b x))";
+	
+	WexprExpression* original = wexpr_Expression_createFromString (text, WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (original, "Cannot create expression");
+	
+	char* before = wexpr_Expression_createStringRepresentation (original, 0, WexprWriteFlagNone);
+	
+	// change children fetched by reading the copy
+	WexprExpression* copy = wexpr_Expression_createCopy (original);
+	wexpr_Expression_valueSet (wexpr_Expression_mapValueForKey (wexpr_Expression_mapValueForKey (copy, "a"), "b"), "CHANGED");
+	wexpr_Expression_arrayAddElementToEnd (wexpr_Expression_mapValueForKey (copy, "list"), wexpr_Expression_createValue ("4"));
+	
+	char* after = wexpr_Expression_createStringRepresentation (original, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp (before, after) == 0, "Changing the copy's children should not change the original");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (wexpr_Expression_mapValueForKey (copy, "list")) == 4, "Copy should change");
+	
+	// and the other way around
+	wexpr_Expression_valueSet (wexpr_Expression_arrayAt (wexpr_Expression_mapValueForKey (original, "list"), 0), "0");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_arrayAt (wexpr_Expression_mapValueForKey (copy, "list"), 0)), "1") == 0,
+		"Changing the original's children should not change the copy"
+	);
+	
+	free (before);
+	free (after);
+	wexpr_Expression_destroy (copy);
+	wexpr_Expression_destroy (original);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionReferencesAreIndependent)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a [p]@(x 1 list #(a)) b *[p] c *[p])", WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprExpression* b = wexpr_Expression_mapValueForKey (expr, "b");
+	wexpr_Expression_valueSet (wexpr_Expression_mapValueForKey (b, "x"), "2");
+	wexpr_Expression_arrayAddElementToEnd (wexpr_Expression_mapValueForKey (b, "list"), wexpr_Expression_createValue ("b"));
+	
+	const char* names[] = { "a", "c" };
+	for (size_t i=0; i < 2; ++i)
+	{
+		WexprExpression* other = wexpr_Expression_mapValueForKey (expr, names[i]);
+		WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (other, "x")), "1") == 0, "Other expansions should not change");
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (wexpr_Expression_mapValueForKey (other, "list")) == 1, "Other expansions should not change");
+	}
+	
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanFreeze)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(name bob list #(a b c))", WexprParseFlagNone, &err);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	wexpr_Expression_freeze (expr);
+	
+	WexprExpression* list = wexpr_Expression_mapValueForKey (expr, "list");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isFrozen (expr) && wexpr_Expression_isFrozen (list), "Whole tree should be frozen");
+	
+	// changes are ignored
+	wexpr_Expression_valueSet (wexpr_Expression_mapValueForKey (expr, "name"), "alice");
+	wexpr_Expression_arrayRemoveAt (list, 0);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_arrayTakeAt (list, 0), "Cannot take from a frozen array");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_mapRemoveKey (expr, "name"), "Cannot remove from a frozen map");
+	wexpr_Expression_changeType (expr, WexprExpressionTypeNull);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (expr, "name")), "bob") == 0, "Name should not change");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (list) == 3, "List should not change");
+	
+	// copies can change
+	WexprExpression* copy = wexpr_Expression_createCopy (expr);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_isFrozen (copy), "Copy should not be frozen");
+	
+	wexpr_Expression_arrayRemoveAt (wexpr_Expression_mapSlotForKey (copy, "list"), 0);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (wexpr_Expression_mapValueForKey (copy, "list")) == 2, "Copy should change");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_arrayCount (list) == 3, "Frozen list should not change with the copy");
+	
+	wexpr_Expression_destroy (expr);
+	wexpr_Expression_destroy (copy);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanSnapshot)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(server @(host example.com ports #(80 443)) name bob)", WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	// not frozen : a full copy
+	WexprExpression* copy = wexpr_Expression_createSnapshot (expr);
+	wexpr_Expression_valueSet (wexpr_Expression_mapValueForKey (copy, "name"), "alice");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (expr, "name")), "bob") == 0, "Original should not change");
+	wexpr_Expression_destroy (copy);
+	
+	wexpr_Expression_freeze (expr);
+	char* before = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	
+	WexprExpression* snapshot = wexpr_Expression_createSnapshot (expr);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_isFrozen (snapshot), "Snapshot should not be frozen");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (snapshot, expr), "Snapshot should be equal");
+	
+	// shared children cant change
+	wexpr_Expression_valueSet (wexpr_Expression_mapValueForKey (snapshot, "name"), "alice");
+	
+	// changing through slots only copies the path
+	WexprExpression* ports = wexpr_Expression_mapSlotForKey (wexpr_Expression_mapSlotForKey (snapshot, "server"), "ports");
+	wexpr_Expression_valueSet (wexpr_Expression_arraySlotAt (ports, 0), "8080");
+	wexpr_Expression_mapSetValueForKey (snapshot, "name", wexpr_Expression_createValue ("carol"));
+	
+	char* after = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	WEXPR_UNITTEST_ASSERT (strcmp (before, after) == 0, "Original should not change");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_arrayAt (ports, 0)), "8080") == 0, "Snapshot should change");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (snapshot, "name")), "carol") == 0, "Snapshot should change");
+	
+	// snapshots outlive what they were taken from
+	wexpr_Expression_destroy (expr);
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (
+			wexpr_Expression_mapValueForKey (snapshot, "server"), "host"
+		)), "example.com") == 0, "Snapshot should keep what it shared"
+	);
+	
+	free (before);
+	free (after);
+	wexpr_Expression_destroy (snapshot);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanCompare)
+	WexprExpression* a = wexpr_Expression_createFromString ("@(x 1 y #(a b <aGVsbG8=>) z @(q null))", WexprParseFlagNone, NULL);
+	WexprExpression* b = wexpr_Expression_createFromString ("@(z @(q null) y #(a b <aGVsbG8=>) x 1)", WexprParseFlagNone, NULL);
+	WexprExpression* c = wexpr_Expression_createFromString ("@(x 1 y #(b a <aGVsbG8=>) z @(q null))", WexprParseFlagNone, NULL);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (a, b), "Map order should not matter");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_hash (a) == wexpr_Expression_hash (b), "Equal expressions should hash the same");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_isEqual (a, c), "Array order should matter");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_hash (a) != wexpr_Expression_hash (c), "Array order should change the hash");
+	
+	// copies, frozen or not
+	WexprExpression* copy = wexpr_Expression_createCopy (a);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (a, copy), "Copy should be equal");
+	
+	wexpr_Expression_valueSet (wexpr_Expression_mapSlotForKey (copy, "x"), "2");
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_isEqual (a, copy), "Changed copy should not be equal");
+	
+	uint64_t hashBefore = wexpr_Expression_hash (a);
+	wexpr_Expression_freeze (a);
+	wexpr_Expression_freeze (b);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_hash (a) == hashBefore, "Freezing should not change the hash");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (a, b), "Frozen should still be equal");
+	
+	WexprExpression* frozenCopy = wexpr_Expression_createCopy (a);
+	wexpr_Expression_freeze (frozenCopy);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (frozenCopy, b), "Frozen copy should be equal");
+	
+	wexpr_Expression_freeze (copy);
+	WEXPR_UNITTEST_ASSERT (!wexpr_Expression_isEqual (copy, b), "Frozen changed copy should not be equal");
+	
+	wexpr_Expression_destroy (a);
+	wexpr_Expression_destroy (b);
+	wexpr_Expression_destroy (c);
+	wexpr_Expression_destroy (copy);
+	wexpr_Expression_destroy (frozenCopy);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanDeduplicate)
+	const char* text = "@(a @(policy #(read write) limits @(rps 10)) b @(policy #(read write) limits @(rps 10)) c #(@(rps 10) @(rps 10)))";
+	
+	WexprExpression* expr = wexpr_Expression_createFromString (text, WexprParseFlagNone, NULL);
+	WexprExpression* original = wexpr_Expression_createFromString (text, WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (expr && original, "Cannot create expression");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_deduplicate (expr) > 0, "Repeats should be freed");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (expr, original), "Deduplicating should not change the contents");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_hash (expr) == wexpr_Expression_hash (original), "Deduplicating should not change the hash");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_deduplicate (expr) == 0, "Nothing should be left to free");
+	
+	// shared parts are still changed separately
+	WexprExpression* limits = wexpr_Expression_mapSlotForKey (wexpr_Expression_mapSlotForKey (expr, "b"), "limits");
+	wexpr_Expression_mapSetValueForKey (limits, "rps", wexpr_Expression_createValue ("20"));
+	
+	WexprExpression* otherLimits = wexpr_Expression_mapValueForKey (wexpr_Expression_mapValueForKey (expr, "a"), "limits");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (otherLimits, "rps")), "10") == 0, "Other repeats should not change");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_mapValueForKey (limits, "rps")), "20") == 0, "Repeat should change");
+	
+	// frozen trees keep sharing
+	wexpr_Expression_freeze (original);
+	uint64_t hash = wexpr_Expression_hash (original);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_deduplicate (original) > 0, "Frozen repeats should be freed");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isFrozen (original), "Should still be frozen");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_hash (original) == hash, "Frozen hash should not change");
+	
+	char* str = wexpr_Expression_createStringRepresentation (original, 0, WexprWriteFlagNone);
+	WexprExpression* reparsed = wexpr_Expression_createFromString (str, WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (reparsed, original), "Should write the same");
+	
+	free (str);
+	wexpr_Expression_destroy (reparsed);
+	wexpr_Expression_destroy (expr);
+	wexpr_Expression_destroy (original);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanMeasureMemoryUsage)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a #(1 2) b <aGVsbG8=> c null)", WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprMemoryUsage usage;
+	size_t total = wexpr_Expression_memoryUsage (expr, &usage);
+	WEXPR_UNITTEST_ASSERT (total == usage.totalBytes, "Should return the total");
+	WEXPR_UNITTEST_ASSERT (total == usage.nodeBytes + usage.stringBytes + usage.containerBytes + usage.binaryDataBytes, "Total should be the sum");
+	WEXPR_UNITTEST_ASSERT (usage.nodeBytes > 0 && usage.stringBytes > 0 && usage.containerBytes > 0 && usage.binaryDataBytes >= 5, "Every category should be used");
+	WEXPR_UNITTEST_ASSERT (usage.nodeCount == 6, "Should count every node");
+	WEXPR_UNITTEST_ASSERT (usage.mapCount == 1 && usage.arrayCount == 1 && usage.valueCount == 2 && usage.binaryDataCount == 1 && usage.nullCount == 1, "Should count nodes by type");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_memoryUsage (expr, NULL) == total, "Report should be optional");
+	
+	// snapshots share their contents, which is only counted once
+	wexpr_Expression_freeze (expr);
+	
+	WexprExpression* copies = wexpr_Expression_createNull ();
+	wexpr_Expression_changeType (copies, WexprExpressionTypeArray);
+	wexpr_Expression_arrayAddElementToEnd (copies, wexpr_Expression_createSnapshot (expr));
+	wexpr_Expression_arrayAddElementToEnd (copies, wexpr_Expression_createSnapshot (expr));
+	
+	WexprMemoryUsage copiesUsage;
+	wexpr_Expression_memoryUsage (copies, &copiesUsage);
+	WEXPR_UNITTEST_ASSERT (copiesUsage.nodeCount == 8, "Shared contents should be counted once");
+	WEXPR_UNITTEST_ASSERT (copiesUsage.stringBytes == usage.stringBytes, "Shared strings should be counted once");
+	
+	wexpr_Expression_destroy (copies);
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ExpressionCanWriteSharedRepeats)
+	WexprExpression* expr = wexpr_Expression_createFromString (
+		"@(a [p]@(allow #(read write) limits @(rps 10 burst 20)) b *[p] c #(*[p] *[p]) d #(read write))",
+		WexprParseFlagNone, NULL
+	);
+	WEXPR_UNITTEST_ASSERT (expr, "Cannot create expression");
+	
+	WexprMutableBuffer full = wexpr_Expression_createBinaryRepresentation (expr);
+	WexprMutableBuffer shared = wexpr_Expression_createBinaryRepresentationWithFlags (expr, WexprWriteFlagShareRepeats);
+	WEXPR_UNITTEST_ASSERT (shared.byteSize < full.byteSize, "Sharing repeats should be smaller");
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* read = wexpr_Expression_createFromBinaryChunk (shared.data, shared.byteSize, &err);
+	WEXPR_UNITTEST_ASSERT (read && err.code == WexprErrorCodeNone, "Should read shared repeats");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (read, expr), "Should read the same expression");
+	
+	// repeats change on their own, even through children fetched by reading
+	wexpr_Expression_mapSetValueForKey (wexpr_Expression_mapValueForKey (read, "a"), "allow", wexpr_Expression_createNull ());
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_type (wexpr_Expression_mapValueForKey (wexpr_Expression_mapValueForKey (read, "b"), "allow")) == WexprExpressionTypeArray,
+		"Other repeats should not change"
+	);
+	
+	WexprExpression* allow = wexpr_Expression_mapValueForKey (wexpr_Expression_mapValueForKey (read, "b"), "allow");
+	wexpr_Expression_valueSet (wexpr_Expression_arrayAt (allow, 0), "none");
+	WexprExpression* otherAllow = wexpr_Expression_mapValueForKey (wexpr_Expression_arrayAt (wexpr_Expression_mapValueForKey (read, "c"), 0), "allow");
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_Expression_arrayAt (otherAllow, 0)), "read") == 0,
+		"Changing a repeat's child should not change the others"
+	);
+	
+	// a reference to a definition that doesnt exist : #([4][0x06][0])
+	const uint8_t badReference[] = { 0x00, 0x00, 0x00, 0x09, 0x02, 0x00, 0x00, 0x00, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00 };
+	WexprExpression* bad = wexpr_Expression_createFromBinaryChunk (badReference, sizeof(badReference), &err);
+	WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeBinaryUnknownReference, "Unknown references should fail");
+	WEXPR_ERROR_FREE (err);
+	
+	// a definition as a key, which is thrown away, then referred to : @([6][0x05]([1][0x01]k) null b [4][0x06][0])
+	const uint8_t keyDefinition[] = {
+		0x00, 0x00, 0x00, 0x1f, 0x03,
+		0x00, 0x00, 0x00, 0x06, 0x05, 0x00, 0x00, 0x00, 0x01, 0x01, 'k',
+		0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x01, 0x01, 'b',
+		0x00, 0x00, 0x00, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00
+	};
+	err.code = WexprErrorCodeNone;
+	bad = wexpr_Expression_createFromBinaryChunk (keyDefinition, sizeof(keyDefinition), &err);
+	WEXPR_UNITTEST_ASSERT (!bad && err.code == WexprErrorCodeMapKeyMustBeAValue, "Definitions cannot be keys");
+	WEXPR_ERROR_FREE (err);
+	
+	// a repeated key replacing a definition, which is referred to after : @(a [11][0x05]#(1) a x b [4][0x06][0])
+	const uint8_t replacedDefinition[] = {
+		0x00, 0x00, 0x00, 0x31, 0x03,
+		0x00, 0x00, 0x00, 0x01, 0x01, 'a',
+		0x00, 0x00, 0x00, 0x0B, 0x05, 0x00, 0x00, 0x00, 0x06, 0x02, 0x00, 0x00, 0x00, 0x01, 0x01, '1',
+		0x00, 0x00, 0x00, 0x01, 0x01, 'a',
+		0x00, 0x00, 0x00, 0x01, 0x01, 'x',
+		0x00, 0x00, 0x00, 0x01, 0x01, 'b',
+		0x00, 0x00, 0x00, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00
+	};
+	err.code = WexprErrorCodeNone;
+	WexprExpression* replaced = wexpr_Expression_createFromBinaryChunk (replacedDefinition, sizeof(replacedDefinition), &err);
+	WEXPR_UNITTEST_ASSERT (replaced && err.code == WexprErrorCodeNone, "Should read a definition that was replaced");
+	
+	WexprExpression* replacedExpected = wexpr_Expression_createFromString ("@(a x b #(1))", WexprParseFlagNone, NULL);
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (replaced, replacedExpected), "Reference should still give the definition");
+	
+	wexpr_Expression_destroy (replaced);
+	wexpr_Expression_destroy (replacedExpected);
+	
+	free (full.data);
+	free (shared.data);
+	wexpr_Expression_destroy (read);
+	wexpr_Expression_destroy (expr);
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
 WEXPR_UNITTEST_BEGIN(ExpressionCanHandleNullExpression)
 	WexprError err = WEXPR_ERROR_INIT();
 	WexprExpression* nullExpr = wexpr_Expression_createFromString("null", WexprParseFlagNone, &err);
@@ -424,6 +989,32 @@ WEXPR_UNITTEST_BEGIN(ExpressionCanHandleBinaryExpression)
 WEXPR_UNITTEST_END()
 
 
+WEXPR_UNITTEST_BEGIN(ExpressionRejectsTooLargeLengths)
+	WexprExpression* value = wexpr_Expression_createValue ("small");
+	WexprExpression* bin = wexpr_Expression_createFromString ("<aGVsbG8=>", WexprParseFlagNone, NULL);
+	
+	// lengths only have 32 bits, so bigger ones are refused instead of truncated. Never read since they're refused.
+	if (sizeof(size_t) > sizeof(uint32_t))
+	{
+		size_t tooLarge = (size_t) UINT32_MAX + 1;
+		
+		wexpr_Expression_valueSetLengthString (value, "x", tooLarge);
+		WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (value), "small") == 0, "Too large values should be refused");
+		
+		wexpr_Expression_binaryData_setValue (bin, "x", tooLarge);
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_binaryData_size (bin) == 5, "Too large binary data should be refused");
+		
+		WEXPR_UNITTEST_ASSERT (!wexpr_Expression_createValueFromLengthString ("x", tooLarge), "Too large values shouldnt be created");
+	}
+	
+	wexpr_Expression_valueSetLengthString (value, "bigger", 6);
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (value), "bigger") == 0, "Normal values should still set");
+	
+	wexpr_Expression_destroy (bin);
+	wexpr_Expression_destroy (value);
+	
+WEXPR_UNITTEST_END()
+
 WEXPR_UNITTEST_SUITE_BEGIN (Expression)
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateNull);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateValue);
@@ -436,13 +1027,31 @@ WEXPR_UNITTEST_SUITE_BEGIN (Expression)
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDerefReference);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDerefArrayReference);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDerefMapProperly);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionSharesParsedMapKeys);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanLookupWithKeyHandle);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCreateString);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanChangeType);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanSetValue);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanAddToArray);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanSetInMap);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanMoveArrayElements);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanMoveMapValues);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionReplacesDuplicateMapKeys);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanReserveAndShrink);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCompact);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCopiesAreIndependent);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionReadingCopiesKeepsChildren);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCopiedChildrenAreIndependent);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionReferencesAreIndependent);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanFreeze);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanSnapshot);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanCompare);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanDeduplicate);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanMeasureMemoryUsage);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanWriteSharedRepeats);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanHandleNullExpression);
 	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionCanHandleBinaryExpression);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Expression, ExpressionRejectsTooLargeLengths);
 WEXPR_UNITTEST_SUITE_END ()
 
 #endif // WEXPR_TESTS_EXPRESSION_H
@@ -159,6 +159,17 @@ WEXPR_UNITTEST_BEGIN (ExpressionErrorsInvalidReferenceName)
 	WEXPR_ERROR_FREE (err);
 WEXPR_UNITTEST_END ()
 
+WEXPR_UNITTEST_BEGIN (ExpressionErrorsInvalidStringEscape)
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* valueExpr = wexpr_Expression_createFromString("\"a\\qb\"", WexprParseFlagNone, &err);
+	
+	WEXPR_UNITTEST_ASSERT (!valueExpr, "Shouldnt generate expression");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeInvalidStringEscape, "Invalid escape");
+	WEXPR_UNITTEST_ASSERT (err.message, "Should have a message");
+	
+	WEXPR_ERROR_FREE (err); // the message is ours to free
+WEXPR_UNITTEST_END ()
+
 WEXPR_UNITTEST_SUITE_BEGIN (ExpressionErrors)
 	WEXPR_UNITTEST_SUITE_ADDTEST (ExpressionErrors, ExpressionErrorsEmptyIsInvalid);
 	WEXPR_UNITTEST_SUITE_ADDTEST (ExpressionErrors, ExpressionErrorsExtraDataAfterExpression);
@@ -170,6 +181,7 @@ WEXPR_UNITTEST_SUITE_BEGIN (ExpressionErrors)
 	WEXPR_UNITTEST_SUITE_ADDTEST (ExpressionErrors, ExpressionErrorsBlankIsError);
 	WEXPR_UNITTEST_SUITE_ADDTEST (ExpressionErrors, ExpressionErrorsJustCommentIsError);
 	WEXPR_UNITTEST_SUITE_ADDTEST (ExpressionErrors, ExpressionErrorsInvalidReferenceName);
+	WEXPR_UNITTEST_SUITE_ADDTEST (ExpressionErrors, ExpressionErrorsInvalidStringEscape);
 WEXPR_UNITTEST_SUITE_END ()
 
 #endif // WEXPR_TESTS_EXPRESSIONERRORS_H
@@ -0,0 +1,93 @@
+//
+/// \file Iterator.h
+/// \brief Iterator tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_ITERATOR_H
+#define WEXPR_TESTS_ITERATOR_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Iterator.h>
+
+#include <string.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN (IteratorCanWalkArrays)
+	WexprExpression* expr = wexpr_Expression_createFromString ("#(a b c)", WexprParseFlagNone, NULL);
+	
+	WexprArrayIterator it;
+	wexpr_ArrayIterator_init (&it, expr);
+	
+	const char* expected[] = { "a", "b", "c" };
+	for (size_t i=0; i < 3; ++i)
+	{
+		WexprExpression* child = wexpr_ArrayIterator_next (&it);
+		WEXPR_UNITTEST_ASSERT (child && strcmp (wexpr_Expression_value (child), expected[i]) == 0, "Should be in order");
+	}
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_ArrayIterator_next (&it) == NULL, "Should end");
+	
+	wexpr_ArrayIterator_initAtIndex (&it, expr, 2);
+	WEXPR_UNITTEST_ASSERT (strcmp (wexpr_Expression_value (wexpr_ArrayIterator_next (&it)), "c") == 0, "Should start at index");
+	
+	wexpr_ArrayIterator_init (&it, wexpr_Expression_arrayAt (expr, 0));
+	WEXPR_UNITTEST_ASSERT (wexpr_ArrayIterator_next (&it) == NULL, "Values have no elements");
+	
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (IteratorCanWalkMaps)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a 1 b 2 c 3)", WexprParseFlagNone, NULL);
+	
+	WexprMapIterator it;
+	wexpr_MapIterator_init (&it, expr);
+	
+	const char* key = NULL;
+	WexprExpression* value = NULL;
+	size_t count = 0;
+	
+	while (wexpr_MapIterator_next (&it, &key, &value))
+	{
+		WEXPR_UNITTEST_ASSERT (strcmp (key, wexpr_Expression_mapKeyAt (expr, count)) == 0, "Should match mapKeyAt");
+		WEXPR_UNITTEST_ASSERT (value == wexpr_Expression_mapValueForKey (expr, key), "Value should belong to the key");
+		++count;
+	}
+	
+	WEXPR_UNITTEST_ASSERT (count == 3, "Should visit every pair");
+	WEXPR_UNITTEST_ASSERT (!wexpr_MapIterator_next (&it, &key, &value), "Should stay ended");
+	
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Iterator)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Iterator, IteratorCanWalkArrays);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Iterator, IteratorCanWalkMaps);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_ITERATOR_H
@@ -28,9 +28,18 @@
 // #LICENSE_END#
 //
 
+#include "Allocator.h"
 #include "Expression.h"
 #include "ExpressionErrors.h"
 #include "ExpressionType.h"
+#include "Iterator.h"
+#include "Patch.h"
+#include "PathIndex.h"
+#include "Pool.h"
+#include "Query.h"
+#include "Shape.h"
+#include "Stats.h"
+#include "Transcoder.h"
 
 int main (int argc, char** argv)
 {
@@ -43,9 +52,18 @@ int main (int argc, char** argv)
 			res.successes += r.successes; \
 		}
 	
+	RUN_SUITE(Allocator)
 	RUN_SUITE(Expression)
 	RUN_SUITE(ExpressionErrors)
 	RUN_SUITE(ExpressionType)
+	RUN_SUITE(Iterator)
+	RUN_SUITE(Patch)
+	RUN_SUITE(PathIndex)
+	RUN_SUITE(Pool)
+	RUN_SUITE(Query)
+	RUN_SUITE(Shape)
+	RUN_SUITE(Stats)
+	RUN_SUITE(Transcoder)
 	
 	printf ("\nTEST RESULTS: Success: %d Failures: %d\n", res.successes, res.failures);
 	
@@ -0,0 +1,154 @@
+//
+/// \file Patch.h
+/// \brief Diff and patch tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_PATCH_H
+#define WEXPR_TESTS_PATCH_H
+
+#include <libWexpr/Expression.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+static const char* s_patchTestFrom =
+	"@(servers #(@(name alpha rps 10) @(name beta rps 20) @(name gamma rps 30)) \"a/b\" slash old value data <aGVsbG8=>)";
+
+static const char* s_patchTestTo =
+	"@(servers #(@(name alpha rps 10 region west) @(name beta rps 25)) \"a/b\" #(slash) new value data <aGVsbG8=>)";
+
+// diff from and to, then apply the patch to from. Returns true if it became to.
+static bool s_patchRoundTrips (WexprExpression* from, WexprExpression* to, size_t* operationCount)
+{
+	WexprExpression* patch = wexpr_Expression_diff (from, to);
+	*operationCount = wexpr_Expression_arrayCount (patch);
+	
+	WexprExpression* patched = wexpr_Expression_createCopy (from);
+	bool applied = wexpr_Expression_applyPatch (patched, patch, NULL);
+	bool equal = applied && wexpr_Expression_isEqual (patched, to);
+	
+	wexpr_Expression_destroy (patched);
+	wexpr_Expression_destroy (patch);
+	
+	return equal;
+}
+
+WEXPR_UNITTEST_BEGIN (PatchCanDiffAndApply)
+	WexprExpression* from = wexpr_Expression_createFromString (s_patchTestFrom, WexprParseFlagNone, NULL);
+	WexprExpression* to = wexpr_Expression_createFromString (s_patchTestTo, WexprParseFlagNone, NULL);
+	
+	size_t operationCount = 0;
+	WEXPR_UNITTEST_ASSERT (s_patchRoundTrips (from, to, &operationCount), "Patch should turn from into to");
+	WEXPR_UNITTEST_ASSERT (operationCount == 6, "Should only have the changes");
+	
+	WEXPR_UNITTEST_ASSERT (s_patchRoundTrips (to, from, &operationCount), "Reverse patch should turn to into from");
+	WEXPR_UNITTEST_ASSERT (s_patchRoundTrips (from, from, &operationCount) && operationCount == 0, "No changes is an empty patch");
+	
+	// replacing the root
+	WexprExpression* value = wexpr_Expression_createValue ("root");
+	WEXPR_UNITTEST_ASSERT (s_patchRoundTrips (from, value, &operationCount) && operationCount == 1, "Should replace the root");
+	
+	wexpr_Expression_destroy (value);
+	wexpr_Expression_destroy (from);
+	wexpr_Expression_destroy (to);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PatchCanBeWritten)
+	WexprExpression* from = wexpr_Expression_createFromString (s_patchTestFrom, WexprParseFlagNone, NULL);
+	WexprExpression* to = wexpr_Expression_createFromString (s_patchTestTo, WexprParseFlagNone, NULL);
+	WexprExpression* patch = wexpr_Expression_diff (from, to);
+	
+	// text
+	char* text = wexpr_Expression_createStringRepresentation (patch, 0, WexprWriteFlagNone);
+	WexprExpression* textPatch = wexpr_Expression_createFromString (text, WexprParseFlagNone, NULL);
+	
+	// binary
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentation (patch);
+	WexprExpression* binaryPatch = wexpr_Expression_createFromBinaryChunk (binary.data, binary.byteSize, NULL);
+	
+	WexprExpression* fromText = wexpr_Expression_createCopy (from);
+	WexprExpression* fromBinary = wexpr_Expression_createCopy (from);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_applyPatch (fromText, textPatch, NULL), "Text patch should apply");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_applyPatch (fromBinary, binaryPatch, NULL), "Binary patch should apply");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (fromText, to) && wexpr_Expression_isEqual (fromBinary, to), "Both should match");
+	
+	free (text);
+	free (binary.data);
+	wexpr_Expression_destroy (textPatch);
+	wexpr_Expression_destroy (binaryPatch);
+	wexpr_Expression_destroy (fromText);
+	wexpr_Expression_destroy (fromBinary);
+	wexpr_Expression_destroy (patch);
+	wexpr_Expression_destroy (from);
+	wexpr_Expression_destroy (to);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PatchFailuresChangeNothing)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a 1 b #(x y))", WexprParseFlagNone, NULL);
+	WexprExpression* original = wexpr_Expression_createCopy (expr);
+	
+	const char* badPatches[] = {
+		"#(@(op replace path a value 2) @(op remove path missing))",
+		"#(@(op add path a value 2))",
+		"#(@(op replace path \"b/#5\" value z))",
+		"#(@(op move path a))",
+		"#(@(op remove path \"b/*\"))",
+		"@(op remove path a)",
+		NULL
+	};
+	
+	for (const char** patchText = badPatches; *patchText; ++patchText)
+	{
+		WexprExpression* patch = wexpr_Expression_createFromString (*patchText, WexprParseFlagNone, NULL);
+		WEXPR_UNITTEST_ASSERT (patch, "Cannot create patch");
+		
+		WexprError err = WEXPR_ERROR_INIT();
+		
+		WEXPR_UNITTEST_ASSERT (!wexpr_Expression_applyPatch (expr, patch, &err), "Bad patch should fail");
+		WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodePatchInvalid, "Should be an invalid patch");
+		WEXPR_UNITTEST_ASSERT (wexpr_Expression_isEqual (expr, original), "Failed patch should not change anything");
+		
+		WEXPR_ERROR_FREE (err);
+		wexpr_Expression_destroy (patch);
+	}
+	
+	wexpr_Expression_destroy (expr);
+	wexpr_Expression_destroy (original);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Patch)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Patch, PatchCanDiffAndApply);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Patch, PatchCanBeWritten);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Patch, PatchFailuresChangeNothing);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_PATCH_H
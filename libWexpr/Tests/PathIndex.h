@@ -0,0 +1,130 @@
+//
+/// \file PathIndex.h
+/// \brief PathIndex tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_PATHINDEX_H
+#define WEXPR_TESTS_PATHINDEX_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/PathIndex.h>
+
+#include <string.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN (PathIndexCanLookupPaths)
+	WexprExpression* expr = wexpr_Expression_createFromString (
+		"@(servers #(@(name alpha limits @(rps 10)) @(name beta)) \"a/b\" slash \"#\" hash)",
+		WexprParseFlagNone, NULL
+	);
+	
+	WexprPathIndex* index = wexpr_PathIndex_build (expr);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_count (index) == 10, "Should index every expression");
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_lookup (index, "") == expr, "Empty path is the root");
+	
+	WexprExpression* rps = wexpr_PathIndex_lookup (index, "servers/#0/limits/rps");
+	WEXPR_UNITTEST_ASSERT (rps && strcmp (wexpr_Expression_value (rps), "10") == 0, "Should find deep paths");
+	
+	WexprKey nameKey = wexpr_Key_fromString ("servers/#1/name");
+	WexprExpression* name = wexpr_PathIndex_lookupKeyHandle (index, &nameKey);
+	WEXPR_UNITTEST_ASSERT (name && strcmp (wexpr_Expression_value (name), "beta") == 0, "Should find with a key handle");
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_lookup (index, "a\\/b") != NULL, "Should escape slashes");
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_lookup (index, "\\#") != NULL, "Should escape a leading #");
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_lookup (index, "servers/#2") == NULL, "Should not find missing paths");
+	
+	wexpr_PathIndex_destroy (index);
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PathIndexIsInvalidatedByChanges)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a @(b 1))", WexprParseFlagNone, NULL);
+	WexprExpression* other = wexpr_Expression_createFromString ("@(a 1)", WexprParseFlagNone, NULL);
+	
+	WexprPathIndex* index = wexpr_PathIndex_build (expr);
+	
+	// changing something not indexed is fine
+	wexpr_Expression_mapSetValueForKey (other, "b", wexpr_Expression_createValue ("2"));
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_isValid (index), "Unrelated changes shouldnt invalidate");
+	
+	wexpr_Expression_mapSetValueForKey (wexpr_Expression_mapValueForKey (expr, "a"), "c", wexpr_Expression_createValue ("2"));
+	WEXPR_UNITTEST_ASSERT (!wexpr_PathIndex_isValid (index), "Changes should invalidate");
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_lookup (index, "a/b") == NULL, "Invalid index finds nothing");
+	
+	wexpr_PathIndex_rebuild (index);
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_isValid (index), "Rebuilding should be valid");
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_lookup (index, "a/c") != NULL, "Should find the new value");
+	
+	wexpr_PathIndex_destroy (index);
+	wexpr_Expression_destroy (other);
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (PathIndexIgnoresOtherTrees)
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a @(b 1))", WexprParseFlagNone, NULL);
+	WexprExpression* old = wexpr_Expression_createFromString ("@(a @(b 0))", WexprParseFlagNone, NULL);
+	
+	WexprPathIndex* index = wexpr_PathIndex_build (expr);
+	WexprPathIndex* oldIndex = wexpr_PathIndex_build (old);
+	
+	// changing a copy, or dropping another indexed tree as a reload would
+	WexprExpression* copy = wexpr_Expression_createCopy (expr);
+	wexpr_Expression_valueSet (wexpr_Expression_mapSlotForKey (wexpr_Expression_mapSlotForKey (copy, "a"), "b"), "2");
+	wexpr_Expression_destroy (copy);
+	
+	wexpr_Expression_valueSet (wexpr_PathIndex_lookup (oldIndex, "a/b"), "3");
+	WEXPR_UNITTEST_ASSERT (!wexpr_PathIndex_isValid (oldIndex), "Its own tree changing should invalidate");
+	
+	wexpr_PathIndex_destroy (oldIndex);
+	wexpr_Expression_destroy (old);
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_isValid (index), "Other trees shouldnt invalidate");
+	WexprExpression* b = wexpr_PathIndex_lookup (index, "a/b");
+	WEXPR_UNITTEST_ASSERT (b && strcmp (wexpr_Expression_value (b), "1") == 0, "Should still find");
+	
+	// a subtree indexed on its own as well invalidates both
+	WexprPathIndex* subIndex = wexpr_PathIndex_build (wexpr_Expression_mapValueForKey (expr, "a"));
+	WEXPR_UNITTEST_ASSERT (wexpr_PathIndex_isValid (index) && wexpr_PathIndex_isValid (subIndex), "Both should be valid");
+	
+	wexpr_Expression_valueSet (b, "4");
+	WEXPR_UNITTEST_ASSERT (!wexpr_PathIndex_isValid (index) && !wexpr_PathIndex_isValid (subIndex), "Both should be invalidated");
+	
+	wexpr_PathIndex_destroy (subIndex);
+	wexpr_PathIndex_destroy (index);
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (PathIndex)
+	WEXPR_UNITTEST_SUITE_ADDTEST (PathIndex, PathIndexCanLookupPaths);
+	WEXPR_UNITTEST_SUITE_ADDTEST (PathIndex, PathIndexIsInvalidatedByChanges);
+	WEXPR_UNITTEST_SUITE_ADDTEST (PathIndex, PathIndexIgnoresOtherTrees);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_PATHINDEX_H
@@ -0,0 +1,148 @@
+//
+/// \file Pool.h
+/// \brief Pool tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_POOL_H
+#define WEXPR_TESTS_POOL_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Pool.h>
+
+#if defined(LIBWEXPR_TESTS_PTHREADS)
+	#include <pthread.h>
+#endif
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN(PoolIsOffByDefault)
+	WexprPoolStats stats = wexpr_Pool_stats ();
+	WEXPR_UNITTEST_ASSERT (stats.cachedBlocks == 0, "Nothing should be cached before pooling is turned on");
+	
+	WexprExpression* expr = wexpr_Expression_createNull ();
+	wexpr_Expression_destroy (expr);
+	
+	stats = wexpr_Pool_stats ();
+	WEXPR_UNITTEST_ASSERT (stats.recycled == 0 && stats.cachedBlocks == 0, "Should release straight to the allocator");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(PoolRecyclesExpressions)
+	wexpr_Pool_setMaxCachedBytes (1024 * 1024);
+	wexpr_Pool_trim ();
+	wexpr_Pool_resetStats ();
+	
+	for (int i = 0; i < 100; ++i)
+	{
+		WexprExpression* expr = wexpr_Expression_createValue ("short value");
+		wexpr_Expression_destroy (expr);
+	}
+	
+	WexprPoolStats stats = wexpr_Pool_stats ();
+	WEXPR_UNITTEST_ASSERT (stats.misses == 2, "Only the first node and value should miss");
+	WEXPR_UNITTEST_ASSERT (stats.hits == 198, "Every other allocation should be recycled");
+	WEXPR_UNITTEST_ASSERT (stats.cachedBlocks == 2, "Node and value should be waiting for reuse");
+	
+	wexpr_Pool_trim ();
+	
+	stats = wexpr_Pool_stats ();
+	WEXPR_UNITTEST_ASSERT (stats.cachedBlocks == 0 && stats.cachedBytes == 0, "Trim should release everything");
+	
+	wexpr_Pool_setMaxCachedBytes (0);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(PoolCanBeDisabled)
+	wexpr_Pool_setMaxCachedBytes (1024 * 1024);
+	wexpr_Pool_setMaxCachedBytes (0);
+	wexpr_Pool_resetStats ();
+	
+	WexprExpression* expr = wexpr_Expression_createNull ();
+	wexpr_Expression_destroy (expr);
+	
+	WexprPoolStats stats = wexpr_Pool_stats ();
+	WEXPR_UNITTEST_ASSERT (stats.recycled == 0 && stats.released == 1, "Should release straight to the allocator");
+	WEXPR_UNITTEST_ASSERT (stats.cachedBlocks == 0, "Nothing should be cached");
+WEXPR_UNITTEST_END()
+
+#if defined(LIBWEXPR_TESTS_PTHREADS)
+	// destroys the expression with this thread's pool, returning how many blocks it kept
+	static void* s_Pool_destroyOnThread (void* expr)
+	{
+		wexpr_Pool_setMaxCachedBytes (1024 * 1024);
+		wexpr_Expression_destroy (expr);
+		
+		size_t* cachedBlocks = malloc (sizeof(size_t));
+		*cachedBlocks = wexpr_Pool_stats ().cachedBlocks;
+		
+		wexpr_Pool_trim (); // or they'd be lost when the thread exits
+		return cachedBlocks;
+	}
+#endif
+
+WEXPR_UNITTEST_BEGIN(PoolHandlesDestroyingOnAnotherThread)
+	wexpr_Pool_setMaxCachedBytes (1024 * 1024);
+	
+	// a thread without pooling gives the blocks straight back to the allocator
+	WexprExpression* expr = wexpr_Expression_createFromString ("@(a short b #(1 2))", WexprParseFlagNone, NULL);
+	wexpr_Pool_setMaxCachedBytes (0);
+	wexpr_Pool_resetStats ();
+	
+	wexpr_Expression_destroy (expr);
+	
+	WexprPoolStats stats = wexpr_Pool_stats ();
+	WEXPR_UNITTEST_ASSERT (stats.recycled == 0 && stats.released > 0, "Should release to the allocator");
+	
+#if defined(LIBWEXPR_TESTS_PTHREADS)
+	// a pooling thread keeps them, leaving our pool alone
+	wexpr_Pool_setMaxCachedBytes (1024 * 1024);
+	expr = wexpr_Expression_createFromString ("@(a short b #(1 2))", WexprParseFlagNone, NULL);
+	
+	size_t cachedBlocks = wexpr_Pool_stats ().cachedBlocks;
+	
+	pthread_t thread;
+	void* result = NULL;
+	WEXPR_UNITTEST_ASSERT (pthread_create (&thread, NULL, &s_Pool_destroyOnThread, expr) == 0, "Should start the thread");
+	pthread_join (thread, &result);
+	
+	size_t threadCachedBlocks = *(size_t*) result;
+	free (result);
+	
+	WEXPR_UNITTEST_ASSERT (threadCachedBlocks > 0, "The destroying thread should pool the blocks");
+	WEXPR_UNITTEST_ASSERT (wexpr_Pool_stats ().cachedBlocks == cachedBlocks, "Our pool shouldnt get them");
+	
+	wexpr_Pool_setMaxCachedBytes (0);
+#endif
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Pool)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Pool, PoolIsOffByDefault);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Pool, PoolRecyclesExpressions);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Pool, PoolCanBeDisabled);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Pool, PoolHandlesDestroyingOnAnotherThread);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_POOL_H
@@ -0,0 +1,213 @@
+//
+/// \file Query.h
+/// \brief Query tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_QUERY_H
+#define WEXPR_TESTS_QUERY_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Query.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+static const char* s_queryTestDocument =
+	"@(servers #("
+		"@(name alpha limits @(rps 10))"
+		"@(name beta limits @(rps 20))"
+		"@(name gamma limits @(rps 30))"
+	") \"a/b\" slash)";
+
+// Returns true if the matches of path within expr are exactly the values given, in order. values is NULL terminated.
+static bool s_queryMatches (WexprExpression* expr, const char* path, const char** values)
+{
+	WexprQuery* query = wexpr_Query_compile (path, NULL);
+	if (!query)
+		return false;
+	
+	bool matches = true;
+	WexprQueryIterator* it = wexpr_Query_evaluate (query, expr);
+	
+	for (; *values; ++values)
+	{
+		WexprExpression* match = wexpr_QueryIterator_next (it);
+		const char* value = match ? wexpr_Expression_value (match) : NULL;
+		
+		if (!value || strcmp (value, *values) != 0)
+			matches = false;
+	}
+	
+	if (wexpr_QueryIterator_next (it) != NULL)
+		matches = false; // too many matches
+	
+	wexpr_QueryIterator_destroy (it);
+	wexpr_Query_destroy (query);
+	
+	return matches;
+}
+
+WEXPR_UNITTEST_BEGIN (QueryCanFindPaths)
+	WexprExpression* expr = wexpr_Expression_createFromString (s_queryTestDocument, WexprParseFlagNone, NULL);
+	
+	const char* rps[] = { "10", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#0/limits/rps", rps), "Should find keys and indexes");
+	
+	const char* last[] = { "gamma", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#-1/name", last), "Negative indexes count from the end");
+	
+	const char* escaped[] = { "slash", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "a\\/b", escaped), "Should unescape keys");
+	
+	const char* none[] = { NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#3/name", none), "Out of range is no match");
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/name", none), "Key on an array is no match");
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "missing", none), "Missing key is no match");
+	
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (QueryCanUseWildcardsAndSlices)
+	WexprExpression* expr = wexpr_Expression_createFromString (s_queryTestDocument, WexprParseFlagNone, NULL);
+	
+	const char* all[] = { "alpha", "beta", "gamma", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/*/name", all), "Wildcard should match all elements");
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#:/name", all), "Empty slice should match all elements");
+	
+	const char* rest[] = { "20", "30", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#1:/limits/rps", rest), "Slice from 1");
+	
+	const char* first[] = { "alpha", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#0:-2/name", first), "Slice with negative end");
+	
+	const char* limits[] = { "10", NULL };
+	WEXPR_UNITTEST_ASSERT (s_queryMatches (expr, "servers/#0/limits/*", limits), "Wildcard should match map values");
+	
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (QueryCanFindFirst)
+	WexprExpression* expr = wexpr_Expression_createFromString (s_queryTestDocument, WexprParseFlagNone, NULL);
+	
+	WexprQuery* query = wexpr_Query_compile ("servers/*/limits/rps", NULL);
+	WexprExpression* match = wexpr_Query_first (query, expr);
+	WEXPR_UNITTEST_ASSERT (match && strcmp (wexpr_Expression_value (match), "10") == 0, "Should find the first match");
+	wexpr_Query_destroy (query);
+	
+	query = wexpr_Query_compile ("", NULL);
+	WEXPR_UNITTEST_ASSERT (wexpr_Query_first (query, expr) == expr, "Empty path should match the root");
+	wexpr_Query_destroy (query);
+	
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (QueryReportsInvalidPaths)
+	const char* invalidPaths[] = { "a//b", "a/", "#x", "#1:y", "#", "a\\", "#99999999999999999999999", "#-1:99999999999999999999999", NULL };
+	
+	for (const char** path = invalidPaths; *path; ++path)
+	{
+		WexprError err = WEXPR_ERROR_INIT();
+		WexprQuery* query = wexpr_Query_compile (*path, &err);
+		
+		WEXPR_UNITTEST_ASSERT (!query, "Shouldnt compile");
+		WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeQueryInvalid, "Should be an invalid query");
+		
+		WEXPR_ERROR_FREE (err);
+	}
+WEXPR_UNITTEST_END ()
+
+// returns the value at path in expr, or NULL
+static const char* s_queryValue (WexprExpression* expr, const char* path)
+{
+	WexprQuery* query = wexpr_Query_compile (path, NULL);
+	WexprExpression* match = wexpr_Query_first (query, expr);
+	wexpr_Query_destroy (query);
+	
+	return match ? wexpr_Expression_value (match) : NULL;
+}
+
+// returns a new version of expr with value (which can be NULL) at path
+static WexprExpression* s_queryUpdated (WexprExpression* expr, const char* path, const char* value)
+{
+	WexprQuery* query = wexpr_Query_compile (path, NULL);
+	WexprExpression* version = wexpr_Query_createUpdated (query, expr, value ? wexpr_Expression_createValue (value) : NULL);
+	wexpr_Query_destroy (query);
+	
+	return version;
+}
+
+WEXPR_UNITTEST_BEGIN (QueryCanCreateVersions)
+	WexprExpression* v1 = wexpr_Expression_createFromString (s_queryTestDocument, WexprParseFlagNone, NULL);
+	wexpr_Expression_freeze (v1);
+	
+	WexprExpression* v2 = s_queryUpdated (v1, "servers/#1/limits/rps", "25");
+	WexprExpression* v3 = s_queryUpdated (v2, "servers/#-1/name", NULL);
+	WexprExpression* v4 = s_queryUpdated (v3, "servers/#0/region", "west");
+	
+	WEXPR_UNITTEST_ASSERT (v2 && v3 && v4, "Should create each version");
+	WEXPR_UNITTEST_ASSERT (wexpr_Expression_isFrozen (v4), "Versions of frozen expressions are frozen");
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (v1, "servers/#1/limits/rps"), "20") == 0, "First version should not change");
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (v2, "servers/#1/limits/rps"), "25") == 0, "Second version should have the new value");
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (v2, "servers/#2/name"), "gamma") == 0, "Second version still has the name");
+	WEXPR_UNITTEST_ASSERT (!s_queryValue (v3, "servers/#2/name"), "Third version removed the name");
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (v4, "servers/#0/region"), "west") == 0, "Fourth version added a key");
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (v4, "servers/#1/limits/rps"), "25") == 0, "Fourth version keeps earlier changes");
+	
+	WEXPR_UNITTEST_ASSERT (!s_queryUpdated (v4, "servers/#5/name", "x"), "Missing index cant be updated");
+	WEXPR_UNITTEST_ASSERT (!s_queryUpdated (v4, "servers/*/name", "x"), "Wildcards cant be updated");
+	
+	// versions outlive each other in any order
+	wexpr_Expression_destroy (v2);
+	wexpr_Expression_destroy (v1);
+	
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (v3, "servers/#0/limits/rps"), "10") == 0, "Third version should still work");
+	
+	// an unfrozen copy of a version can change
+	WexprExpression* copy = wexpr_Expression_createCopy (v4);
+	wexpr_Expression_destroy (v4);
+	
+	WexprExpression* servers = wexpr_Expression_mapSlotForKey (copy, "servers");
+	wexpr_Expression_valueSet (wexpr_Expression_mapSlotForKey (wexpr_Expression_arraySlotAt (servers, 0), "name"), "delta");
+	WEXPR_UNITTEST_ASSERT (strcmp (s_queryValue (copy, "servers/#0/name"), "delta") == 0, "Copy should change");
+	
+	wexpr_Expression_destroy (v3);
+	wexpr_Expression_destroy (copy);
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Query)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Query, QueryCanFindPaths);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Query, QueryCanUseWildcardsAndSlices);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Query, QueryCanFindFirst);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Query, QueryReportsInvalidPaths);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Query, QueryCanCreateVersions);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_QUERY_H
@@ -0,0 +1,117 @@
+//
+/// \file Shape.h
+/// \brief Shape tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_SHAPE_H
+#define WEXPR_TESTS_SHAPE_H
+
+#include <libWexpr/Allocator.h>
+#include <libWexpr/Expression.h>
+#include <libWexpr/Shape.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN(ShapeCountsText)
+	const char* str = "@(a #(1 22 333) b @(c nil) d <aGVsbG8=> e #())";
+	WexprShape shape;
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Shape_fromLengthString (&shape, str, strlen (str), NULL), "Should scan");
+	
+	WEXPR_UNITTEST_ASSERT (shape.nodeCount == 9, "Keys shouldn't be counted as nodes");
+	WEXPR_UNITTEST_ASSERT (shape.nullCount == 1 && shape.valueCount == 3 && shape.arrayCount == 2 &&
+		shape.mapCount == 2 && shape.binaryDataCount == 1, "Each type should be counted");
+	WEXPR_UNITTEST_ASSERT (shape.maxDepth == 3, "Elements of the inner array are at depth 3");
+	WEXPR_UNITTEST_ASSERT (shape.depthTotal == 1 + 4*2 + 4*3, "Every node should add its depth");
+	
+	WEXPR_UNITTEST_ASSERT (shape.arrayLengths[0] == 1 && shape.arrayLengths[2] == 1, "One empty array, one of 3");
+	WEXPR_UNITTEST_ASSERT (shape.mapSizes[1] == 1 && shape.mapSizes[3] == 1, "One map of 1, one of 4");
+	WEXPR_UNITTEST_ASSERT (shape.valueLengths[1] == 1 && shape.valueLengths[2] == 2, "Values should be bucketed by length");
+	WEXPR_UNITTEST_ASSERT (shape.valueBytes == 6 && shape.maxValueLength == 3, "Value bytes should be counted");
+	WEXPR_UNITTEST_ASSERT (shape.binaryDataBytes == 5, "Binary data should be counted decoded");
+	WEXPR_UNITTEST_ASSERT (shape.referenceCount == 0 && shape.expandedNodeCount == shape.nodeCount, "No references");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ShapeBinaryMatchesText)
+	const char* str = "@(a #(1 22 333) b @(c nil) d <aGVsbG8=> e #())";
+	WexprShape textShape;
+	WEXPR_UNITTEST_ASSERT (wexpr_Shape_fromLengthString (&textShape, str, strlen (str), NULL), "Should scan text");
+	
+	WexprExpression* expr = wexpr_Expression_createFromString (str, WexprParseFlagNone, NULL);
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentation (expr);
+	
+	WexprShape binaryShape;
+	WEXPR_UNITTEST_ASSERT (wexpr_Shape_fromBinaryChunk (&binaryShape, binary.data, binary.byteSize, NULL), "Should scan binary");
+	WEXPR_UNITTEST_ASSERT (memcmp (&textShape, &binaryShape, sizeof(WexprShape)) == 0, "Both forms should have the same shape");
+	
+	wexpr_Allocator_free (binary.data);
+	wexpr_Expression_destroy (expr);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ShapeCountsReferences)
+	const char* str = "#([a]@(x 1) *[a] *[a])";
+	WexprShape shape;
+	
+	WEXPR_UNITTEST_ASSERT (wexpr_Shape_fromLengthString (&shape, str, strlen (str), NULL), "Should scan");
+	WEXPR_UNITTEST_ASSERT (shape.nodeCount == 3, "Inserted references aren't written nodes");
+	WEXPR_UNITTEST_ASSERT (shape.referenceDefinitionCount == 1 && shape.referenceCount == 2, "References should be counted");
+	WEXPR_UNITTEST_ASSERT (shape.expandedNodeCount == 7, "Each insert should add the nodes it refers to");
+	WEXPR_UNITTEST_ASSERT (shape.arrayLengths[2] == 1, "The array has 3 elements");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_BEGIN(ShapeFailsOnInvalid)
+	const char* str = "#(1 *[missing])";
+	WexprShape shape;
+	WexprError err = WEXPR_ERROR_INIT();
+	
+	WEXPR_UNITTEST_ASSERT (!wexpr_Shape_fromLengthString (&shape, str, strlen (str), &err), "Unknown references should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeReferenceUnknownReference, "Should give the reason");
+	WEXPR_ERROR_FREE (err);
+	
+	const char* extra = "#(1) 2";
+	WEXPR_UNITTEST_ASSERT (!wexpr_Shape_fromLengthString (&shape, extra, strlen (extra), &err), "Extra data should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeExtraDataAfterParsingRoot, "Should give the reason");
+	WEXPR_ERROR_FREE (err);
+	
+	const uint8_t truncated[] = { 0x00, 0x00, 0x00, 0x09, 0x02 };
+	WEXPR_UNITTEST_ASSERT (!wexpr_Shape_fromBinaryChunk (&shape, truncated, sizeof(truncated), NULL), "Truncated chunks should fail");
+	
+	const uint8_t unknown[] = { 0x00, 0x00, 0x00, 0x00, 0x7F };
+	WEXPR_UNITTEST_ASSERT (!wexpr_Shape_fromBinaryChunk (&shape, unknown, sizeof(unknown), &err), "Unknown chunk types should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeBinaryUnknownChunkType, "Should give the reason");
+	WEXPR_ERROR_FREE (err);
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Shape)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Shape, ShapeCountsText);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Shape, ShapeBinaryMatchesText);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Shape, ShapeCountsReferences);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Shape, ShapeFailsOnInvalid);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_SHAPE_H
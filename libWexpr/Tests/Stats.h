@@ -0,0 +1,85 @@
+//
+/// \file Stats.h
+/// \brief Stats tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_STATS_H
+#define WEXPR_TESTS_STATS_H
+
+#include <libWexpr/Allocator.h>
+#include <libWexpr/Expression.h>
+#include <libWexpr/Stats.h>
+
+#include "UnitTest.h"
+
+WEXPR_UNITTEST_BEGIN(StatsCountParseAndWrite)
+	wexpr_Stats_reset ();
+	
+	const char* str = "@(a 1 b #(2 3) c <aGVsbG8=>)";
+	WexprStats parseStats;
+	WexprExpression* expr = wexpr_Expression_createFromLengthStringWithStats (str, strlen (str), WexprParseFlagNone, NULL, &parseStats);
+	WEXPR_UNITTEST_ASSERT (expr != NULL, "Should parse");
+	
+	WexprStats writeStats;
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentationWithStats (expr, WexprWriteFlagNone, &writeStats);
+	WexprStats total = wexpr_Stats_get ();
+	
+	if (wexpr_Stats_isEnabled ())
+	{
+		WEXPR_UNITTEST_ASSERT (parseStats.nodes >= 6, "Every node parsed should be counted");
+		WEXPR_UNITTEST_ASSERT (parseStats.allocations > 0 && parseStats.bytesAllocated > 0, "Parsing should allocate");
+		WEXPR_UNITTEST_ASSERT (parseStats.hashProbes > 0, "Adding keys to the map should probe");
+		WEXPR_UNITTEST_ASSERT (writeStats.nodes == 0, "Writing should not create nodes");
+		WEXPR_UNITTEST_ASSERT (writeStats.allocations > 0, "Writing should allocate the buffer");
+		WEXPR_UNITTEST_ASSERT (total.allocations == parseStats.allocations + writeStats.allocations, "Thread counters should include both calls");
+	}
+	else
+	{
+		WEXPR_UNITTEST_ASSERT (parseStats.allocations == 0 && parseStats.nodes == 0 && writeStats.allocations == 0, "Nothing should be counted");
+		WEXPR_UNITTEST_ASSERT (total.allocations == 0 && total.hashProbes == 0, "Nothing should be counted");
+	}
+	
+	wexpr_Allocator_free (binary.data);
+	wexpr_Expression_destroy (expr);
+	
+	if (wexpr_Stats_isEnabled ())
+	{
+		WexprStats after = wexpr_Stats_get ();
+		WEXPR_UNITTEST_ASSERT (after.frees > total.frees, "Destroying should count frees");
+	}
+	
+	wexpr_Stats_reset ();
+	total = wexpr_Stats_get ();
+	WEXPR_UNITTEST_ASSERT (total.allocations == 0 && total.frees == 0 && total.nodes == 0, "Reset should clear the counters");
+WEXPR_UNITTEST_END()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Stats)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Stats, StatsCountParseAndWrite);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_STATS_H
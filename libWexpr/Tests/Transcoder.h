@@ -0,0 +1,352 @@
+//
+/// \file Transcoder.h
+/// \brief Transcoder tests
+///
+/// #LICENSE_BEGIN:MIT#
+/// 
+/// Copyright (c) 2017-2018, Kenneth Perry (thothonegan)
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining
+/// a copy of this software and associated documentation files (the
+/// "Software"), to deal in the Software without restriction, including
+/// without limitation the rights to use, copy, modify, merge, publish,
+/// distribute, sublicense, and/or sell copies of the Software, and to
+/// permit persons to whom the Software is furnished to do so, subject to
+/// the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be
+/// included in all copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+/// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+/// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+/// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+/// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+/// 
+/// #LICENSE_END#
+//
+
+#ifndef WEXPR_TESTS_TRANSCODER_H
+#define WEXPR_TESTS_TRANSCODER_H
+
+#include <libWexpr/Expression.h>
+#include <libWexpr/Transcoder.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "UnitTest.h"
+
+// Collects transcoder output into a growing string
+typedef struct TranscoderTestOutput
+{
+	char* data;
+	size_t size;
+} TranscoderTestOutput;
+
+static void s_transcoderTestWrite (void* userData, const char* data, size_t length)
+{
+	TranscoderTestOutput* out = WEXPR_UNITTEST_STATICCAST(TranscoderTestOutput*, userData);
+	
+	out->data = WEXPR_UNITTEST_STATICCAST(char*, realloc (out->data, out->size + length + 1));
+	memcpy (out->data + out->size, data, length);
+	out->size += length;
+	out->data[out->size] = '\0';
+}
+
+// Returns true if transcoding the binary form of str gives the same text as writing the expression.
+// flags are used for both, each ignores the ones meant for the other.
+static bool s_transcoderMatchesWriter (const char* str, WexprWriteFlags flags)
+{
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString (str, WexprParseFlagNone, &err);
+	if (!expr)
+	{
+		WEXPR_ERROR_FREE (err);
+		return false;
+	}
+	
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentationWithFlags (expr, flags);
+	char* expected = wexpr_Expression_createStringRepresentation (expr, 0, flags);
+	
+	TranscoderTestOutput out = { NULL, 0 };
+	WexprSink sink;
+	sink.write = &s_transcoderTestWrite;
+	sink.userData = &out;
+	
+	size_t used = wexpr_Transcoder_binaryChunkToString (binary.data, binary.byteSize, 0, flags, sink, &err);
+	
+	bool matches = (used == binary.byteSize && err.code == WexprErrorCodeNone &&
+		out.data && strcmp (out.data, expected) == 0
+	);
+	
+	free (out.data);
+	free (expected);
+	free (binary.data);
+	wexpr_Expression_destroy (expr);
+	WEXPR_ERROR_FREE (err);
+	
+	return matches;
+}
+
+// Same as s_transcoderMatchesWriter(), but gives the binary form to a WexprTranscoder blockSize bytes at a time.
+static bool s_transcoderStreamMatchesWriter (const char* str, WexprWriteFlags flags, size_t blockSize)
+{
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromString (str, WexprParseFlagNone, &err);
+	if (!expr)
+	{
+		WEXPR_ERROR_FREE (err);
+		return false;
+	}
+	
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentationWithFlags (expr, flags);
+	char* expected = wexpr_Expression_createStringRepresentation (expr, 0, flags);
+	
+	TranscoderTestOutput out = { NULL, 0 };
+	WexprSink sink;
+	sink.write = &s_transcoderTestWrite;
+	sink.userData = &out;
+	
+	WexprTranscoder* transcoder = wexpr_Transcoder_create (0, flags, sink);
+	size_t pos = 0;
+	bool success = true;
+	
+	while (success && pos < binary.byteSize)
+	{
+		size_t amount = (binary.byteSize - pos < blockSize) ? binary.byteSize - pos : blockSize;
+		success = (wexpr_Transcoder_write (transcoder, WEXPR_UNITTEST_STATICCAST(const uint8_t*, binary.data) + pos, amount, &err) == amount);
+		pos += amount;
+	}
+	
+	bool matches = (success && wexpr_Transcoder_isDone (transcoder) && err.code == WexprErrorCodeNone &&
+		out.data && strcmp (out.data, expected) == 0
+	);
+	
+	wexpr_Transcoder_destroy (transcoder);
+	free (out.data);
+	free (expected);
+	free (binary.data);
+	wexpr_Expression_destroy (expr);
+	WEXPR_ERROR_FREE (err);
+	
+	return matches;
+}
+
+// Returns true if measuring the binary form of str with a WexprTranscoder, blockSize bytes at a time and writing nothing,
+// gives the same shape as wexpr_Shape_fromBinaryChunk().
+static bool s_transcoderShapeMatches (const char* str, WexprWriteFlags flags, size_t blockSize)
+{
+	WexprExpression* expr = wexpr_Expression_createFromString (str, WexprParseFlagNone, NULL);
+	if (!expr)
+		return false;
+	
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentationWithFlags (expr, flags);
+	
+	WexprShape expected;
+	bool matches = wexpr_Shape_fromBinaryChunk (&expected, binary.data, binary.byteSize, NULL);
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprSink sink;
+	sink.write = NULL;
+	sink.userData = NULL;
+	
+	WexprShape shape;
+	WexprTranscoder* transcoder = wexpr_Transcoder_create (0, WexprWriteFlagNone, sink);
+	wexpr_Transcoder_measureShape (transcoder, &shape);
+	size_t pos = 0;
+	
+	while (matches && pos < binary.byteSize)
+	{
+		size_t amount = (binary.byteSize - pos < blockSize) ? binary.byteSize - pos : blockSize;
+		matches = (wexpr_Transcoder_write (transcoder, WEXPR_UNITTEST_STATICCAST(const uint8_t*, binary.data) + pos, amount, &err) == amount);
+		pos += amount;
+	}
+	
+	matches = (matches && wexpr_Transcoder_isDone (transcoder) && memcmp (&shape, &expected, sizeof(WexprShape)) == 0);
+	
+	wexpr_Transcoder_destroy (transcoder);
+	free (binary.data);
+	wexpr_Expression_destroy (expr);
+	WEXPR_ERROR_FREE (err);
+	
+	return matches;
+}
+
+WEXPR_UNITTEST_BEGIN (TranscoderMatchesWriterForValues)
+
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter ("null", WexprWriteFlagNone), "Null should match");
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter ("asdf", WexprWriteFlagNone), "Value should match");
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter ("\"a b\"", WexprWriteFlagNone), "Quoted value should match");
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter ("<aGVsbG8=>", WexprWriteFlagNone), "Binary data should match");
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderMatchesWriterForContainers)
+
+	const char* str = "#(1 #() @() @(key #(a \"b c\" <aGVsbG8=>)) null)";
+	
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter (str, WexprWriteFlagNone), "Mini output should match");
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter (str, WexprWriteFlagHumanReadable), "Human readable output should match");
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderMatchesWriterForSharedRepeats)
+
+	const char* str = "#([p]@(allow #(read write) limits @(rps 10 burst 20)) @(inner *[p]) *[p] @(inner *[p]) #(read write))";
+	
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter (str, WexprWriteFlagShareRepeats), "Mini output should match");
+	WEXPR_UNITTEST_ASSERT (s_transcoderMatchesWriter (str, WexprWriteFlagShareRepeats | WexprWriteFlagHumanReadable), "Human readable output should match");
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderMatchesWriterWhenStreamed)
+
+	const char* containers = "#(1 #() @() @(key #(a \"b c\" <aGVsbG8gd29ybGQ=>)) null)";
+	const char* shared = "#([p]@(allow #(read write) limits @(rps 10 burst 20)) @(inner *[p]) *[p] @(inner *[p]) #(read write))";
+	
+	WEXPR_UNITTEST_ASSERT (s_transcoderStreamMatchesWriter (containers, WexprWriteFlagNone, 1), "Should match a byte at a time");
+	WEXPR_UNITTEST_ASSERT (s_transcoderStreamMatchesWriter (containers, WexprWriteFlagHumanReadable, 3), "Should match in small blocks");
+	WEXPR_UNITTEST_ASSERT (s_transcoderStreamMatchesWriter (shared, WexprWriteFlagShareRepeats, 1), "Shared repeats should match a byte at a time");
+	WEXPR_UNITTEST_ASSERT (s_transcoderStreamMatchesWriter (shared, WexprWriteFlagShareRepeats | WexprWriteFlagHumanReadable, 7),
+		"Shared repeats should match in small blocks"
+	);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderHandlesLargeBinaryData)
+
+	// bigger than the transcoder's internal buffers
+	size_t size = 10000;
+	uint8_t* bytes = WEXPR_UNITTEST_STATICCAST(uint8_t*, malloc (size));
+	for (size_t i=0; i < size; ++i)
+		bytes[i] = WEXPR_UNITTEST_STATICCAST(uint8_t, i * 7);
+	
+	WexprExpression* expr = wexpr_Expression_createNull();
+	wexpr_Expression_changeType (expr, WexprExpressionTypeBinaryData);
+	wexpr_Expression_binaryData_setValue (expr, bytes, size);
+	
+	WexprMutableBuffer binary = wexpr_Expression_createBinaryRepresentation (expr);
+	char* expected = wexpr_Expression_createStringRepresentation (expr, 0, WexprWriteFlagNone);
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	TranscoderTestOutput out = { NULL, 0 };
+	WexprSink sink;
+	sink.write = &s_transcoderTestWrite;
+	sink.userData = &out;
+	
+	wexpr_Transcoder_binaryChunkToString (binary.data, binary.byteSize, 0, WexprWriteFlagNone, sink, &err);
+	
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeNone, "Should transcode");
+	WEXPR_UNITTEST_ASSERT (out.data && strcmp (out.data, expected) == 0, "Output should match the writer");
+	
+	free (out.data);
+	free (expected);
+	free (binary.data);
+	free (bytes);
+	wexpr_Expression_destroy (expr);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderMeasuresShape)
+
+	const char* containers = "@(a #(1 22 333) b @(c nil) d <aGVsbG8=> e #() f #(#(#(deep))))";
+	const char* shared = "#([p]@(allow #(read write) limits @(rps 10 burst 20)) @(inner *[p]) *[p] @(inner *[p]) #(read write))";
+	
+	WEXPR_UNITTEST_ASSERT (s_transcoderShapeMatches (containers, WexprWriteFlagNone, 1024), "Should match the shape scanner");
+	WEXPR_UNITTEST_ASSERT (s_transcoderShapeMatches (containers, WexprWriteFlagNone, 1), "Should match a byte at a time");
+	WEXPR_UNITTEST_ASSERT (s_transcoderShapeMatches (shared, WexprWriteFlagShareRepeats, 1024), "Shared repeats should match");
+	WEXPR_UNITTEST_ASSERT (s_transcoderShapeMatches (shared, WexprWriteFlagShareRepeats, 3), "Shared repeats should match in small blocks");
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderReportsTruncatedChunks)
+
+	// array chunk claiming 6 bytes, holding a value chunk claiming 10
+	const uint8_t data[] = { 0x00, 0x00, 0x00, 0x06, 0x02, 0x00, 0x00, 0x00, 0x0A, 0x01, 'a' };
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprSink sink;
+	TranscoderTestOutput out = { NULL, 0 };
+	sink.write = &s_transcoderTestWrite;
+	sink.userData = &out;
+	
+	size_t used = wexpr_Transcoder_binaryChunkToString (data, sizeof(data), 0, WexprWriteFlagNone, sink, &err);
+	
+	WEXPR_UNITTEST_ASSERT (used == 0, "Should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeBinaryChunkBiggerThanData, "Child chunk is bigger than the data");
+	
+	free (out.data);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderReportsBadMapKeys)
+
+	// map chunk holding a null key and a value
+	const uint8_t data[] = { 0x00, 0x00, 0x00, 0x0B, 0x03,
+		0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x01, 0x01, 'a'
+	};
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprSink sink;
+	TranscoderTestOutput out = { NULL, 0 };
+	sink.write = &s_transcoderTestWrite;
+	sink.userData = &out;
+	
+	size_t used = wexpr_Transcoder_binaryChunkToString (data, sizeof(data), 0, WexprWriteFlagNone, sink, &err);
+	
+	WEXPR_UNITTEST_ASSERT (used == 0, "Should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeMapKeyMustBeAValue, "Map keys must be values");
+	
+	free (out.data);
+	WEXPR_ERROR_FREE (err);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_BEGIN (TranscoderReportsUnknownChunkTypes)
+
+	// array chunk holding a chunk of an unknown type
+	const uint8_t data[] = { 0x00, 0x00, 0x00, 0x05, 0x02, 0x00, 0x00, 0x00, 0x00, 0x7F };
+	
+	WexprError err = WEXPR_ERROR_INIT();
+	WexprSink sink;
+	TranscoderTestOutput out = { NULL, 0 };
+	sink.write = &s_transcoderTestWrite;
+	sink.userData = &out;
+	
+	size_t used = wexpr_Transcoder_binaryChunkToString (data, sizeof(data), 0, WexprWriteFlagNone, sink, &err);
+	
+	WEXPR_UNITTEST_ASSERT (used == 0, "Should fail");
+	WEXPR_UNITTEST_ASSERT (err.code == WexprErrorCodeBinaryUnknownChunkType, "Chunk type is unknown");
+	
+	WexprError parseErr = WEXPR_ERROR_INIT();
+	WexprExpression* expr = wexpr_Expression_createFromBinaryChunk (data, sizeof(data), &parseErr);
+	
+	WEXPR_UNITTEST_ASSERT (expr == NULL, "Parsing should fail");
+	WEXPR_UNITTEST_ASSERT (parseErr.code == WexprErrorCodeBinaryUnknownChunkType, "Parsing should report the unknown type");
+	
+	free (out.data);
+	WEXPR_ERROR_FREE (err);
+	WEXPR_ERROR_FREE (parseErr);
+	
+WEXPR_UNITTEST_END ()
+
+WEXPR_UNITTEST_SUITE_BEGIN (Transcoder)
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderMatchesWriterForValues);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderMatchesWriterForContainers);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderMatchesWriterForSharedRepeats);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderMatchesWriterWhenStreamed);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderHandlesLargeBinaryData);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderMeasuresShape);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderReportsTruncatedChunks);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderReportsBadMapKeys);
+	WEXPR_UNITTEST_SUITE_ADDTEST (Transcoder, TranscoderReportsUnknownChunkTypes);
+WEXPR_UNITTEST_SUITE_END ()
+
+#endif // WEXPR_TESTS_TRANSCODER_H